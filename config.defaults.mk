@@ -12,6 +12,8 @@ LIBS_DBUS=-ldbus-1
 LIBS_QT=-lqt-mt
 LIBS_PAM=-lpam
 LIBS_TCL=
+LIBS_LZ4=-llz4
+LIBS_ZSTD=-lzstd
 
 prefix=/usr/local
 datadir=${prefix}/share
@@ -42,3 +44,5 @@ with_readline=no
 with_qt=/usr
 with_xplc=../wvports/xplc/build/xplc
 with_zlib=
+with_lz4=no
+with_zstd=no
@@ -3,6 +3,9 @@
 #include "wvfile.h"
 #include "wvfileutils.h"
 #include "wvx509mgr.h"
+#ifndef _WIN32
+#include "wvworkerpool.h"
+#endif
 
 // default keylen for where we're not using pre-existing certs
 const static int DEFAULT_KEYLEN = 512; 
@@ -106,3 +109,122 @@ WVTEST_MAIN("Loading/unloading from file")
     WVPASS(test_encode_load_file(WvCRL::CRLPEM));
     WVPASS(test_encode_load_file(WvCRL::CRLDER));
 }
+
+
+WVTEST_MAIN("revocation checks on a big CRL")
+{
+    WvX509Mgr ca("cn=testca.ca,dc=testca,dc=ca", DEFAULT_KEYLEN, true);
+    WvCRL crl(ca);
+
+    WvRSAKey rsakey(DEFAULT_KEYLEN);
+    WvString certreq = WvX509Mgr::certreq(
+        "cn=test.signed.com,dc=signed,dc=com", rsakey);
+    WvX509 user;
+    user.decode(WvX509::CertPEM, ca.signreq(certreq));
+
+    for (int i = 1; i <= 2000; i += 2)
+    {
+        user.set_serial(i);
+        crl.addcert(user);
+    }
+    WVPASSEQ(crl.numcerts(), 1000);
+    WVPASS(crl.isrevoked("1"));
+    WVFAIL(crl.isrevoked("2"));
+    WVPASS(crl.isrevoked("1999"));
+    WVFAIL(crl.isrevoked("2001"));
+    user.set_serial(1001);
+    WVPASS(crl.isrevoked(user));
+
+    // adding a certificate after the index is built still works
+    user.set_serial(2002);
+    WVFAIL(crl.isrevoked(user));
+    crl.addcert(user);
+    WVPASS(crl.isrevoked(user));
+    WVPASS(crl.isrevoked("2002"));
+}
+
+
+static void write_crl(WvStringParm filename, const WvCRL &crl)
+{
+    // replace it in one go, like anything that updates CRLs should
+    WvString tmpfile("%s.new", filename);
+    {
+        WvFile f(tmpfile, O_WRONLY|O_CREAT|O_TRUNC);
+        WvDynBuf buf;
+        crl.encode(WvCRL::CRLPEM, buf);
+        f.write(buf, buf.used());
+    }
+    ::rename(tmpfile, filename);
+}
+
+
+WVTEST_MAIN("refreshing a CRL from its file")
+{
+    WvString tmpfile = wvtmpfilename("crl");
+
+    WvX509Mgr ca("cn=testca.ca,dc=testca,dc=ca", DEFAULT_KEYLEN, true);
+    WvRSAKey rsakey(DEFAULT_KEYLEN);
+    WvString certreq = WvX509Mgr::certreq(
+        "cn=test.signed.com,dc=signed,dc=com", rsakey);
+    WvX509 user;
+    user.decode(WvX509::CertPEM, ca.signreq(certreq));
+
+    WvCRL crl1(ca);
+    write_crl(tmpfile, crl1);
+
+    WvCRL crl;
+    WVPASS(crl.load(tmpfile));
+    WVFAIL(crl.isrevoked(user));
+    WVFAIL(crl.refresh());
+
+    crl1.addcert(user);
+    ca.signcrl(crl1);
+    write_crl(tmpfile, crl1);
+    WVPASS(crl.refresh());
+    WVPASS(crl.isrevoked(user));
+
+    // the same again, but parsed on a worker thread
+    WvCRL crl2(ca);
+    write_crl(tmpfile, crl2);
+#ifndef _WIN32
+    WvWorkerPool pool(1);
+    WVPASS(crl.refresh(&pool));
+    pool.finish();
+#else
+    WVPASS(crl.refresh());
+#endif
+    WVFAIL(crl.isrevoked(user));
+
+    // a broken file doesn't replace a good CRL
+    {
+        WvFile f(WvString("%s.new", tmpfile), O_WRONLY|O_CREAT|O_TRUNC);
+        f.print("not a CRL\n");
+    }
+    ::rename(WvString("%s.new", tmpfile), tmpfile);
+    WVPASS(crl.refresh());
+    WVPASS(crl.isok());
+    WVPASSEQ(crl.get_issuer(), crl2.get_issuer());
+
+    // checking doesn't reload anything by itself; refresh_every() does,
+    // but not more often than it's told to
+    write_crl(tmpfile, crl1);
+    WVFAIL(crl.isrevoked(user));
+    WVFAIL(crl.refresh_every(3600));
+    WVFAIL(crl.isrevoked(user));
+    WVPASS(crl.refresh_every(0));
+    WVPASS(crl.isrevoked(user));
+
+#ifndef _WIN32
+    // if the pool goes away before the reload is done, nothing changes,
+    // and we can try again
+    write_crl(tmpfile, crl2);
+    WvWorkerPool *pool2 = new WvWorkerPool(1);
+    WVPASS(crl.refresh(pool2));
+    delete pool2;
+    WVPASS(crl.isrevoked(user));
+    WVPASS(crl.refresh());
+    WVFAIL(crl.isrevoked(user));
+#endif
+
+    ::unlink(tmpfile);
+}
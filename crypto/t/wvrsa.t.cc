@@ -1,6 +1,12 @@
 /* FIXME: horribly incomplete */
 #include "wvtest.h"
 #include "wvrsa.h"
+#include "wvlinklist.h"
+#ifndef _WIN32
+#include "wvworkerpool.h"
+#endif
+
+DeclareWvList(WvRSAKey);
 
 WVTEST_MAIN("extremely basic test")
 {
@@ -141,3 +147,40 @@ WVTEST_MAIN("rsagen")
     WVPASSEQ(rsa_pub.encode(WvRSAKey::RsaPubHex), 
 	     rsa_pub2.encode(WvRSAKey::RsaPubHex));
 }
+
+
+#ifndef _WIN32
+static void got_key(WvRSAKeyList &keys, WvRSAKey *key)
+{
+    if (key)
+	keys.append(key, true);
+}
+
+
+WVTEST_MAIN("rsagen on a worker pool")
+{
+    WvWorkerPool pool(2);
+    WvRSAKeyList keys;
+    for (int i = 0; i < 4; i++)
+	WvRSAKey::generate(pool, 512, wv::bind(got_key, wv::ref(keys), _1));
+    pool.finish();
+    WVPASSEQ(keys.count(), 4);
+
+    WvRSAKeyList::Iter i(keys);
+    for (i.rewind(); i.next(); )
+	WVPASS(i->isok());
+}
+
+
+WVTEST_MAIN("rsagen when the pool goes away first")
+{
+    // the keys still pending are freed along with the pool, and nobody
+    // gets called back
+    WvRSAKeyList keys;
+    WvWorkerPool *pool = new WvWorkerPool(1);
+    for (int i = 0; i < 4; i++)
+	WvRSAKey::generate(*pool, 512, wv::bind(got_key, wv::ref(keys), _1));
+    delete pool;
+    WVPASSEQ(keys.count(), 0);
+}
+#endif
@@ -1,6 +1,7 @@
 #include "wvtest.h"
 #include "wvsslstream.h"
 #include "wvloopback2.h"
+#include "wvbufstream.h"
 #include "wvx509mgr.h"
 #include "wvrsa.h"
 #include "wvtcp.h"
@@ -355,3 +356,263 @@ WVTEST_MAIN("sslcert moniker creation")
 
     WVRELEASE(dumb);
 }
+
+
+static void echo_line(WvSSLStream *ssl)
+{
+    const char *line = ssl->getline(0);
+    if (line)
+	ssl->print("%s\n", line);
+}
+
+
+static void echo_listener(WvIStreamList *list, WvX509Mgr *mgr,
+			  IWvStream *conn)
+{
+    WvSSLStream *ssl = new WvSSLStream(conn, mgr, 0, true);
+    ssl->setcallback(wv::bind(echo_line, ssl));
+    list->append(ssl, true, "ssl echo stream");
+}
+
+
+WVTEST_MAIN("ssl session resumption")
+{
+    signal(SIGPIPE, SIG_IGN);
+    WvX509Mgr mgr("cn=random_stupid_dn", 1024);
+    WvIStreamList list;
+
+    WvTCPListener *l = new WvTCPListener(WvIPPortAddr("127.0.0.1", 0));
+    l->onaccept(wv::bind(echo_listener, &list, &mgr, _1));
+    list.append(l, true, "listener");
+    WvIPPortAddr addr("127.0.0.1", l->src()->port);
+
+    // the second connection to the same server picks up the session
+    // the first one left behind in the shared client context.
+    for (int i = 0; i < 2; i++)
+    {
+	WvSSLStream *ssl = new WvSSLStream(new WvTCPConn(addr), NULL);
+	list.append(ssl, false, "ssl client");
+	ssl->print("ping %s\n", i);
+
+	WvString line;
+	for (int j = 0; j < 200 && !line; j++)
+	{
+	    list.runonce(10);
+	    line = ssl->getline(0);
+	}
+	WVPASSEQ(line, WvString("ping %s", i));
+	WVPASSEQ(ssl->resumed(), i > 0);
+
+	list.unlink(ssl);
+	WVRELEASE(ssl);
+    }
+}
+
+
+static void bulk_sender(WvIStreamList *list, WvX509Mgr *mgr, size_t size,
+			IWvStream *conn)
+{
+    WvSSLStream *ssl = new WvSSLStream(conn, mgr, 0, true);
+    list->append(ssl, true, "ssl bulk sender");
+
+    // different-sized writes, so retries land in the middle of records
+    unsigned char buf[40000];
+    for (size_t i = 0; i < sizeof(buf); i++)
+	buf[i] = i % 251;
+    for (size_t sent = 0, n = 1; sent < size; n = n * 7 % sizeof(buf) + 1)
+    {
+	size_t len = size - sent < n ? size - sent : n;
+	size_t off = sent % 251;
+	if (off + len > sizeof(buf))
+	    len = sizeof(buf) - off;
+	ssl->write(buf + off, len);
+	sent += len;
+    }
+}
+
+
+WVTEST_MAIN("ssl bulk transfer")
+{
+    signal(SIGPIPE, SIG_IGN);
+    WvX509Mgr mgr("cn=random_stupid_dn", 1024);
+    WvIStreamList list;
+    const size_t size = 4*1024*1024;
+
+    WvTCPListener *l = new WvTCPListener(WvIPPortAddr("127.0.0.1", 0));
+    l->onaccept(wv::bind(bulk_sender, &list, &mgr, size, _1));
+    list.append(l, true, "listener");
+
+    WvSSLStream *ssl = new WvSSLStream(
+	new WvTCPConn(WvIPPortAddr("127.0.0.1", l->src()->port)), NULL);
+    list.append(ssl, false, "ssl bulk receiver");
+
+    size_t got = 0, bad = 0;
+    WvDynBuf in;
+    for (int i = 0; i < 20000 && got < size && ssl->isok(); i++)
+    {
+	list.runonce(10);
+	ssl->read(in, 1024*1024);
+	while (in.used())
+	{
+	    size_t len = in.optgettable();
+	    const unsigned char *p = in.get(len);
+	    for (size_t j = 0; j < len; j++, got++)
+		if (p[j] != got % 251)
+		    bad++;
+	}
+    }
+    WVPASSEQ(got, size);
+    WVPASSEQ(bad, 0);
+
+    list.unlink(ssl);
+    WVRELEASE(ssl);
+}
+
+
+// A stream with no file descriptor at all: whatever you write to it comes
+// out of 'peer'.
+class MemPipe : public WvBufStream
+{
+public:
+    MemPipe *peer;
+
+    MemPipe() : peer(NULL) {}
+    virtual ~MemPipe()
+        { if (peer) peer->peer = NULL; }
+
+    virtual size_t uwrite(const void *buf, size_t size)
+        { return peer ? peer->WvBufStream::uwrite(buf, size) : 0; }
+    virtual size_t write(WvBuf &inbuf, size_t count = INT_MAX)
+        { return WvStream::write(inbuf, count); }
+    using WvStream::write;
+};
+
+
+WVTEST_MAIN("ssl over a non-fd stream")
+{
+    WvX509Mgr mgr("cn=random_stupid_dn", 1024);
+    WvIStreamList list;
+
+    MemPipe *p1 = new MemPipe, *p2 = new MemPipe;
+    p1->peer = p2;
+    p2->peer = p1;
+    WvSSLStream *s1 = new WvSSLStream(p1, &mgr, 0, true);
+    WvSSLStream *s2 = new WvSSLStream(p2, NULL);
+    list.append(s1, false, "s1");
+    list.append(s2, false, "s2");
+
+    s1->print("from the server\n");
+    s2->print("from the client\n");
+
+    WvString l1, l2;
+    for (int i = 0; i < 100 && (!l1 || !l2); i++)
+    {
+        list.runonce(10);
+        if (!l1)
+            l1 = s1->getline(0);
+        if (!l2)
+            l2 = s2->getline(0);
+    }
+    WVPASSEQ(l1, "from the client");
+    WVPASSEQ(l2, "from the server");
+
+    // and lots of data, so the BIOs fill up along the way
+    char block[65536];
+    memset(block, 'x', sizeof(block));
+    for (int i = 0; i < 16; i++)
+        s1->write(block, sizeof(block));
+
+    size_t got = 0;
+    WvDynBuf in;
+    for (int i = 0; i < 1000 && got < 16 * sizeof(block); i++)
+    {
+        list.runonce(10);
+        got += s2->read(in, 1024*1024);
+        in.zap();
+    }
+    WVPASSEQ(got, 16 * sizeof(block));
+
+    list.zap();
+    WVRELEASE(s1);
+    WVRELEASE(s2);
+}
+
+
+// A MemPipe that stops passing data along while 'stalled' is set, like a
+// peer that isn't reading.
+class StallPipe : public MemPipe
+{
+public:
+    bool stalled;
+
+    StallPipe() : stalled(false) {}
+
+    virtual size_t uwrite(const void *buf, size_t size)
+        { return stalled ? 0 : MemPipe::uwrite(buf, size); }
+};
+
+
+WVTEST_MAIN("ssl with a stalled peer and a limited outbuf")
+{
+    WvX509Mgr mgr("cn=random_stupid_dn", 1024);
+    WvIStreamList list;
+
+    StallPipe *p1 = new StallPipe;
+    MemPipe *p2 = new MemPipe;
+    p1->peer = p2;
+    p2->peer = p1;
+    WvSSLStream *s1 = new WvSSLStream(p1, &mgr, 0, true);
+    WvSSLStream *s2 = new WvSSLStream(p2, NULL);
+    list.append(s1, false, "s1");
+    list.append(s2, false, "s2");
+
+    for (int i = 0; i < 100 && !s2->getline(0); i++)
+    {
+        if (i == 1)
+            s1->print("hello\n");
+        list.runonce(10);
+    }
+
+    // once the peer stops reading, every layer fills up, and WvStream
+    // retries SSL_write() with whatever fits in the outbufs
+    p1->outbuf_limit(1000);
+    s1->outbuf_limit(4000);
+    p1->stalled = true;
+
+    const size_t size = 1024*1024;
+    unsigned char block[16384];
+    size_t sent = 0, got = 0, bad = 0;
+    WvDynBuf in;
+    for (int i = 0; i < 5000 && got < size && s1->isok(); i++)
+    {
+        if (sent < size)
+        {
+            size_t len = size - sent < sizeof(block)
+                ? size - sent : sizeof(block);
+            for (size_t j = 0; j < len; j++)
+                block[j] = (sent + j) % 251;
+            sent += s1->write(block, len);
+        }
+        if (i == 50)
+            p1->stalled = false;
+
+        list.runonce(i < 50 ? 0 : 10);
+        s2->read(in, 1024*1024);
+        while (in.used())
+        {
+            size_t len = in.optgettable();
+            const unsigned char *p = in.get(len);
+            for (size_t j = 0; j < len; j++, got++)
+                if (p[j] != got % 251)
+                    bad++;
+        }
+    }
+    WVPASS(s1->isok());
+    WVPASSEQ(sent, size);
+    WVPASSEQ(got, size);
+    WVPASSEQ(bad, 0);
+
+    list.zap();
+    WVRELEASE(s1);
+    WVRELEASE(s2);
+}
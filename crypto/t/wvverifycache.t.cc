@@ -0,0 +1,168 @@
+#include "wvtest.h"
+#include "wvverifycache.h"
+#include "wvworkerpool.h"
+#include "wvx509mgr.h"
+
+// default keylen for where we're not using pre-existing certs
+const static int DEFAULT_KEYLEN = 512;
+
+
+static void signed_cert(WvX509Mgr &ca, WvStringParm dn, WvX509 &cert)
+{
+    WvRSAKey rsakey(DEFAULT_KEYLEN);
+    WvString certreq = WvX509Mgr::certreq(dn, rsakey);
+    cert.decode(WvX509::CertPEM, ca.signreq(certreq));
+}
+
+
+WVTEST_MAIN("verify cache basics")
+{
+    WvX509Mgr ca("cn=testca.ca,dc=testca,dc=ca", DEFAULT_KEYLEN, true);
+    WvX509Mgr otherca("cn=otherca.ca,dc=otherca,dc=ca", DEFAULT_KEYLEN, true);
+    WvX509 user;
+    signed_cert(ca, "cn=test.signed.com,dc=signed,dc=com", user);
+
+    WvVerifyCache cache;
+    WVPASS(cache.validate(user, &ca));
+    WVPASSEQ(cache.misses, 1);
+    WVPASSEQ(cache.hits, 0);
+    WVPASS(cache.validate(user, &ca));
+    WVPASSEQ(cache.hits, 1);
+
+    // bad answers get cached too
+    WVFAIL(cache.validate(user, &otherca));
+    WVFAIL(cache.validate(user, &otherca));
+    WVPASSEQ(cache.hits, 2);
+    WVPASSEQ(cache.count(), 2);
+
+    cache.zap();
+    WVPASSEQ(cache.count(), 0);
+    WVPASS(cache.validate(user, &ca));
+    WVPASSEQ(cache.misses, 3);
+
+    // nothing is kept once it has expired
+    cache.zap();
+    cache.ttl = 0;
+    cache.negative_ttl = 0;
+    WVPASS(cache.validate(user, &ca));
+    WVFAIL(cache.validate(user, &otherca));
+    WVPASSEQ(cache.count(), 0);
+}
+
+
+WVTEST_MAIN("verify cache size limit")
+{
+    WvX509Mgr ca("cn=testca.ca,dc=testca,dc=ca", DEFAULT_KEYLEN, true);
+    WvVerifyCache cache(NULL, 2);
+
+    for (int i = 0; i < 3; i++)
+    {
+	WvX509 user;
+	signed_cert(ca, WvString("cn=test%s.signed.com,dc=signed,dc=com", i),
+		    user);
+	WVPASS(cache.validate(user, &ca));
+	WVPASS(cache.count() <= 2);
+    }
+}
+
+
+static void got_answer(int &count, bool &answer, bool result)
+{
+    count++;
+    answer = result;
+}
+
+
+WVTEST_MAIN("verify cache with worker pool")
+{
+    WvX509Mgr ca("cn=testca.ca,dc=testca,dc=ca", DEFAULT_KEYLEN, true);
+    WvX509Mgr otherca("cn=otherca.ca,dc=otherca,dc=ca", DEFAULT_KEYLEN, true);
+    WvX509 user;
+    signed_cert(ca, "cn=test.signed.com,dc=signed,dc=com", user);
+
+    WvWorkerPool pool(2);
+    WvVerifyCache cache(&pool);
+
+    int count = 0, badcount = 0;
+    bool answer = false, badanswer = true;
+    for (int i = 0; i < 3; i++)
+	cache.validate(user, ca, wv::bind(got_answer, wv::ref(count),
+					  wv::ref(answer), _1));
+    cache.validate(user, otherca, wv::bind(got_answer, wv::ref(badcount),
+					   wv::ref(badanswer), _1));
+    pool.finish();
+    WVPASSEQ(count, 3);
+    WVPASS(answer);
+    WVPASSEQ(badcount, 1);
+    WVFAIL(badanswer);
+
+    // the three requests for the same pair only needed one check
+    WVPASSEQ(cache.misses, 2);
+    WVPASSEQ(cache.count(), 2);
+
+    // and now it's answered right away
+    unsigned long hits = cache.hits;
+    cache.validate(user, ca, wv::bind(got_answer, wv::ref(count),
+				      wv::ref(answer), _1));
+    WVPASSEQ(count, 4);
+    WVPASSEQ(cache.hits, hits + 1);
+}
+
+
+WVTEST_MAIN("verify cache when the pool goes first")
+{
+    WvX509Mgr ca("cn=testca.ca,dc=testca,dc=ca", DEFAULT_KEYLEN, true);
+    WvX509 user;
+    signed_cert(ca, "cn=test.signed.com,dc=signed,dc=com", user);
+
+    WvWorkerPool *pool = new WvWorkerPool(1);
+    WvVerifyCache cache(pool);
+
+    int count = 0;
+    bool answer = false;
+    cache.validate(user, ca, wv::bind(got_answer, wv::ref(count),
+				      wv::ref(answer), _1));
+
+    // the pending check (and its copies of the certificates) goes away
+    // with the pool, and nobody gets called back
+    delete pool;
+    WVPASSEQ(count, 0);
+    WVPASSEQ(cache.count(), 0);
+}
+
+
+WVTEST_MAIN("WvX509::validate uses the shared cache")
+{
+    WvX509Mgr ca("cn=testca.ca,dc=testca,dc=ca", DEFAULT_KEYLEN, true);
+    WvX509Mgr otherca("cn=otherca.ca,dc=otherca,dc=ca", DEFAULT_KEYLEN, true);
+    WvX509 user;
+    signed_cert(ca, "cn=test.signed.com,dc=signed,dc=com", user);
+
+    WvVerifyCache &cache = WvVerifyCache::shared();
+    cache.zap();
+    unsigned long hits = cache.hits, misses = cache.misses;
+
+    WVPASS(user.validate(&ca));
+    WVPASS(user.validate(&ca));
+    WVFAIL(user.validate(&otherca));
+    WVPASSEQ(cache.misses, misses + 2);
+    WVPASSEQ(cache.hits, hits + 1);
+
+    // no CA means no signature check
+    WVPASS(user.validate());
+    WVPASSEQ(cache.misses, misses + 2);
+}
+
+
+WVTEST_MAIN("verify cache CRLs")
+{
+    WvX509Mgr ca("cn=testca.ca,dc=testca,dc=ca", DEFAULT_KEYLEN, true);
+    WvX509Mgr otherca("cn=otherca.ca,dc=otherca,dc=ca", DEFAULT_KEYLEN, true);
+    WvCRL crl(ca);
+
+    WvVerifyCache cache;
+    WVPASSEQ(cache.validate(crl, ca), WvCRL::VALID);
+    WVPASSEQ(cache.validate(crl, ca), WvCRL::VALID);
+    WVPASSEQ(cache.hits, 1);
+    WVPASS(cache.validate(crl, otherca) != WvCRL::VALID);
+}
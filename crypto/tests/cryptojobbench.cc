@@ -0,0 +1,134 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * How slow does the event loop get during a storm of RSA signatures?
+ * A ticker stream asks to run as often as it can while we make 'count'
+ * 2048-bit signatures, either right in the event loop (like a server
+ * doing its handshakes inline) or on a WvWorkerPool, and we report how
+ * long it had to wait between turns.
+ *
+ * Usage: cryptojobbench [-s] [-t threads] [count]
+ *    -s   sign synchronously, in the event loop
+ */
+#include "wvistreamlist.h"
+#include "wvtimeutils.h"
+#include "wvworkerpool.h"
+#include "wvx509mgr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct Ticks
+{
+    WvTime last;
+    int count;
+    long long total_gap, max_gap; // in microseconds
+};
+
+
+static void tick(WvStream *ticker, Ticks *t)
+{
+    WvTime now = wvtime();
+    long long gap = (now.tv_sec - t->last.tv_sec) * 1000000LL
+	+ (now.tv_usec - t->last.tv_usec);
+    t->count++;
+    t->total_gap += gap;
+    if (gap > t->max_gap)
+	t->max_gap = gap;
+
+    t->last = now;
+    ticker->alarm(0);
+}
+
+
+static void sign_one(WvStream *signer, WvX509Mgr *x509, int *left)
+{
+    // one "handshake" per callback, so the ticker gets a turn in between
+    WvDynBuf data;
+    data.putstr("cryptojobbench");
+    if (!x509->sign(data))
+	fprintf(stderr, "cryptojobbench: signing failed!\n");
+    if (--*left > 0)
+	signer->alarm(0);
+}
+
+
+static void signed_one(int *left, WvStringParm sig)
+{
+    if (!sig)
+	fprintf(stderr, "cryptojobbench: signing failed!\n");
+    --*left;
+}
+
+
+int main(int argc, char **argv)
+{
+    int count = 200, threads = 0;
+    bool sync = false;
+    for (int i = 1; i < argc; i++)
+    {
+	if (!strcmp(argv[i], "-s"))
+	    sync = true;
+	else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+	    threads = atoi(argv[++i]);
+	else
+	    count = atoi(argv[i]);
+    }
+
+    WvX509Mgr x509("cn=cryptojobbench", 2048);
+    if (!x509.isok())
+    {
+	fprintf(stderr, "cryptojobbench: %s\n", x509.errstr().cstr());
+	return 1;
+    }
+
+    WvIStreamList list;
+    Ticks t;
+    t.count = 0;
+    t.total_gap = t.max_gap = 0;
+    WvStream *ticker = new WvStream;
+    ticker->setcallback(wv::bind(tick, ticker, &t));
+    list.append(ticker, true, "ticker");
+
+    WvWorkerPool *pool = NULL;
+    int left = count;
+    WvTime start = wvtime();
+    if (sync)
+    {
+	WvStream *signer = new WvStream;
+	signer->setcallback(wv::bind(sign_one, signer, &x509, &left));
+	signer->alarm(0);
+	list.append(signer, true, "signer");
+    }
+    else
+    {
+	pool = new WvWorkerPool(threads);
+	list.append(pool, false, "worker pool");
+	WvDynBuf data;
+	data.putstr("cryptojobbench");
+	for (int i = 0; i < count; i++)
+	    x509.sign(data, *pool, wv::bind(signed_one, &left, _1));
+    }
+
+    t.last = wvtime();
+    ticker->alarm(0);
+    while (left > 0)
+	list.runonce(10);
+    double secs = msecdiff(wvtime(), start) / 1000.0;
+
+    printf("%s: %d signatures in %.3f seconds (%.1f/s); %d ticks, "
+	   "%.3f ms apart on average, %.3f ms at worst\n",
+	   sync ? "in the event loop"
+	   : WvString("%s worker threads", pool->threads()).cstr(),
+	   count, secs, secs > 0 ? count / secs : 0.0, t.count,
+	   t.count ? t.total_gap / 1000.0 / t.count : 0.0,
+	   t.max_gap / 1000.0);
+
+    if (pool)
+    {
+	list.unlink(pool);
+	delete pool;
+    }
+    return 0;
+}
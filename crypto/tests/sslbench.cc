@@ -0,0 +1,94 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * WvSSLStream throughput benchmark.  Sends a lot of data to ourselves
+ * over an SSL connection on the loopback interface, and reports how fast
+ * it came through.
+ *
+ * Usage: sslbench [megabytes]
+ */
+#include "wvistreamlist.h"
+#include "wvsslstream.h"
+#include "wvtcp.h"
+#include "wvtcplistener.h"
+#include "wvtimeutils.h"
+#include "wvx509mgr.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t size, sent = 0;
+static char block[65536];
+
+
+static void send_more(WvSSLStream *ssl)
+{
+    // write() stops taking data once the outbuf is full
+    while (sent < size && ssl->isok())
+    {
+	size_t len = size - sent < sizeof(block) ? size - sent : sizeof(block);
+	len = ssl->write(block, len);
+	if (!len)
+	    break;
+	sent += len;
+    }
+}
+
+
+static void accepted(WvIStreamList *list, WvX509Mgr *x509, IWvStream *conn)
+{
+    WvSSLStream *ssl = new WvSSLStream(conn, x509, 0, true);
+    ssl->outbuf_limit(4 * sizeof(block));
+    ssl->force_select(false, true);
+    ssl->setcallback(wv::bind(send_more, ssl));
+    list->append(ssl, true, "sender");
+}
+
+
+int main(int argc, char **argv)
+{
+    size = (argc > 1 ? atoi(argv[1]) : 256) * 1024 * 1024;
+    memset(block, 'x', sizeof(block));
+
+    signal(SIGPIPE, SIG_IGN);
+    WvX509Mgr x509("cn=sslbench", 2048);
+    if (!x509.isok())
+    {
+	fprintf(stderr, "sslbench: %s\n", x509.errstr().cstr());
+	return 1;
+    }
+
+    WvIStreamList list;
+    WvTCPListener *l = new WvTCPListener(WvIPPortAddr("127.0.0.1", 0));
+    l->onaccept(wv::bind(accepted, &list, &x509, _1));
+    list.append(l, true, "listener");
+
+    WvSSLStream *ssl = new WvSSLStream(
+	new WvTCPConn(WvIPPortAddr("127.0.0.1", l->src()->port)), NULL);
+    list.append(ssl, false, "receiver");
+
+    size_t total = 0;
+    WvDynBuf sink;
+    WvTime start = wvtime();
+    while (total < size && ssl->isok())
+    {
+	list.runonce(100);
+	size_t len;
+	while ((len = ssl->read(sink, 1024*1024)) > 0)
+	{
+	    total += len;
+	    sink.zap();
+	}
+    }
+    double secs = msecdiff(wvtime(), start) / 1000.0;
+
+    printf("%lu of %lu bytes in %.3f seconds (%.1f MB/s)\n",
+	   (unsigned long)total, (unsigned long)size, secs,
+	   secs > 0 ? total / secs / (1024*1024) : 0.0);
+
+    list.unlink(ssl);
+    WVRELEASE(ssl);
+    return total == size ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * WvSSLStream handshake benchmark.  Makes a lot of SSL connections to
+ * ourselves on the loopback interface, sends one line over each, and
+ * reports how many handshakes per second we managed.
+ *
+ * Usage: sslhandshakebench [-u] [connections]
+ *    -u   give every stream its own WvSSLContext, so nothing is shared
+ *         and no session is ever resumed
+ */
+#include "wvistreamlist.h"
+#include "wvsslcontext.h"
+#include "wvsslstream.h"
+#include "wvtcp.h"
+#include "wvtcplistener.h"
+#include "wvtimeutils.h"
+#include "wvx509mgr.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool unshared = false;
+
+
+static WvSSLStream *new_stream(IWvStream *conn, WvX509Mgr *x509,
+			       bool is_server)
+{
+    if (!unshared)
+	return new WvSSLStream(conn, x509, 0, is_server);
+
+    WvSSLContext *context = new WvSSLContext(x509, is_server);
+    WvSSLStream *ssl = new WvSSLStream(conn, *context);
+    context->release(); // the stream has its own reference
+    return ssl;
+}
+
+
+static void echo_line(WvSSLStream *ssl)
+{
+    const char *line = ssl->getline(0);
+    if (line)
+	ssl->print("%s\n", line);
+}
+
+
+static void accepted(WvIStreamList *list, WvX509Mgr *x509, IWvStream *conn)
+{
+    WvSSLStream *ssl = new_stream(conn, x509, true);
+    ssl->setcallback(wv::bind(echo_line, ssl));
+    list->append(ssl, true, "server");
+}
+
+
+int main(int argc, char **argv)
+{
+    int count = 200;
+    for (int i = 1; i < argc; i++)
+    {
+	if (!strcmp(argv[i], "-u"))
+	    unshared = true;
+	else
+	    count = atoi(argv[i]);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    WvX509Mgr x509("cn=sslhandshakebench", 2048);
+    if (!x509.isok())
+    {
+	fprintf(stderr, "sslhandshakebench: %s\n", x509.errstr().cstr());
+	return 1;
+    }
+
+    WvIStreamList list;
+    WvTCPListener *l = new WvTCPListener(WvIPPortAddr("127.0.0.1", 0));
+    l->onaccept(wv::bind(accepted, &list, &x509, _1));
+    list.append(l, true, "listener");
+    WvIPPortAddr addr("127.0.0.1", l->src()->port);
+
+    int ok = 0, resumed = 0;
+    WvTime start = wvtime();
+    for (int i = 0; i < count; i++)
+    {
+	WvSSLStream *ssl = new_stream(new WvTCPConn(addr), NULL, false);
+	list.append(ssl, false, "client");
+	ssl->print("hello\n");
+
+	const char *line = NULL;
+	while (!line && ssl->isok())
+	{
+	    list.runonce(100);
+	    line = ssl->getline(0);
+	}
+	if (line)
+	    ok++;
+	if (ssl->resumed())
+	    resumed++;
+
+	list.unlink(ssl);
+	WVRELEASE(ssl);
+    }
+    double secs = msecdiff(wvtime(), start) / 1000.0;
+
+    printf("%s: %d of %d handshakes (%d resumed) in %.3f seconds "
+	   "(%.1f/s)\n", unshared ? "unshared" : "shared",
+	   ok, count, resumed, secs, secs > 0 ? ok / secs : 0.0);
+    return ok == count ? 0 : 1;
+}
@@ -7,10 +7,24 @@
 
 #include <openssl/x509v3.h>
 #include <openssl/pem.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #include "wvcrl.h"
 #include "wvx509mgr.h"
 #include "wvbase64.h"
+#include "wvworkerpool.h"
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+# define revoked_serial_of(r) X509_REVOKED_get0_serialNumber(r)
+#else
+# define revoked_serial_of(r) ((r)->serialNumber)
+#endif
+
 
 
 static const char * warning_str_get = "Tried to determine %s, but CRL is blank!\n";
@@ -37,16 +51,196 @@ static ASN1_INTEGER * serial_to_int(WvStringParm serial)
 }
 
 
+/**
+ * An open-addressed hash table of the entries in a CRL's revoked list,
+ * keyed by serial number.  It only points into the X509_CRL, so it has to
+ * go away whenever the CRL changes.
+ *
+ * OpenSSL can find a serial number by itself, but only by sorting the
+ * whole list first (and again after every change), then doing a binary
+ * search with ASN1_INTEGER_cmp(); for CRLs with hundreds of thousands of
+ * entries, this is a lot faster.
+ */
+class WvCRLIndex
+{
+public:
+    WvCRLIndex(X509_CRL *crl);
+    ~WvCRLIndex()
+        { delete[] slots; }
+
+    bool contains(ASN1_INTEGER *serial) const;
+
+private:
+    X509_REVOKED **slots;
+    unsigned int mask;
+
+    static unsigned int hash(const ASN1_INTEGER *serial);
+};
+
+
+unsigned int WvCRLIndex::hash(const ASN1_INTEGER *serial)
+{
+    // FNV-1a over the bytes of the number
+    unsigned int h = 2166136261U;
+    for (int i = 0; i < serial->length; i++)
+	h = (h ^ serial->data[i]) * 16777619U;
+    return h;
+}
+
+
+WvCRLIndex::WvCRLIndex(X509_CRL *crl)
+{
+    STACK_OF(X509_REVOKED) *rev = X509_CRL_get_REVOKED(crl);
+    int n = rev ? sk_X509_REVOKED_num(rev) : 0;
+
+    // keep it at most half full, so the probe sequences stay short
+    unsigned int size = 16;
+    while (size < (unsigned int)n * 2)
+	size <<= 1;
+    mask = size - 1;
+    slots = new X509_REVOKED *[size];
+    memset(slots, 0, size * sizeof(*slots));
+
+    for (int i = 0; i < n; i++)
+    {
+	X509_REVOKED *r = sk_X509_REVOKED_value(rev, i);
+	unsigned int h = hash(revoked_serial_of(r)) & mask;
+	while (slots[h])
+	    h = (h + 1) & mask;
+	slots[h] = r;
+    }
+}
+
+
+bool WvCRLIndex::contains(ASN1_INTEGER *serial) const
+{
+    for (unsigned int h = hash(serial) & mask; slots[h]; h = (h + 1) & mask)
+    {
+	if (!ASN1_INTEGER_cmp((ASN1_INTEGER *)revoked_serial_of(slots[h]),
+			      serial))
+	    return true;
+    }
+    return false;
+}
+
+
+/**
+ * Decode the CRL in 'filename' straight out of an mmap() of the file,
+ * whether it's PEM or DER, and fill 'st' with what fstat() said about it.
+ * This also runs on WvWorkerPool threads, so it doesn't log anything: on
+ * failure, it returns NULL and sets 'errnum' to an errno, or to 0 if the
+ * file didn't decode.
+ */
+static X509_CRL *map_crl(const char *filename, struct stat &st, int &errnum)
+{
+    memset(&st, 0, sizeof(st));
+    errnum = 0;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+	errnum = errno;
+	return NULL;
+    }
+    if (fstat(fd, &st) < 0)
+    {
+	errnum = errno;
+	close(fd);
+	return NULL;
+    }
+    if (st.st_size <= 0)
+    {
+	close(fd);
+	return NULL;
+    }
+#ifndef _WIN32
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+	errnum = errno;
+	return NULL;
+    }
+#else
+    char *p = new char[st.st_size];
+    bool ok = (read(fd, p, st.st_size) == st.st_size);
+    close(fd);
+    if (!ok)
+    {
+	delete[] p;
+	errnum = EIO;
+	return NULL;
+    }
+#endif
+
+    X509_CRL *crl;
+    const unsigned char *data = (const unsigned char *)p;
+    if (data[0] == 0x30) // the SEQUENCE that every DER CRL starts with
+	crl = d2i_X509_CRL(NULL, &data, st.st_size);
+    else
+    {
+	BIO *bio = BIO_new_mem_buf(p, st.st_size);
+	crl = PEM_read_bio_X509_CRL(bio, NULL, NULL, NULL);
+	BIO_free(bio);
+    }
+#ifndef _WIN32
+    munmap(p, st.st_size);
+#else
+    delete[] p;
+#endif
+    return crl;
+}
+
+
+// A CRL being parsed on the worker pool.  The pool's job owns it, so it
+// goes away with the job, even if the pool is destroyed before the 'done'
+// function gets to run.
+struct WvCRL::Reload
+{
+    WvCRL *crl; // NULL if the WvCRL went away first
+    WvString filename;
+    X509_CRL *newcrl;
+    WvCRLIndex *index;
+    struct stat st;
+    int errnum;
+
+    Reload(WvCRL *_crl) : crl(_crl), filename(_crl->filename),
+        newcrl(NULL), index(NULL), errnum(0) {}
+
+    ~Reload()
+    {
+	// if we never got to reload_done(), let the WvCRL try again later
+	if (crl)
+	    crl->reloading = NULL;
+	if (newcrl)
+	    X509_CRL_free(newcrl);
+	delete index;
+    }
+};
+
+
 WvCRL::WvCRL()
     : debug("X509 CRL", WvLog::Debug5)
 {
     crl = NULL;
+    index = NULL;
+    file_mtime = 0;
+    file_size = 0;
+    file_ino = 0;
+    reloading = NULL;
+    last_refresh = 0;
 }
 
 
 WvCRL::WvCRL(const WvX509Mgr &ca)
     : debug("X509 CRL", WvLog::Debug5)
 {
+    index = NULL;
+    file_mtime = 0;
+    file_size = 0;
+    file_ino = 0;
+    reloading = NULL;
+    last_refresh = 0;
     assert(crl = X509_CRL_new());
 
     // Use Version 2 CRLs - Of COURSE that means
@@ -81,8 +275,26 @@ WvCRL::WvCRL(const WvX509Mgr &ca)
 WvCRL::~WvCRL()
 {
     debug("Deleting.\n");
+    if (reloading)
+	reloading->crl = NULL;
+    replace(NULL, NULL);
+}
+
+
+void WvCRL::replace(X509_CRL *newcrl, WvCRLIndex *newindex)
+{
     if (crl)
 	X509_CRL_free(crl);
+    forget_index();
+    crl = newcrl;
+    index = newindex;
+}
+
+
+void WvCRL::forget_index() const
+{
+    delete index;
+    index = NULL;
 }
 
 
@@ -148,6 +360,15 @@ bool WvCRL::expired() const
 }
 
 
+time_t WvCRL::get_next_update() const
+{
+    CHECK_CRL_EXISTS_GET("CRL's next update", 0);
+
+    ASN1_TIME *t = X509_CRL_get_nextUpdate(crl);
+    return t ? wvssl_asn1_time(t) : 0;
+}
+
+
 bool WvCRL::has_critical_extensions() const
 {
     CHECK_CRL_EXISTS_GET("if CRL has critical extensions", false);
@@ -239,50 +460,11 @@ void WvCRL::encode(const DumpMode mode, WvBuf &buf) const
 
 void WvCRL::decode(const DumpMode mode, WvStringParm str)
 {
-    if (crl)
-    {
-	debug("Replacing already existant CRL.\n");
-	X509_CRL_free(crl);
-	crl = NULL;
-    }
-
-    if (mode == CRLFileDER)
-    {
-        BIO *bio = BIO_new(BIO_s_file());
-        
-        if (BIO_read_filename(bio, str.cstr()) <= 0)
-        {
-            debug(WvLog::Warning, "Import CRL from '%s': %s\n", 
-                  str, wvssl_errstr());
-            BIO_free(bio);
-            return;
-        }
-        
-        if (!(crl = d2i_X509_CRL_bio(bio, NULL)))
-            debug(WvLog::Warning, "Read CRL from '%s': %s\n",
-		  str, wvssl_errstr());
-        
-        BIO_free(bio);
-        return;
-    }
-    else if (mode == CRLFilePEM)
+    if (mode == CRLFileDER || mode == CRLFilePEM)
     {
-        FILE * fp = fopen(str, "rb");
-        if (!fp)
-        {
-	    int errnum = errno;
-            debug(WvLog::Warning,
-		  "open '%s': %s\n", 
-                  str, strerror(errnum));
-            return;
-        }
-
-        if (!(crl = PEM_read_X509_CRL(fp, NULL, NULL, NULL)))
-            debug(WvLog::Warning, "Import CRL from '%s': %s\n",
-		  str, wvssl_errstr());
-        
-        fclose(fp);
-        return;
+	// load() tells the two apart by itself
+	load(str);
+	return;
     }
 
     // we use the buffer decode functions for everything else
@@ -297,9 +479,9 @@ void WvCRL::decode(const DumpMode mode, WvBuf &buf)
     if (crl)
     {
 	debug("Replacing already existant CRL.\n");
-	X509_CRL_free(crl);
-	crl = NULL;
+	replace(NULL, NULL);
     }
+    filename = WvString::null;
 
     if (mode == CRLFileDER || mode == CRLFilePEM)
     {
@@ -334,10 +516,10 @@ bool WvCRL::isrevoked(const WvX509 &cert) const
 {
     if (cert.cert)
     {
-        debug("Checking to see if certificate with name '%s' and serial "
-              "number '%s' is revoked.\n", cert.get_subject(), 
-              cert.get_serial());
-	return isrevoked(cert.get_serial());
+	bool revoked = revoked_serial(X509_get_serialNumber(cert.cert));
+	if (revoked)
+	    debug("Certificate '%s' is revoked.\n", cert.get_subject());
+	return revoked;
     }
     else
     {
@@ -350,38 +532,16 @@ bool WvCRL::isrevoked(const WvX509 &cert) const
 
 bool WvCRL::isrevoked(WvStringParm serial_number) const
 {
-    CHECK_CRL_EXISTS_GET("if certificate is revoked in CRL", false);
-
     if (!!serial_number)
     {
 	ASN1_INTEGER *serial = serial_to_int(serial_number);
 	if (serial)
 	{
-	    X509_REVOKED mayberevoked;
-	    mayberevoked.serialNumber = serial;
-	    if (crl->crl->revoked)
-	    {
-		int idx = sk_X509_REVOKED_find(crl->crl->revoked, 
-					       &mayberevoked);
-		ASN1_INTEGER_free(serial);
-		if (idx >= 0)
-                {
-                    debug("Certificate is revoked.\n");
-		    return true;
-                }
-                else
-                {
-                    debug("Certificate is not revoked.\n");
-		    return false;
-                }
-	    }
-	    else
-	    {
-		ASN1_INTEGER_free(serial);
-		debug("CRL does not have revoked list.\n");
-                return false;
-	    }
-	    
+	    bool revoked = revoked_serial(serial);
+	    ASN1_INTEGER_free(serial);
+	    if (revoked)
+		debug("Certificate is revoked.\n");
+	    return revoked;
 	}
 	else
 	    debug(WvLog::Warning, "Can't convert serial number to ASN1 format. "
@@ -394,7 +554,121 @@ bool WvCRL::isrevoked(WvStringParm serial_number) const
           "was).\n");
     return false;
 }
-    
+
+
+bool WvCRL::revoked_serial(ASN1_INTEGER *serial) const
+{
+    CHECK_CRL_EXISTS_GET("if certificate is revoked in CRL", false);
+
+    if (!index)
+	index = new WvCRLIndex(crl);
+    return index->contains(serial);
+}
+
+
+bool WvCRL::load(WvStringParm _filename)
+{
+    if (crl)
+	debug("Replacing already existant CRL.\n");
+
+    filename = _filename;
+    last_refresh = time(NULL);
+    struct stat st;
+    int errnum;
+    X509_CRL *newcrl = map_crl(filename, st, errnum);
+    file_mtime = st.st_mtime;
+    file_size = st.st_size;
+    file_ino = st.st_ino;
+
+    if (!newcrl)
+	debug(WvLog::Warning, "Import CRL from '%s': %s\n", filename,
+	      errnum ? strerror(errnum) : wvssl_errstr());
+    replace(newcrl, NULL);
+    return isok();
+}
+
+
+bool WvCRL::refresh(WvWorkerPool *pool)
+{
+    if (!filename || reloading)
+	return false;
+    last_refresh = time(NULL);
+
+    // if the file went away, keep what we have
+    struct stat st;
+    if (stat(filename, &st) < 0
+	|| (st.st_mtime == file_mtime && st.st_size == file_size
+	    && st.st_ino == file_ino))
+	return false;
+
+    debug("'%s' has changed; reloading.\n", filename);
+#ifndef _WIN32 // there's no WvWorkerPool on win32
+    if (pool)
+    {
+	wvssl_threads_init();
+	ReloadPtr r(new Reload(this));
+	reloading = r.get();
+	pool->add(wv::bind(&WvCRL::reload_run, r),
+		  wv::bind(&WvCRL::reload_done, r));
+	return true;
+    }
+#endif
+
+    int errnum;
+    X509_CRL *newcrl = map_crl(filename, st, errnum);
+    file_mtime = st.st_mtime;
+    file_size = st.st_size;
+    file_ino = st.st_ino;
+    if (newcrl)
+	replace(newcrl, NULL);
+    else
+	debug(WvLog::Warning, "Reload CRL from '%s': %s; keeping the "
+	      "old one.\n", filename,
+	      errnum ? strerror(errnum) : wvssl_errstr());
+    return true;
+}
+
+
+void WvCRL::reload_run(ReloadPtr r)
+{
+    r->newcrl = map_crl(r->filename.cstr(), r->st, r->errnum);
+    if (r->newcrl)
+	r->index = new WvCRLIndex(r->newcrl);
+}
+
+
+void WvCRL::reload_done(ReloadPtr r)
+{
+    WvCRL *c = r->crl;
+    if (!c)
+	return; // ~Reload() frees whatever we parsed
+
+    c->reloading = NULL;
+    r->crl = NULL;
+    c->file_mtime = r->st.st_mtime;
+    c->file_size = r->st.st_size;
+    c->file_ino = r->st.st_ino;
+    if (r->newcrl)
+    {
+	c->debug("Reloaded '%s'.\n", c->filename);
+	c->replace(r->newcrl, r->index);
+	r->newcrl = NULL;
+	r->index = NULL;
+    }
+    else
+	c->debug(WvLog::Warning, "Reload CRL from '%s': %s; keeping the "
+		 "old one.\n", c->filename,
+		 r->errnum ? strerror(r->errnum) : "can't decode it");
+}
+
+
+bool WvCRL::refresh_every(int secs, WvWorkerPool *pool)
+{
+    if (time(NULL) - last_refresh < secs)
+	return false;
+    return refresh(pool);
+}
+
 
 WvCRL::Valid WvCRL::validate(const WvX509 &cacert) const
 {
@@ -452,6 +726,7 @@ void WvCRL::addcert(const WvX509 &cert)
 	X509_REVOKED_set_revocationDate(revoked, now);
 	// FIXME: We don't deal with the reason here...
 	X509_CRL_add0_revoked(crl, revoked);
+	forget_index();
 	ASN1_GENERALIZEDTIME_free(now);
 	ASN1_INTEGER_free(serial);
     }
@@ -32,6 +32,10 @@ char *alloca ();
 
 #include "wvdiffiehellman.h"
 #include "strutils.h"
+#ifndef _WIN32
+#include "wvworkerpool.h"
+#include "wvx509.h"
+#endif
 
 WvDiffieHellman::WvDiffieHellman(const unsigned char *_key, int _keylen, 
 				 BN_ULONG _generator) :
@@ -103,3 +107,53 @@ bool WvDiffieHellman::create_secret(WvBuf &inbuf, size_t in_len, WvBuf& outbuf)
 
     return true;
 }
+
+
+#ifndef _WIN32
+// A secret being computed on the worker pool.  The pool's job owns it,
+// and it holds its own reference to the DH parameters, so nothing leaks
+// or dangles if the pool or the WvDiffieHellman goes away first.
+struct DHJob
+{
+    struct dh_st *info;
+    WvDynBuf in, out;
+    WvDHSecretCallback cb;
+
+    DHJob(struct dh_st *_info, const WvDHSecretCallback &_cb)
+	: info(_info), cb(_cb)
+	{ DH_up_ref(info); }
+    ~DHJob()
+	{ DH_free(info); }
+};
+typedef wv::shared_ptr<DHJob> DHJobPtr;
+
+
+static void dh_secret_run(DHJobPtr j)
+{
+    size_t in_len = j->in.used();
+    BIGNUM *pub = BN_bin2bn(j->in.get(in_len), in_len, NULL);
+    if (!pub)
+	return;
+    unsigned char *secret = j->out.alloc(DH_size(j->info));
+    int len = DH_compute_key(secret, pub, j->info);
+    j->out.unalloc(DH_size(j->info) - (len > 0 ? len : 0));
+    BN_free(pub);
+}
+
+
+static void dh_secret_done(DHJobPtr j)
+{
+    j->cb(j->out);
+}
+
+
+void WvDiffieHellman::create_secret(WvBuf &inbuf, size_t in_len,
+				    WvWorkerPool &pool,
+				    const WvDHSecretCallback &cb)
+{
+    wvssl_threads_init();
+    DHJobPtr j(new DHJob(info, cb));
+    j->in.put(inbuf.get(in_len), in_len);
+    pool.add(wv::bind(dh_secret_run, j), wv::bind(dh_secret_done, j));
+}
+#endif // !_WIN32
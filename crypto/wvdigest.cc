@@ -11,12 +11,43 @@
 #include <assert.h>
 #include <zlib.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (__GNUC__ >= 5 || defined(__clang__))
+# define WV_X86_SIMD 1
+# include <cpuid.h>
+# include <emmintrin.h>
+# include <smmintrin.h>
+# include <tmmintrin.h>
+# include <wmmintrin.h>
+#else
+# define WV_X86_SIMD 0
+#endif
+
+/***** WvDigest *****/
+
+void WvDigest::digest_many(const void *const *data, const size_t *lens,
+			   size_t count, unsigned char *out)
+{
+    size_t size = digestsize();
+    for (size_t i = 0; i < count; i++, out += size)
+    {
+	WvConstInPlaceBuf inbuf(data[i], lens[i]);
+	WvInPlaceBuf outbuf(out, 0, size);
+	reset();
+	encode(inbuf, outbuf);
+	finish(outbuf);
+    }
+    reset();
+}
+
+
 /***** WvEVPMDDigest *****/
 
 WvEVPMDDigest::WvEVPMDDigest(const env_md_st *_evpmd) :
     evpmd(_evpmd), active(false)
 {
     evpctx = new EVP_MD_CTX;
+    EVP_MD_CTX_init(evpctx);
     _reset();
 }
 
@@ -24,6 +55,7 @@ WvEVPMDDigest::WvEVPMDDigest(const env_md_st *_evpmd) :
 WvEVPMDDigest::~WvEVPMDDigest()
 {
     cleanup();
+    EVP_MD_CTX_cleanup(evpctx);
     delete evpctx;
 }
 
@@ -46,7 +78,7 @@ bool WvEVPMDDigest::_finish(WvBuf &outbuf)
     assert(active);
     unsigned char digest[EVP_MAX_MD_SIZE];
     unsigned int size; // size_t is not an unsigned int on many 64 bit systems
-    EVP_DigestFinal(evpctx, digest, & size);
+    EVP_DigestFinal_ex(evpctx, digest, & size);
     active = false;
     outbuf.put(digest, size);
     return true;
@@ -60,7 +92,10 @@ bool WvEVPMDDigest::_reset()
     // the typecast is necessary for API compatibility with different
     // versions of openssl.  None of them *actually* change the contents of
     // the pointer.
-    EVP_DigestInit(evpctx, (env_md_st *)evpmd);
+    //
+    // The _ex versions keep the context's digest state allocated between
+    // messages, instead of freeing and reallocating it every time.
+    EVP_DigestInit_ex(evpctx, (env_md_st *)evpmd, NULL);
     active = true;
     return true;
 }
@@ -72,11 +107,26 @@ void WvEVPMDDigest::cleanup()
     {
         // discard digest
         unsigned char digest[EVP_MAX_MD_SIZE];
-        EVP_DigestFinal(evpctx, digest, NULL);
+        EVP_DigestFinal_ex(evpctx, digest, NULL);
         active = false;
     }
 }
 
+
+void WvEVPMDDigest::digest_many(const void *const *data, const size_t *lens,
+				size_t count, unsigned char *out)
+{
+    cleanup();
+    unsigned int size;
+    for (size_t i = 0; i < count; i++, out += size)
+    {
+	EVP_DigestInit_ex(evpctx, (env_md_st *)evpmd, NULL);
+	EVP_DigestUpdate(evpctx, data[i], lens[i]);
+	EVP_DigestFinal_ex(evpctx, out, &size);
+    }
+    reset();
+}
+
 size_t WvEVPMDDigest::digestsize() const
 {
     return EVP_MD_size((env_md_st *)evpmd);
@@ -105,12 +155,18 @@ WvHMACDigest::WvHMACDigest(WvEVPMDDigest *_digest,
     key = new unsigned char[keysize];
     memcpy(key, _key, keysize);
     hmacctx = new HMAC_CTX;
-    _reset();
+    HMAC_CTX_init(hmacctx);
+
+    // this hashes the key into the context once; _reset() reuses that
+    HMAC_Init_ex(hmacctx, key, keysize, (env_md_st *)digest->getevpmd(),
+		 NULL);
+    active = true;
 }
 
 WvHMACDigest::~WvHMACDigest()
 {
     cleanup();
+    HMAC_CTX_cleanup(hmacctx);
     delete hmacctx;
     deletev key;
     delete digest;
@@ -145,7 +201,7 @@ bool WvHMACDigest::_finish(WvBuf &outbuf)
 bool WvHMACDigest::_reset()
 {
     cleanup();
-    HMAC_Init(hmacctx, key, keysize, (env_md_st *)digest->getevpmd());
+    HMAC_Init_ex(hmacctx, NULL, 0, NULL, NULL);
     active = true;
     return true;
 }
@@ -169,6 +225,269 @@ size_t WvHMACDigest::digestsize() const
 }
 
 
+void WvHMACDigest::digest_many(const void *const *data, const size_t *lens,
+			       size_t count, unsigned char *out)
+{
+    cleanup();
+    unsigned int size;
+    for (size_t i = 0; i < count; i++, out += size)
+    {
+	HMAC_Init_ex(hmacctx, NULL, 0, NULL, NULL);
+	HMAC_Update(hmacctx, (const unsigned char *)data[i], lens[i]);
+	HMAC_Final(hmacctx, out, &size);
+    }
+    reset();
+}
+
+
+/***** WvCrc32Digest and WvAdler32Digest *****/
+
+static void put_be32(unsigned char *out, uint32_t n)
+{
+    // the same byte order wv_serialize() uses
+    out[0] = n >> 24;
+    out[1] = n >> 16;
+    out[2] = n >> 8;
+    out[3] = n;
+}
+
+
+#if WV_X86_SIMD
+
+enum { CPU_UNKNOWN = -1, CPU_PLAIN = 0, CPU_PCLMUL = 1, CPU_SSSE3 = 2 };
+static int cpu_features = CPU_UNKNOWN;
+
+static int get_cpu_features()
+{
+    if (cpu_features == CPU_UNKNOWN)
+    {
+	unsigned int eax, ebx, ecx, edx;
+	int features = CPU_PLAIN;
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+	{
+	    if ((ecx & bit_PCLMUL) && (ecx & bit_SSE4_1))
+		features |= CPU_PCLMUL;
+	    if (ecx & bit_SSSE3)
+		features |= CPU_SSSE3;
+	}
+	cpu_features = features;
+    }
+    return cpu_features;
+}
+
+
+/*
+ * CRC-32 by folding 64 bytes at a time with carry-less multiplies, from
+ * Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction".  'len' must be a multiple of 16, and at least 64; 'crc' is
+ * the un-inverted CRC, unlike zlib's.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *buf,
+			     size_t len)
+{
+    static const uint64_t k1k2[] __attribute__((aligned(16)))
+	= { 0x0154442bd4ULL, 0x01c6e41596ULL };
+    static const uint64_t k3k4[] __attribute__((aligned(16)))
+	= { 0x01751997d0ULL, 0x00ccaa009eULL };
+    static const uint64_t k5k0[] __attribute__((aligned(16)))
+	= { 0x0163cd6124ULL, 0x0000000000ULL };
+    static const uint64_t poly[] __attribute__((aligned(16)))
+	= { 0x01db710641ULL, 0x01f7011641ULL };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    buf += 64;
+    len -= 64;
+
+    // fold four 128-bit lanes in parallel
+    while (len >= 64)
+    {
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+	x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+	x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+	x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+	y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+	y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+	y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+	y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+	x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+	x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+	x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+	buf += 64;
+	len -= 64;
+    }
+
+    // fold the four lanes into one
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // then the remaining 16-byte blocks
+    while (len >= 16)
+    {
+	x2 = _mm_loadu_si128((const __m128i *)buf);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	buf += 16;
+	len -= 16;
+    }
+
+    // 128 bits down to 64
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // and a Barrett reduction down to 32
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return _mm_extract_epi32(x1, 1);
+}
+
+
+#define ADLER_BASE 65521U // largest prime smaller than 65536
+#define ADLER_NMAX 5552   // bytes we can sum before s2 might overflow
+
+/*
+ * Adler-32, 32 bytes at a time: s1 is a plain sum of the bytes, and each
+ * byte adds (its distance from the end of the block) times itself to s2,
+ * which is what _mm_maddubs_epi16 does with the right weights.
+ */
+__attribute__((target("ssse3")))
+static uint32_t adler32_ssse3(uint32_t adler, const unsigned char *buf,
+			      size_t len)
+{
+    uint32_t s1 = adler & 0xffff;
+    uint32_t s2 = adler >> 16;
+
+    const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+				       24, 23, 22, 21, 20, 19, 18, 17);
+    const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9,
+				       8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+
+    size_t blocks = len / 32;
+    len -= blocks * 32;
+    while (blocks)
+    {
+	size_t n = ADLER_NMAX / 32;
+	if (n > blocks)
+	    n = blocks;
+	blocks -= n;
+
+	__m128i v_ps = _mm_set_epi32(0, 0, 0, s1 * n);
+	__m128i v_s2 = _mm_set_epi32(0, 0, 0, s2);
+	__m128i v_s1 = _mm_setzero_si128();
+	do
+	{
+	    __m128i bytes1 = _mm_loadu_si128((const __m128i *)buf);
+	    __m128i bytes2 = _mm_loadu_si128((const __m128i *)(buf + 16));
+
+	    // every byte summed so far counts once more for each block
+	    v_ps = _mm_add_epi32(v_ps, v_s1);
+
+	    v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+	    v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+				     _mm_maddubs_epi16(bytes1, tap1), ones));
+	    v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+	    v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+				     _mm_maddubs_epi16(bytes2, tap2), ones));
+	    buf += 32;
+	} while (--n);
+
+	v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+	// add up the lanes
+	v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1,0,3,2)));
+	s1 += _mm_cvtsi128_si32(v_s1);
+	v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2,3,0,1)));
+	v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1,0,3,2)));
+	s2 = _mm_cvtsi128_si32(v_s2);
+
+	s1 %= ADLER_BASE;
+	s2 %= ADLER_BASE;
+    }
+
+    // zlib does the leftovers
+    return ::adler32((s2 << 16) | s1, buf, len);
+}
+
+#endif // WV_X86_SIMD
+
+
+uint32_t WvCrc32Digest::crc32(uint32_t crc, const void *_buf, size_t len)
+{
+    const unsigned char *buf = (const unsigned char *)_buf;
+#if WV_X86_SIMD
+    if (len >= 64 && (get_cpu_features() & CPU_PCLMUL))
+    {
+	size_t chunk = len & ~(size_t)15;
+	crc = ~crc32_pclmul(~crc, buf, chunk);
+	buf += chunk;
+	len -= chunk;
+    }
+#endif
+    // zlib's length is a uInt, which might be smaller than a size_t
+    while (len > 0)
+    {
+	uInt n = len > 0x40000000 ? 0x40000000 : len;
+	crc = ::crc32(crc, buf, n);
+	buf += n;
+	len -= n;
+    }
+    return crc;
+}
+
+
+uint32_t WvAdler32Digest::adler32(uint32_t adler, const void *_buf,
+				  size_t len)
+{
+    const unsigned char *buf = (const unsigned char *)_buf;
+#if WV_X86_SIMD
+    if (len >= 64 && (get_cpu_features() & CPU_SSSE3))
+	return adler32_ssse3(adler, buf, len);
+#endif
+    while (len > 0)
+    {
+	uInt n = len > 0x40000000 ? 0x40000000 : len;
+	adler = ::adler32(adler, buf, n);
+	buf += n;
+	len -= n;
+    }
+    return adler;
+}
+
+
 WvCrc32Digest::WvCrc32Digest()
 {
     _reset();
@@ -193,7 +512,7 @@ bool WvCrc32Digest::_finish(WvBuf &outbuf)
 
 bool WvCrc32Digest::_reset()
 {
-    crc = crc32(0, NULL, 0);
+    crc = ::crc32(0, NULL, 0);
     return true;
 }
 
@@ -204,6 +523,16 @@ size_t WvCrc32Digest::digestsize() const
 }
 
 
+void WvCrc32Digest::digest_many(const void *const *data, const size_t *lens,
+				size_t count, unsigned char *out)
+{
+    uint32_t init = ::crc32(0, NULL, 0);
+    for (size_t i = 0; i < count; i++, out += sizeof(crc))
+	put_be32(out, crc32(init, data[i], lens[i]));
+    reset();
+}
+
+
 WvAdler32Digest::WvAdler32Digest()
 {
     _reset();
@@ -228,7 +557,7 @@ bool WvAdler32Digest::_finish(WvBuf &outbuf)
 
 bool WvAdler32Digest::_reset()
 {
-    crc = adler32(0, NULL, 0);
+    crc = ::adler32(0, NULL, 0);
     return true;
 }
 
@@ -237,3 +566,13 @@ size_t WvAdler32Digest::digestsize() const
 {
     return sizeof(crc);
 }
+
+
+void WvAdler32Digest::digest_many(const void *const *data, const size_t *lens,
+				  size_t count, unsigned char *out)
+{
+    uint32_t init = ::adler32(0, NULL, 0);
+    for (size_t i = 0; i < count; i++, out += sizeof(crc))
+	put_be32(out, adler32(init, data[i], lens[i]));
+    reset();
+}
@@ -71,6 +71,25 @@ void WvOakleyAuth::create_secret(WvBuf &_other_pub_key, short len)
     return;
 }
 
+#ifndef _WIN32
+void WvOakleyAuth::create_secret(WvBuf &_other_pub_key, short len,
+				 WvWorkerPool &pool,
+				 const wv::function<void()> &cb)
+{
+    other_pub_key.put(_other_pub_key.peek(0, len), len);
+    other_len = len;
+    dh->create_secret(_other_pub_key, len, pool,
+		      wv::bind(&WvOakleyAuth::got_secret, this, _1, cb));
+}
+
+
+void WvOakleyAuth::got_secret(WvBuf &secret, wv::function<void()> cb)
+{
+    dh_secret.merge(secret);
+    cb();
+}
+#endif
+
 short WvOakleyAuth::other_pub_len()
 {
     return other_len;
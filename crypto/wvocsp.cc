@@ -165,8 +165,12 @@ WvX509 WvOCSPResp::get_signing_cert() const
 
 
 WvOCSPResp::Status WvOCSPResp::get_status(const WvX509 &cert, 
-                                          const WvX509 &issuer) const
+                                          const WvX509 &issuer,
+                                          time_t *next_update) const
 {
+    if (next_update)
+        *next_update = 0;
+
     if (!isok())
         return Error;
 
@@ -194,6 +198,9 @@ WvOCSPResp::Status WvOCSPResp::get_status(const WvX509 &cert,
         return Error;
     }
 
+    if (next_update && nextupd)
+        *next_update = wvssl_asn1_time(nextupd);
+
     if (status == V_OCSP_CERTSTATUS_GOOD)
         return Good;
     else if (status == V_OCSP_CERTSTATUS_REVOKED)
@@ -11,6 +11,10 @@
 #include "wvrsa.h"
 #include "wvhex.h"
 #include "wvfileutils.h"
+#ifndef _WIN32
+#include "wvworkerpool.h"
+#endif
+#include "wvx509.h"
 
 /***** WvRSAKey *****/
 
@@ -70,6 +74,50 @@ WvRSAKey::WvRSAKey(int bits)
 }
 
 
+#ifndef _WIN32
+// A key being generated on the worker pool.  The pool's job owns it, so
+// the key is freed even if the pool is destroyed before 'done' runs.
+struct RSAGenJob
+{
+    int bits;
+    struct rsa_st *rsa;
+    WvRSAKeyCallback cb;
+
+    RSAGenJob(int _bits, const WvRSAKeyCallback &_cb)
+	: bits(_bits), rsa(NULL), cb(_cb) {}
+    ~RSAGenJob()
+    {
+	if (rsa)
+	    RSA_free(rsa);
+    }
+};
+typedef wv::shared_ptr<RSAGenJob> RSAGenJobPtr;
+
+
+static void rsa_gen_run(RSAGenJobPtr j)
+{
+    j->rsa = RSA_generate_key(j->bits, 0x10001, NULL, NULL);
+}
+
+
+static void rsa_gen_done(RSAGenJobPtr j)
+{
+    struct rsa_st *rsa = j->rsa;
+    j->rsa = NULL; // the WvRSAKey owns it now
+    j->cb(rsa ? new WvRSAKey(rsa, true) : NULL);
+}
+
+
+void WvRSAKey::generate(WvWorkerPool &pool, int bits,
+			const WvRSAKeyCallback &cb)
+{
+    wvssl_threads_init();
+    RSAGenJobPtr j(new RSAGenJob(bits, cb));
+    pool.add(wv::bind(rsa_gen_run, j), wv::bind(rsa_gen_done, j));
+}
+#endif
+
+
 WvRSAKey::~WvRSAKey()
 {
     if (rsa)
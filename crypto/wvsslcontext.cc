@@ -0,0 +1,261 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A shared, refcounted SSL_CTX for WvSSLStream.  See wvsslcontext.h.
+ */
+#define OPENSSL_NO_KRB5
+#include "wvsslcontext.h"
+#include "wvx509mgr.h"
+#include "wvcrypto.h"
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+UUID_MAP_BEGIN(WvSSLContext)
+  UUID_MAP_ENTRY(IObject)
+  UUID_MAP_END
+
+int WvSSLContext::max_cached = 16;
+
+// every context get() has handed out, most recently used first
+static WvSSLContextList *contexts = NULL;
+
+// where prepare_client() keeps the peer name of each client SSL object
+static int peer_index = -1;
+
+static const unsigned char session_id_context[] = "WvSSLStream";
+
+
+static int wv_verify_cb(int preverify_ok, X509_STORE_CTX *ctx)
+{
+    // This just returns true, since what we really want is for the
+    // WvSSLValidateCallback to do this work
+    return 1;
+}
+
+
+static void free_peer(void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+		      int idx, long argl, void *argp)
+{
+    delete (WvString *)ptr;
+}
+
+
+WvSSLContext::Session::~Session()
+{
+    SSL_SESSION_free(sess);
+}
+
+
+WvSSLContext *WvSSLContext::get(WvX509Mgr *x509, bool is_server)
+{
+    if (!contexts)
+	contexts = new WvSSLContextList;
+
+    WvSSLContextList::Iter i(*contexts);
+    for (i.rewind(); i.next(); )
+    {
+	if (i->x509 == x509 && i->is_server == is_server && i->isok())
+	{
+	    // move it to the front, so purging keeps the busy ones
+	    WvSSLContext *c = i.ptr();
+	    i.xunlink();
+	    contexts->prepend(c, false);
+	    c->addRef();
+	    return c;
+	}
+    }
+
+    WvSSLContext *c = new WvSSLContext(x509, is_server);
+    if (c->isok())
+    {
+	contexts->prepend(c, false); // the list holds the first reference
+	c->addRef();
+
+	// keep only max_cached contexts that aren't in use.  If the list
+	// has the only reference, our addRef() makes it 2.
+	int idle = 0;
+	for (i.rewind(); i.next(); )
+	{
+	    WvSSLContext *old = i.ptr();
+	    bool unused = (old->addRef() == 2);
+	    old->release();
+	    if (unused && ++idle > max_cached)
+	    {
+		i.xunlink();
+		old->release();
+	    }
+	}
+    }
+    return c;
+}
+
+
+void WvSSLContext::purge()
+{
+    if (!contexts)
+	return;
+
+    WvSSLContextList::Iter i(*contexts);
+    for (i.rewind(); i.next(); )
+    {
+	WvSSLContext *c = i.ptr();
+	i.xunlink();
+	c->release();
+    }
+    delete contexts;
+    contexts = NULL;
+}
+
+
+WvSSLContext::WvSSLContext(WvX509Mgr *_x509, bool _is_server)
+    : x509(_x509), is_server(_is_server), ctx(NULL),
+      debug(WvString("SSL Context (%s)", _is_server ? "server" : "client"),
+	    WvLog::Debug5)
+{
+    wvssl_init();
+    if (x509)
+	x509->addRef(); // openssl keeps pointers into this object
+
+    if (peer_index < 0)
+	peer_index = SSL_get_ex_new_index(0, NULL, NULL, NULL, free_peer);
+
+    if (x509 && !x509->isok())
+    {
+	seterr("Certificate + key pair invalid.");
+	return;
+    }
+
+    if (is_server && !x509)
+    {
+	seterr("Certificate not available: server mode not possible!");
+	return;
+    }
+
+    ctx = SSL_CTX_new(is_server ? SSLv23_server_method()
+		      : SSLv23_client_method());
+    if (!ctx)
+    {
+	debug("Can't get SSL context! Error: %s\n",
+	      ERR_reason_error_string(ERR_get_error()));
+	seterr("Can't get SSL context!");
+	return;
+    }
+    SSL_CTX_set_app_data(ctx, this);
+
+    if (x509 && !x509->bind_ssl(ctx))
+    {
+	seterr("Unable to bind Certificate to SSL Context!");
+	return;
+    }
+
+    set_tickets(false);
+
+    if (is_server)
+    {
+	// Allow SSL Writes to only write part of a request...
+	SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE);
+
+	// Tell SSL to use 128 bit or better ciphers - this appears to
+	// be necessary for some reason... *sigh*
+	SSL_CTX_set_cipher_list(ctx, "HIGH");
+
+	// Enable the workarounds for broken clients and servers
+	// and disable the insecure SSLv2 protocol
+	SSL_CTX_set_options(ctx, SSL_OP_ALL|SSL_OP_NO_SSLv2);
+
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER|SSL_VERIFY_CLIENT_ONCE,
+			   wv_verify_cb);
+
+	// sessions can't be resumed without an ID context when we ask for
+	// client certificates.
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_set_session_id_context(ctx, session_id_context,
+				       sizeof(session_id_context) - 1);
+    }
+    else
+    {
+	// OpenSSL only tells us about new sessions if it's caching them;
+	// we do the actual storing ourselves, by server address.
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT
+				       | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, new_session_cb);
+    }
+
+    debug("Configured algorithms and methods for %s mode.\n",
+	  is_server ? "server" : "client");
+}
+
+
+WvSSLContext::~WvSSLContext()
+{
+    sessions.zap();
+    if (ctx)
+	SSL_CTX_free(ctx);
+    WVRELEASE(x509);
+    wvssl_free();
+}
+
+
+void WvSSLContext::set_tickets(bool enable)
+{
+#ifdef SSL_OP_NO_TICKET
+    if (!ctx)
+	return;
+    if (enable)
+	SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+    else
+	SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+#endif
+}
+
+
+void WvSSLContext::prepare_client(SSL *ssl, WvStringParm peer)
+{
+    if (is_server || !peer)
+	return;
+
+    SSL_set_ex_data(ssl, peer_index, new WvString(peer));
+
+    SessionList::Iter i(sessions);
+    for (i.rewind(); i.next(); )
+    {
+	if (i->peer == peer)
+	{
+	    debug("Trying to resume the session with %s.\n", peer);
+	    SSL_set_session(ssl, i->sess);
+	    break;
+	}
+    }
+}
+
+
+void WvSSLContext::save_session(WvStringParm peer, SSL_SESSION *sess)
+{
+    SessionList::Iter i(sessions);
+    for (i.rewind(); i.next(); )
+    {
+	if (i->peer == peer)
+	{
+	    i.xunlink();
+	    break;
+	}
+    }
+
+    if (sessions.count() >= MAX_SESSIONS)
+	sessions.unlink(sessions.last());
+    sessions.prepend(new Session(peer, sess), true);
+}
+
+
+int WvSSLContext::new_session_cb(SSL *ssl, SSL_SESSION *sess)
+{
+    WvSSLContext *c = (WvSSLContext *)SSL_CTX_get_app_data(
+	SSL_get_SSL_CTX(ssl));
+    WvString *peer = (WvString *)SSL_get_ex_data(ssl, peer_index);
+    if (!c || !peer)
+	return 0;
+
+    c->save_session(*peer, sess);
+    return 1; // we keep the reference OpenSSL gave us
+}
@@ -4,6 +4,8 @@
  */
 #define OPENSSL_NO_KRB5
 #include "wvsslstream.h"
+#include "wvsslcontext.h"
+#include "wvaddr.h"
 #include "wvx509mgr.h"
 #include "wvcrypto.h"
 #include "wvlistener.h"
@@ -12,22 +14,7 @@
 #include "wvlinkerhack.h"
 #include <openssl/ssl.h>
 #include <openssl/err.h>
-#include <assert.h>
-
-#ifndef _WIN32
-# if HAVE_ARGZ_H
-#  include <argz.h>
-# else
-#  if HAVE_ERRNO_H
-#   include <errno.h>
-#  endif
-# endif
-#else
-#undef errno
-#define errno GetLastError()
-#undef EAGAIN
-#define EAGAIN WSAEWOULDBLOCK
-#endif
+#include <limits.h>
 
 WV_LINK(WvSSLStream);
 
@@ -153,7 +140,11 @@ static IWvListener *sslcertlistener(WvStringParm s, IObject *obj)
 static WvMoniker<IWvListener> lreg("ssl", listener);
 static WvMoniker<IWvListener> lsslcertreg("sslcert", sslcertlistener);
 
-#define MAX_BOUNCE_AMOUNT (16384) // 1 SSLv3/TLSv1 record
+// how much ciphertext SSL_read() may pull out of the BIO at once
+#define READ_AHEAD_AMOUNT (65536)
+
+// how much ciphertext the BIO pair holds in each direction
+#define BIO_BUFFER_SIZE (65536)
 
 static int ssl_stream_count = 0;
 
@@ -170,10 +161,27 @@ WvSSLStream::WvSSLStream(IWvStream *_slave, WvX509Mgr *_x509,
     WvSSLValidateCallback _vcb, bool _is_server) :
     WvStreamClone(_slave),
     debug(WvString("WvSSLStream %s", ++ssl_stream_count), WvLog::Debug5),
-    write_bouncebuf(MAX_BOUNCE_AMOUNT), write_eat(0),
-    read_bouncebuf(MAX_BOUNCE_AMOUNT), read_pending(false)
+    read_pending(false)
+{
+    init(WvSSLContext::get(_x509, _is_server), _vcb);
+}
+
+
+WvSSLStream::WvSSLStream(IWvStream *_slave, WvSSLContext &_context,
+    WvSSLValidateCallback _vcb) :
+    WvStreamClone(_slave),
+    debug(WvString("WvSSLStream %s", ++ssl_stream_count), WvLog::Debug5),
+    read_pending(false)
+{
+    _context.addRef();
+    init(&_context, _vcb);
+}
+
+
+void WvSSLStream::init(WvSSLContext *_context, WvSSLValidateCallback _vcb)
 {
-    x509 = _x509;
+    context = _context;
+    x509 = context->x509;
     if (x509)
 	x509->addRef(); // openssl may keep a pointer to this object
     
@@ -181,81 +189,24 @@ WvSSLStream::WvSSLStream(IWvStream *_slave, WvX509Mgr *_x509,
     if (!vcb && global_vcb)
 	vcb = wv::bind(global_vcb, _1, this);;
 
-    is_server = _is_server;
+    is_server = context->is_server;
     ctx = NULL;
     ssl = NULL;
+    netbio = NULL;
+    slave_eof = false;
     //meth = NULL;
     sslconnected = ssl_stop_read = ssl_stop_write = false;
     
     wvssl_init();
     
-    if (x509 && !x509->isok())
-    {
-	seterr("Certificate + key pair invalid.");
-	return;
-    }
-
-    if (is_server && !x509)
+    if (!context->isok())
     {
-	seterr("Certificate not available: server mode not possible!");
+	seterr(context->errstr());
 	return;
     }
-
-    if (is_server)
-    {
-    	debug("Configured algorithms and methods for server mode.\n");
-
-	ctx = SSL_CTX_new(SSLv23_server_method());
-    	if (!ctx)
-    	{
-            ERR_print_errors_fp(stderr);
-            debug("Can't get SSL context! Error: %s\n", 
-                  ERR_reason_error_string(ERR_get_error()));
-	    seterr("Can't get SSL context!");
-	    return;
-    	}
-	
-	// Allow SSL Writes to only write part of a request...
-	SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE);
-
-	// Tell SSL to use 128 bit or better ciphers - this appears to
-	// be necessary for some reason... *sigh*
-	SSL_CTX_set_cipher_list(ctx, "HIGH");
-
-	// Enable the workarounds for broken clients and servers
-	// and disable the insecure SSLv2 protocol
-        SSL_CTX_set_options(ctx, SSL_OP_ALL|SSL_OP_NO_SSLv2);
-
-	if (!x509->bind_ssl(ctx))
-	{
-	    seterr("Unable to bind Certificate to SSL Context!");
-	    return;
-	}
-	
-        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER|SSL_VERIFY_CLIENT_ONCE, 
-                               wv_verify_cb);
-	
-	debug("Server mode ready.\n");
-    }
-    else
-    {
-    	debug("Configured algorithms and methods for client mode.\n");
+    ctx = context->ctx;
+    debug("Using shared %s context.\n", is_server ? "server" : "client");
     
-    	ctx = SSL_CTX_new(SSLv23_client_method());
-    	if (!ctx)
-    	{
-	    seterr("Can't get SSL context!");
-	    return;
-    	}
-        if (x509 && !x509->bind_ssl(ctx))
-        {
-            seterr("Unable to bind Certificate to SSL Context!");
-            return;
-        }
-    }
-    
-    //SSL_CTX_set_read_ahead(ctx, 1);
-
     ERR_clear_error();
     ssl = SSL_new(ctx);
     if (!ssl)
@@ -264,6 +215,31 @@ WvSSLStream::WvSSLStream(IWvStream *_slave, WvX509Mgr *_x509,
 	return;
     }
 
+    BIO *sslbio = NULL;
+    if (!BIO_new_bio_pair(&sslbio, BIO_BUFFER_SIZE, &netbio, BIO_BUFFER_SIZE))
+    {
+	seterr("Can't create SSL BIO pair!");
+	return;
+    }
+    SSL_set_bio(ssl, sslbio, sslbio);
+    if (is_server)
+	SSL_set_accept_state(ssl);
+    else
+	SSL_set_connect_state(ssl);
+
+    // uwrite() hands SSL_write() whatever buffer WvStream gives it, and
+    // when a write has to be retried, it's from our own copy in
+    // pending_record, which won't be where the first try was.
+    SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE
+		 | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    // process as many records at once as the BIO has for us; older
+    // versions can't tell us about read-ahead data in ssl_pending().
+    SSL_set_read_ahead(ssl, 1);
+    SSL_set_default_read_buffer_len(ssl, READ_AHEAD_AMOUNT);
+#endif
+
     // If we set this, it seems we always verify the client... security hole,
     // no?  Well, if we don't set it, the server doesn't even ask the client
     // for a certificate, so, ya know, it's not actually any more secure.
@@ -273,6 +249,10 @@ WvSSLStream::WvSSLStream(IWvStream *_slave, WvX509Mgr *_x509,
 	SSL_set_verify(ssl, SSL_VERIFY_PEER|SSL_VERIFY_CLIENT_ONCE, 
                        wv_verify_cb);
 
+    // pick up where we left off the last time we talked to this server
+    if (!is_server && cloned && cloned->src())
+	context->prepare_client(ssl, WvString(*cloned->src()));
+
     connect_wants.readable = true;
     connect_wants.writable = true; // force ssl initiation ASAP
     connect_wants.isexception = false;
@@ -289,6 +269,7 @@ WvSSLStream::~WvSSLStream()
 	debug("Error was: %s\n", errstr());
     
     WVRELEASE(x509);
+    WVRELEASE(context);
     wvssl_free();
 }
 
@@ -307,120 +288,138 @@ void WvSSLStream::printerr(WvStringParm func)
 }
 
  
+static bool ssl_pending(SSL *ssl)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    return SSL_has_pending(ssl);
+#else
+    return SSL_pending(ssl) > 0;
+#endif
+}
+
+
+size_t WvSSLStream::pump_in()
+{
+    if (!netbio || !cloned || slave_eof)
+	return 0;
+
+    // read straight into the BIO's buffer; it's a ring, so there might be
+    // two pieces of free space.
+    size_t total = 0;
+    char *space;
+    int avail;
+    while ((avail = BIO_nwrite0(netbio, &space)) > 0)
+    {
+	size_t len = cloned->isok() ? cloned->read(space, avail) : 0;
+	if (!len)
+	{
+	    if (!cloned->isok())
+	    {
+		// let SSL_read() see the EOF once it's used up the rest
+		BIO_shutdown_wr(netbio);
+		slave_eof = true;
+	    }
+	    break;
+	}
+	BIO_nwrite(netbio, &space, len);
+	total += len;
+	if (len < (size_t)avail)
+	    break;
+    }
+    return total;
+}
+
+
+bool WvSSLStream::pump_out()
+{
+    if (!netbio || !cloned)
+	return true;
+
+    char *data;
+    int avail;
+    while ((avail = BIO_nread0(netbio, &data)) > 0)
+    {
+	size_t len = cloned->write(data, avail);
+	if (!len)
+	    return false;
+	BIO_nread(netbio, &data, len);
+    }
+    return cloned->flush(0);
+}
+
+
 size_t WvSSLStream::uread(void *buf, size_t len)
 {
     if (!sslconnected)
         return 0;
     if (len == 0) return 0;
 
-    // if SSL buffers stuff on its own, select() may not wake us up
-    // the next time around unless we're sure there is nothing left
-    read_pending = true;
-    
+    // decrypt right into the caller's buffer, topping up the BIO from the
+    // slave only when OpenSSL has run out of whole records.
     size_t total = 0;
-    for (;;)
+    bool more = false;
+    while (len > 0)
     {
-        // handle SSL_read quirk
-        if (read_bouncebuf.used() != 0)
+	ERR_clear_error();
+        int result = SSL_read(ssl, buf, len < INT_MAX ? len : INT_MAX);
+	// debug("<< SSL_read result %s for %s bytes\n", result, len);
+        if (result > 0)
         {
-            // copy out cached data
-            size_t amount = len < read_bouncebuf.used() ?
-                len : read_bouncebuf.used();
-            read_bouncebuf.move(buf, amount);
-
-            // locate next chunk in buffer
-            len -= amount;
-            total += amount;
-            if (len == 0)
-	    {
-		read_pending = false;
-                break;
-	    }
-            buf = (unsigned char *)buf + amount;
-	    
-	    // FIXME: this shouldn't be necessary, but it resolves weird
-	    // problems when the other end disconnects in the middle of
-	    // SSL negotiation, but only on emakela's machine.  I don't
-	    // know why.  -- apenwarr (2004/02/10)
-	    break;
+            total += result;
+            len -= result;
+            buf = (unsigned char *)buf + result;
+            more = (len == 0);
+            continue;
         }
 
-        // attempt to read
-        read_bouncebuf.zap(); // force use of same position in buffer
-        size_t avail = read_bouncebuf.free();
-        unsigned char *data = read_bouncebuf.alloc(avail);
+        // once we have something to return, leave the slave alone, so
+        // that if it's at EOF, it doesn't close before we return the data.
+        int sslerrcode = SSL_get_error(ssl, result);
+        if (sslerrcode == SSL_ERROR_WANT_READ && !total && pump_in())
+            continue;
         
-	ERR_clear_error();
-        int result = SSL_read(ssl, data, avail);
-	// debug("<< SSL_read result %s for %s bytes (wanted %s)\n",
-	//      result, avail, len);
-        if (result <= 0)
+        switch (sslerrcode)
         {
-	    error_t err = errno;
-            read_bouncebuf.unalloc(avail);
-            int sslerrcode = SSL_get_error(ssl, result);
-	    switch (sslerrcode)
-            {
-                case SSL_ERROR_WANT_READ:
-		    debug("<< SSL_read() needs to wait for writable.\n");
-                    break; // wait for later
-                case SSL_ERROR_WANT_WRITE:
-		    debug("<< SSL_read() needs to wait for readable.\n");
-                    break; // wait for later
-                    
-                case SSL_ERROR_NONE:
-                    break; // no error, but can't make progress
-                    
-	        case SSL_ERROR_ZERO_RETURN:
-		    debug("<< EOF: zero return\n");
-		
-		    // don't do this if we're returning nonzero!
-		    // (SSL has no way to do a one-way shutdown, so if SSL
-		    // detects a read problem, it's also a write problem.)
-		    if (!total) { noread(); nowrite(); }
-                    break;
+            case SSL_ERROR_WANT_READ:
+            case SSL_ERROR_WANT_WRITE:
+            case SSL_ERROR_NONE:
+                break; // no error, but can't make progress yet
+                
+            case SSL_ERROR_ZERO_RETURN:
+                debug("<< EOF: zero return\n");
+            
+                // don't do this if we're returning nonzero!
+                // (SSL has no way to do a one-way shutdown, so if SSL
+                // detects a read problem, it's also a write problem.)
+                if (!total) { noread(); nowrite(); }
+                break;
 
-		case SSL_ERROR_SYSCALL:
-		    if (!err)
-		    {
-			if (result == 0)
-			{
-			    debug("<< EOF: syscall error "
-				  "(%s/%s, %s/%s) total=%s\n",
-				  stop_read, stop_write,
-				  isok(), cloned && cloned->isok(), total);
-			    
-			    // don't do this if we're returning nonzero!
-			    // (SSL has no way to do a one-way shutdown, so
-			    // if SSL detects a read problem, it's also a
-			    // write problem.)
-			    if (!total) { noread(); nowrite(); }
-			}
-		    }
-		    else
-		    {
-			debug("<< SSL_read() err=%s (%s)\n",
-			    err, strerror(err));
-			seterr_both(err, WvString("SSL read: %s",
-			    strerror(err)));
-		    }
-		    break;
-                    
-                default:
-                    printerr("SSL_read");
-                    seterr("SSL read error #%s", sslerrcode);
-                    break;
-            }
-            read_pending = false;
-            break; // wait for next iteration
+            case SSL_ERROR_SYSCALL:
+                // the BIO never fails, so this means the slave hit EOF
+                // without a proper SSL shutdown.  If it hit an error
+                // instead, it'll be !isok() and so will we.
+                debug("<< EOF: syscall error (%s/%s, %s/%s) total=%s\n",
+                      stop_read, stop_write,
+                      isok(), cloned && cloned->isok(), total);
+                if (!total) { noread(); nowrite(); }
+                break;
+                
+            default:
+                printerr("SSL_read");
+                seterr("SSL read error #%s", sslerrcode);
+                break;
         }
-	// debug("<< read result was %s\n", result);
-	
-	if (result < 0)
-	    result = 0;
-        read_bouncebuf.unalloc(avail - result);
+        break; // wait for next iteration
     }
 
+    // reading can make SSL want to say something too (eg. a key update)
+    pump_out();
+
+    // if we stopped because buf filled up, there might be more where
+    // that came from, and select() on the slave won't tell us so.
+    read_pending = more && ssl
+        && (ssl_pending(ssl) || BIO_ctrl_pending(SSL_get_rbio(ssl)));
+
     // debug("<< read %s bytes (%s, %s)\n",
     //	  total, isok(), cloned && cloned->isok());
     return total;
@@ -440,54 +439,41 @@ size_t WvSSLStream::uwrite(const void *buf, size_t len)
 
 //    debug(">> I want to write %s bytes.\n", len);
 
-    size_t total = 0;
+    // the record we're holding onto has to go out before anything else
+    if (!retry_record())
+	return 0;
+
+    size_t total = write_records(buf, len, true);
+    pump_out();
     
-    // eat any data that was precached and already written
-    if (write_eat >= len)
-    {
-        write_eat -= len;
-        total = len;
-        len = 0;
-    }
-    else
-    {
-        buf = (const unsigned char *)buf + write_eat;
-        total = write_eat;
-        len -= write_eat;
-        write_eat = 0;
-    }
+    //debug(">> wrote %s bytes\n", total);
+    return total;
+}
 
-    // FIXME: WOW!!! Ummm... hope this never spins...
-    // 
-    for (;;) 
-    {
-        // handle SSL_write quirk
-        if (write_bouncebuf.used() == 0)
-        {
-            if (len == 0) break;
-
-            // copy new data into the bounce buffer only if empty
-            // if it were not empty, then SSL_write probably returned
-            // SSL_ERROR_WANT_WRITE on the previous call and we
-            // must invoke it with precisely the same arguments
-            size_t amount = len < write_bouncebuf.free() ?
-                len : write_bouncebuf.free();
-            write_bouncebuf.put(buf, amount);
-            // note: we don't adjust the total yet...
-        } // otherwise we use what we cached last time in bounce buffer
-        
-        // attempt to write
-        size_t used = write_bouncebuf.used();
-        const unsigned char *data = write_bouncebuf.get(used);
 
+// With partial writes on, each SSL_write() puts at most one record into
+// the BIO.  When the BIO is full, we pass it all on to the slave and carry
+// on, unless the slave is backed up too.  Then OpenSSL has already
+// encrypted the record, and insists that the retry start at the same
+// byte and be at least as long.  WvStream won't promise that: write()
+// only keeps as much as fits under outbuf_limit(), and flush_outbuf()
+// might only offer the first piece of outbuf.  So if 'keep' is set, we
+// take a copy of the record's worth of data, report it as written, and
+// do the retrying ourselves in retry_record().
+size_t WvSSLStream::write_records(const void *buf, size_t len, bool keep)
+{
+    size_t total = 0;
+    while (len > 0)
+    {
         ERR_clear_error();
-        int result = SSL_write(ssl, data, used);
-	// debug("<< SSL_write result %s for %s bytes\n",
-	//      result, used);
+        int result = SSL_write(ssl, buf, len < INT_MAX ? len : INT_MAX);
+	// debug("<< SSL_write result %s for %s bytes\n", result, len);
         if (result <= 0)
         {
             int sslerrcode = SSL_get_error(ssl, result);
-            write_bouncebuf.unget(used);
+            if (sslerrcode == SSL_ERROR_WANT_WRITE && pump_out())
+                continue;
+
             switch (sslerrcode)
             {
                 case SSL_ERROR_WANT_READ:
@@ -495,11 +481,18 @@ size_t WvSSLStream::uwrite(const void *buf, size_t len)
                     break; // wait for later
                 case SSL_ERROR_WANT_WRITE:
                     // debug(">> SSL_write() needs to wait for writable.\n");
+		    if (keep)
+		    {
+			size_t n = len < SSL3_RT_MAX_PLAIN_LENGTH
+			    ? len : SSL3_RT_MAX_PLAIN_LENGTH;
+			pending_record.put(buf, n);
+			total += n;
+		    }
                     break; // wait for later
                     
 	        case SSL_ERROR_SYSCALL:
-		    debug(">> ERROR: SSL_write() failed on socket error.\n");
-		    seterr(WvString("SSL write error: %s", strerror(errno)));
+		    debug(">> ERROR: SSL_write() failed on closed stream.\n");
+		    seterr("SSL write error: stream closed");
 		    break;
 	    
 	        // This case can cause truncated web pages... give more info
@@ -524,32 +517,46 @@ size_t WvSSLStream::uwrite(const void *buf, size_t len)
             }
             break; // wait for next iteration
         }
-	else
-	    assert((size_t)result == used);
-        write_bouncebuf.zap(); // force use of same position in buffer
-        
-        // locate next chunk to be written
-        // note: we assume that initial contents of buf and of the
-        //       bouncebuf match since if we got SSL_ERROR_WANT_WRITE
-        //       we did not claim to actually have written the chunk
-        //       that we cached so we will have gotten it again here
-        if (size_t(result) >= len)
-        {
-            // if we cached more previously than we were given, claim
-            // we wrote what we got and remember to eat the rest later
-            write_eat = result - len;
-            total += len;
-            break;
-        }
+
         total += size_t(result);
         len -= size_t(result);
         buf = (const unsigned char *)buf + size_t(result);
     }
-    
-    //debug(">> wrote %s bytes\n", total);
     return total;
 }
 
+
+bool WvSSLStream::retry_record()
+{
+    size_t len = pending_record.used();
+    if (!len)
+	return true;
+    if (!ssl)
+	return false;
+
+    size_t wrote = write_records(pending_record.get(len), len, false);
+    pending_record.unget(len - wrote);
+    if (wrote < len)
+	return false;
+    pump_out();
+    return true;
+}
+
+
+bool WvSSLStream::flush_internal(time_t msec_timeout)
+{
+    // the slave's outbuf is what's holding up our record, so wait for it
+    WvTime stoptime = msecadd(wvtime(), msec_timeout);
+    while (sslconnected && cloned && isok() && !retry_record())
+    {
+	time_t left = msec_timeout < 0 ? -1 : msecdiff(stoptime, wvtime());
+	if (!msec_timeout || (msec_timeout > 0 && left <= 0))
+	    return false;
+	cloned->flush(left);
+    }
+    return WvStreamClone::flush_internal(msec_timeout);
+}
+
 void WvSSLStream::close()
 {
     debug("Closing SSL connection (ok=%s,sr=%s,sw=%s,child=%s).\n",
@@ -558,19 +565,28 @@ void WvSSLStream::close()
     if (ssl)
     {
         ERR_clear_error();
+	// we're closing anyway, so the slave mustn't call us back if
+	// sending the close_notify makes it notice it's dead.
+	if (cloned)
+	    cloned->setclosecallback(0);
+	if (sslconnected)
+	    retry_record();
 	SSL_shutdown(ssl);
+	pump_out();
 	SSL_free(ssl);
 	ssl = NULL;
 	sslconnected = false;
     }
+    if (netbio)
+    {
+	BIO_free(netbio);
+	netbio = NULL;
+    }
     
     WvStreamClone::close();
     
-    if (ctx)
-    {
-	SSL_CTX_free(ctx);
-	ctx = NULL;
-    }
+    // the context is shared, so it stays around until we're deleted
+    ctx = NULL;
 }
 
 
@@ -580,6 +596,12 @@ bool WvSSLStream::isok() const
 }
 
 
+bool WvSSLStream::resumed() const
+{
+    return ssl && sslconnected && SSL_session_reused(ssl);
+}
+
+
 void WvSSLStream::noread()
 {
     // WARNING: openssl always needs two-way socket communications even for
@@ -620,7 +642,7 @@ void WvSSLStream::pre_select(SelectInfo &si)
     
     // the SSL library might be keeping its own internal buffers
     // or we might have left buffered data behind deliberately
-    if (si.wants.readable && (read_pending || read_bouncebuf.used()))
+    if ((si.wants.readable || readcb) && read_pending)
     {
 	// debug("pre_select: try reading again immediately.\n");
 	si.msec_timeout = 0;
@@ -629,6 +651,16 @@ void WvSSLStream::pre_select(SelectInfo &si)
 	return;
     }
 
+    // we're holding a record for the slave, so wake up when it can take
+    // some more, whatever our user is waiting for
+    if (pending_record.used() && cloned)
+    {
+	SelectRequest w = si.wants;
+	si.wants = SelectRequest(false, true, false);
+	cloned->pre_select(si);
+	si.wants = w;
+    }
+
     WvStreamClone::pre_select(si);
     si.inherit_request = oldinherit;
     si.wants = oldwant;
@@ -646,6 +678,9 @@ bool WvSSLStream::post_select(SelectInfo &si)
 	si.inherit_request = true; // ignore force_select() until connected
     }
     
+    if (pending_record.used())
+	retry_record();
+
     bool result = WvStreamClone::post_select(si);
     si.wants = oldwant;
     si.inherit_request = oldinherit;
@@ -663,53 +698,40 @@ bool WvSSLStream::post_select(SelectInfo &si)
 	
 	connect_wants.writable = false;
 	
-	// for ssl streams to work, we have to be cloning a stream that
-	// actually uses a single, valid fd.
-        WvFDStream *fdstream = static_cast<WvFDStream*>(cloned);
-        int fd = fdstream->getfd();
-        assert(fd >= 0);
+	pump_in();
         ERR_clear_error();
-	SSL_set_fd(ssl, fd);
-//	debug("SSL connected on fd %s.\n", fd);
-	
-	int err;
-    
-	if (is_server)
-	{
-	    // If we are a server, get ready to accept an incoming SSL
-	    // connection
-	    err = SSL_accept(ssl);
-	}
-	else
-	    err = SSL_connect(ssl);
+	int err = SSL_do_handshake(ssl);
+	pump_out();
 	
-	if (err < 0)
+	if (err <= 0)
 	{
-	    if (errno == EAGAIN)
+	    int sslerrcode = SSL_get_error(ssl, err);
+	    if (sslerrcode == SSL_ERROR_WANT_READ
+		    || sslerrcode == SSL_ERROR_WANT_WRITE)
 		debug("Still waiting for SSL negotiation.\n");
-	    else if (!errno)
-            {
-                printerr(is_server ? "SSL_accept" : "SSL_connect");
-		seterr(WvString("SSL negotiation failed (%s)!", err));
-            }
 	    else
             {
                 printerr(is_server ? "SSL_accept" : "SSL_connect");
-		seterr(errno);
+		seterr(WvString("SSL negotiation failed (%s)!", sslerrcode));
             }
 	}
 	else  // We're connected, so let's do some checks ;)
 	{
-	    debug("SSL connection using cipher %s.\n", SSL_get_cipher(ssl));
+	    debug("SSL connection using cipher %s (%s session).\n",
+		  SSL_get_cipher(ssl),
+		  SSL_session_reused(ssl) ? "resumed" : "new");
 
 	    WvX509 *peercert = new WvX509(SSL_get_peer_certificate(ssl));
 	    //Should we try to validate before storing, or not?
-	    if (peercert->isok() && peercert->validate())
+	    bool peerok = peercert->isok() && peercert->validate();
+	    if (peerok)
 		setattr("peercert", peercert->encode(WvX509::CertPEM));
 	    if (!!vcb)
 	    {
+		// a vcb that calls peercert->validate(cacert) gets its
+		// signature check from WvVerifyCache::shared()
 		debug("SSL Peer is: %s\n", peercert->get_subject());
-	    	if (peercert->isok() && peercert->validate() && vcb(peercert))
+	    	if (peerok && vcb(peercert))
 	    	{
                     setconnected(true);
 	    	    debug("SSL finished negotiating - certificate is valid.\n");
@@ -734,8 +756,7 @@ bool WvSSLStream::post_select(SelectInfo &si)
 	return false;
     }
 
-    if ((si.wants.readable || readcb)
-	&& (read_pending || read_bouncebuf.used()))
+    if ((si.wants.readable || readcb) && read_pending)
 	result = true;
 
     return result;
@@ -745,6 +766,10 @@ bool WvSSLStream::post_select(SelectInfo &si)
 void WvSSLStream::setconnected(bool conn)
 {
     sslconnected = conn;
+
+    // the data might have arrived along with the end of the handshake
+    read_pending = conn && ssl
+	&& (ssl_pending(ssl) || BIO_ctrl_pending(SSL_get_rbio(ssl)));
     if (conn) write(unconnected_buf);
 }
     
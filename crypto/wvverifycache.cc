@@ -0,0 +1,352 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Remembers the results of certificate, CRL and OCSP checks.  See
+ * wvverifycache.h.
+ */
+#include "wvverifycache.h"
+#include "wvworkerpool.h"
+#include "wvbuf.h"
+#include "wvstringlist.h"
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <stdio.h>
+#include <time.h>
+
+// No WvLog member: shared() lives until exit, and a WvLog that's still
+// around keeps the default log receiver (and its fd) open.
+#define LOGNAME "Verify Cache"
+
+
+WvVerifyCache::WvVerifyCache(WvWorkerPool *_pool, int _max_entries)
+    : ttl(3600), negative_ttl(60), hits(0), misses(0),
+      pool(_pool), max_entries(_max_entries), entries(64), pending(16)
+{
+    if (pool)
+	wvssl_threads_init();
+}
+
+
+WvVerifyCache &WvVerifyCache::shared()
+{
+    static WvVerifyCache cache;
+    return cache;
+}
+
+
+WvVerifyCache::~WvVerifyCache()
+{
+    // checks still on the pool clean up after themselves, when the pool
+    // is done with them
+    PendingDict::Iter i(pending);
+    for (i.rewind(); i.next(); )
+	i->cache = NULL;
+    pending.zap();
+    entries.zap();
+}
+
+
+void WvVerifyCache::zap()
+{
+    entries.zap();
+}
+
+
+bool WvVerifyCache::lookup(WvStringParm key, int &result)
+{
+    Entry *e = entries[key];
+    if (e && e->expires > time(NULL))
+    {
+	hits++;
+	result = e->result;
+	return true;
+    }
+    if (e)
+	entries.remove(e);
+    misses++;
+    return false;
+}
+
+
+void WvVerifyCache::store(WvStringParm key, int result, time_t expires)
+{
+    if (expires <= time(NULL))
+	return;
+
+    Entry *e = entries[key];
+    if (e)
+    {
+	e->result = result;
+	e->expires = expires;
+	return;
+    }
+
+    if ((int)entries.count() >= max_entries)
+    {
+	// throw out whatever has expired; if that's not enough, start over
+	time_t now = time(NULL);
+	WvStringList expired;
+	EntryDict::Iter i(entries);
+	for (i.rewind(); i.next(); )
+	    if (i->expires <= now)
+		expired.append(i->key);
+	WvStringList::Iter j(expired);
+	for (j.rewind(); j.next(); )
+	    entries.remove(entries[*j]);
+	if ((int)entries.count() >= max_entries)
+	{
+	    WvLog debug(LOGNAME, WvLog::Debug5);
+	    debug("Cache full; forgetting %s answers.\n", entries.count());
+	    entries.zap();
+	}
+    }
+
+    entries.add(new Entry(key, result, expires), true);
+}
+
+
+// Nothing that might run on a worker thread may touch WvLog (or anything
+// else that isn't thread-safe), so this is plain OpenSSL.
+bool WvVerifyCache::check_sig(X509 *cert, X509 *cacert)
+{
+    if (!cert || !cacert)
+	return false;
+
+    EVP_PKEY *pkey = X509_get_pubkey(cacert);
+    if (!pkey)
+	return false;
+    int result = X509_verify(cert, pkey);
+    EVP_PKEY_free(pkey);
+
+    return result > 0 && X509_check_issued(cacert, cert) == X509_V_OK;
+}
+
+
+time_t WvVerifyCache::sig_expiry(const WvX509 &cert, const WvX509 &cacert,
+				 bool result) const
+{
+    time_t expires = time(NULL) + (result ? ttl : negative_ttl);
+    if (!result)
+	return expires;
+
+    // once either of them expires, validate() fails anyway
+    time_t t1 = wvssl_asn1_time(X509_get_notAfter(cert.cert));
+    time_t t2 = wvssl_asn1_time(X509_get_notAfter(cacert.cert));
+    if (t1 && t1 < expires)
+	expires = t1;
+    if (t2 && t2 < expires)
+	expires = t2;
+    return expires;
+}
+
+
+static bool dates_ok(X509 *cert)
+{
+    return X509_cmp_current_time(X509_get_notAfter(cert)) >= 0
+	&& X509_cmp_current_time(X509_get_notBefore(cert)) <= 0;
+}
+
+
+bool WvVerifyCache::validate(const WvX509 &cert, const WvX509 *cacert)
+{
+    if (!cert.cert)
+	return false;
+
+    bool datesok = dates_ok(cert.cert);
+    if (!cacert)
+	return datesok;
+
+    return signedbyca(cert, *cacert) && datesok;
+}
+
+
+bool WvVerifyCache::signedbyca(const WvX509 &cert, const WvX509 &cacert)
+{
+    if (!cert.cert || !cacert.cert)
+	return false;
+
+    WvString key("sig %s %s", cert.get_fingerprint(),
+		 cacert.get_fingerprint());
+    int result;
+    if (!lookup(key, result))
+    {
+	result = check_sig(cert.cert, cacert.cert);
+	WvLog debug(LOGNAME, WvLog::Debug5);
+	debug("Certificate %s %s signed by CA %s.\n", cert.get_subject(),
+	      result ? "was" : "was NOT", cacert.get_subject());
+	store(key, result, sig_expiry(cert, cacert, result));
+    }
+
+    return result;
+}
+
+
+void WvVerifyCache::validate(const WvX509 &cert, const WvX509 &cacert,
+			     const Callback &cb)
+{
+    if (!pool || !cert.cert || !cacert.cert)
+    {
+	cb(validate(cert, &cacert));
+	return;
+    }
+
+    bool datesok = dates_ok(cert.cert);
+    WvString key("sig %s %s", cert.get_fingerprint(),
+		 cacert.get_fingerprint());
+    int result;
+    if (lookup(key, result))
+    {
+	cb(datesok && result);
+	return;
+    }
+
+    if (!datesok)
+    {
+	// no point checking the signature of an expired certificate
+	cb(false);
+	return;
+    }
+
+    Pending *p = pending[key];
+    if (!p)
+    {
+	PendingPtr job(new Pending(key));
+	p = job.get();
+	p->cache = this;
+	p->cert = X509_dup(cert.cert);
+	p->cacert = X509_dup(cacert.cert);
+	p->expires = sig_expiry(cert, cacert, true);
+	pending.add(p, false);
+	pool->add(wv::bind(&WvVerifyCache::run_pending, job),
+		  wv::bind(&WvVerifyCache::pending_done, job));
+    }
+    else
+	misses--; // it's not a new check, just a new waiter
+    p->waiters.append(new Waiter(cb), true);
+}
+
+
+WvVerifyCache::Pending::~Pending()
+{
+    if (cert)
+	X509_free(cert);
+    if (cacert)
+	X509_free(cacert);
+    if (cache)
+	cache->pending.remove(this);
+}
+
+
+void WvVerifyCache::run_pending(PendingPtr p)
+{
+    p->result = check_sig(p->cert, p->cacert);
+}
+
+
+void WvVerifyCache::pending_done(PendingPtr p)
+{
+    WvVerifyCache *cache = p->cache;
+    if (cache)
+    {
+	cache->pending.remove(p.get());
+	p->cache = NULL;
+	cache->store(p->key, p->result, p->result ? p->expires
+		     : time(NULL) + cache->negative_ttl);
+
+	WaiterList::Iter i(p->waiters);
+	for (i.rewind(); i.next(); )
+	    i->cb(p->result);
+    }
+}
+
+
+WvString WvVerifyCache::crl_fingerprint(const WvCRL &crl)
+{
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int n;
+    if (!crl.crl || !X509_CRL_digest(crl.crl, EVP_sha1(), md, &n))
+	return WvString::null;
+
+    // WvString's formatting doesn't do %X
+    WvDynBuf store;
+    char buf[3];
+    for (unsigned int i = 0; i < n; i++)
+    {
+	sprintf(buf, "%02X", md[i]);
+	store.putstr(buf);
+    }
+    return store.getstr();
+}
+
+
+WvCRL::Valid WvVerifyCache::validate(const WvCRL &crl, const WvX509 &cacert)
+{
+    WvString fp = crl_fingerprint(crl);
+    if (!fp || !cacert.cert)
+	return crl.validate(cacert);
+
+    WvString key("crl %s %s", fp, cacert.get_fingerprint());
+    int result;
+    if (lookup(key, result))
+    {
+	// the nextUpdate check is cheap, and the clock may have moved
+	if (result == WvCRL::VALID && crl.expired())
+	    return WvCRL::EXPIRED;
+	return (WvCRL::Valid)result;
+    }
+
+    WvCRL::Valid valid = crl.validate(cacert);
+    time_t expires = time(NULL) + negative_ttl;
+    if (valid == WvCRL::VALID)
+    {
+	time_t next = crl.get_next_update();
+	expires = next ? next : time(NULL) + ttl;
+    }
+    store(key, valid, expires);
+    return valid;
+}
+
+
+WvOCSPResp::Status WvVerifyCache::check_ocsp(const WvOCSPResp &resp,
+					     const WvX509 &signer,
+					     const WvX509 &cert,
+					     const WvX509 &issuer)
+{
+    if (!resp.signedbycert(signer))
+    {
+	WvLog debug(LOGNAME, WvLog::Debug5);
+	debug("OCSP response for %s not signed by %s.\n",
+	      cert.get_subject(), signer.get_subject());
+	return WvOCSPResp::Error;
+    }
+
+    time_t next = 0;
+    WvOCSPResp::Status status = resp.get_status(cert, issuer, &next);
+    if (status == WvOCSPResp::Good || status == WvOCSPResp::Revoked)
+    {
+	// an answer without a nextUpdate is only good right now, says
+	// RFC 2560, but that's a bit much; treat it like anything else.
+	WvString key("ocsp %s %s", cert.get_fingerprint(),
+		     issuer.get_fingerprint());
+	store(key, status, next ? next : time(NULL) + ttl);
+    }
+    return status;
+}
+
+
+bool WvVerifyCache::cached_ocsp(const WvX509 &cert, const WvX509 &issuer,
+				WvOCSPResp::Status &status)
+{
+    if (!cert.cert || !issuer.cert)
+	return false;
+
+    WvString key("ocsp %s %s", cert.get_fingerprint(),
+		 issuer.get_fingerprint());
+    int result;
+    if (!lookup(key, result))
+	return false;
+    status = (WvOCSPResp::Status)result;
+    return true;
+}
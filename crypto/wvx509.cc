@@ -6,6 +6,7 @@
  */ 
 #include "wvx509.h"
 #include "wvcrl.h"
+#include "wvverifycache.h"
 #include "wvsslhacks.h"
 #include "wvcrypto.h"
 #include "wvstringlist.h"
@@ -19,6 +20,9 @@
 #include <openssl/err.h>
 #include <openssl/sha.h>
 #include <openssl/ssl.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 // enable this to add some extra debugging trace messages (this can be VERY
 // verbose)
@@ -112,6 +116,41 @@ void wvssl_free()
 }
 
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L && !defined(_WIN32)
+static pthread_mutex_t *ssl_locks = NULL;
+
+static void ssl_locking_cb(int mode, int n, const char *file, int line)
+{
+    if (mode & CRYPTO_LOCK)
+	pthread_mutex_lock(&ssl_locks[n]);
+    else
+	pthread_mutex_unlock(&ssl_locks[n]);
+}
+
+
+static unsigned long ssl_id_cb()
+{
+    return (unsigned long)pthread_self();
+}
+#endif
+
+
+void wvssl_threads_init()
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L && !defined(_WIN32)
+    if (ssl_locks || CRYPTO_get_locking_callback())
+	return;
+
+    int n = CRYPTO_num_locks();
+    ssl_locks = new pthread_mutex_t[n];
+    for (int i = 0; i < n; i++)
+	pthread_mutex_init(&ssl_locks[i], NULL);
+    CRYPTO_set_id_callback(ssl_id_cb);
+    CRYPTO_set_locking_callback(ssl_locking_cb);
+#endif
+}
+
+
 WvString wvssl_errstr()
 {
     char buf[256];
@@ -381,11 +420,10 @@ bool WvX509::validate(WvX509 *cacert) const
         retval = false;
     }
 
+    // the signature check is the expensive part, and we tend to see the
+    // same certificates over and over
     if (cacert)
-    {
-        retval &= signedbyca(*cacert);
-        retval &= issuedbyca(*cacert);
-    }
+        retval &= WvVerifyCache::shared().signedbyca(*this, *cacert);
     
     return retval;
 }
@@ -1508,39 +1546,61 @@ bool WvX509::verify(WvBuf &original, WvStringParm signature) const
 }
 
 
-static time_t ASN1_TIME_to_time_t(ASN1_TIME *t)
+// parse 'len' decimal digits
+static int asn1_digits(const unsigned char *p, int len)
 {
-    struct tm newtime;
-    char *p = NULL;
-    char d[18];
-    memset(&d,'\0',sizeof(d));    
-    memset(&newtime,'\0',sizeof newtime);
-    
-    if (t->type == V_ASN1_GENERALIZEDTIME) 
+    int val = 0;
+    for (int i = 0; i < len; i++)
     {
-         // For time values >= 2050, OpenSSL uses
-         // ASN1_GENERALIZEDTIME - which we'll worry about
-         // later.
-	return 0;
+        if (p[i] < '0' || p[i] > '9')
+            return -1;
+        val = val * 10 + p[i] - '0';
     }
+    return val;
+}
 
-    p = (char *)t->data;
-    sscanf(p,"%2s%2s%2s%2s%2s%2sZ", d, &d[3], &d[6], &d[9], &d[12], &d[15]);
-    
-    int year = strtol(d, (char **)NULL, 10);
-    if (year < 49)
-	year += 100;
+
+time_t wvssl_asn1_time(const ASN1_TIME *t)
+{
+    if (!t || !t->data)
+        return 0;
+
+    // UTCTime is YYMMDDHHMMSSZ, GeneralizedTime is YYYYMMDDHHMMSSZ.  We
+    // don't bother with fractional seconds or timezone offsets, which
+    // RFC 5280 doesn't allow anyway.
+    const unsigned char *p = t->data;
+    int year;
+    if (t->type == V_ASN1_GENERALIZEDTIME)
+    {
+        if (t->length < 15)
+            return 0;
+        year = asn1_digits(p, 4);
+        p += 4;
+    }
     else
-	year += 50;
-    
-    newtime.tm_year = year;
-    newtime.tm_mon = strtol(&d[3], (char **)NULL, 10) - 1;
-    newtime.tm_mday = strtol(&d[6], (char **)NULL, 10);
-    newtime.tm_hour = strtol(&d[9], (char **)NULL, 10);
-    newtime.tm_min = strtol(&d[12], (char **)NULL, 10);
-    newtime.tm_sec = strtol(&d[15], (char **)NULL, 10);
+    {
+        if (t->length < 13)
+            return 0;
+        year = asn1_digits(p, 2);
+        year += (year < 50) ? 2000 : 1900;
+        p += 2;
+    }
+    int mon = asn1_digits(p, 2), mday = asn1_digits(p + 2, 2),
+        hour = asn1_digits(p + 4, 2), min = asn1_digits(p + 6, 2),
+        sec = asn1_digits(p + 8, 2);
+    if (year < 1970 || mon < 1 || mon > 12 || mday < 1 || hour < 0
+            || min < 0 || sec < 0)
+        return 0;
+
+    // days since 1970-01-01, counting years from March so that the leap
+    // day comes last.
+    int y = year - (mon <= 2);
+    int era = y / 400, yoe = y - era * 400;
+    int doy = (153 * (mon + (mon > 2 ? -3 : 9)) + 2) / 5 + mday - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = era * 146097L + doe - 719468L;
 
-    return mktime(&newtime);
+    return (time_t)days * 86400 + hour * 3600 + min * 60 + sec;
 }
 
 
@@ -1548,7 +1608,7 @@ time_t WvX509::get_notvalid_before() const
 {
     CHECK_CERT_EXISTS_GET("not valid before", 0);
 
-    return ASN1_TIME_to_time_t(X509_get_notBefore(cert));
+    return wvssl_asn1_time(X509_get_notBefore(cert));
 }
 
 
@@ -1556,7 +1616,7 @@ time_t WvX509::get_notvalid_after() const
 {
     CHECK_CERT_EXISTS_GET("not valid after", 0);
 
-    return ASN1_TIME_to_time_t(X509_get_notAfter(cert));
+    return wvssl_asn1_time(X509_get_notAfter(cert));
 }
 
 
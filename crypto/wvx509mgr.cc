@@ -2,6 +2,9 @@
 #include "wvsslhacks.h"
 #include "wvx509mgr.h"
 #include "wvautoconf.h"
+#ifndef _WIN32
+#include "wvworkerpool.h"
+#endif
 
 #include <openssl/pem.h>
 #include <openssl/x509v3.h>
@@ -341,13 +344,13 @@ WvString WvX509Mgr::signreq(WvStringParm pkcs10req) const
 }
 
 
-bool WvX509Mgr::signcert(WvX509 &unsignedcert) const
+EVP_PKEY *WvX509Mgr::signing_key(const WvX509 &unsignedcert) const
 {
     if (!isok())
     {
         debug(WvLog::Warning, "Asked to sign certificate, but not ok! "
               "Aborting.\n");
-        return false;
+        return NULL;
     }
 
     if (cert == unsignedcert.cert)
@@ -359,35 +362,91 @@ bool WvX509Mgr::signcert(WvX509 &unsignedcert) const
     {
         debug("This certificate is not a CA, and is thus not allowed to sign "
               "certificates!\n");
-        return false;
+        return NULL;
     }
 #endif
     else if (!((cert->ex_flags & EXFLAG_KUSAGE) && 
                (cert->ex_kusage & KU_KEY_CERT_SIGN)))
     {
 	debug("This Certificate is not allowed to sign certificates!\n");
-	return false;
+	return NULL;
     }
     
-    debug("Ok, now sign the new cert with the current RSA key.\n");
     EVP_PKEY *certkey = EVP_PKEY_new();
-    bool cakeyok = EVP_PKEY_set1_RSA(certkey, rsa->rsa);
-    if (cakeyok)
-    {	
-	X509_sign(unsignedcert.get_cert(), certkey, EVP_sha1());
-    }
-    else
+    if (!EVP_PKEY_set1_RSA(certkey, rsa->rsa))
     {
 	debug("No keys??\n");
 	EVP_PKEY_free(certkey);
-	return false;
+	return NULL;
     }
-    
+    return certkey;
+}
+
+
+bool WvX509Mgr::signcert(WvX509 &unsignedcert) const
+{
+    EVP_PKEY *certkey = signing_key(unsignedcert);
+    if (!certkey)
+	return false;
+
+    debug("Ok, now sign the new cert with the current RSA key.\n");
+    X509_sign(unsignedcert.get_cert(), certkey, EVP_sha1());
     EVP_PKEY_free(certkey);
     return true;
 }
 
 
+#ifndef _WIN32
+// The jobs that run on a WvWorkerPool only touch OpenSSL: WvLog and
+// friends aren't thread-safe.  The pool's job owns the SignJob, so the
+// key is freed even if the pool is destroyed before 'done' runs.
+struct SignJob
+{
+    EVP_PKEY *key;
+    X509 *cert; // not ours: the caller keeps it until 'done'
+    WvDynBuf data, sig;
+    bool ok;
+    WvX509SignedCallback signedcb;
+    WvX509SignatureCallback sigcb;
+
+    SignJob(EVP_PKEY *_key, X509 *_cert)
+	: key(_key), cert(_cert), ok(false) {}
+    ~SignJob()
+	{ EVP_PKEY_free(key); }
+};
+typedef wv::shared_ptr<SignJob> SignJobPtr;
+
+
+static void signcert_run(SignJobPtr j)
+{
+    j->ok = X509_sign(j->cert, j->key, EVP_sha1()) > 0;
+}
+
+
+static void signcert_done(SignJobPtr j)
+{
+    j->signedcb(j->ok);
+}
+
+
+void WvX509Mgr::signcert(WvX509 &unsignedcert, WvWorkerPool &pool,
+			 const WvX509SignedCallback &cb) const
+{
+    EVP_PKEY *certkey = signing_key(unsignedcert);
+    if (!certkey)
+    {
+	cb(false);
+	return;
+    }
+
+    wvssl_threads_init();
+    SignJobPtr j(new SignJob(certkey, unsignedcert.get_cert()));
+    j->signedcb = cb;
+    pool.add(wv::bind(signcert_run, j), wv::bind(signcert_done, j));
+}
+#endif // !_WIN32
+
+
 bool WvX509Mgr::signcrl(WvCRL &crl) const
 {
     if (!isok() || !crl.isok())
@@ -450,13 +509,30 @@ WvString WvX509Mgr::sign(WvStringParm data) const
 }
 
 
+// SHA-1 sign 'len' bytes at 'data' with 'pk', and put the signature in
+// 'sig'.  Safe to call from any thread.
+static bool sign_data(EVP_PKEY *pk, const void *data, size_t len, WvBuf &sig)
+{
+    unsigned char sig_buf[4096];
+    unsigned int sig_len = sizeof(sig_buf);
+
+    EVP_MD_CTX *sig_ctx = EVP_MD_CTX_create();
+    EVP_SignInit(sig_ctx, EVP_sha1());
+    EVP_SignUpdate(sig_ctx, data, len);
+    int sig_err = EVP_SignFinal(sig_ctx, sig_buf, &sig_len, pk);
+    EVP_MD_CTX_destroy(sig_ctx);
+    if (sig_err != 1)
+	return false;
+
+    sig.put(sig_buf, sig_len);
+    return true;
+}
+
+
 WvString WvX509Mgr::sign(WvBuf &data) const
 {
     assert(rsa);
 
-    EVP_MD_CTX sig_ctx;
-    unsigned char sig_buf[4096];
-    
     EVP_PKEY *pk = EVP_PKEY_new();
     assert(pk); // OOM 
     
@@ -467,27 +543,62 @@ WvString WvX509Mgr::sign(WvBuf &data) const
 	return WvString::null;
     }
     
-    EVP_SignInit(&sig_ctx, EVP_sha1());
-    EVP_SignUpdate(&sig_ctx, data.peek(0, data.used()), data.used());
-    unsigned int sig_len = sizeof(sig_buf);
-    int sig_err = EVP_SignFinal(&sig_ctx, sig_buf, 
-				&sig_len, pk);
-    if (sig_err != 1)
+    WvDynBuf buf;
+    bool ok = sign_data(pk, data.peek(0, data.used()), data.used(), buf);
+    EVP_PKEY_free(pk);
+    if (!ok)
     {
 	debug("Error while signing.\n");
-	EVP_PKEY_free(pk);
 	return WvString::null;
     }
 
-    EVP_PKEY_free(pk);
-    EVP_MD_CTX_cleanup(&sig_ctx); // this isn't my fault ://
-    WvDynBuf buf;
-    buf.put(sig_buf, sig_len);
     debug("Signature size: %s\n", buf.used());
     return WvBase64Encoder().strflushbuf(buf, true);
 }
 
 
+#ifndef _WIN32
+static void sign_run(SignJobPtr j)
+{
+    j->ok = sign_data(j->key, j->data.peek(0, j->data.used()),
+		      j->data.used(), j->sig);
+}
+
+
+static void sign_done(SignJobPtr j)
+{
+    if (j->ok)
+	j->sigcb(WvBase64Encoder().strflushbuf(j->sig, true));
+    else
+	j->sigcb(WvString::null);
+}
+
+
+void WvX509Mgr::sign(WvBuf &data, WvWorkerPool &pool,
+		     const WvX509SignatureCallback &cb) const
+{
+    assert(rsa);
+
+    EVP_PKEY *pk = EVP_PKEY_new();
+    assert(pk); // OOM 
+
+    if (!EVP_PKEY_set1_RSA(pk, rsa->rsa))
+    {
+	debug("Error setting RSA keys.\n");
+	EVP_PKEY_free(pk);
+	cb(WvString::null);
+	return;
+    }
+
+    wvssl_threads_init();
+    SignJobPtr j(new SignJob(pk, NULL));
+    j->data.put(data.peek(0, data.used()), data.used());
+    j->sigcb = cb;
+    pool.add(wv::bind(sign_run, j), wv::bind(sign_done, j));
+}
+#endif // !_WIN32
+
+
 bool WvX509Mgr::write_p12(WvStringParm _fname, WvStringParm _pkcs12pass) const
 {
     debug("Dumping RSA Key and X509 Cert to PKCS12 structure.\n");
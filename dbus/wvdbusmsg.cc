@@ -11,10 +11,21 @@
 #include "wvdbusmsg.h"
 #include "wvdbusconn.h"
 #include "wvstrutils.h"
+#include "wvstringcache.h"
 #undef interface // windows
 #include <dbus/dbus.h>
 
 
+// The same few bus, object, interface and method names turn up in message
+// after message, so share them.  This is never deleted, since messages
+// might still be around at exit.
+static WvStringCache &header_cache()
+{
+    static WvStringCache *cache = new WvStringCache;
+    return *cache;
+}
+
+
 class WvDBusReplyMsg : public WvDBusMsg
 {
 public:
@@ -358,38 +369,38 @@ WvDBusMsg::operator DBusMessage* () const
 
 WvString WvDBusMsg::get_sender() const
 {
-    return dbus_message_get_sender(msg);
+    return header_cache().get(dbus_message_get_sender(msg));
 }
 
 
 WvString WvDBusMsg::get_dest() const
 {
-    return dbus_message_get_destination(msg);
+    return header_cache().get(dbus_message_get_destination(msg));
 }
 
 
 WvString WvDBusMsg::get_path() const
 {
-    return dbus_message_get_path(msg);
+    return header_cache().get(dbus_message_get_path(msg));
 }
 
 
 WvString WvDBusMsg::get_interface() const
 {
-    return dbus_message_get_interface(msg);
+    return header_cache().get(dbus_message_get_interface(msg));
 }
 
 
 WvString WvDBusMsg::get_member() const
 {
-    return dbus_message_get_member(msg);
+    return header_cache().get(dbus_message_get_member(msg));
 }
 
 
 WvString WvDBusMsg::get_error() const
 {
     if (iserror())
-	return dbus_message_get_error_name(msg);
+	return header_cache().get(dbus_message_get_error_name(msg));
 
     return WvString::null;
 }
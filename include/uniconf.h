@@ -192,8 +192,8 @@ public:
     /**
      * Stores a string value for this key into the registry.
      */
-    void setme(WVSTRING_FORMAT_DECL) const
-        { return setme(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE void setme(WVSTRING_FORMAT_TDECL) const
+        { return setme(WvString(WVSTRING_FORMAT_TCALL)); }
 
     /** A different way to say cfg[x].setme(y). */
     void xset(WvStringParm key, WvStringParm value) const
@@ -52,6 +52,22 @@ class UniConfKey
             WvString(segment)
         {
         }
+#if __cplusplus >= 201103L
+        Segment(Segment &&segment) :
+            WvString(std::move(segment))
+        {
+        }
+        Segment &operator= (const Segment &segment)
+        {
+            WvString::operator=(segment);
+            return *this;
+        }
+        Segment &operator= (Segment &&segment)
+        {
+            WvString::operator=(std::move(segment));
+            return *this;
+        }
+#endif
         
         bool iswild() const
         {
@@ -97,7 +113,11 @@ class UniConfKey
                 if (limit > _used)
                     limit = _used;
                 for (int i=0; i<limit; ++i)
+#if __cplusplus >= 201103L
+                    vec[i+shift] = std::move(old_vec[i]);
+#else
                     vec[i+shift] = old_vec[i];
+#endif
                 deletev old_vec;
             }
             _size = size;
@@ -122,7 +142,7 @@ class UniConfKey
         }
         void append(WvStringParm string)
         {
-            append(Segment(string));
+            vec[_used++] = Segment(string);
         }
         void replace(int index, const Segment &segment)
         {
@@ -132,7 +152,9 @@ class UniConfKey
         }
         void replace(int index, WvStringParm string)
         {
-            replace(index, Segment(string));
+            vec[index] = Segment(string);
+            if (index >= _used)
+                _used = index + 1;
         }
         const Segment &operator [](int index) const
         {
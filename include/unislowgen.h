@@ -49,8 +49,8 @@ private:
     int slowcount;
     
     void be_slow(WvStringParm what);
-    void be_slow(WVSTRING_FORMAT_DECL)
-        { be_slow(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE void be_slow(WVSTRING_FORMAT_TDECL)
+        { be_slow(WvString(WVSTRING_FORMAT_TCALL)); }
 };
 
 #endif //__UNISLOWGEN_H
@@ -31,8 +31,8 @@ public:
      * "str" is the string
      */
     void putstr(WvStringParm str);
-    void putstr(WVSTRING_FORMAT_DECL)
-        { putstr(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE void putstr(WVSTRING_FORMAT_TDECL)
+        { putstr(WvString(WVSTRING_FORMAT_TCALL)); }
 
     /**
      * Returns the entire buffer as a null-terminated WvString.
@@ -41,6 +41,14 @@ public:
     
     virtual size_t uread(void *buf, size_t size);
     virtual size_t uwrite(const void *buf, size_t size);
+
+    /**
+     * Moves 'count' bytes from 'inbuf' into our input buffer.  For a
+     * WvDynBuf, whole chunks of it are handed over instead of copied.
+     */
+    virtual size_t write(WvBuf &inbuf, size_t count = INT_MAX);
+    using WvStream::write;
+
     virtual bool isok() const;
     virtual void pre_select(SelectInfo &si);
     virtual bool post_select(SelectInfo &si);
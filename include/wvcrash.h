@@ -45,6 +45,22 @@ void wvcrash_ring_buffer_put(const char *str);
 void wvcrash_ring_buffer_put(const char *str, size_t len);
 const char *wvcrash_ring_buffer_get();
 
+// Functions to be called from the crash handler, before anything else
+// happens, to get buffered data (eg. queued log lines) out to disk.  They
+// run inside a signal handler, so they must stick to async-signal-safe calls.
+typedef void WvCrashFlushFunc(void *userdata);
+void wvcrash_add_flush(WvCrashFlushFunc *func, void *userdata);
+void wvcrash_del_flush(WvCrashFlushFunc *func, void *userdata);
+void wvcrash_run_flush();
+
+// Functions to be called from the crash handler to add extra information
+// (eg. recent log messages) to the crash report, by writing it to 'fd'.
+// The same async-signal-safety rules apply.
+typedef void WvCrashDumpFunc(int fd, void *userdata);
+void wvcrash_add_dump(WvCrashDumpFunc *func, void *userdata);
+void wvcrash_del_dump(WvCrashDumpFunc *func, void *userdata);
+void wvcrash_run_dump(int fd);
+
 #if defined(_WIN32)
 extern void setup_console_crash();
 #endif
@@ -9,7 +9,9 @@
 
 #include "wverror.h"
 #include "wvlog.h"
+#include "wvtr1.h"
 #include "wvx509.h"
+#include <sys/types.h>
 
 // Structures to make the compiler happy so we don't have to include x509v3.h ;)
 struct X509_crl_st;
@@ -20,6 +22,8 @@ struct asn1_string_st;
 typedef struct asn1_string_st ASN1_INTEGER;
 
 class WvX509Mgr;
+class WvWorkerPool;
+class WvCRLIndex;
 
 /**
  * CRL Class to handle certificate revocation lists and their related
@@ -74,6 +78,12 @@ public:
      */
     bool expired() const;
 
+    /**
+     * Returns the time of the nextUpdate field, ie. when a newer CRL should
+     * be available; 0 if there isn't one.
+     */
+    time_t get_next_update() const;
+
     /*
      * Checks to see if the CRL has any critical extensions in it.
      * - returns true if the CRL has any critical extensions.
@@ -129,10 +139,41 @@ public:
 
     /**
      * Is the certificate in cert revoked?
+     *
+     * The first call builds a hash table of the revoked serial numbers,
+     * so every check after that takes the same time no matter how big
+     * the CRL is.  It never reloads the CRL; see refresh().
      */
     bool isrevoked(const WvX509 &cert) const;
     bool isrevoked(WvStringParm serial_number) const;
 
+    /**
+     * Load the CRL from 'filename', which can be in PEM or DER format.
+     * The file is mmap()ed and decoded in place rather than read through
+     * stdio.  decode() with CRLFilePEM or CRLFileDER does the same thing.
+     * - returns isok().
+     */
+    bool load(WvStringParm filename);
+
+    /**
+     * If the CRL came from a file and the file has changed since, load it
+     * again.  If 'pool' is given, the new file is parsed (and its index
+     * built) on one of the pool's threads, and swapped in from the pool's
+     * callback; meanwhile, the old CRL stays in use.  A file that can't
+     * be decoded doesn't replace the current CRL.
+     * - returns true if the file had changed.
+     */
+    bool refresh(WvWorkerPool *pool = NULL);
+
+    /**
+     * refresh(pool), unless the file was last checked (by load(),
+     * refresh() or this) less than 'secs' seconds ago.  A long-running
+     * server can call this before each batch of isrevoked() checks to
+     * pick up a new CRL without stat()ing the file every time.
+     * - returns true if the file had changed.
+     */
+    bool refresh_every(int secs, WvWorkerPool *pool = NULL);
+
     /**
      * Add the certificate specified by cert to the CRL.
      */
@@ -146,8 +187,29 @@ public:
     int numcerts() const;
     
 private:    
+    friend class WvVerifyCache;
     mutable WvLog debug;
     X509_CRL *crl;
+
+    // the revoked serial numbers, built by the first isrevoked()
+    mutable WvCRLIndex *index;
+
+    // where load() got the CRL, so refresh() can tell if it changed
+    WvString filename;
+    time_t file_mtime;
+    off_t file_size;
+    ino_t file_ino;
+
+    struct Reload;
+    typedef wv::shared_ptr<Reload> ReloadPtr;
+    Reload *reloading;
+    time_t last_refresh;
+
+    void replace(X509_CRL *newcrl, WvCRLIndex *newindex);
+    void forget_index() const;
+    bool revoked_serial(ASN1_INTEGER *serial) const;
+    static void reload_run(ReloadPtr r);
+    static void reload_done(ReloadPtr r);
 };
 
 #endif // __WVCRL_H
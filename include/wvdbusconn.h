@@ -106,8 +106,8 @@ public:
     wvuid_t get_uid() { return auth ? auth->get_uid() : WVUID_INVALID; }
     
     void out(WvStringParm s);
-    void out(WVSTRING_FORMAT_DECL)
-        { return out(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE void out(WVSTRING_FORMAT_TDECL)
+        { return out(WvString(WVSTRING_FORMAT_TCALL)); }
     const char *in();
 
     /**
@@ -309,10 +309,11 @@ public:
 	setup2();
     }
     
+    WVSTRING_FORMAT_TEMPLATE
     WvDBusError(WvDBusMsg &in_reply_to,
-		WvStringParm errname, WVSTRING_FORMAT_DECL)
+		WvStringParm errname, WVSTRING_FORMAT_TDECL)
 	: WvDBusMsg(setup1(in_reply_to, errname,
-			   WvString(WVSTRING_FORMAT_CALL)))
+			   WvString(WVSTRING_FORMAT_TCALL)))
     {
 	setup2();
     }
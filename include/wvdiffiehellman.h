@@ -13,6 +13,11 @@
 #include "wvstream.h"
 #include "wvlog.h"
 
+class WvWorkerPool;
+
+/** Gets the shared secret from an asynchronous create_secret(). */
+typedef wv::function<void(WvBuf &)> WvDHSecretCallback;
+
 class WvDiffieHellman
 {
 public:
@@ -26,6 +31,16 @@ public:
     int pub_key_len();
     bool create_secret(WvBuf &inbuf, size_t in_len, WvBuf& outbuf);
 
+    /**
+     * Same as create_secret(inbuf, in_len, outbuf), except that the work
+     * happens on one of the threads of 'pool', and the secret goes to
+     * 'cb' from the pool's callback (empty, if it failed).  The in_len
+     * bytes are taken from inbuf right away, but this object has to stay
+     * around until 'cb' is called.
+     */
+    void create_secret(WvBuf &inbuf, size_t in_len, WvWorkerPool &pool,
+		       const WvDHSecretCallback &cb);
+
 protected:
     struct dh_st *info;
     BN_ULONG generator;
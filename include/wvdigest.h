@@ -35,6 +35,19 @@ class WvDigest : public WvEncoder
 public:
     /** Returns the number of bytes in the message digest. */
     virtual size_t digestsize() const = 0;
+
+    /**
+     * Computes the digests of 'count' unrelated messages in one go: the
+     * i'th message is the lens[i] bytes at data[i], and its digest goes
+     * to out + i*digestsize().  The answers are the same as from calling
+     * reset(), encode() and finish() for each message, without the
+     * per-message buffer and setup overhead.
+     *
+     * Anything the encoder was in the middle of is thrown away, and it's
+     * left reset() afterwards.
+     */
+    virtual void digest_many(const void *const *data, const size_t *lens,
+			     size_t count, unsigned char *out);
 };
 
 
@@ -59,7 +72,12 @@ protected:
         bool flush); // consumes input
     virtual bool _finish(WvBuf &outbuf); // outputs digest
     virtual bool _reset(); // supported: resets digest value
-    
+
+public:
+    virtual void digest_many(const void *const *data, const size_t *lens,
+			     size_t count, unsigned char *out);
+
+protected:
     const env_md_st *getevpmd()
         { return evpmd; }
 
@@ -120,6 +138,8 @@ public:
 		 size_t _keysize);
     virtual ~WvHMACDigest();
     virtual size_t digestsize() const;
+    virtual void digest_many(const void *const *data, const size_t *lens,
+			     size_t count, unsigned char *out);
 
 protected:
     virtual bool _encode(WvBuf &inbuf, WvBuf &outbuf,
@@ -135,6 +155,8 @@ private:
 /**
  * CRC32 checksum
  * Digest length of 4 bytes.
+ *
+ * Uses the PCLMULQDQ instruction on x86 CPUs that have it.
  */
 class WvCrc32Digest : public WvDigest
 {
@@ -144,7 +166,12 @@ public:
     WvCrc32Digest();
     virtual ~WvCrc32Digest() { }
 
+    /** Same as zlib's crc32(), but faster where the CPU allows. */
+    static uint32_t crc32(uint32_t crc, const void *buf, size_t len);
+
     virtual size_t digestsize() const;
+    virtual void digest_many(const void *const *data, const size_t *lens,
+			     size_t count, unsigned char *out);
     virtual bool _encode(WvBuf &inbuf, WvBuf &outbuf,
                          bool flush); // consumes input
     virtual bool _finish(WvBuf &outbuf); // outputs digest
@@ -155,6 +182,8 @@ public:
 /**
  * Adler32 checksum
  * Digest length of 4 bytes.
+ *
+ * Uses SSSE3 on x86 CPUs that have it.
  */
 class WvAdler32Digest : public WvDigest
 {
@@ -164,7 +193,12 @@ public:
     WvAdler32Digest();
     virtual ~WvAdler32Digest() { }
 
+    /** Same as zlib's adler32(), but faster where the CPU allows. */
+    static uint32_t adler32(uint32_t adler, const void *buf, size_t len);
+
     virtual size_t digestsize() const;
+    virtual void digest_many(const void *const *data, const size_t *lens,
+			     size_t count, unsigned char *out);
     virtual bool _encode(WvBuf &inbuf, WvBuf &outbuf,
                          bool flush); // consumes input
     virtual bool _finish(WvBuf &outbuf); // outputs digest
@@ -0,0 +1,138 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A stub DNS resolver that looks up host names without blocking.
+ */
+#ifndef __WVDNSSTREAM_H
+#define __WVDNSSTREAM_H
+
+#include "wvudp.h"
+#include "wvlinklist.h"
+#include "wvhashtable.h"
+#include "wvtimeutils.h"
+
+DeclareWvList(WvIPAddr);
+
+class WvDNSQuery;
+class WvDNSHostsEntry;
+
+DeclareWvDict(WvDNSQuery, WvString, name);
+DeclareWvDict(WvDNSHostsEntry, WvString, name);
+
+#define WVDNS_MAXNS 3      // the most nameservers we'll use, like libc
+#define WVDNS_MAXSEARCH 6  // the most search domains we'll use
+
+/**
+ * WvDNSStream looks up the IPv4 addresses of host names by sending
+ * queries for A records straight to the nameservers in /etc/resolv.conf,
+ * over its own UDP socket.  It doesn't fork or start threads, so it
+ * can have hundreds of lookups going at once.  Select on it (or add it to
+ * a WvIStreamList) and its callback will pass the answers along as they
+ * come in.
+ *
+ * The "nameserver", "search", "domain" and "options ndots: timeout:
+ * attempts:" lines of resolv.conf are understood, as is /etc/hosts, which
+ * is checked first.  Names that are already dotted-quad addresses are
+ * answered right away, without asking anyone.
+ *
+ * Every query goes out with a random ID, and whenever there are no
+ * queries left waiting, the next one goes out from a new random port, to
+ * make forged answers hard to get past us.
+ *
+ * If there are no nameservers to ask at all (for example, on Win32, or if
+ * there's no resolv.conf), lookup() falls back to gethostbyname(), which
+ * blocks the caller - and so the whole event loop - until it's done.
+ *
+ * If you ask for a name that's already being looked up, no new query is
+ * sent; you just get told when the first one finishes.
+ */
+class WvDNSStream : public WvUDPStream
+{
+public:
+    /**
+     * Tells you the addresses found for 'name', in the order they came
+     * in, and how many seconds you can keep them.  If the name doesn't
+     * exist, the list is empty and 'ttl' is how long you can remember
+     * that; if no nameserver answered, the list is empty and 'ttl' is -1.
+     */
+    typedef wv::function<void(WvStringParm name, WvIPAddrList &addrs,
+			      int ttl)> Callback;
+
+    /**
+     * Read nameservers and search domains from 'resolvconf' and
+     * hostnames from 'hostsfile'.  Either can be null, and then you have
+     * to add_nameserver() yourself.
+     */
+    WvDNSStream(WvStringParm resolvconf = "/etc/resolv.conf",
+		WvStringParm hostsfile = "/etc/hosts");
+    virtual ~WvDNSStream();
+
+    /**
+     * Send queries to 'addr' as well.  If resolv.conf didn't name any
+     * nameservers, this replaces the default of 127.0.0.1.
+     */
+    void add_nameserver(const WvIPPortAddr &addr);
+
+    /** the number of nameservers we know about */
+    int num_nameservers() const
+        { return numservers; }
+
+    /** Wait 'msec' for each answer, and ask each nameserver 'attempts' times. */
+    void set_retry(time_t msec, int attempts);
+
+    /**
+     * Start looking up 'name', and call 'cb' when we know the answer.  If
+     * the answer is already known (from /etc/hosts, say, or because
+     * 'name' is an IP address), 'cb' is called right away, before
+     * lookup() returns.  So is it if num_nameservers() is 0, but then
+     * lookup() blocks until gethostbyname() has found out.
+     */
+    void lookup(WvStringParm name, const Callback &cb);
+
+    /** the number of names we're still waiting to hear about */
+    size_t pending() const
+        { return queries.count(); }
+
+    /** the number of query packets sent so far */
+    unsigned int queries_sent() const
+        { return sent; }
+
+    virtual void pre_select(SelectInfo &si);
+    virtual bool post_select(SelectInfo &si);
+
+protected:
+    virtual void execute();
+
+private:
+    WvIPPortAddr nameservers[WVDNS_MAXNS];
+    int numservers;
+    bool default_ns;
+    WvString search[WVDNS_MAXSEARCH];
+    int numsearch, ndots, attempts;
+    time_t timeout;
+    unsigned int sent, sent_here;
+    int randfd;
+    unsigned char randpool[64];
+    size_t randused;
+    WvDNSQueryDict queries;
+    WvDNSHostsEntryDict hosts;
+
+    void read_resolvconf(WvStringParm filename);
+    void read_hosts(WvStringParm filename);
+    void blocking_lookup(WvStringParm name, const Callback &cb);
+    unsigned int random16();
+    void rebind();
+
+    void send(WvDNSQuery *q);
+    void got_packet(const unsigned char *pkt, size_t len);
+    void next_candidate(WvDNSQuery *q, int ttl);
+    void next_server(WvDNSQuery *q);
+    void finish(WvDNSQuery *q, WvIPAddrList &addrs, int ttl);
+    time_t next_timeout();
+
+public:
+    const char *wstype() const { return "WvDNSStream"; }
+};
+
+#endif // __WVDNSSTREAM_H
@@ -376,8 +376,8 @@ protected:
         { errstr = message; setnotok(); }
 
     /** Sets an error condition, then setnotok(). */
-    void seterror(WVSTRING_FORMAT_DECL)
-        { seterror(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE void seterror(WVSTRING_FORMAT_TDECL)
+        { seterror(WvString(WVSTRING_FORMAT_TCALL)); }
 
     /** Sets 'finished' to true explicitly. */
     void setfinished()
@@ -542,6 +542,10 @@ protected:
  * An encoder chain owns a list of encoders that are used in sequence
  * to transform data from a source buffer to a target buffer.
  * 
+ * Large inputs are pushed through the whole chain a slice at a time, so
+ * the buffers between encoders stay small and get reused, and the last
+ * encoder writes directly into the target buffer.
+ * 
  * Supports reset() if all the encoders it contains also support
  * reset().
  * 
@@ -701,6 +705,10 @@ private:
     /** Used by _encode() and _finish() */
     bool do_encode(WvBuf &in, WvBuf &out, ChainElem *start_after,
 		   bool flush, bool finish);
+
+    /** Runs "in" once through the encoders after "start_after" */
+    bool run_stages(WvBuf &in, WvBuf &out, ChainElem *start_after,
+		    bool flush, bool finish);
 };
 
 #endif // __WVENCODER_H
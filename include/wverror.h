@@ -67,11 +67,12 @@ public:
      */
     virtual void seterr(int _errnum);
     void seterr(WvStringParm specialerr);
-    void seterr(WVSTRING_FORMAT_DECL)
-        { seterr(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE void seterr(WVSTRING_FORMAT_TDECL)
+        { seterr(WvString(WVSTRING_FORMAT_TCALL)); }
     void seterr_both(int _errnum, WvStringParm specialerr);
-    void seterr_both(int _errnum, WVSTRING_FORMAT_DECL)
-        { seterr_both(_errnum, WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE
+    void seterr_both(int _errnum, WVSTRING_FORMAT_TDECL)
+        { seterr_both(_errnum, WvString(WVSTRING_FORMAT_TCALL)); }
     void seterr(const WvErrorBase &err);
     
     /** Reset our error state - there's no error condition anymore. */
@@ -98,8 +99,8 @@ public:
         { seterr(_errnum); }
     void set(WvStringParm specialerr)
         { seterr(specialerr); }
-    void set(WVSTRING_FORMAT_DECL)
-        { seterr(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE void set(WVSTRING_FORMAT_TDECL)
+        { seterr(WvString(WVSTRING_FORMAT_TCALL)); }
     void set_both(int _errnum, WvStringParm specialerr)
         { seterr_both(_errnum, specialerr); }
     void set(const WvErrorBase &err)
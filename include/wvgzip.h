@@ -11,6 +11,7 @@
 #include "wvencoderstream.h"
 
 struct z_stream_s;
+class WvWorkerPool;
 
 /**
  * An encoder implementing Gzip encryption and decryption.
@@ -31,6 +32,10 @@ struct z_stream_s;
  *     this point, no additional data can be decompressed.
  * 
  * 
+ * A compressor can also be given a WvWorkerPool (see parallel()), in
+ * which case it splits its input into blocks and compresses them on the
+ * pool's threads, like pigz.  The output is still one ordinary stream,
+ * which any inflater (including this one) can decompress.
  */
 class WvGzipEncoder : public WvEncoder
 {
@@ -74,6 +79,22 @@ public:
      */
     bool full_flush;
 
+    /**
+     * Compress blocks of '_blocksize' bytes at a time on 'pool', instead
+     * of on the calling thread.  Only for Deflate mode, and only before
+     * any data has been encoded.  Pass NULL to go back to compressing
+     * on the calling thread.
+     *
+     * Each block is compressed separately (though with the previous
+     * block's last 32k as its dictionary, unless 'full_flush' is set),
+     * so output only appears once a whole block is done, or on flush().
+     * 'out_limit' is ignored in this mode.
+     *
+     * The pool has to outlive the encoder.  Like any WvWorkerPool, it
+     * should be on a WvIStreamList, so it can clean up after its jobs.
+     */
+    void parallel(WvWorkerPool *pool, size_t _blocksize = 128*1024);
+
 protected:
     virtual bool _encode(WvBuf &inbuf, WvBuf &outbuf, bool flush);
     virtual bool _finish(WvBuf &outbuf);
@@ -81,14 +102,21 @@ protected:
 
 private:
     struct z_stream_s *zstr;
-    WvInPlaceBuf tmpbuf;
     Mode mode;
     size_t output;
 
+    struct Parallel;
+    Parallel *par; // NULL unless we're compressing on a worker pool
+
     void init();
     void close();
     void prepare(WvBuf *inbuf);
     bool process(WvBuf &outbuf, bool flush, bool finish);
+
+    bool par_encode(WvBuf &inbuf, WvBuf &outbuf, bool flush);
+    bool par_finish(WvBuf &outbuf);
+    void par_submit(bool last);
+    bool par_collect(WvBuf &outbuf, size_t max_left);
 };
 
 
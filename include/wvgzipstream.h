@@ -15,6 +15,9 @@
  * By default, written data is compressed using WvGzipEncoder::Deflate,
  * read data is decompressed using WvGzipEncoder::Inflate.
  * 
+ * If you give it a WvWorkerPool, data written with Deflate is compressed
+ * on the pool's threads (see WvGzipEncoder::parallel()).
+ * 
  * @see WvGzipEncoder
  */
 class WvGzipStream : public WvEncoderStream
@@ -22,11 +25,15 @@ class WvGzipStream : public WvEncoderStream
 public:
     WvGzipStream(WvStream *_cloned,
 		 WvGzipEncoder::Mode readmode = WvGzipEncoder::Inflate,
-		 WvGzipEncoder::Mode writemode = WvGzipEncoder::Deflate)
+		 WvGzipEncoder::Mode writemode = WvGzipEncoder::Deflate,
+		 WvWorkerPool *pool = NULL)
         : WvEncoderStream(_cloned)
 	{
 	    readchain.append(new WvGzipEncoder(readmode), true);
-	    writechain.append(new WvGzipEncoder(writemode), true);
+	    WvGzipEncoder *writer = new WvGzipEncoder(writemode);
+	    if (pool)
+		writer->parallel(pool);
+	    writechain.append(writer, true);
 	}
     virtual ~WvGzipStream() { }
 
@@ -40,6 +40,9 @@ struct WvHTTPHeader
 DeclareWvDict(WvHTTPHeader, WvString, name);
 
 
+class WvUrlRequest;
+typedef wv::function<void(WvUrlRequest*)> WvUrlRequestCallback;
+
 class WvUrlRequest
 {
 public:
@@ -54,6 +57,9 @@ public:
     bool is_dir;
     bool create_dirs;
     WvString method;
+
+    /// called once, by done(), when the request is finished
+    WvUrlRequestCallback ondone;
     
     WvUrlRequest(WvStringParm _url, WvStringParm _method, WvStringParm _headers,
 		 WvStream *content_source, bool _create_dirs, bool _pipeline_test);
@@ -121,6 +127,9 @@ public:
     Target target;
     static int max_requests;
 
+    /// how long (in msec) to keep the connection open once it's idle
+    int idle_msec;
+
 protected:
     WvLog log;
     WvUrlRequestList urls, waiting_urls;
@@ -137,6 +146,7 @@ public:
     {
     	request_count = 0;
     	curl = NULL;
+        idle_msec = 5000;
     }
 
     virtual ~WvUrlStream() {};
@@ -147,6 +157,14 @@ public:
     // only implemented in WvHttpStream
     virtual size_t remaining()
     { return 0; }
+
+    /// the number of requests queued on or running over this connection
+    size_t load() const
+        { return urls.count() + waiting_urls.count(); }
+
+    /// true if this connection won't be sending any more requests
+    bool used_up() const
+        { return request_count >= max_requests; }
     
     virtual void execute() = 0;
     
@@ -156,7 +174,20 @@ public:
 
 unsigned WvHash(const WvUrlStream::Target &n);
 
-DeclareWvDict(WvUrlStream, WvUrlStream::Target, target);
+DeclareWvList(WvUrlStream);
+
+
+/** All the connections a WvHttpPool has open to one server. */
+struct WvUrlHost
+{
+    WvUrlStream::Target target;
+    WvUrlStreamList streams;
+
+    WvUrlHost(const WvUrlStream::Target &_target)
+        : target(_target) {}
+};
+
+DeclareWvDict(WvUrlHost, WvUrlStream::Target, target);
 
 
 class WvHttpStream : public WvUrlStream
@@ -179,6 +210,11 @@ private:
     size_t bytes_remaining;
     bool in_chunk_trailer, last_was_pipeline_test, in_doneurl;
 
+    // how much body data (or PUT data) we move around at once
+    enum { BODY_CHUNK = 65536 };
+    WvDynBuf body_buf;
+    size_t pass_body(size_t count, bool deliver);
+
     virtual void doneurl();
     virtual void request_next();
     void start_pipeline_test(WvUrl *url);
@@ -247,16 +283,31 @@ class WvHttpPool : public WvIStreamList
 {
     WvLog log;
     WvResolver dns;
-    WvUrlStreamDict conns;
-    WvUrlRequestList urls;
+    WvUrlHostDict hosts;
+    WvUrlRequestList urls;      // every request; we own these
+    WvUrlRequestList pending;   // waiting for DNS
+    WvUrlRequestList waiting;   // resolved, but waiting for a connection
+    WvUrlRequestList finished;  // done, and ready to be deleted
     int num_streams_created;
-    bool sure;
+    bool dispatch_needed;
     
     WvIPPortAddrTable pipeline_incompatible;
     
 public:
     WvHttpPool();
     virtual ~WvHttpPool();
+
+    /**
+     * The most connections to open to any one server (as any one user).
+     * A new request goes to an idle connection if there is one, or else a
+     * new connection if we're under this limit, or else whichever
+     * connection has the fewest requests queued.  The default of 1 leaves
+     * all the parallelism up to pipelining.
+     */
+    int max_conns_per_host;
+
+    /// How long (in msec) an idle connection stays open for reuse.
+    int idle_timeout;
     
     virtual void pre_select(SelectInfo &si);
     virtual bool post_select(SelectInfo &si);
@@ -272,7 +323,9 @@ public:
 //    WvBufUrlStream *addputurl(WvStringParm _url, WvStringParm _headers,
 //			      WvStream *s, bool create_dirs = false);
 private:
-    void unconnect(WvUrlStream *s);
+    void unconnect(WvUrlHost *host, WvUrlStream *s);
+    WvUrlStream *pick_stream(WvUrlRequest *url);
+    void url_done(WvUrlRequest *url);
     
 public:
     bool idle() const 
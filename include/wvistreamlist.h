@@ -74,10 +74,11 @@ public:
             s->set_wsname(id);
         WvIStreamListBase::append(s, auto_free, id);
     }
-    void append(IWvStream *s, bool auto_free, WVSTRING_FORMAT_DECL)
+    WVSTRING_FORMAT_TEMPLATE
+    void append(IWvStream *s, bool auto_free, WVSTRING_FORMAT_TDECL)
     {
         if (s->wsname() == NULL)
-            s->set_wsname(WvString(WVSTRING_FORMAT_CALL));
+            s->set_wsname(WvString(WVSTRING_FORMAT_TCALL));
         WvIStreamListBase::append(s, auto_free, s->wsname());
     }
 
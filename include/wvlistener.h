@@ -89,8 +89,8 @@ public:
         { return "Listener"; }
     virtual void set_wsname(WvStringParm name)
         { }
-    void set_wsname(WVSTRING_FORMAT_DECL)
-        { set_wsname(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE void set_wsname(WVSTRING_FORMAT_TDECL)
+        { set_wsname(WvString(WVSTRING_FORMAT_TCALL)); }
     virtual const char *wstype() const
         { return "Listener"; }
     virtual WSID wsid() const
@@ -110,14 +110,16 @@ public:
     }
     
     /** change the loglevel and then print a formatted message */
-    size_t operator() (LogLevel _loglevel, WVSTRING_FORMAT_DECL)
+    WVSTRING_FORMAT_TEMPLATE
+    size_t operator() (LogLevel _loglevel, WVSTRING_FORMAT_TDECL)
     { 
 	LogLevel l = loglevel;
         size_t x;
         if (filter)
-            x = lvl(_loglevel).print((*filter)(WvString(WVSTRING_FORMAT_CALL)));
+            x = lvl(_loglevel).print(
+                    (*filter)(WvString(WVSTRING_FORMAT_TCALL)));
         else
-            x = lvl(_loglevel).print(WVSTRING_FORMAT_CALL);
+            x = lvl(_loglevel).print(WVSTRING_FORMAT_TCALL);
 	lvl(l);
 	return x;
     }
@@ -128,11 +130,23 @@ public:
      */
     size_t operator() (WvStringParm s)
         { return WvStream::operator()(filter ? (*filter)(s) : s); }
+#if __cplusplus >= 201103L
+    // the format is a template parameter too, just so that this one doesn't
+    // get in the way when it's actually a LogLevel.
+    template <typename F, typename A0, typename... Args>
+    typename std::enable_if<!std::is_same<F, LogLevel>::value, size_t>::type
+        operator() (const F &format, const A0 &a0, const Args &... args)
+        { return (filter ? 
+            WvStream::operator()((*filter)(WvString(format, a0, args...))) :
+            WvStream::operator()(format, a0, args...) );
+        }
+#else
     size_t operator() (WVSTRING_FORMAT_DECL)
         { return (filter ? 
             WvStream::operator()((*filter)(WvString(WVSTRING_FORMAT_CALL))) :
             WvStream::operator()(WVSTRING_FORMAT_CALL) );
         }
+#endif
     
     /**
      * split off a new WvLog object with the requested loglevel.  This way
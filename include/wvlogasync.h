@@ -0,0 +1,130 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A bounded queue of finished log lines, drained by a dedicated writer
+ * thread.  Used by WvLogFileBase and WvSyslog in "async" mode so that a
+ * slow disk or a blocked syslog socket can't stall the main event loop.
+ */
+#ifndef __WVLOGASYNC_H
+#define __WVLOGASYNC_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <pthread.h>
+
+/**
+ * WvLogAsync is a single-producer, single-consumer ring of log records.
+ *
+ * The producer (whoever calls push(), normally the event loop thread) never
+ * takes a lock unless the queue is full and the overflow policy is Block.
+ * The writer thread wakes up at least every 'flush_msec' milliseconds,
+ * collects every record that is ready and hands them to write_records() in
+ * one go, so a burst of log lines costs one writev() and one fsync().
+ *
+ * Subclasses implement write_records() (and optionally sync()), which
+ * always run on the writer thread.  Since the thread calls those virtual
+ * functions, subclasses must call stop() in their own destructors.
+ */
+class WvLogAsync
+{
+public:
+    /// the most records passed to write_records() at once
+    enum { MAX_BATCH = 64 };
+
+    enum OverflowPolicy {
+	Drop,   /// throw away new records when full, and count them
+	Block,  /// make push() wait for the writer thread to catch up
+    };
+
+    /**
+     * Create a queue holding up to 'ringsize' bytes of records.  The
+     * writer thread isn't started until start() is called.
+     */
+    WvLogAsync(size_t ringsize = 1024*1024,
+	       OverflowPolicy _policy = Drop, int _flush_msec = 100);
+    virtual ~WvLogAsync();
+
+    OverflowPolicy policy;
+    int flush_msec;
+
+    /** Start the writer thread.  Returns false if it couldn't be started. */
+    bool start();
+
+    /** Drain the queue and stop the writer thread. */
+    void stop();
+
+    bool running() const
+        { return thread_running; }
+
+    /**
+     * Queue one log record with the given (receiver-defined) level.
+     * Returns false if the record had to be dropped.
+     */
+    bool push(int level, const char *str, size_t len);
+
+    /**
+     * Wait until everything pushed so far has been passed to
+     * write_records() and sync(), ie. the writer thread is idle.
+     */
+    void flush();
+
+    /** The number of records dropped because the queue was full. */
+    unsigned long dropped() const
+        { return num_dropped; }
+
+    /**
+     * Write all the records that haven't been written yet to 'fd', using
+     * only async-signal-safe calls.  This is meant for use by wvcrash, when
+     * the writer thread may never get another chance to run.
+     *
+     * It's only best-effort: it can't stop the writer thread, so it just
+     * tells it to quit after the batch it's working on, if any.  Records
+     * in that batch may come out twice.  From then on, push() drops
+     * everything, and stop() only waits for the writer to finish quitting.
+     */
+    void emergency_flush(int fd);
+
+protected:
+    /**
+     * Called by the writer thread with 'count' records.  iov[i] points
+     * at the text of record i (iov_len doesn't count the terminating nul,
+     * but it's there), and levels[i] is the level it was pushed with.
+     * Contents are only valid until this function returns.
+     */
+    virtual void write_records(const struct iovec *iov, const int *levels,
+			       int count) = 0;
+
+    /** Called by the writer thread after each batch of write_records(). */
+    virtual void sync() {}
+
+private:
+    struct Header
+    {
+	unsigned int len;
+	int level;
+    };
+
+    char *ring;
+    size_t ringsize;
+    volatile size_t head, tail; // producer owns head, writer owns tail
+    volatile unsigned long num_dropped;
+    unsigned long reported_dropped;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, progress;
+    volatile bool thread_running, want_stop, writer_waiting, writer_busy;
+    volatile bool crashing; // emergency_flush() has taken over
+
+    size_t space() const;
+    bool put_record(int level, const char *str, size_t len);
+    void kick();
+    size_t write_batch();
+
+    static void *thread_main(void *userdata);
+    void run();
+};
+
+
+#endif // __WVLOGASYNC_H
@@ -0,0 +1,139 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A "Log Receiver" that writes compact binary records to a memory-mapped
+ * file, and a reader that decodes them again.
+ *
+ * Unlike WvLogRcv, WvLogBinary does no formatting at all: each call to
+ * log() becomes one record holding the timestamp, an interned source ID,
+ * the log level and the raw message bytes.  That makes high-rate debug
+ * logging cheap enough to leave turned on; use wvlogdecode (or
+ * WvLogBinaryReader) to turn the result into the usual text format later.
+ */
+#ifndef __WVLOGBINARY_H
+#define __WVLOGBINARY_H
+
+#include "wvlog.h"
+#include "wvhashtable.h"
+#include "wverror.h"
+#include <sys/time.h>
+#include <vector>
+
+/**
+ * On-disk layout.  A file starts with WVLOGBINARY_MAGIC, followed by
+ * records, each aligned to 4 bytes and starting with a WvLogBinaryHeader.
+ * A header with len == 0 and type == 0 marks the end of the file.
+ *
+ * Source names are interned per file: the first time a source appears, a
+ * SourceDef record (whose payload is the source name) assigns it an ID,
+ * and later Message records refer to it by that ID.  Every file is
+ * self-contained, so rotated files can be decoded on their own.
+ */
+#define WVLOGBINARY_MAGIC "WvLogBn1"
+#define WVLOGBINARY_MAGIC_LEN 8
+
+struct WvLogBinaryHeader
+{
+    enum Type { Message = 1, SourceDef = 2 };
+
+    unsigned int len;     // length of the payload following this header
+    unsigned int sec;     // timestamp
+    unsigned int usec;
+    unsigned short src;   // interned source ID
+    unsigned char level;  // WvLog::LogLevel
+    unsigned char type;   // Type
+};
+
+
+/**
+ * Logs to a memory-mapped file named 'filename'.  When the mapping
+ * fills up, the file is trimmed to its real length, renamed to
+ * <filename>.1 (shifting older files up to <filename>.<keep_files>), and
+ * a new one is started.
+ *
+ * Messages and source names longer than about half of '_map_size' get
+ * cut short, so that any one message always fits in a new file.
+ */
+class WvLogBinary : public WvLogRcvBase, public WvErrorBase
+{
+public:
+    WvLogBinary(WvStringParm _filename,
+		WvLog::LogLevel _max_level = WvLog::NUM_LOGLEVELS,
+		size_t _map_size = 16*1024*1024, int _keep_files = 5);
+    virtual ~WvLogBinary();
+
+    WvLog::LogLevel level() const
+        { return max_level; }
+    void level(WvLog::LogLevel lvl)
+        { max_level = lvl; }
+
+    /** Close the current file and start a new one. */
+    void rotate();
+
+protected:
+    virtual void log(WvStringParm source, int loglevel,
+		     const char *_buf, size_t len);
+
+private:
+    struct Source
+    {
+	WvString name;
+	unsigned short id;
+	Source(WvStringParm _name, unsigned short _id)
+	    : name(_name), id(_id) {}
+    };
+    DeclareWvDict(Source, WvString, name);
+
+    WvString filename;
+    WvLog::LogLevel max_level;
+    size_t map_size;
+    int keep_files;
+
+    int fd;
+    char *map;
+    size_t used;
+    SourceDict sources;
+    Source *last_source;
+
+    bool start_file();
+    void close_file();
+    size_t max_payload() const;
+    bool reserve(size_t len);
+    void put_record(WvLogBinaryHeader::Type type, const struct timeval &tv,
+		    unsigned short src, int level,
+		    const char *buf, size_t len);
+    unsigned short intern(WvStringParm source, const struct timeval &tv);
+};
+
+
+/**
+ * Reads back a file written by WvLogBinary, one message at a time.
+ *
+ *    WvLogBinaryReader r(filename);
+ *    while (r.next())
+ *        printf("%s: %.*s", r.source.cstr(), r.len, r.data);
+ */
+class WvLogBinaryReader : public WvErrorBase
+{
+public:
+    WvLogBinaryReader(WvStringParm filename);
+    ~WvLogBinaryReader();
+
+    /** Advance to the next message.  Returns false at end of file. */
+    bool next();
+
+    // the current message, valid after next() returns true
+    struct timeval tv;
+    WvString source;
+    WvLog::LogLevel level;
+    const char *data;
+    size_t len;
+
+private:
+    char *map;
+    size_t map_size, pos;
+    std::vector<WvString> names;
+};
+
+#endif // __WVLOGBINARY_H
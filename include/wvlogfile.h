@@ -10,6 +10,9 @@
 
 #include "wvfile.h"
 #include "wvlogrcv.h"
+#ifndef _WIN32
+#include "wvlogasync.h"
+#endif
 
 /// Basic WvLogRcv that logs to a file. Always logs to the same file.
 /// No auto-rotation of log files.
@@ -18,10 +21,30 @@ class WvLogFileBase : public WvLogRcv, public WvFile
 public:
     WvLogFileBase(WvStringParm _filename,
 		  WvLog::LogLevel _max_level = WvLog::NUM_LOGLEVELS);
+    virtual ~WvLogFileBase();
     
     // run fsync() every so many log messages.  0 never fsyncs.
+    // In async mode, any nonzero value means one fsync() per batch.
     int fsync_every;
 
+#ifndef _WIN32
+    /**
+     * Switch to async mode: finished lines are queued (up to 'queue_size'
+     * bytes of them) and written by a separate thread, so a slow disk
+     * doesn't hold up the caller.  Queued lines are written out by wvcrash
+     * if the program dies.  Returns false if the thread couldn't be started,
+     * in which case we keep writing synchronously.
+     */
+    bool set_async(size_t queue_size = 1024*1024,
+		   WvLogAsync::OverflowPolicy policy = WvLogAsync::Drop);
+
+    /// Wait until all queued lines have been written (async mode only).
+    void flush_async();
+
+    /// The number of lines dropped because the async queue was full.
+    unsigned long dropped() const;
+#endif
+
 protected:
     WvLogFileBase(WvLog::LogLevel _max_level);
     virtual void _make_prefix(time_t now_sec); 
@@ -29,6 +52,13 @@ protected:
     virtual void _end_line();
 
     int fsync_count;
+
+#ifndef _WIN32
+    WvLogAsync *async;
+    WvDynBuf current;
+
+    static void crash_flush(void *userdata);
+#endif
 };
 
 
@@ -0,0 +1,84 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A fixed-size ring of recent log messages in shared memory.
+ */
+#ifndef __WVLOGRING_H
+#define __WVLOGRING_H
+
+#include "wvlogrcv.h"
+#include "wvshmzone.h"
+
+/**
+ * WvLogRing is a cheaper, crash-surviving alternative to WvLogBuffer.
+ *
+ * Instead of keeping a list of separately allocated messages, it copies
+ * each message (with its timestamp, level and source) straight into a
+ * fixed-size ring inside a WvShmZone, overwriting the oldest messages
+ * when it fills up.  Logging a message never allocates memory.
+ *
+ * If the zone is backed by a file, the ring survives the process dying;
+ * constructing a WvLogRing on the same file again picks up where the old
+ * one left off, so a restarted program can dump() what led up to the
+ * crash.  Either way, if wvcrash_setup() was called, the last
+ * 'crash_secs' seconds of messages are included in the wvcrash report.
+ */
+class WvLogRing : public WvLogRcvBase
+{
+public:
+    /** A ring of 'size' bytes in anonymous shared memory. */
+    WvLogRing(size_t size = 1024*1024,
+	      WvLog::LogLevel _max_level = WvLog::NUM_LOGLEVELS);
+
+    /** A ring of 'size' bytes that lives in the file 'filename'. */
+    WvLogRing(WvStringParm filename, size_t size = 1024*1024,
+	      WvLog::LogLevel _max_level = WvLog::NUM_LOGLEVELS);
+    virtual ~WvLogRing();
+
+    bool isok() const
+        { return ring != NULL; }
+
+    WvLog::LogLevel level() const
+        { return max_level; }
+    void level(WvLog::LogLevel lvl)
+        { max_level = lvl; }
+
+    /// How many seconds of messages to include in a wvcrash report.
+    int crash_secs;
+
+    /// Pass every message from the last 'secs' seconds (0 for all of them)
+    /// to another receiver, oldest first.
+    void feed_receiver(WvLogRcv &receiver, int secs = 0);
+
+    /// Print every message from the last 'secs' seconds to 's'.
+    void dump(WvStream &s, int secs = 0);
+
+    /**
+     * Write every message from the last 'secs' seconds to 'fd', using only
+     * async-signal-safe calls.  This is what wvcrash uses.
+     */
+    void dump_fd(int fd, int secs) const;
+
+protected:
+    virtual void log(WvStringParm source, int loglevel,
+		     const char *_buf, size_t len);
+
+private:
+    struct RingHeader;
+    struct Record;
+
+    WvShmZone zone;
+    RingHeader *ring;
+    char *data;
+    size_t datasize;
+    WvLog::LogLevel max_level;
+
+    void init();
+    const Record *find_first(int secs) const;
+    const Record *next_record(const Record *r) const;
+
+    static void crash_dump(int fd, void *userdata);
+};
+
+#endif // __WVLOGRING_H
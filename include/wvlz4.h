@@ -0,0 +1,86 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * LZ4 encoder/decoder based on liblz4.
+ */
+#ifndef __WVLZ4_H
+#define __WVLZ4_H
+
+#include "wvencoder.h"
+
+struct LZ4F_cctx_s;
+struct LZ4F_dctx_s;
+struct LZ4F_CDict_s;
+
+/**
+ * An encoder implementing LZ4 compression and decompression, using the
+ * standard LZ4 frame format (the same as the "lz4" command line tool).
+ * LZ4 compresses less than gzip, but many times faster, so it's a better
+ * fit for fast links where the CPU is the bottleneck.
+ *
+ * When compressing:
+ *
+ *  - On flush(), everything compressed so far is written out, so that
+ *     the other end can decompress it right away.
+ *
+ *  - On finish(), the frame is ended, and the encoder stays finished
+ *     until reset(), which starts a new frame.
+ *
+ * When decompressing:
+ *
+ *  - The encoder will transition to isfinished() == true on its own
+ *     at the end of a frame.  Whatever follows it in the input is left
+ *     there.
+ *
+ * Both ends can share a dictionary (see set_dictionary()), which helps a
+ * lot when the stream is a series of small, similar messages.
+ */
+class WvLZ4Encoder : public WvEncoder
+{
+public:
+    enum Mode {
+        Compress,  /*!< Compress using LZ4 */
+        Decompress /*!< Decompress using LZ4 */
+    };
+
+    /**
+     * Creates an LZ4 encoder.
+     *
+     * "mode" is the compression mode.  "level" is the compression level:
+     * 0 is the normal fast compressor, and 3 to 12 use the slower "high
+     * compression" one.  The decompressor ignores it.
+     */
+    WvLZ4Encoder(Mode mode, int level = 0);
+    virtual ~WvLZ4Encoder();
+
+    /**
+     * Use the 'len' bytes at 'dict' as a dictionary: a sample of the
+     * sort of data we expect to see.  Both ends have to use the same
+     * one.  The dictionary is copied, and the encoder is reset().
+     * Pass NULL to stop using one.
+     */
+    void set_dictionary(const void *dict, size_t len);
+
+protected:
+    virtual bool _encode(WvBuf &inbuf, WvBuf &outbuf, bool flush);
+    virtual bool _finish(WvBuf &outbuf);
+    virtual bool _reset();
+
+private:
+    Mode mode;
+    int level;
+    struct LZ4F_cctx_s *cctx;
+    struct LZ4F_dctx_s *dctx;
+    struct LZ4F_CDict_s *cdict;
+    unsigned char *dict;
+    size_t dictlen;
+    bool started; // have we written this frame's header yet?
+
+    bool begin(WvBuf &outbuf);
+    bool compress(WvBuf &outbuf, const void *data, size_t len);
+    bool decompress(WvBuf &inbuf, WvBuf &outbuf);
+    bool check(size_t result);
+};
+
+#endif // __WVLZ4_H
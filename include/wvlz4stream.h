@@ -0,0 +1,53 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * An LZ4 stream.
+ */
+#ifndef __WVLZ4STREAM_H
+#define __WVLZ4STREAM_H
+
+#include "wvencoderstream.h"
+#include "wvlz4.h"
+
+/**
+ * A stream implementing LZ4 compression and decompression: written data
+ * is compressed, and read data is decompressed.
+ *
+ * You can also get one with the "lz4:" moniker, the same way as "gzip:".
+ *
+ * @see WvLZ4Encoder
+ */
+class WvLZ4Stream : public WvEncoderStream
+{
+public:
+    WvLZ4Stream(WvStream *_cloned, int level = 0)
+        : WvEncoderStream(_cloned)
+	{
+	    reader = new WvLZ4Encoder(WvLZ4Encoder::Decompress);
+	    writer = new WvLZ4Encoder(WvLZ4Encoder::Compress, level);
+	    readchain.append(reader, true);
+	    writechain.append(writer, true);
+	}
+    virtual ~WvLZ4Stream() { }
+
+    /**
+     * Use a shared dictionary in both directions; the other end has to
+     * use the same one.  See WvLZ4Encoder::set_dictionary().  Do this
+     * before reading or writing anything.
+     */
+    void set_dictionary(const void *dict, size_t len)
+	{
+	    reader->set_dictionary(dict, len);
+	    writer->set_dictionary(dict, len);
+	}
+
+private:
+    WvLZ4Encoder *reader, *writer;
+
+public:
+    const char *wstype() const { return "WvLZ4Stream"; }
+};
+
+
+#endif /* __WVLZ4STREAM_H */
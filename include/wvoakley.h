@@ -20,6 +20,14 @@ public:
     short get_public_key(WvBuf &outbuf, short len);
     short get_other_public_key(WvBuf &outbuf, short len);
     void create_secret(WvBuf &_other_pub_key, short len);
+
+    /**
+     * Same as create_secret(_other_pub_key, len), but the secret is
+     * computed on one of the threads of 'pool'.  dh_secret is filled in,
+     * and 'cb' called, from the pool's callback.
+     */
+    void create_secret(WvBuf &_other_pub_key, short len, WvWorkerPool &pool,
+		       const wv::function<void()> &cb);
     WvDynBuf dh_secret;
 
 private:
@@ -27,6 +35,8 @@ private:
     short pub_len, other_len;
     short secret_len;
     WvDynBuf other_pub_key;
+
+    void got_secret(WvBuf &secret, wv::function<void()> cb);
 };
 
 #endif /* __WVOAKLEY_H */
@@ -59,7 +59,14 @@ public:
     WvX509 get_signing_cert() const;
 
     enum Status { Error, Good, Revoked, Unknown };
-    Status get_status(const WvX509 &cert, const WvX509 &issuer) const;
+
+    /**
+     * Returns the status of 'cert' in this response.  If 'next_update' is
+     * given, it's set to the time the responder will have newer
+     * information (or 0 if it didn't say).
+     */
+    Status get_status(const WvX509 &cert, const WvX509 &issuer,
+                      time_t *next_update = NULL) const;
     static WvString status_str(Status status);
 
 private:
@@ -8,6 +8,7 @@
 #define __WVRESOLVER_H
 
 #include "wvaddr.h"
+#include "wvdnsstream.h"
 #include "wvstream.h"
 #include "wvlinklist.h"
 #include "wvhashtable.h"
@@ -18,14 +19,19 @@ class WvResolverAddr;
 DeclareWvDict(WvResolverHost, WvString, name);
 DeclareWvDict(WvResolverAddr, WvIPAddr, addr[0]);
 
-DeclareWvList(WvIPAddr);
-
-/** ASynchronous DNS resolver functions, so that we can do non-blocking lookups */
+/**
+ * ASynchronous DNS resolver functions, so that we can do non-blocking
+ * lookups.  All the WvResolvers share one WvDNSStream, and one cache,
+ * which keeps each answer for as long as the DNS says it's good for.
+ */
 class WvResolver
 {
     static int numresolvers;
     static WvResolverHostDict *hostmap;
     static WvResolverAddrDict *addrmap;
+    static WvDNSStream *dns;
+
+    static void got_addrs(WvStringParm name, WvIPAddrList &addrs, int ttl);
 public:
     WvResolver();
     ~WvResolver();
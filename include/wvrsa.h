@@ -13,6 +13,11 @@
 #include "wvlog.h"
 
 struct rsa_st;
+class WvRSAKey;
+class WvWorkerPool;
+
+/** Gets a new key from WvRSAKey::generate(), or NULL if that failed. */
+typedef wv::function<void(WvRSAKey *)> WvRSAKeyCallback;
 
 /**
  * An RSA public key or public/private key pair that can be used for
@@ -46,6 +51,14 @@ public:
      * Create a new RSA key of bits strength.
      */
     WvRSAKey(int bits);
+
+    /**
+     * Same as WvRSAKey(bits), but the key is generated on one of the
+     * threads of 'pool', then handed to 'cb' from the pool's callback.
+     * The callback owns the new key and must delete it.
+     */
+    static void generate(WvWorkerPool &pool, int bits,
+			 const WvRSAKeyCallback &cb);
     
     virtual ~WvRSAKey();
     
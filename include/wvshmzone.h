@@ -26,10 +26,19 @@ public:
      * "size" is the size of the zone in bytes
      */
     WvShmZone(size_t size);
+
+    /**
+     * Creates a shared memory zone backed by the file 'filename', which
+     * is created (or grown) to "size" bytes.  Whatever the file already
+     * contains is left alone, so the zone's contents survive the process
+     * exiting or crashing.
+     */
+    WvShmZone(WvStringParm filename, size_t size);
     ~WvShmZone();
     
 private:
     int fd;
+    void map(int flags);
     
 public:
     int size;
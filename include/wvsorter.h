@@ -12,11 +12,18 @@
 #include "wvxplc.h"
 #include "wvlink.h"
 
+class WvWorkerPool;
+
+// don't bother with threads for fewer elements than this
+#define WVSORT_PARALLEL_MIN 16384
+
 // the base class for sorted list iterators.
 // It is similar to IterBase, except for rewind(), next(), and cur().
 // The sorting is done in rewind(), which makes an array of WvLink
-// pointers and calls qsort.  "lptr" is a pointer to the current WvLink *
+// pointers and merge-sorts it.  "lptr" is a pointer to the current WvLink *
 // in the array, and next() increments to the next one.
+// The sort is stable, and keeps no global state, so you can sort from
+// inside a compare function, or on several threads at once.
 // NOTE: we do not keep "prev" because it makes no sense to do so.
 //       I guess Sorter::unlink() will be slow... <sigh>
 //       ...so we didn't implement it.
@@ -28,9 +35,10 @@ public:
     void *list;
     void **array;
     void **lptr;
+    WvWorkerPool *pool;
     
     WvSorterBase(void *_list)
-    	{ list = _list; array = lptr = NULL; }
+    	{ list = _list; array = lptr = NULL; pool = NULL; }
     ~WvSorterBase()
     	{ if (array) deletev array; }
     bool next()
@@ -38,11 +46,25 @@ public:
     bool cur()
     	{ return *lptr != 0; }
     
+    /**
+     * Sort big lists (at least WVSORT_PARALLEL_MIN elements) on 'pool's
+     * threads as well as this one.  The compare function has to be safe
+     * to call from other threads, and you have to rewind() from the thread
+     * that owns the pool, not one of its workers.  Pass NULL to sort on
+     * this thread only.
+     */
+    void parallel(WvWorkerPool *_pool)
+        { pool = _pool; }
+    
+    /**
+     * Stably sort the 'n' pointers in 'array' using 'cmp', and 'pool' (if
+     * it's not NULL and the array is big) to help.
+     */
+    static void sort(void **array, size_t n, CompareFunc *cmp,
+		     WvWorkerPool *pool = NULL);
+    
 protected:
     template <class _list_,class _iter_> void rewind(CompareFunc *cmp);
-    
-    static int magic_compare(const void *_a, const void *_b);
-    static CompareFunc *actual_compare;
 };
 
 // the actual type-specific sorter.  Set _list_ and _iter_ to be your
@@ -110,12 +132,7 @@ void WvSorterBase::rewind(CompareFunc *cmp)
     
     *aptr = NULL;
 
-    // sort the array.  "Very nearly re-entrant" (unless the compare function
-    // ends up being called recursively or something really weird...)
-    CompareFunc *old_compare = actual_compare;
-    actual_compare = cmp;
-    qsort(array+1, n, sizeof(void *), magic_compare);
-    actual_compare = old_compare;
+    sort(array+1, n, cmp, pool);
 
     lptr = array;
 }
@@ -0,0 +1,112 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A shared, refcounted SSL_CTX for WvSSLStream, with TLS session caching.
+ */
+#ifndef __WVSSLCONTEXT_H
+#define __WVSSLCONTEXT_H
+
+#include "wverror.h"
+#include "wvlinklist.h"
+#include "wvlog.h"
+#include "wvxplc.h"
+#include "xplc/utils.h"
+
+struct ssl_st;
+struct ssl_ctx_st;
+struct ssl_session_st;
+
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct ssl_st SSL;
+typedef struct ssl_session_st SSL_SESSION;
+
+class WvX509Mgr;
+
+/**
+ * Everything about an SSL connection that doesn't depend on the connection
+ * itself: the SSL_CTX, with its certificate, cipher list and verify mode
+ * already set up.  Setting one of those up costs a lot more than the
+ * SSL_new() that each WvSSLStream still does on its own.
+ *
+ * Sharing a context is also what makes TLS session resumption work: in
+ * server mode, the SSL_CTX keeps a cache of recent sessions, and in client
+ * mode, we remember the last session we got from each server address, so
+ * that reconnecting can skip most of the handshake.
+ *
+ * Use WvSSLContext::get() to find the shared context for a given
+ * certificate and mode, and release() it when you're done.
+ */
+class WvSSLContext : public IObject, public WvErrorBase
+{
+    IMPLEMENT_IOBJECT(WvSSLContext);
+public:
+    /**
+     * Return the shared context for 'x509' (which may be NULL for a
+     * client) in the given mode, creating it if there isn't one yet.
+     * The caller gets its own reference, and must release() it.
+     */
+    static WvSSLContext *get(WvX509Mgr *x509, bool is_server);
+
+    /**
+     * The most unused contexts get() keeps around for later.  Each one
+     * holds a reference to its WvX509Mgr.
+     */
+    static int max_cached;
+
+    /**
+     * Forget all the contexts get() is keeping around.  The ones that are
+     * still in use go away (along with the sessions they remember) once
+     * their last user releases them.
+     */
+    static void purge();
+
+    /**
+     * Create an unshared context.  You probably want get() instead, unless
+     * you need to change its settings without affecting anyone else.
+     */
+    WvSSLContext(WvX509Mgr *_x509, bool _is_server);
+    virtual ~WvSSLContext();
+
+    WvX509Mgr *x509;
+    bool is_server;
+    SSL_CTX *ctx;
+
+    /**
+     * Enable or disable stateless session tickets (RFC 5077).  They're
+     * disabled by default, so that only the session cache is used.
+     */
+    void set_tickets(bool enable);
+
+    /**
+     * Client mode: get ready to resume the last session we had with the
+     * server called 'peer' (normally the WvIPPortAddr as a string), and to
+     * remember the new session once the handshake finishes.
+     */
+    void prepare_client(SSL *ssl, WvStringParm peer);
+
+    /// The number of client sessions remembered at once.
+    enum { MAX_SESSIONS = 64 };
+
+private:
+    struct Session
+    {
+        WvString peer;
+        SSL_SESSION *sess;
+
+        Session(WvStringParm _peer, SSL_SESSION *_sess)
+            : peer(_peer), sess(_sess) {}
+        ~Session();
+    };
+    DeclareWvList(Session);
+
+    WvLog debug;
+    SessionList sessions;
+
+    void save_session(WvStringParm peer, SSL_SESSION *sess);
+    static int new_session_cb(SSL *ssl, SSL_SESSION *sess);
+};
+
+DeclareWvList(WvSSLContext);
+
+#endif // __WVSSLCONTEXT_H
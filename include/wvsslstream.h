@@ -15,13 +15,16 @@
 struct ssl_st;
 struct ssl_ctx_st;
 struct ssl_method_st;
+struct bio_st;
 
 typedef struct ssl_ctx_st SSL_CTX;
 typedef struct ssl_st SSL;
 typedef struct ssl_method_st SSL_METHOD;
+typedef struct bio_st BIO;
 
 class WvX509;
 class WvX509Mgr;
+class WvSSLContext;
 class WvSSLStream;
 
 typedef wv::function<bool(WvX509*)> WvSSLValidateCallback;
@@ -31,6 +34,11 @@ typedef wv::function<bool(WvX509*, WvSSLStream *)> WvSSLGlobalValidateCallback;
  * SSL Stream, handles SSLv2, SSLv3, and TLS
  * Methods - If you want it to be a server, then you must feed the constructor
  * a WvX509Mgr object
+ *
+ * OpenSSL never touches the slave stream directly: it reads and writes a
+ * pair of memory BIOs, and we move the ciphertext between those and the
+ * slave with plain read() and write().  So the slave can be any IWvStream
+ * at all, not just one with a file descriptor.
  */
 class WvSSLStream : public WvStreamClone
 {
@@ -50,9 +58,20 @@ public:
      * Start an SSL connection on the stream _slave.  The x509 structure
      * is optional for a client, and mandatory for a server.  You need to
      * keep the X509 object around for the entire life of this object!
+     *
+     * All the streams with the same x509 object and mode share one
+     * WvSSLContext, so reconnecting can resume the previous TLS session.
      */
     WvSSLStream(IWvStream *_slave, WvX509Mgr *_x509 = NULL, 
     		WvSSLValidateCallback _vcb = 0, bool _is_server = false);
+
+    /**
+     * Start an SSL connection on the stream _slave using the given
+     * context, whose mode decides whether we're a client or a server.
+     * The stream keeps its own reference to the context.
+     */
+    WvSSLStream(IWvStream *_slave, WvSSLContext &_context,
+		WvSSLValidateCallback _vcb = 0);
     
     /** Cleans up everything (calls close + frees up the SSL Objects used) */
     virtual ~WvSSLStream();
@@ -64,23 +83,39 @@ public:
     virtual bool isok() const;
     virtual void noread();
     virtual void nowrite();
+
+    /** True if the handshake resumed an earlier TLS session. */
+    bool resumed() const;
     
 protected:
     WvX509Mgr *x509;
     
+    /** The shared context that ctx belongs to */
+    WvSSLContext *context;
+    
     /** SSL Context - used to create SSL Object */
     SSL_CTX *ctx;
     
     /**
-     * Main SSL Object - after SSL_set_fd() we make all calls through the
-     * connection through here
+     * Main SSL Object - we make all calls through the connection through
+     * here
      */
     SSL *ssl;
+
+    /**
+     * Our end of the BIO pair that 'ssl' reads from and writes to.
+     * Ciphertext from the slave goes in here, and ciphertext for the
+     * slave comes out.
+     */
+    BIO *netbio;
     
     virtual size_t uwrite(const void *buf, size_t len);
     virtual size_t uread(void *buf, size_t len);
+    virtual bool flush_internal(time_t msec_timeout);
     
 private:
+    void init(WvSSLContext *_context, WvSSLValidateCallback _vcb);
+
     /**
      * Connection Status Flag, since SSL takes a few seconds to
      * initialize itself.
@@ -90,6 +125,33 @@ private:
 
     /** Set the connected flag and flush the unconnected_buf */
     void setconnected(bool conn);
+
+    /**
+     * Move whatever ciphertext the slave has for us into netbio.
+     * Returns the number of bytes moved.
+     */
+    size_t pump_in();
+
+    /**
+     * Hand all the ciphertext waiting in netbio to the slave.  Returns
+     * false if the slave couldn't send all of it right away.
+     */
+    bool pump_out();
+
+    /**
+     * SSL_write() as much of 'buf' as we can.  If the slave is backed up,
+     * and 'keep' is set, the record OpenSSL got stuck on goes into
+     * pending_record and counts as written.
+     */
+    size_t write_records(const void *buf, size_t len, bool keep);
+
+    /**
+     * Try again to send pending_record.  Returns true once it's gone.
+     */
+    bool retry_record();
+
+    /** True once we've told OpenSSL that the slave is at EOF */
+    bool slave_eof;
     
     /** Keep track of whether we are a client or a server */
     bool is_server;
@@ -104,23 +166,25 @@ private:
     WvLog debug;
 
     /**
-     * SSL_write() may return an SSL_ERROR_WANT_WRITE code which
-     * indicates that the function should be called again with
-     * precisely the same arguments as the last time.  To ensure that
-     * this can happen, we must unfortunately copy data into a bounce
-     * buffer and remeber the fact.  We use a WvBuf here to allow
-     * an arbitrary amount of data to be set aside.
+     * SSL_read() decrypts straight into the caller's buffer, but if that
+     * fills up, there may be whole records left in OpenSSL or netbio, and
+     * select() won't tell us about them.  If so, this is set, and we
+     * pretend to be readable until they're gone.
      */
-    WvInPlaceBuf write_bouncebuf;
-    size_t write_eat;
-
-    /** Similar nastiness happens with SSL_read() */
-    WvInPlaceBuf read_bouncebuf;
     bool read_pending;
 
     /** Need to buffer writes until sslconnected */
     WvDynBuf unconnected_buf;
 
+    /**
+     * The plaintext of a record SSL_write() couldn't hand to the slave.
+     * OpenSSL wants it retried with the same bytes, and no fewer of them,
+     * which WvStream's outbuf doesn't promise; so we keep it here, and
+     * nothing else gets written until it's gone.  It's never more than
+     * one record (16k).
+     */
+    WvDynBuf pending_record;
+
     /** Prints out the entire SSL error queue */
     void printerr(WvStringParm func);
 
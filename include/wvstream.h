@@ -73,8 +73,8 @@ public:
     virtual void seterr(int _errnum);
     void seterr(WvStringParm specialerr)
         { WvErrorBase::seterr(specialerr); }
-    void seterr(WVSTRING_FORMAT_DECL)
-        { seterr(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE void seterr(WVSTRING_FORMAT_TDECL)
+        { seterr(WvString(WVSTRING_FORMAT_TCALL)); }
     
     /** return true if the stream is actually usable right now */
     virtual bool isok() const;
@@ -543,17 +543,17 @@ public:
         { return write(s); }
 
     /** preformat and write() a string. */
-    size_t print(WVSTRING_FORMAT_DECL)
-	{ return write(WvString(WVSTRING_FORMAT_CALL)); }
-    size_t operator() (WVSTRING_FORMAT_DECL)
-        { return write(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE size_t print(WVSTRING_FORMAT_TDECL)
+	{ return write(WvString(WVSTRING_FORMAT_TCALL)); }
+    WVSTRING_FORMAT_TEMPLATE size_t operator() (WVSTRING_FORMAT_TDECL)
+        { return write(WvString(WVSTRING_FORMAT_TCALL)); }
 
     const char *wsname() const
         { return my_wsname; }
     void set_wsname(WvStringParm wsname)
         { my_wsname = wsname; }
-    void set_wsname(WVSTRING_FORMAT_DECL)
-        { set_wsname(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE void set_wsname(WVSTRING_FORMAT_TDECL)
+        { set_wsname(WvString(WVSTRING_FORMAT_TCALL)); }
         
     const char *wstype() const { return "WvStream"; }
     
@@ -19,11 +19,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string> // no code is actually used from here
+#if __cplusplus >= 201103L
+# include <type_traits>
+# include <utility>
+#endif
 
 
 /* 1 byte for terminating NUL */
 #define WVSTRING_EXTRA 1
 
+/*
+ * Strings this long (including the NUL) are kept inside the string object
+ * itself, instead of in a WvStringBuf of their own.  That's enough for any
+ * 64-bit number, and for most config keys, log sources and DBus names.
+ */
+#define WVSTRING_LOCAL 24
+
 
 #define __WVS_F(n) WvStringParm __wvs_##n
 #define __WVS_FORM(n) WvStringParm __wvs_##n = WvFastString::null
@@ -51,8 +62,30 @@
 		__wvs_a11, __wvs_a12, __wvs_a13, __wvs_a14, __wvs_a15, \
 		__wvs_a16, __wvs_a17, __wvs_a18, __wvs_a19
 
+/*
+ * Functions that just pass their format and arguments along to WvString
+ * should use these instead: in C++11 they take any number of arguments,
+ * and don't turn each one into a WvString first.  For example:
+ *     WVSTRING_FORMAT_TEMPLATE void print(WVSTRING_FORMAT_TDECL)
+ *         { print(WvString(WVSTRING_FORMAT_TCALL)); }
+ * Since they're templates, the function has to be defined right there,
+ * in the header.
+ */
+#if __cplusplus >= 201103L
+#define WVSTRING_FORMAT_TEMPLATE \
+		template <typename __WvsA0, typename... __WvsArgs>
+#define WVSTRING_FORMAT_TDECL WvStringParm __wvs_format, \
+		const __WvsA0 &__wvs_a0, const __WvsArgs &... __wvs_args
+#define WVSTRING_FORMAT_TCALL __wvs_format, __wvs_a0, __wvs_args...
+#else
+#define WVSTRING_FORMAT_TEMPLATE
+#define WVSTRING_FORMAT_TDECL WVSTRING_FORMAT_DECL
+#define WVSTRING_FORMAT_TCALL WVSTRING_FORMAT_CALL
+#endif
+
 struct WvStringBuf;
 class WvFastString;
+class WvFormatArg;
 class WvString;
 class QString; // for operator QString()
 class QCString;
@@ -71,6 +104,10 @@ struct WvStringBuf
     char data[1];	// optional room for extra string data
 };
 
+// set in WvStringBuf::links if copies of the buf might be made or dropped
+// by more than one thread, so the count has to be changed atomically.
+#define WVSTRINGBUF_SHARED 0x80000000u
+
 
 // the _actual_ space taken by a WvStringBuf, without the data[] array
 // (which is variable-sized, not really 1 byte)
@@ -97,10 +134,17 @@ class WvFastString
 protected:
     WvStringBuf *buf;
     char *str;
+    char local[WVSTRING_LOCAL]; // the string itself, if buf == &localbuf
     
     // WvStringBuf used for char* strings that have not been cloned.
     static WvStringBuf nullbuf;
     
+    // never really used; buf points here when the string is in local[].
+    static WvStringBuf localbuf;
+    
+    // drop a link to _buf, and return how many are left.
+    static unsigned unlink_buf(WvStringBuf *_buf);
+    
 public:
     // a null string, converted to char* as "(nil)"
     static const WvFastString null;
@@ -129,6 +173,16 @@ public:
     WvFastString(const WvFastString &s);
     WvFastString(const WvString &s);
     
+#if __cplusplus >= 201103L
+    /**
+     * Move constructors.  These take over the other string's buffer
+     * without touching its link count, and leave it NULL.
+     */
+    WvFastString(WvFastString &&s)
+        { take(s); }
+    WvFastString(WvString &&s);
+#endif
+    
     /**
      * Create a string out of a (char *)-style string _without_ copying any
      * memory.  It's fast, but we have to trust that the _str won't change
@@ -168,7 +222,24 @@ public:
     static void do_format(WvFastString &output, const char *format,
 			  const WvFastString * const *a);
     
+    /**
+     * The same, but for 'argc' arguments that haven't been made into
+     * strings yet.  Recently used format strings are remembered, so they
+     * don't have to be parsed again.
+     */
+    static void do_format(WvFastString &output, const char *format,
+                          const WvFormatArg *argv, size_t argc);
     
+#if __cplusplus >= 201103L
+    /**
+     * Format a string, like printf(), but only with %s (and %c).  See
+     * do_format() for the details.  Any number of arguments is allowed,
+     * and numbers are written straight into the result instead of into
+     * WvStrings of their own first.
+     */
+    template <typename A0, typename... Args>
+    WvFastString(WvStringParm format, const A0 &a0, const Args &... args);
+#else
     /**
      * Now, you're probably thinking to yourself: Boy, does this ever
      * look ridiculous.  And indeed it does.  However, it is
@@ -213,6 +284,7 @@ public:
 	link(&nullbuf, NULL);
 	do_format(*this, __wvs_format.str, x);
     }
+#endif
     
     ~WvFastString();
     
@@ -232,8 +304,37 @@ protected:
     void link(WvStringBuf *_buf, const char *_str);
     void unlink();
     
+    // share s's WvStringBuf, or copy its local[] if it uses that.
+    void link(const WvFastString &s)
+    {
+        if (s.buf == &localbuf)
+            copy_local(s);
+        else
+            link(s.buf, s.str);
+    }
+    void copy_local(const WvFastString &s)
+    {
+        memcpy(local, s.local, sizeof(local));
+        buf = &localbuf;
+        str = local + (s.str - s.local);
+    }
+    
+    // like link(s), but s gives up its reference instead of us adding one.
+    void take(WvFastString &s)
+    {
+        if (s.buf == &localbuf)
+            copy_local(s);
+        else
+        {
+            buf = s.buf;
+            str = s.str;
+        }
+        s.buf = NULL;
+        s.str = NULL;
+    }
+    
     // allocate new space for buffers - needed only by the (int i) constructor,
-    // for now.
+    // for now.  newbuf() uses local[] instead if the string will fit.
     WvStringBuf *alloc(size_t size);
     void newbuf(size_t size);
     
@@ -353,6 +454,14 @@ public:
     	{ copy_constructor(s); }
     WvString(const WvFastString &s)
         { copy_constructor(s); }
+#if __cplusplus >= 201103L
+    /**
+     * Moving from another WvString is always safe: its memory is already
+     * its own.  (Not so for a WvFastString, so there's no move from one.)
+     */
+    WvString(WvString &&s) : WvFastString(std::move(s))
+        { }
+#endif
     
     /**
      * Create a WvString out of a char* string.  We always allocate memory
@@ -375,15 +484,29 @@ public:
      */
     inline WvString(const std::string &s);
 
-    WvString(WVSTRING_FORMAT_DECL) : WvFastString(WVSTRING_FORMAT_CALL)
+    WVSTRING_FORMAT_TEMPLATE WvString(WVSTRING_FORMAT_TDECL)
+        : WvFastString(WVSTRING_FORMAT_TCALL)
         { }
     
     WvString &append(WvStringParm s);
-    WvString &append(WVSTRING_FORMAT_DECL)
-        { return append(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE WvString &append(WVSTRING_FORMAT_TDECL)
+        { return append(WvString(WVSTRING_FORMAT_TCALL)); }
 
     WvString &operator= (int i);
     WvString &operator= (const WvFastString &s2);
+    WvString &operator= (const WvString &s2)
+        { return *this = (const WvFastString &)s2; }
+#if __cplusplus >= 201103L
+    WvString &operator= (WvString &&s2)
+    {
+        if (&s2 != this)
+        {
+            unlink();
+            take(s2);
+        }
+        return *this;
+    }
+#endif
     WvString &operator= (const char *s2)
         { return *this = WvFastString(s2); }
     
@@ -393,6 +516,15 @@ public:
     /** returns true if this string is already unique() */
     bool is_unique() const;
 
+    /**
+     * Let copies of this string be made and thrown away by any thread,
+     * not just this one.  Its buf is copied first if it's borrowed from a
+     * char*, and from then on its link count is only changed atomically,
+     * which is a bit slower.  WvStringCache does this to everything it
+     * hands out.
+     */
+    WvString &shareable();
+
     /** make the string editable, and return a non-const (char*) */
     char *edit()
         { return unique().str; }
@@ -411,6 +543,93 @@ protected:
 };
 
 
+/**
+ * One argument to the string formatter: a string that's already there, or
+ * a number, written out right here.  There's no need to create these
+ * yourself; WvString's formatting constructor does it for you.
+ */
+class WvFormatArg
+{
+    WvFastString hold; // for things that have to be made into strings first
+    const char *str;
+    int numlen;
+    char num[32];
+
+    void setnum(long long i);
+    void setunum(unsigned long long i);
+    void setdouble(double d);
+    
+    // not allowed
+    WvFormatArg &operator= (const WvFormatArg &);
+    
+public:
+    WvFormatArg(const WvFastString &s) : str(s.cstr()), numlen(0) { }
+    WvFormatArg(const WvString &s) : str(s.cstr()), numlen(0) { }
+    WvFormatArg(const char *s) : str(s), numlen(0) { }
+    WvFormatArg(char *s) : str(s), numlen(0) { }
+    WvFormatArg(bool i) { setnum(i); }
+    WvFormatArg(char i) { setnum(i); }
+    WvFormatArg(signed char i) { setnum(i); }
+    WvFormatArg(unsigned char i) { setnum(i); }
+    WvFormatArg(short i) { setnum(i); }
+    WvFormatArg(unsigned short i) { setnum(i); }
+    WvFormatArg(int i) { setnum(i); }
+    WvFormatArg(unsigned int i) { setunum(i); }
+    WvFormatArg(long i) { setnum(i); }
+    WvFormatArg(unsigned long i) { setunum(i); }
+    WvFormatArg(long long i) { setnum(i); }
+    WvFormatArg(unsigned long long i) { setunum(i); }
+    WvFormatArg(float d) { setdouble(d); }
+    WvFormatArg(double d) { setdouble(d); }
+
+    // 'hold' may keep a short string in its own local[], so a copy has to
+    // point at its own copy of it, not the original's.
+    WvFormatArg(const WvFormatArg &a) : hold(a.hold), numlen(a.numlen)
+    {
+        if (numlen)
+            memcpy(num, a.num, sizeof(num));
+        else
+            str = (a.str == a.hold.cstr()) ? hold.cstr() : a.str;
+    }
+#if __cplusplus >= 201103L
+    template <typename T>
+    WvFormatArg(const T &e,
+            typename std::enable_if<std::is_enum<T>::value>::type * = 0)
+        { setnum(e); }
+    template <typename T>
+    WvFormatArg(const T &t,
+            typename std::enable_if<!std::is_enum<T>::value>::type * = 0)
+        : hold(t), str(hold.cstr()), numlen(0) { }
+#endif
+
+    /** the argument as a string, or NULL */
+    const char *cstr() const
+        { return numlen ? num : str; }
+
+    /** the length of cstr(), which mustn't be NULL */
+    size_t len() const
+        { return numlen ? numlen : strlen(str); }
+};
+
+
+#if __cplusplus >= 201103L
+inline WvFastString::WvFastString(WvString &&s)
+{
+    take(s);
+}
+
+
+template <typename A0, typename... Args>
+inline WvFastString::WvFastString(WvStringParm format, const A0 &a0,
+                                  const Args &... args)
+{
+    const WvFormatArg argv[] = { a0, args... };
+    link(&nullbuf, NULL);
+    do_format(*this, format.str, argv, 1 + sizeof...(args));
+}
+#endif
+
+
 /**
  * A ridiculous class needed because UniConf::operator->() needs to return
  * a pointer, even though that pointer is going to be dereferenced
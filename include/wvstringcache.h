@@ -7,7 +7,13 @@
 #ifndef __WVSTRINGCACHE_H
 #define __WVSTRINGCACHE_H
 
-#include "wvstringtable.h"
+#include "wvstring.h"
+
+// the cache is split up this many ways, each with its own lock
+#define WVSTRINGCACHE_SHARDS 16
+
+// by default, stop caching new strings once they take up this much memory
+#define WVSTRINGCACHE_MAXBYTES (16*1024*1024)
 
 /**
  * A cache table of WvString objects.  If you think you might be reusing
@@ -15,35 +21,54 @@
  * provides the same string value a million times in a config file you're
  * reading), you might be able to save a lot of memory by sharing the
  * strings via a WvStringCache.
- * 
+ *
  * To potentially share a string, call get(string), throw away the input
  * string, and use the output string (which is guaranteed to have the same
  * content) in its place.  The string will be saved in the cache table for
- * next time.
- * 
- * Every once and a while, you should call clean() to remove any strings from
- * the table that are no longer referenced elsewhere.  This is especially
- * important after deleting a large data structure, because you won't actually
- * free up the memory used by those strings until clean() is called.
- * 
+ * next time.  Strings short enough to live inside a WvString (see
+ * WVSTRING_LOCAL) don't take up any memory of their own, so they're just
+ * handed back without being cached.
+ *
+ * Strings that nobody but the cache is using any more get thrown out a few
+ * at a time as new ones are added, oldest first, unless they've been asked
+ * for again lately; and once the cache takes up more than set_limit()
+ * bytes, it stops adding new strings until some old ones can go.  You can
+ * still call clean() to get rid of all the unused ones right away, for
+ * example after deleting a large data structure.
+ *
  * All WvStringCaches in the app are shared, to optimize the benefits of
- * the cache.
+ * the cache, and get() can be called from any thread.  The strings it
+ * returns are shareable(), so copies of them can be passed between threads
+ * too.
  */
 class WvStringCache
 {
-    static WvStringTable *t;
+public:
+    struct Shard;
+
+private:
+    static Shard *shards;
     static int refcount;
-    static size_t clean_threshold;
-    
+    static size_t maxbytes;
+
 public:
     WvStringCache();
     ~WvStringCache();
-    
+
     /** Get a shared string corresponding to 's'. */
     WvString get(WvStringParm s);
-    
+
     /** Remove any now-unused strings from the cache. */
     void clean();
+
+    /** Don't let the cache grow past about 'bytes' bytes. */
+    static void set_limit(size_t bytes);
+
+    /** the number of strings in the cache right now */
+    static size_t count();
+
+    /** roughly how much memory the cached strings are taking up */
+    static size_t size();
 };
 
 
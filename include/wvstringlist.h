@@ -81,8 +81,8 @@ public:
     void fill(const char * const *array);
 
     void append(WvStringParm str);
-    void append(WVSTRING_FORMAT_DECL)
-        { append(WvString(WVSTRING_FORMAT_CALL)); }
+    WVSTRING_FORMAT_TEMPLATE void append(WVSTRING_FORMAT_TDECL)
+        { append(WvString(WVSTRING_FORMAT_TCALL)); }
     void append(WvString *strp, bool autofree, char *id = NULL);
 
     /** 
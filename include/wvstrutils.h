@@ -14,6 +14,7 @@
 #include <ctype.h>
 #include "wvstring.h"
 #include "wvstringlist.h"
+#include "wvbuf.h"
 #include "wvhex.h"
 #ifndef _WIN32
 #include "wvregex.h"
@@ -111,6 +112,10 @@ bool is_word(const char *string);
  */
 WvString hexdump_buffer(const void *buf, size_t len, bool charRep = true);
 
+/** Like hexdump_buffer(), but appends the dump to 'out'. */
+void hexdump_buffer(WvBuf &out, const void *buf, size_t len,
+                    bool charRep = true);
+
 /**
  * Returns true if 'c' is a newline or carriage return character. 
  * Increases code readability a bit.
@@ -126,6 +131,9 @@ bool isnewline(char c);
  */
 WvString url_decode(WvStringParm str, bool no_space = false);
 
+/** Like url_decode(), but appends the result to 'out'. */
+void url_decode(WvBuf &out, WvStringParm str, bool no_space = false);
+
 
 /**
  * Converts all those pesky spaces, colons, and other nasties into nice 
@@ -136,6 +144,9 @@ WvString url_decode(WvStringParm str, bool no_space = false);
  * otherwise the string would not be decodable.
  */
 WvString url_encode(WvStringParm str, WvStringParm unsafe = "");
+
+/** Like url_encode(), but appends the result to 'out'. */
+void url_encode(WvBuf &out, WvStringParm str, WvStringParm unsafe = "");
  
 
 /**
@@ -189,6 +200,9 @@ WvString passwd_md5(const char *str);
  */
 WvString backslash_escape(WvStringParm s1);
 
+/** Like backslash_escape(), but appends the result to 'out'. */
+void backslash_escape(WvBuf &out, WvStringParm s1);
+
 /** How many times does 'c' occur in "s"? */
 int strcount(WvStringParm s, const char c);
 
@@ -267,6 +281,14 @@ WvString secondstoa(unsigned int total_seconds);
 int lookup(const char *str, const char * const *table,
     bool case_sensitive = false);
 
+/**
+ * Make a new WvString out of s[0..len), for strcoll_split() and friends.
+ * This saves them from making an editable copy of the whole string just to
+ * put NULs in it.
+ */
+WvString *strcoll_piece(const char *s, size_t len);
+
+
 /**
  * Splits a string and adds each substring to a collection.
  *   coll       : the collection of strings to add to
@@ -278,8 +300,7 @@ template<class StringCollection>
 void strcoll_split(StringCollection &coll, WvStringParm _s,
     const char *splitchars = " \t", int limit = 0)
 {
-    WvString s(_s);
-    char *sptr = s.edit(), *eptr, oldc;
+    const char *sptr = _s, *eptr;
     
     // Simple if statement to catch (and add) empty (but not NULL) strings.
     if (sptr && !*sptr )
@@ -313,13 +334,7 @@ void strcoll_split(StringCollection &coll, WvStringParm _s,
 	    eptr = sptr + strlen(sptr);
 	}
 	
-	oldc = *eptr;
-	*eptr = 0;
-	
-	WvString *newstr = new WvString(sptr);
-        coll.add(newstr, true);
-	
-	*eptr = oldc;
+        coll.add(strcoll_piece(sptr, eptr - sptr), true);
 	sptr = eptr;
     }
 }
@@ -342,8 +357,7 @@ template<class StringCollection>
 void strcoll_splitstrict(StringCollection &coll, WvStringParm _s,
     const char *splitchars = " \t", int limit = 0)
 {
-    WvString s(_s);
-    char *cur = s.edit();
+    const char *cur = _s;
 
     if (!cur) return;
 
@@ -357,11 +371,7 @@ void strcoll_splitstrict(StringCollection &coll, WvStringParm _s,
         }
 
         int len = strcspn(cur, splitchars);
-
-        char tmp = cur[len];
-        cur[len] = 0;
-        coll.add(new WvString(cur), true);
-        cur[len] = tmp;
+        coll.add(strcoll_piece(cur, len), true);
 
         if (!cur[len]) break;
         cur += len + 1;
@@ -454,6 +464,9 @@ WvString strcoll_join(const StringCollection &coll,
  */
 WvString strreplace(WvStringParm s, WvStringParm a, WvStringParm b);
 
+/** Like strreplace(), but appends the result to 'out'. */
+void strreplace(WvBuf &out, WvStringParm s, WvStringParm a, WvStringParm b);
+
 /** Replace any consecutive instances of character c with a single one */
 WvString undupe(WvStringParm s, char c);
 
@@ -559,6 +572,11 @@ extern const CStrExtraEscape CSTR_TCLSTR_ESCAPES[];
 WvString cstr_escape(const void *data, size_t size,
         const CStrExtraEscape extra_escapes[] = NULL);
 
+/// Like cstr_escape(), but appends the result to 'out'; nothing at all if
+/// data is NULL.
+void cstr_escape(WvBuf &out, const void *data, size_t size,
+        const CStrExtraEscape extra_escapes[] = NULL);
+
 /// Converts a C-style string constant into data.
 // 
 // This function does *not* include the trailing null that a C compiler would --
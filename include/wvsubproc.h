@@ -16,6 +16,11 @@
  * scripts which launch other programs.  stop() and kill() will kill
  * them all. (If you don't want that, use stop_primary() and
  * kill_primary().)
+ *
+ * Where it can, WvSubProc starts the program with posix_spawn() instead
+ * of fork() and exec(), so a big parent process doesn't have to copy its
+ * page tables just to throw them away again.  Subclasses don't, unless
+ * they ask for it; see spawnable().
  */
 #ifndef __WVSUBPROC_H
 #define __WVSUBPROC_H
@@ -49,9 +54,26 @@ public:
 private:
     void init();
     int _startv(const char cmd[], const char * const *argv);
+    int spawn(const char cmd[], const char * const *argv);
 
     int memlimit;
     
+protected:
+    /**
+     * True if the child needs nothing done between fork() and exec(), so
+     * we can start it with posix_spawn() instead.
+     *
+     * NOTE: posix_spawn() never calls fork(), so a subclass that overrides
+     * fork() to set things up in the child would silently lose that setup.
+     * So this is only true for plain WvSubProc objects: a subclass gets
+     * fork() and exec() unless it overrides this too, saying when it's
+     * safe (and checking can_spawn()).
+     */
+    virtual bool spawnable() const;
+
+    /** True if posix_spawn() can do everything WvSubProc itself needs. */
+    bool can_spawn() const;
+    
 public:
     void prepare(const char cmd[], ...);
     void preparev(const char cmd[], va_list ap);
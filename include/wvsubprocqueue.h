@@ -50,6 +50,17 @@
  * arbitrary delays because of nonstop add_file() calls) and also exactly
  * once at the very end, but not every single time.
  * 
+ * Each process can also have a priority.  Between two sync points,
+ * waiting processes with a higher priority start before ones with a
+ * lower priority, and ones with the same priority start in the order
+ * they were added.  Nothing ever jumps past a sync point, in either
+ * direction.
+ * 
+ * On Linux, we find out about processes exiting through a pidfd for each
+ * one, so go() doesn't have to check on every running process each time
+ * it's called; getexitfd() gives you something to select() on so you know
+ * when to call it.
+ * 
  * In case it wasn't obvious, if you create more than one
  * WvSubProcQueue, they operate totally independently of each other.  That
  * means if you have two queues with a max of 10 processes, you might have
@@ -60,7 +71,8 @@ class WvSubProcQueue
 public:
     /**
      * Create a WvSubProcQueue.  _maxrunning is the maximum number of
-     * processes to have running in parallel.  1 is usually a good choice.
+     * processes to have running in parallel.  1 is usually a good choice;
+     * 0 means one per CPU that we're allowed to run on.
      */
     WvSubProcQueue(unsigned _maxrunning);
     
@@ -71,17 +83,21 @@ public:
      * be added at the end of the queue.  If cookie is non-NULL, it will
      * be treated as a "sync point" as described above.
      * 
+     * If cookie is NULL, processes with a higher priority run before
+     * waiting ones with a lower priority.  Sync points ignore priority.
+     * 
      * WARNING!  Do not start_again() the proc before passing it to the
      * WvSubProcQueue.  This is done automatically in some WvSubProc
      * constructors.  Use WvSubProc::prepare() or preparev() instead.
      */
-    void add(void *cookie, WvSubProc *proc);
+    void add(void *cookie, WvSubProc *proc, int priority = 0);
     
     /**
      * Like add(cookie, proc) but you don't have to build the WvSubProc
      * yourself for simple cases.
      */
-    void add(void *cookie, const char *cmd, const char * const *argv);
+    void add(void *cookie, const char *cmd, const char * const *argv,
+	     int priority = 0);
     
     /**
      * Clean up after any running processes in the queue, and start running
@@ -111,14 +127,36 @@ public:
     /// True if there are no unfinished (ie. running *or* waiting) processes.
     bool isempty() const;
     
+    /// Return the most processes we'll run at once.
+    unsigned max_running() const
+        { return maxrunning; }
+    
+    /**
+     * An fd that becomes readable when a running process exits, so you
+     * know it's time to call go(), or -1 if we can't tell that way.  Even
+     * if there is one, check needs_polling() too.
+     */
+    int getexitfd() const
+        { return exitfd; }
+    
+    /**
+     * True if some running process can't tell us through getexitfd() when
+     * it's done (say, its main process exited but left children behind),
+     * so you have to keep calling go() every now and then to find out.
+     */
+    bool needs_polling() const
+        { return npolled > 0; }
+    
 private:
     struct Ent
     {
-	Ent(void *_cookie, WvSubProc *_proc)
+	Ent(void *_cookie, WvSubProc *_proc, int _priority)
 	{
 	    cookie = _cookie;
 	    proc = _proc;
+	    priority = _priority;
 	    redo = false;
+	    pidfd = -1;
 	}
 	
 	~Ent()
@@ -128,14 +166,22 @@ private:
 	
 	void *cookie;
 	WvSubProc *proc;
+	int priority;
 	bool redo;
+	int pidfd;
     };
     DeclareWvList(Ent);
     
     unsigned maxrunning;
     EntList runq, waitq;
+    int exitfd;
+    unsigned cookies_running, npolled;
 
-    bool cookie_running();
+    void start(Ent *e);
+    void watch(Ent *e);
+    void unwatch(Ent *e);
+    bool reap(Ent *e);
+    void retire(EntList::Iter &i);
 };
 
 
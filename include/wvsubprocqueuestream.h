@@ -10,7 +10,9 @@
 
 /**
  * A variant of WvSubProcQueue that can be added to a WvStreamList so that
- * WvSubProcQueue::go() gets called automatically at a reasonable interval.
+ * WvSubProcQueue::go() gets called automatically at a reasonable interval,
+ * and right away whenever one of its processes exits, if the queue can
+ * tell us that.
  */
 class WvSubProcQueueStream : public WvStream, public WvSubProcQueue
 {
@@ -18,6 +20,8 @@ public:
     WvSubProcQueueStream(int _maxrunning);
     virtual ~WvSubProcQueueStream();
     
+    virtual void pre_select(SelectInfo &si);
+    virtual bool post_select(SelectInfo &si);
     virtual void execute();
     
 private:
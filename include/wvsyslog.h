@@ -7,6 +7,9 @@
 #define __WVSYSLOG_H
 
 #include "wvlogrcv.h"
+#ifndef _WIN32
+#include "wvlogasync.h"
+#endif
 
 /**
  * WvSyslog is a descendant of WvLogRcv that sends messages to the syslogd
@@ -20,7 +23,25 @@ public:
 	     WvLog::LogLevel _max_level = WvLog::NUM_LOGLEVELS);
     virtual ~WvSyslog();
 
+#ifndef _WIN32
+    /**
+     * Switch to async mode: finished lines are queued (up to 'queue_size'
+     * bytes of them) and passed to syslog() by a separate thread, so a
+     * blocked syslog socket doesn't hold up the caller.  Returns false if
+     * the thread couldn't be started.
+     */
+    bool set_async(size_t queue_size = 256*1024,
+		   WvLogAsync::OverflowPolicy policy = WvLogAsync::Drop);
+
+    /// The number of lines dropped because the async queue was full.
+    unsigned long dropped() const
+        { return async ? async->dropped() : 0; }
+#endif
+
 protected:
+#ifndef _WIN32
+    WvLogAsync *async;
+#endif
     WvLog::LogLevel first_debug;
     WvDynBuf current;
     WvString syslog_prefix;
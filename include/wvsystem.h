@@ -114,6 +114,7 @@ private:
     
     void init(const char * const *argv);
     virtual int fork(int *waitfd);
+    virtual bool spawnable() const;
 };
 
 
@@ -28,8 +28,23 @@
 
 #define WVTASK_MAGIC 0x123678
 
+/* Task stacks come in sizes that are powers of two up to this */
+#define WVTASK_STACK_CLASSES (sizeof(size_t) * 8)
+
 class WvTaskMan;
 
+/**
+ * How the task stacks of one size are being used.  See
+ * WvTaskMan::get_stack_stats().
+ */
+struct WvTaskStackStats
+{
+    size_t stacksize;   // the size of each stack
+    int mapped;         // how many stacks of this size we have
+    int idle;           // how many of those no task is using
+    size_t high_water;  // the most stack any task has used, to a page
+};
+
 /** Represents a single thread of control. */
 class WvTask
 {
@@ -56,6 +71,7 @@ class WvTask
     WvTaskMan &man;
     ucontext_t mystate;	// used for resuming the task
     ucontext_t func_call, func_return;
+    void *mysp;         // ditto, when WvTaskMan switches stacks itself
     
     TaskFunc *func;
     void *userdata;
@@ -85,13 +101,14 @@ class WvTaskMan
     static int links;
     
     static int magic_number;
-    static WvTaskList all_tasks, free_tasks;
+    static WvTaskList all_tasks, free_tasks[WVTASK_STACK_CLASSES];
     
     static void get_stack(WvTask &task, size_t size);
     static void stackmaster();
     static void _stackmaster();
     static void do_task();
     static void call_func(WvTask *task);
+    static void task_main(void *userdata);
 
     static char *stacktop;
     static ucontext_t stackmaster_task;
@@ -101,6 +118,7 @@ class WvTaskMan
     
     static WvTask *current_task;
     static ucontext_t toplevel;
+    static void *toplevel_sp;
     
     WvTaskMan();
     virtual ~WvTaskMan();
@@ -129,9 +147,19 @@ public:
     static const void *current_top_of_stack();
     static size_t current_stacksize_limit();
 
+    /**
+     * Fills in up to 'max' entries of 'stats', one for each size of task
+     * stack we've used so far, and returns how many it filled in.  The
+     * high-water marks show how much of personal_stack_size your streams
+     * really need.
+     */
+    static size_t get_stack_stats(WvTaskStackStats *stats, size_t max);
+
 private:
     static WvString debugger_tasks_run_cb(WvStringParm, WvStringList &,
             WvStreamsDebugger::ResultCallback, void *);
+    static WvString debugger_stacks_run_cb(WvStringParm, WvStringList &,
+            WvStreamsDebugger::ResultCallback, void *);
 };
 
 
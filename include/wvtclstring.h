@@ -69,6 +69,10 @@ extern const WvStringMask WVTCL_SPLITCHARS;
 WvString wvtcl_escape(WvStringParm s,
 		      const WvStringMask &nasties = WVTCL_NASTY_SPACES);
 
+/** Like wvtcl_escape(), but appends the result to 'out'. */
+void wvtcl_escape(WvBuf &out, WvStringParm s,
+		  const WvStringMask &nasties = WVTCL_NASTY_SPACES);
+
 
 /**
  * tcl-unescape a string.  This is generally the reverse of wvtcl_escape,
@@ -27,14 +27,28 @@
 #include "wvfdstream.h"
 #include "wvaddr.h"
 #include "wvresolver.h"
+#include "wvtimeutils.h"
 
 
 class WvTCPListener;
+class WvTCPAttempt;
+
+DeclareWvList(WvTCPAttempt);
+
+/** default milliseconds between starting connections to each address */
+#define WVTCP_STAGGER 250
 
 /**
  * WvTCPConn tries to make all outgoing connections asynchronously (in
  * the background).  You can tell the connection has been established
  * when a select() call returns 'true' with writable==true.
+ *
+ * If a hostname has more than one address, WvTCPConn doesn't wait for
+ * each one to time out before trying the next: it starts connecting to
+ * one, then another every 'stagger' milliseconds (or right away, if one
+ * is refused), and keeps whichever answers first.  The addresses that
+ * were quickest last time go first, and ones that failed recently go
+ * last.
  */
 class WvTCPConn : public WvFDStream
 {
@@ -45,6 +59,9 @@ protected:
     bool incoming;
     WvIPPortAddr remaddr;
     WvResolver dns;
+    WvTCPAttemptList *candidates;
+    WvTime next_start;
+    int numtried;
     
     /** Start a WvTCPConn on an already-open socket (used by WvTCPListener) */
     WvTCPConn(int _fd, const WvIPPortAddr &_remaddr);
@@ -55,6 +72,18 @@ protected:
     /** Resolve the remote address, if it was fed in non-IP form */
     void check_resolver();
     
+    /** Race connections to each of 'addrs', best first */
+    void start_race(const WvIPAddrList &addrs);
+    
+    /** Start connecting to the next address in the race, if any */
+    void start_next();
+    
+    /** The connection to 'a' won the race; use it and drop the others */
+    void win(WvTCPAttempt *a);
+    
+    /** Stop all the connections still racing */
+    void drop_race();
+    
 public:
    /**
     * WvTCPConn tries to make all outgoing connections asynchronously (in
@@ -66,6 +95,9 @@ public:
     /** Resolve the hostname, then connect a new socket */
     WvTCPConn(WvStringParm _hostname, uint16_t _port = 0);
 
+    /** Connect to 'port' on whichever of 'addrs' answers first */
+    WvTCPConn(const WvIPAddrList &addrs, uint16_t port);
+
     /**
      * Destructor - rarely do you need to call this - close()
      * is a much better way to tear down a TCP Stream ;)
@@ -107,6 +139,17 @@ public:
     bool isconnected() const
         { return connected; }
     
+    /** the number of addresses we've tried connecting to so far */
+    int connect_attempts() const
+        { return numtried; }
+    
+    /**
+     * Start a connection to the next address every 'msec' milliseconds
+     * while racing, in all WvTCPConns.  The default is WVTCP_STAGGER.
+     */
+    static void set_stagger(time_t msec)
+        { stagger = msec; }
+    
     /** override pre_select() to cause select() results when resolving names. */
     virtual void pre_select(SelectInfo &si);
     
@@ -121,10 +164,15 @@ public:
      * Note: isok() will always be true if !resolved, even though fd==-1.
      */
     virtual bool isok() const;
+    
+    virtual void close();
 
 protected:
     virtual size_t uwrite(const void *buf, size_t count);
 
+private:
+    static time_t stagger;
+
 public:
     const char *wstype() const { return "WvTCPConn"; }
 };
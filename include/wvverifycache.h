@@ -0,0 +1,163 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Remembers the results of certificate, CRL and OCSP checks.
+ */
+#ifndef __WVVERIFYCACHE_H
+#define __WVVERIFYCACHE_H
+
+#include "wvcrl.h"
+#include "wvhashtable.h"
+#include "wvocsp.h"
+#include "wvtr1.h"
+#include "wvx509.h"
+
+class WvWorkerPool;
+
+/**
+ * Checking a certificate chain means an RSA signature verification for
+ * every link, and a busy server sees the same few CA certificates (and
+ * the same CRLs and OCSP answers) over and over.  WvVerifyCache remembers
+ * each answer, keyed by the SHA-1 fingerprints of what was checked, so
+ * each signature only gets verified once:
+ *
+ *  - certificate signatures are remembered for 'ttl' seconds, or until
+ *    either certificate expires;
+ *  - CRL checks are remembered until the CRL's nextUpdate;
+ *  - OCSP answers are remembered until the response's nextUpdate.
+ *
+ * Failed checks are only remembered for 'negative_ttl' seconds.
+ *
+ * The cache itself isn't thread-safe; use it from one thread.  If you
+ * give it a WvWorkerPool, the asynchronous validate() does the actual
+ * RSA work on the pool's threads.
+ */
+class WvVerifyCache
+{
+public:
+    WvVerifyCache(WvWorkerPool *_pool = NULL, int _max_entries = 4096);
+    ~WvVerifyCache();
+
+    /// The longest, in seconds, that a good answer is remembered.
+    int ttl;
+
+    /// How long, in seconds, a bad answer is remembered.
+    int negative_ttl;
+
+    /**
+     * The cache WvX509::validate() uses for its signature checks.  It has
+     * no worker pool, and like the rest of WvStreams, it expects to be
+     * used from one thread.
+     */
+    static WvVerifyCache &shared();
+
+    /**
+     * Same as cert.validate(cacert), except that the signature check is
+     * only done once.  The validity dates are checked every time.
+     */
+    bool validate(const WvX509 &cert, const WvX509 *cacert = NULL);
+
+    /**
+     * Same as cert.signedbyca(cacert) && cert.issuedbyca(cacert), but
+     * only done once.
+     */
+    bool signedbyca(const WvX509 &cert, const WvX509 &cacert);
+
+    typedef wv::function<void(bool)> Callback;
+
+    /**
+     * Same as validate(), but calls 'cb' with the answer instead of
+     * returning it.  If the answer isn't in the cache, the signature is
+     * checked on the worker pool, and 'cb' is called from the pool's
+     * callback(); otherwise, 'cb' is called before this returns.  Any
+     * number of requests for the same certificate share one check.
+     */
+    void validate(const WvX509 &cert, const WvX509 &cacert,
+		  const Callback &cb);
+
+    /** Same as crl.validate(cacert), but only done once per CRL. */
+    WvCRL::Valid validate(const WvCRL &crl, const WvX509 &cacert);
+
+    /**
+     * Checks that 'resp' was signed by 'signer', then returns
+     * resp.get_status(cert, issuer), remembering the answer for
+     * cached_ocsp().
+     */
+    WvOCSPResp::Status check_ocsp(const WvOCSPResp &resp,
+				  const WvX509 &signer,
+				  const WvX509 &cert, const WvX509 &issuer);
+
+    /**
+     * If check_ocsp() gave us an answer for 'cert' that's still current,
+     * put it in 'status' and return true, so you don't need to ask the
+     * OCSP responder again.
+     */
+    bool cached_ocsp(const WvX509 &cert, const WvX509 &issuer,
+		     WvOCSPResp::Status &status);
+
+    /** Forget everything. */
+    void zap();
+
+    size_t count() const
+        { return entries.count(); }
+
+    /// How many checks were answered from the cache, and how many weren't.
+    unsigned long hits, misses;
+
+private:
+    struct Entry
+    {
+	WvString key;
+	int result;
+	time_t expires;
+
+	Entry(WvStringParm _key, int _result, time_t _expires)
+	    : key(_key), result(_result), expires(_expires) {}
+    };
+    DeclareWvDict(Entry, WvString, key);
+
+    struct Waiter
+    {
+	Callback cb;
+
+	Waiter(const Callback &_cb) : cb(_cb) {}
+    };
+    DeclareWvList(Waiter);
+
+    // A signature check running on the worker pool.  The pool's job
+    // owns it, so it goes away with the job, even if the pool is
+    // destroyed before the 'done' function gets to run.
+    struct Pending
+    {
+	WvString key;
+	WvVerifyCache *cache; // NULL if the cache went away first
+	X509 *cert, *cacert;
+	bool result;
+	time_t expires;
+	WaiterList waiters;
+
+	Pending(WvStringParm _key) : key(_key), cache(NULL),
+	    cert(NULL), cacert(NULL), result(false), expires(0) {}
+	~Pending();
+    };
+    DeclareWvDict(Pending, WvString, key);
+    typedef wv::shared_ptr<Pending> PendingPtr;
+
+    WvWorkerPool *pool;
+    int max_entries;
+    EntryDict entries;
+    PendingDict pending;
+
+    bool lookup(WvStringParm key, int &result);
+    void store(WvStringParm key, int result, time_t expires);
+    time_t sig_expiry(const WvX509 &cert, const WvX509 &cacert,
+		      bool result) const;
+    static WvString crl_fingerprint(const WvCRL &crl);
+
+    static bool check_sig(X509 *cert, X509 *cacert);
+    static void run_pending(PendingPtr p);
+    static void pending_done(PendingPtr p);
+};
+
+#endif // __WVVERIFYCACHE_H
@@ -0,0 +1,103 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A pool of worker threads for CPU-heavy jobs, whose results are handed
+ * back to the main event loop.
+ */
+#ifndef __WVWORKERPOOL_H
+#define __WVWORKERPOOL_H
+
+#include "wvfdstream.h"
+#include "wvlinklist.h"
+#include <pthread.h>
+
+/** Runs on one of the worker threads. */
+typedef wv::function<void()> WvWorkerJob;
+
+/** Runs on the thread that owns the WvWorkerPool, once the job is done. */
+typedef wv::function<void()> WvWorkerDone;
+
+/**
+ * WvWorkerPool runs jobs on a fixed set of threads, so that things like
+ * RSA operations or compression don't stall the event loop.
+ *
+ * Add the pool to your WvIStreamList like any other stream.  Each job you
+ * add() runs on some worker thread; after it finishes, the pool becomes
+ * readable, and its callback() runs the job's 'done' function on your
+ * thread.  That's where the result should be used, since most of
+ * WvStreams (WvLog included) isn't safe to call from the workers.
+ *
+ * Jobs run in roughly the order they were added, but with more than one
+ * thread they can finish in any order.
+ */
+class WvWorkerPool : public WvFdStream
+{
+public:
+    /**
+     * Start 'nthreads' worker threads, or one per CPU if it's 0.
+     */
+    WvWorkerPool(int nthreads = 0);
+
+    /**
+     * Waits for the jobs that are running right now, and throws away the
+     * ones that haven't started.  Their 'done' functions aren't called.
+     */
+    virtual ~WvWorkerPool();
+
+    /** The number of worker threads that actually started. */
+    int threads() const
+        { return nthreads; }
+
+    /**
+     * Queue 'job' for one of the workers, and call 'done' (if set) from
+     * callback() once it's finished.  If there are no worker threads,
+     * the job runs right away instead, but 'done' still waits for
+     * callback().
+     */
+    void add(const WvWorkerJob &job, const WvWorkerDone &done = 0);
+
+    /**
+     * The number of jobs that were added but whose 'done' function hasn't
+     * run yet.
+     */
+    size_t pending() const
+        { return npending; }
+
+    /**
+     * Wait for every job to finish, and run all their 'done' functions.
+     * Mostly useful in tests and when shutting down.
+     */
+    void finish();
+
+    /** Run the 'done' function of every job that has finished. */
+    virtual void execute();
+
+private:
+    struct Job
+    {
+	WvWorkerJob job;
+	WvWorkerDone done;
+
+	Job(const WvWorkerJob &_job, const WvWorkerDone &_done)
+	    : job(_job), done(_done) {}
+    };
+    DeclareWvList(Job);
+
+    int nthreads;
+    pthread_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t wake, progress;
+    JobList queue, finished; // protected by 'lock'
+    int running;             // protected by 'lock'
+    bool want_stop;          // protected by 'lock'
+    int wakefd;              // the write end of our pipe
+    size_t npending;         // only used by the owning thread
+
+    void deliver();
+
+    static void *thread_main(void *userdata);
+    void run();
+};
+
+#endif // __WVWORKERPOOL_H
@@ -33,6 +33,15 @@ void wvssl_init();
 void wvssl_free();
 WvString wvssl_errstr();
 
+// OpenSSL 1.1 and up are thread-safe by themselves; older versions need
+// locking callbacks, which this installs (unless the program already did).
+// Call it before handing OpenSSL objects to other threads.
+void wvssl_threads_init();
+
+// convert an ASN1 UTCTime or GeneralizedTime to a time_t (which is
+// always UTC); returns 0 if it can't be parsed.
+time_t wvssl_asn1_time(const ASN1_TIME *t);
+
 
 /**
  * X509 Class to handle certificates and their related
@@ -107,7 +116,8 @@ public:
      * Function to verify the validity of a certificate that has been
      * placed in cert. It checks and make sure that it was signed by
      * the CA certificate cacert, as well as that it is not expired (or
-     * not yet valid).
+     * not yet valid).  The signature check's answer is remembered by
+     * WvVerifyCache::shared().
      */
     bool validate(WvX509 *cacert = NULL) const;
 
@@ -360,6 +370,7 @@ private:
     friend class WvX509Mgr;
     friend class WvOCSPReq;
     friend class WvOCSPResp;
+    friend class WvVerifyCache;
 
     /** X.509v3 Certificate - this is why this class exists */
     X509     *cert;
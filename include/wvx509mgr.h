@@ -11,6 +11,16 @@
 #include "wvx509.h"
 #include "wvcrl.h"
 
+class WvWorkerPool;
+struct evp_pkey_st;
+typedef struct evp_pkey_st EVP_PKEY;
+
+/** Tells you whether an asynchronous WvX509Mgr::signcert() worked. */
+typedef wv::function<void(bool)> WvX509SignedCallback;
+
+/** Gets the signature from an asynchronous WvX509Mgr::sign(). */
+typedef wv::function<void(WvStringParm)> WvX509SignatureCallback;
+
 class WvX509Mgr : public WvX509
 {
   public:
@@ -109,6 +119,14 @@ public:
      */
     bool signcert(WvX509 &unsignedcert) const;
 
+    /**
+     * Same as signcert(unsignedcert), but the signing happens on one of
+     * the threads of 'pool', and 'cb' gets the result from the pool's
+     * callback.  Don't touch (or delete) unsignedcert until then.
+     */
+    void signcert(WvX509 &unsignedcert, WvWorkerPool &pool,
+		  const WvX509SignedCallback &cb) const;
+
     /**
      * Sign the CRL with the rsa key associated with this class. This method
      * will also update the lastUpdate time, and set the CRL's validity period 
@@ -130,6 +148,14 @@ public:
     WvString sign(WvBuf &data) const;
     WvString sign(WvStringParm data) const;
 
+    /**
+     * Same as sign(data), but the signing happens on one of the threads
+     * of 'pool', and 'cb' gets the signature (or WvString::null, if it
+     * failed) from the pool's callback.  'data' is copied right away.
+     */
+    void sign(WvBuf &data, WvWorkerPool &pool,
+	      const WvX509SignatureCallback &cb) const;
+
     /**
      * Encodes the information requested by mode into a buffer.
      */
@@ -164,6 +190,8 @@ public:
     void read_p12(WvStringParm _fname, WvStringParm _pkcs12pass);
 
   private:
+    EVP_PKEY *signing_key(const WvX509 &unsignedcert) const;
+
     /**
      * The Public and Private RSA keypair associated with the certificate
      * Make sure that you save this somewhere!!! If you don't, then you won't
@@ -0,0 +1,83 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Zstandard encoder/decoder based on libzstd.
+ */
+#ifndef __WVZSTD_H
+#define __WVZSTD_H
+
+#include "wvencoder.h"
+
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+/**
+ * An encoder implementing Zstandard compression and decompression.  At
+ * its lower levels, zstd compresses about as well as gzip in a fraction
+ * of the time.
+ *
+ * When compressing:
+ *
+ *  - On flush(), everything compressed so far is written out, so that
+ *     the other end can decompress it right away.
+ *
+ *  - On finish(), the frame is ended, and the encoder stays finished
+ *     until reset(), which starts a new frame.
+ *
+ * When decompressing:
+ *
+ *  - The encoder will transition to isfinished() == true on its own
+ *     at the end of a frame.  Whatever follows it in the input is left
+ *     there.
+ *
+ * Both ends can share a dictionary (see set_dictionary()), which helps a
+ * lot when the stream is a series of small, similar messages.
+ */
+class WvZstdEncoder : public WvEncoder
+{
+public:
+    enum Mode {
+        Compress,  /*!< Compress using zstd */
+        Decompress /*!< Decompress using zstd */
+    };
+
+    /**
+     * Creates a zstd encoder.
+     *
+     * "mode" is the compression mode.  "level" is the compression level,
+     * from 1 (fastest) to 19; negative levels are faster still.  The
+     * decompressor ignores it.
+     */
+    WvZstdEncoder(Mode mode, int level = 1);
+    virtual ~WvZstdEncoder();
+
+    /**
+     * Use the 'len' bytes at 'dict' as a dictionary: either one made by
+     * "zstd --train", or just a sample of the sort of data we expect to
+     * see.  Both ends have to use the same one.  The encoder is reset().
+     * Pass NULL to stop using one.
+     */
+    void set_dictionary(const void *dict, size_t len);
+
+protected:
+    virtual bool _encode(WvBuf &inbuf, WvBuf &outbuf, bool flush);
+    virtual bool _finish(WvBuf &outbuf);
+    virtual bool _reset();
+
+private:
+    Mode mode;
+    int level;
+    struct ZSTD_CCtx_s *cctx;
+    struct ZSTD_DCtx_s *dctx;
+    struct ZSTD_CDict_s *cdict;
+    struct ZSTD_DDict_s *ddict;
+
+    bool compress(WvBuf &outbuf, const void *data, size_t len, int op);
+    bool decompress(WvBuf &inbuf, WvBuf &outbuf);
+    bool check(size_t result);
+};
+
+#endif // __WVZSTD_H
@@ -0,0 +1,53 @@
+/* -*- Mode: C++ -*-
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A Zstandard stream.
+ */
+#ifndef __WVZSTDSTREAM_H
+#define __WVZSTDSTREAM_H
+
+#include "wvencoderstream.h"
+#include "wvzstd.h"
+
+/**
+ * A stream implementing Zstandard compression and decompression: written
+ * data is compressed, and read data is decompressed.
+ *
+ * You can also get one with the "zstd:" moniker, the same way as "gzip:".
+ *
+ * @see WvZstdEncoder
+ */
+class WvZstdStream : public WvEncoderStream
+{
+public:
+    WvZstdStream(WvStream *_cloned, int level = 1)
+        : WvEncoderStream(_cloned)
+	{
+	    reader = new WvZstdEncoder(WvZstdEncoder::Decompress);
+	    writer = new WvZstdEncoder(WvZstdEncoder::Compress, level);
+	    readchain.append(reader, true);
+	    writechain.append(writer, true);
+	}
+    virtual ~WvZstdStream() { }
+
+    /**
+     * Use a shared dictionary in both directions; the other end has to
+     * use the same one.  See WvZstdEncoder::set_dictionary().  Do this
+     * before reading or writing anything.
+     */
+    void set_dictionary(const void *dict, size_t len)
+	{
+	    reader->set_dictionary(dict, len);
+	    writer->set_dictionary(dict, len);
+	}
+
+private:
+    WvZstdEncoder *reader, *writer;
+
+public:
+    const char *wstype() const { return "WvZstdStream"; }
+};
+
+
+#endif /* __WVZSTDSTREAM_H */
@@ -0,0 +1,334 @@
+#include "wvdnsstream.h"
+#include "wvresolver.h"
+#include "wvfile.h"
+#include "wvtest.h"
+#include <unistd.h>
+
+// A pretend nameserver, listening on a random port on localhost:
+//   www.example.com    two addresses, good for 300 and 100 seconds
+//   alias.example.com  a CNAME for www2.example.com, good for 50 seconds
+//   host.search.test   one address
+//   slow.example.com   one address, but only if you ask twice
+//   broken.example.com SERVFAIL
+//   anything else      NXDOMAIN, remembered for 30 seconds
+class FakeDNS
+{
+public:
+    WvUDPStream sock;
+    int queries, slow_queries;
+
+    FakeDNS() : sock(WvIPPortAddr("127.0.0.1", 0), WvIPPortAddr())
+        { queries = slow_queries = 0; }
+
+    WvIPPortAddr addr()
+        { return *(const WvIPPortAddr *)sock.local(); }
+
+    static void put16(WvBuf &buf, unsigned int x)
+        { buf.putch(x >> 8); buf.putch(x & 0xff); }
+
+    static void put32(WvBuf &buf, unsigned long x)
+        { put16(buf, x >> 16); put16(buf, x & 0xffff); }
+
+    static void put_name(WvBuf &buf, WvStringParm name)
+    {
+        WvStringList labels;
+        labels.split(name, ".");
+        WvStringList::Iter i(labels);
+        for (i.rewind(); i.next(); )
+        {
+            buf.putch(i->len());
+            buf.putstr(*i);
+        }
+        buf.putch(0);
+    }
+
+    static void put_a(WvBuf &buf, const char *ip, unsigned long ttl)
+    {
+        put16(buf, 1);
+        put16(buf, 1);
+        put32(buf, ttl);
+        put16(buf, 4);
+        WvIPAddr addr(ip);
+        buf.put(addr.binaddr, 4);
+    }
+
+    void serve()
+    {
+        unsigned char pkt[512];
+        size_t len;
+        while (sock.select(0, true, false)
+               && (len = sock.read(pkt, sizeof(pkt))) > 12)
+        {
+            queries++;
+
+            // the question is the name, then four bytes of type and class
+            WvString name;
+            size_t pos = 12;
+            while (pkt[pos])
+            {
+                WvString label;
+                label.setsize(pkt[pos] + 1);
+                memcpy(label.edit(), pkt + pos + 1, pkt[pos]);
+                label.edit()[pkt[pos]] = 0;
+                name = !name ? label : WvString("%s.%s", name, label);
+                pos += pkt[pos] + 1;
+            }
+            size_t qend = pos + 5;
+
+            WvDynBuf answers;
+            int rcode = 0, ancount = 0, nscount = 0;
+            if (name == "www.example.com")
+            {
+                answers.put("\xc0\x0c", 2);
+                put_a(answers, "10.0.0.1", 300);
+                answers.put("\xc0\x0c", 2);
+                put_a(answers, "10.0.0.2", 100);
+                ancount = 2;
+            }
+            else if (name == "alias.example.com")
+            {
+                WvDynBuf target;
+                put_name(target, "www2.example.com");
+                answers.put("\xc0\x0c", 2);
+                put16(answers, 5);
+                put16(answers, 1);
+                put32(answers, 50);
+                put16(answers, target.used());
+                answers.put(target.peek(0, target.used()), target.used());
+                put_name(answers, "www2.example.com");
+                put_a(answers, "10.0.0.3", 300);
+                ancount = 2;
+            }
+            else if (name == "host.search.test")
+            {
+                answers.put("\xc0\x0c", 2);
+                put_a(answers, "10.0.0.4", 300);
+                ancount = 1;
+            }
+            else if (name == "slow.example.com")
+            {
+                if (!slow_queries++)
+                    continue; // pretend the packet got lost
+                answers.put("\xc0\x0c", 2);
+                put_a(answers, "10.0.0.5", 300);
+                ancount = 1;
+            }
+            else if (name == "broken.example.com")
+                rcode = 2;
+            else
+            {
+                // NXDOMAIN, with an SOA saying how long that lasts
+                rcode = 3;
+                answers.put("\xc0\x0c", 2);
+                put16(answers, 6);
+                put16(answers, 1);
+                put32(answers, 3600);
+                WvDynBuf soa;
+                put_name(soa, "ns.example.com");
+                put_name(soa, "root.example.com");
+                put32(soa, 1);
+                put32(soa, 7200);
+                put32(soa, 900);
+                put32(soa, 86400);
+                put32(soa, 30);
+                put16(answers, soa.used());
+                answers.put(soa.peek(0, soa.used()), soa.used());
+                nscount = 1;
+            }
+
+            WvDynBuf reply;
+            reply.put(pkt, 2);
+            put16(reply, 0x8180 | rcode);
+            put16(reply, 1);
+            put16(reply, ancount);
+            put16(reply, nscount);
+            put16(reply, 0);
+            reply.put(pkt + 12, qend - 12);
+            reply.merge(answers);
+            len = reply.used();
+            sock.write(reply.get(len), len);
+        }
+    }
+};
+
+
+struct Answer
+{
+    int count, ttl;
+    WvString name, addrs;
+
+    Answer() : count(0), ttl(-2) { }
+};
+
+
+static void got(Answer &a, WvStringParm name, WvIPAddrList &addrs, int ttl)
+{
+    a.count++;
+    a.name = name;
+    a.ttl = ttl;
+    a.addrs = "";
+    WvIPAddrList::Iter i(addrs);
+    for (i.rewind(); i.next(); )
+        a.addrs.append("%s%s", !a.addrs ? "" : " ", *i);
+}
+
+
+static void run(WvDNSStream &dns, FakeDNS &server)
+{
+    for (int i = 0; i < 500 && dns.pending(); i++)
+    {
+        server.serve();
+        if (dns.select(10))
+            dns.callback();
+    }
+}
+
+
+WVTEST_MAIN("dns lookups")
+{
+    FakeDNS server;
+    WVPASS(server.sock.isok());
+    WvDNSStream dns(WvString::null, WvString::null);
+    dns.add_nameserver(server.addr());
+    WVPASSEQ(dns.num_nameservers(), 1);
+
+    // the same name, twice at once, only gets asked about once
+    Answer a, b, c, d;
+    dns.lookup("www.example.com", wv::bind(&got, wv::ref(a), _1, _2, _3));
+    dns.lookup("WWW.Example.COM", wv::bind(&got, wv::ref(b), _1, _2, _3));
+    dns.lookup("alias.example.com.",
+               wv::bind(&got, wv::ref(c), _1, _2, _3));
+    dns.lookup("nowhere.example.com",
+               wv::bind(&got, wv::ref(d), _1, _2, _3));
+    WVPASSEQ(dns.pending(), 3);
+    run(dns, server);
+    WVPASSEQ(dns.pending(), 0);
+    WVPASSEQ(server.queries, 3);
+    WVPASSEQ(dns.queries_sent(), 3);
+
+    WVPASSEQ(a.count, 1);
+    WVPASSEQ(a.addrs, "10.0.0.1 10.0.0.2");
+    WVPASSEQ(a.ttl, 100);
+    WVPASSEQ(b.count, 1);
+    WVPASSEQ(b.name, "WWW.Example.COM");
+    WVPASSEQ(b.addrs, a.addrs);
+
+    WVPASSEQ(c.addrs, "10.0.0.3");
+    WVPASSEQ(c.ttl, 50);
+
+    WVPASSEQ(d.count, 1);
+    WVPASSEQ(d.addrs, "");
+    WVPASSEQ(d.ttl, 30);
+
+    // addresses don't need looking up at all
+    Answer e, f;
+    dns.lookup("10.1.2.3", wv::bind(&got, wv::ref(e), _1, _2, _3));
+    WVPASSEQ(e.count, 1);
+    WVPASSEQ(e.addrs, "10.1.2.3");
+    WVPASS(e.ttl > 0);
+    WVPASSEQ(dns.pending(), 0);
+    WVPASSEQ(server.queries, 3);
+
+    // once everything's answered, the next query comes from a new port
+    WvIPPortAddr oldport(*(const WvIPPortAddr *)dns.local());
+    dns.lookup("www.example.com", wv::bind(&got, wv::ref(f), _1, _2, _3));
+    WVPASS(*(const WvIPPortAddr *)dns.local() != oldport);
+    run(dns, server);
+    WVPASSEQ(f.addrs, "10.0.0.1 10.0.0.2");
+    WVPASSEQ(server.queries, 4);
+}
+
+
+WVTEST_MAIN("dns retries")
+{
+    FakeDNS server, dead;
+    WvDNSStream dns(WvString::null, WvString::null);
+    dns.add_nameserver(dead.addr());
+    dns.add_nameserver(server.addr());
+    dns.set_retry(50, 2);
+
+    // the dead one never answers, so we go on to the next one
+    Answer a, b, c;
+    dns.lookup("www.example.com", wv::bind(&got, wv::ref(a), _1, _2, _3));
+    run(dns, server);
+    WVPASSEQ(a.addrs, "10.0.0.1 10.0.0.2");
+
+    // if the answer gets lost, we ask again
+    dns.lookup("slow.example.com", wv::bind(&got, wv::ref(b), _1, _2, _3));
+    run(dns, server);
+    WVPASSEQ(b.addrs, "10.0.0.5");
+    WVPASSEQ(server.slow_queries, 2);
+
+    // a nameserver that's having trouble is as good as none at all
+    dns.lookup("broken.example.com",
+               wv::bind(&got, wv::ref(c), _1, _2, _3));
+    run(dns, server);
+    WVPASSEQ(c.count, 1);
+    WVPASSEQ(c.addrs, "");
+    WVPASSEQ(c.ttl, -1);
+}
+
+
+WVTEST_MAIN("dns config files")
+{
+    WvString conf("/tmp/wvdnsstream-%s.conf", getpid());
+    WvString hosts("/tmp/wvdnsstream-%s.hosts", getpid());
+    {
+        WvFile f(conf, O_WRONLY | O_CREAT | O_TRUNC);
+        f.print("# a comment\n"
+                "nameserver 10.1.2.3\n"
+                "nameserver ::1\n"
+                "search search.test other.test\n"
+                "options ndots:2 timeout:1 attempts:3\n");
+        WvFile h(hosts, O_WRONLY | O_CREAT | O_TRUNC);
+        h.print("127.0.0.1 localhost\n"
+                "10.9.9.9  Mailhost mail # the mail server\n"
+                "::1 ip6-localhost\n");
+    }
+
+    FakeDNS server;
+    WvDNSStream dns(conf, hosts);
+    WVPASSEQ(dns.num_nameservers(), 1);
+
+    // /etc/hosts answers right away
+    Answer a, b;
+    dns.lookup("mailhost", wv::bind(&got, wv::ref(a), _1, _2, _3));
+    WVPASSEQ(a.count, 1);
+    WVPASSEQ(a.addrs, "10.9.9.9");
+
+    // with ndots:2, "host" gets the search domains first
+    WvDNSStream dns2(conf, WvString::null);
+    dns2.add_nameserver(server.addr());
+    dns2.lookup("host", wv::bind(&got, wv::ref(b), _1, _2, _3));
+    run(dns2, server);
+    WVPASSEQ(b.addrs, "10.0.0.4");
+    WVPASSEQ(server.queries, 1);
+
+    unlink(conf);
+    unlink(hosts);
+}
+
+
+WVTEST_MAIN("resolver")
+{
+    // localhost should be in /etc/hosts just about everywhere
+    WvResolver dns;
+    const WvIPAddr *addr = NULL;
+    WvIPAddrList list;
+    int res = dns.findaddr(-1, "localhost", &addr, &list);
+    WVPASS(res > 0);
+    if (res > 0)
+    {
+        WVPASSEQ(WvString(*addr), "127.0.0.1");
+        WVPASSEQ(list.count(), (size_t)res);
+    }
+
+    // and now it's in the cache
+    WVPASSEQ(dns.findaddr(0, "localhost", &addr), res);
+
+    // addresses come straight back, without waiting for anybody
+    list.zap();
+    WVPASSEQ(dns.findaddr(0, "192.168.1.2", &addr, &list), 1);
+    WVPASSEQ(WvString(*addr), "192.168.1.2");
+    WVPASSEQ(list.count(), 1);
+}
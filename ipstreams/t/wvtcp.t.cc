@@ -100,3 +100,99 @@ WVTEST_MAIN("connection refused 2")
     WVPASSEQ(tcp.geterr(), ECONNREFUSED);
     printf("Error string is '%s'\n", tcp.errstr().cstr());
 }
+
+
+static WvIPAddrList *addrlist(const char *a, const char *b)
+{
+    WvIPAddrList *l = new WvIPAddrList;
+    l->append(new WvIPAddr(a), true);
+    l->append(new WvIPAddr(b), true);
+    return l;
+}
+
+
+WVTEST_MAIN("racing connections")
+{
+    // only 127.0.0.1 is listening; 127.0.0.2 refuses
+    WvTCPListener listen("127.0.0.1:0");
+    WVPASS(listen.isok());
+    WvIPPortAddr port(*listen.src());
+    WvIPAddrList *addrs = addrlist("127.0.0.2", "127.0.0.1");
+    
+    WvTCPConn tcp(*addrs, port.port);
+    for (int i = 0; i < 10 && !tcp.isconnected(); i++)
+	tcp.runonce(100);
+    WVPASS(tcp.isconnected());
+    WVPASS(tcp.isok());
+    WVPASSEQ(WvString(*tcp.src()), WvString(port));
+    WVPASSEQ(tcp.connect_attempts(), 2);
+    
+    // now we know better than to try 127.0.0.2 first
+    WvTCPConn tcp2(*addrs, port.port);
+    for (int i = 0; i < 10 && !tcp2.isconnected(); i++)
+	tcp2.runonce(100);
+    WVPASS(tcp2.isok());
+    WVPASSEQ(WvString(*tcp2.src()), WvString(port));
+    WVPASSEQ(tcp2.connect_attempts(), 1);
+    
+    delete addrs;
+}
+
+
+WVTEST_MAIN("racing connections all refused")
+{
+    WvTCPListener listen("127.0.0.1:0");
+    WvIPPortAddr port(*listen.src());
+    listen.close();
+    WvIPAddrList *addrs = addrlist("127.0.0.3", "127.0.0.4");
+    
+    WvTCPConn tcp(*addrs, port.port);
+    for (int i = 0; i < 10 && !tcp.isconnected(); i++)
+	tcp.runonce(100);
+    WVPASS(tcp.isconnected());
+    WVFAIL(tcp.isok());
+    WVPASSEQ(tcp.geterr(), ECONNREFUSED);
+    WVPASSEQ(tcp.connect_attempts(), 2);
+    
+    delete addrs;
+}
+
+
+WVTEST_MAIN("racing past a stalled address")
+{
+    // a listener that never accepts ignores new connections once its
+    // queue is full, so connecting to it just hangs
+    WvTCPListener stall("127.0.0.5:0");
+    WvIPPortAddr port(*stall.src());
+    WvTCPListener listen(WvIPPortAddr("127.0.0.6", port.port));
+    WVPASS(listen.isok());
+    WvTCPConn *fill[8];
+    for (int i = 0; i < 8; i++)
+	fill[i] = new WvTCPConn(port);
+    for (int i = 0; i < 8; i++)
+	fill[i]->runonce(10);
+    
+    WvIPAddrList *addrs = addrlist("127.0.0.5", "127.0.0.6");
+    WvTCPConn::set_stagger(50);
+    WvTime start = wvtime();
+    WvTCPConn tcp(*addrs, port.port);
+    for (int i = 0; i < 20 && !tcp.isconnected(); i++)
+	tcp.runonce(100);
+    WVPASS(tcp.isok());
+    WVPASSEQ(WvString(*tcp.src()),
+	     WvString(WvIPPortAddr("127.0.0.6", port.port)));
+    WVPASSEQ(tcp.connect_attempts(), 2);
+    WVPASS(msecdiff(wvtime(), start) < 1000);
+    
+    // the stalled one was slow, so it goes second now
+    WvTCPConn tcp2(*addrs, port.port);
+    for (int i = 0; i < 20 && !tcp2.isconnected(); i++)
+	tcp2.runonce(100);
+    WVPASS(tcp2.isok());
+    WVPASSEQ(tcp2.connect_attempts(), 1);
+    WvTCPConn::set_stagger(WVTCP_STAGGER);
+    
+    for (int i = 0; i < 8; i++)
+	delete fill[i];
+    delete addrs;
+}
@@ -0,0 +1,795 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A stub DNS resolver that looks up host names without blocking.  See
+ * wvdnsstream.h.
+ */
+#include "wvdnsstream.h"
+#include "wvfile.h"
+#include "wvstringlist.h"
+#include "wvstrutils.h"
+#include <ctype.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include "streams.h"
+#else
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define DNS_PORT 53
+#define DNS_MAXPACKET 512   // the most we can get over UDP without EDNS
+#define DNS_MAXNAME 255
+#define DNS_MAXCNAMES 8     // how far we'll follow a chain of CNAMEs
+
+#define DNS_TYPE_A 1
+#define DNS_TYPE_CNAME 5
+#define DNS_TYPE_SOA 6
+#define DNS_CLASS_IN 1
+
+#define DNS_QR 0x8000       // it's a response
+#define DNS_TC 0x0200       // it was truncated
+#define DNS_RD 0x0100       // please recurse
+#define DNS_RCODE 0x000f
+#define DNS_NOERROR 0
+#define DNS_NXDOMAIN 3
+
+#define HOSTS_TTL 60        // how long answers from /etc/hosts are good for
+#define BLOCKING_TTL 300    // ...and answers from gethostbyname()
+#define LITERAL_TTL 86400   // ...and names that are already addresses
+
+#define REBIND_TRIES 8      // random source ports to try before giving up
+
+
+/** Someone who wants to know, and what they called the name. */
+struct WvDNSWaiter
+{
+    WvString name;
+    WvDNSStream::Callback cb;
+
+    WvDNSWaiter(WvStringParm _name, const WvDNSStream::Callback &_cb) :
+        name(_name), cb(_cb)
+        { }
+};
+
+
+/** One name we're looking up, and everyone who wants to know about it. */
+class WvDNSQuery
+{
+public:
+    WvString name; // lowercase, and the key in the queries dict
+    WvStringList candidates; // the names to ask about, in order
+    WvString asking; // the one we're asking about now
+    WvList<WvDNSWaiter> waiters;
+    unsigned short id;
+    int server, tries, neg_ttl;
+    WvTime deadline;
+
+    WvDNSQuery(WvStringParm _name) : name(_name)
+        { server = tries = 0; neg_ttl = -1; id = 0; }
+};
+
+
+/** The addresses for one name in /etc/hosts. */
+class WvDNSHostsEntry
+{
+public:
+    WvString name;
+    WvIPAddrList addrs;
+
+    WvDNSHostsEntry(WvStringParm _name) : name(_name)
+        { }
+};
+
+
+static WvString lowercase(WvStringParm s)
+{
+    WvString ret(s);
+    strlwr(ret.edit());
+    return ret;
+}
+
+
+static unsigned int get16(const unsigned char *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+
+static unsigned long get32(const unsigned char *p)
+{
+    return ((unsigned long)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+
+// Read the (possibly compressed) name at pkt[pos], and move pos past it.
+// Returns null if it's garbled.
+static WvString read_name(const unsigned char *pkt, size_t len, size_t &pos)
+{
+    char name[DNS_MAXNAME + 2];
+    size_t namelen = 0, p = pos;
+    int jumps = 0;
+    bool jumped = false;
+
+    for (;;)
+    {
+	if (p >= len)
+	    return WvString::null;
+	unsigned int c = pkt[p];
+	if ((c & 0xc0) == 0xc0)
+	{
+	    // a pointer to the rest of the name, somewhere earlier
+	    if (p + 1 >= len || ++jumps > 16)
+		return WvString::null;
+	    if (!jumped)
+		pos = p + 2;
+	    jumped = true;
+	    p = get16(pkt + p) & 0x3fff;
+	    continue;
+	}
+	if (c & 0xc0)
+	    return WvString::null; // some label type we don't know
+	p++;
+	if (!c)
+	    break;
+	if (p + c > len || namelen + c + 1 > DNS_MAXNAME)
+	    return WvString::null;
+	if (namelen)
+	    name[namelen++] = '.';
+	for (unsigned int i = 0; i < c; i++)
+	    name[namelen++] = tolower(pkt[p + i]);
+	p += c;
+    }
+    if (!jumped)
+	pos = p;
+    name[namelen] = 0;
+    return name;
+}
+
+
+// Append 'name' to 'buf' in DNS label format.  Returns false if it won't
+// go.
+static bool put_name(WvBuf &buf, WvStringParm name)
+{
+    if (name.len() > DNS_MAXNAME)
+	return false;
+    const char *cptr = name;
+    while (*cptr)
+    {
+	const char *dot = strchr(cptr, '.');
+	size_t len = dot ? dot - cptr : strlen(cptr);
+	if (!len || len > 63)
+	    return false;
+	buf.putch(len);
+	buf.put(cptr, len);
+	cptr += len;
+	if (*cptr)
+	    cptr++;
+    }
+    buf.putch(0);
+    return true;
+}
+
+
+// Is 'name' an address like "10.0.0.1" already?  If so, put it in 'addr'.
+static bool dotted_quad(const char *name, unsigned char addr[4])
+{
+    for (int i = 0; i < 4; i++)
+    {
+	if (!isdigit((unsigned char)*name))
+	    return false;
+	unsigned int n = 0;
+	for (int digits = 0; isdigit((unsigned char)*name); digits++)
+	{
+	    if (digits == 3)
+		return false;
+	    n = n * 10 + (*name++ - '0');
+	}
+	if (n > 255 || *name != (i < 3 ? '.' : 0))
+	    return false;
+	addr[i] = n;
+	if (i < 3)
+	    name++;
+    }
+    return true;
+}
+
+
+WvDNSStream::WvDNSStream(WvStringParm resolvconf, WvStringParm hostsfile) :
+    WvUDPStream(WvIPPortAddr(), WvIPPortAddr()),
+    queries(16), hosts(16)
+{
+    numservers = numsearch = 0;
+    default_ns = false;
+    ndots = 1;
+    attempts = 2;
+    timeout = 5000;
+    sent = sent_here = 0;
+    randfd = -1;
+    randused = sizeof(randpool);
+
+    if (!!resolvconf)
+	read_resolvconf(resolvconf);
+    if (!!hostsfile)
+	read_hosts(hostsfile);
+}
+
+
+WvDNSStream::~WvDNSStream()
+{
+    // nobody is going to find out about the ones still in progress.
+#ifndef _WIN32
+    if (randfd >= 0)
+	::close(randfd);
+#endif
+}
+
+
+// A number nobody who sees our queries go by can guess, so they can't
+// slip us a fake answer before the real one comes back.
+unsigned int WvDNSStream::random16()
+{
+    if (randused + 2 > sizeof(randpool))
+    {
+	size_t got = 0;
+#ifndef _WIN32
+	if (randfd < 0)
+	{
+	    randfd = open("/dev/urandom", O_RDONLY);
+	    if (randfd >= 0)
+		fcntl(randfd, F_SETFD, FD_CLOEXEC);
+	}
+	if (randfd >= 0)
+	{
+	    ssize_t len = ::read(randfd, randpool, sizeof(randpool));
+	    if (len > 0)
+		got = len;
+	}
+#endif
+	// no /dev/urandom: this is the best we can do
+	for (; got < sizeof(randpool); got++)
+	    randpool[got] = rand() ^ (wvtime().tv_usec >> 3);
+	randused = 0;
+    }
+
+    unsigned int x = get16(randpool + randused);
+    randused += 2;
+    return x;
+}
+
+
+// Switch to a new socket on a random port, so someone trying to guess
+// where our answers should go has 65536 times as many guesses to make.
+// Only do this when no queries are waiting for an answer on the old one.
+void WvDNSStream::rebind()
+{
+#ifndef _WIN32
+    for (int tries = 0; tries < REBIND_TRIES; tries++)
+    {
+	unsigned int port = random16();
+	if (port < 1024)
+	    continue;
+
+	int fd = socket(PF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+	    return;
+	WvIPPortAddr addr(WvIPAddr(), port);
+	struct sockaddr *sa = addr.sockaddr();
+	bool ok = !bind(fd, sa, addr.sockaddr_len());
+	delete sa;
+	if (!ok)
+	{
+	    ::close(fd);
+	    continue; // somebody has that one; try another
+	}
+
+	::close(getfd());
+	setfd(fd);
+	set_close_on_exec(true);
+	set_nonblock(true);
+	localaddr = addr;
+	sent_here = 0;
+	return;
+    }
+    // no luck: the old socket, with its kernel-chosen port, will do
+#endif
+}
+
+
+void WvDNSStream::read_resolvconf(WvStringParm filename)
+{
+    WvFile f(filename, O_RDONLY);
+    if (!f.isok())
+	return; // no nameservers at all: use gethostbyname()
+
+    char *line;
+    while ((line = f.blocking_getline(-1)) != NULL)
+    {
+	WvStringList words;
+	words.split(line, " \t");
+	WvString keyword = words.popstr();
+	if (keyword == "nameserver" && !words.isempty())
+	{
+	    WvString addr = words.popstr();
+	    // we only do IPv4, and libc only uses the first three
+	    if (!strchr(addr, ':') && numservers < WVDNS_MAXNS)
+		nameservers[numservers++] = WvIPPortAddr(WvIPAddr(addr),
+							 DNS_PORT);
+	}
+	else if (keyword == "search" || keyword == "domain")
+	{
+	    // whichever one comes last wins
+	    numsearch = 0;
+	    while (!words.isempty() && numsearch < WVDNS_MAXSEARCH)
+	    {
+		WvString domain = lowercase(words.popstr());
+		if (!!domain && domain != ".")
+		    search[numsearch++] = domain;
+	    }
+	}
+	else if (keyword == "options")
+	{
+	    while (!words.isempty())
+	    {
+		WvString opt = words.popstr();
+		if (!strncmp(opt, "ndots:", 6))
+		    ndots = atoi(opt + 6);
+		else if (!strncmp(opt, "timeout:", 8))
+		    timeout = atoi(opt + 8) * 1000;
+		else if (!strncmp(opt, "attempts:", 9))
+		    attempts = atoi(opt + 9);
+	    }
+	}
+    }
+
+    if (!numservers)
+    {
+	// libc asks the local host if resolv.conf doesn't say
+	nameservers[numservers++] = WvIPPortAddr("127.0.0.1", DNS_PORT);
+	default_ns = true;
+    }
+    if (timeout <= 0)
+	timeout = 1000;
+    if (attempts <= 0)
+	attempts = 1;
+}
+
+
+void WvDNSStream::read_hosts(WvStringParm filename)
+{
+    WvFile f(filename, O_RDONLY);
+    if (!f.isok())
+	return;
+
+    char *line;
+    while ((line = f.blocking_getline(-1)) != NULL)
+    {
+	char *hash = strchr(line, '#');
+	if (hash)
+	    *hash = 0;
+	WvStringList words;
+	words.split(line, " \t");
+	WvString addr = words.popstr();
+	if (words.isempty() || strchr(addr, ':'))
+	    continue; // nothing there, or IPv6
+	WvIPAddr ip(addr);
+	if (ip.is_zero())
+	    continue;
+	while (!words.isempty())
+	{
+	    WvString name = lowercase(words.popstr());
+	    WvDNSHostsEntry *e = hosts[name];
+	    if (!e)
+	    {
+		e = new WvDNSHostsEntry(name);
+		hosts.add(e, true);
+	    }
+	    e->addrs.append(new WvIPAddr(ip), true);
+	}
+    }
+}
+
+
+void WvDNSStream::add_nameserver(const WvIPPortAddr &addr)
+{
+    if (default_ns)
+    {
+	numservers = 0;
+	default_ns = false;
+    }
+    if (numservers < WVDNS_MAXNS)
+	nameservers[numservers++] = addr;
+}
+
+
+void WvDNSStream::set_retry(time_t msec, int _attempts)
+{
+    timeout = msec > 0 ? msec : 1;
+    attempts = _attempts > 0 ? _attempts : 1;
+}
+
+
+void WvDNSStream::lookup(WvStringParm _name, const Callback &cb)
+{
+    if (!_name)
+    {
+	WvIPAddrList none;
+	cb(_name, none, 0);
+	return;
+    }
+
+    // there's nothing to look up about an address
+    unsigned char literal[4];
+    if (dotted_quad(_name, literal))
+    {
+	WvIPAddrList addrs;
+	addrs.append(new WvIPAddr(literal), true);
+	cb(_name, addrs, LITERAL_TTL);
+	return;
+    }
+
+    WvString name = lowercase(_name);
+    bool absolute = name.len() && name[name.len() - 1] == '.';
+    if (absolute)
+	name.edit()[name.len() - 1] = 0;
+
+    // somebody else already asked?
+    WvDNSQuery *q = queries[name];
+    if (q)
+    {
+	q->waiters.append(new WvDNSWaiter(_name, cb), true);
+	return;
+    }
+
+    WvDNSHostsEntry *e = hosts[name];
+    if (e)
+    {
+	cb(_name, e->addrs, HOSTS_TTL);
+	return;
+    }
+
+    if (!numservers)
+    {
+	blocking_lookup(_name, cb);
+	return;
+    }
+
+    // a fresh source port for each batch of queries
+    if (queries.isempty() && sent_here)
+	rebind();
+
+    q = new WvDNSQuery(name);
+    q->waiters.append(new WvDNSWaiter(_name, cb), true);
+
+    // the order resolv.conf(5) says to try things in
+    int dots = 0;
+    for (const char *cptr = name; *cptr; cptr++)
+	if (*cptr == '.')
+	    dots++;
+    if (!absolute && dots >= ndots)
+	q->candidates.append(name);
+    if (!absolute)
+	for (int i = 0; i < numsearch; i++)
+	    q->candidates.append(WvString("%s.%s", name, search[i]));
+    if (absolute || dots < ndots)
+	q->candidates.append(name);
+
+    queries.add(q, true);
+    next_candidate(q, -1);
+}
+
+
+// Only used when we have no nameservers to ask.  This stalls whoever
+// called lookup() until gethostbyname() is done; see wvdnsstream.h.
+void WvDNSStream::blocking_lookup(WvStringParm name, const Callback &cb)
+{
+    WvIPAddrList addrs;
+    struct hostent *he = gethostbyname(name);
+    if (he && he->h_addrtype == AF_INET)
+    {
+	for (char **addr = he->h_addr_list; *addr; addr++)
+	    addrs.append(new WvIPAddr((unsigned char *)*addr), true);
+    }
+    cb(name, addrs, addrs.isempty() ? -1 : BLOCKING_TTL);
+}
+
+
+void WvDNSStream::send(WvDNSQuery *q)
+{
+    WvDynBuf buf;
+    buf.putch(q->id >> 8);
+    buf.putch(q->id & 0xff);
+    buf.putch(DNS_RD >> 8);
+    buf.putch(DNS_RD & 0xff);
+    static const unsigned char counts[] = { 0, 1, 0, 0, 0, 0, 0, 0 };
+    buf.put(counts, sizeof(counts));
+    put_name(buf, q->asking);
+    static const unsigned char qtype[] = {
+	0, DNS_TYPE_A, 0, DNS_CLASS_IN
+    };
+    buf.put(qtype, sizeof(qtype));
+
+    setdest(nameservers[q->server]);
+    size_t len = buf.used();
+    write(buf.get(len), len);
+    sent++;
+    sent_here++;
+    q->deadline = msecadd(wvstime(), timeout);
+}
+
+
+// Move on to the next name in the search list; 'ttl' is how long we can
+// remember that the last one didn't work out.
+void WvDNSStream::next_candidate(WvDNSQuery *q, int ttl)
+{
+    if (ttl >= 0 && (q->neg_ttl < 0 || ttl < q->neg_ttl))
+	q->neg_ttl = ttl;
+
+    WvString asking;
+    while (!q->candidates.isempty() && !asking)
+    {
+	asking = q->candidates.popstr();
+	WvDynBuf test;
+	if (!put_name(test, asking))
+	    asking = WvString::null; // too long to ask about
+    }
+
+    if (!asking)
+    {
+	WvIPAddrList none;
+	finish(q, none, q->neg_ttl);
+	return;
+    }
+
+    // a new random ID each time, that isn't in use by another query
+    bool used;
+    do
+    {
+	q->id = random16();
+	used = false;
+	WvDNSQueryDict::Iter i(queries);
+	for (i.rewind(); i.next() && !used; )
+	    used = i.ptr() != q && i->id == q->id;
+    } while (used);
+
+    q->asking = asking;
+    q->server = q->tries = 0;
+    send(q);
+}
+
+
+void WvDNSStream::next_server(WvDNSQuery *q)
+{
+    if (++q->tries >= attempts * numservers)
+    {
+	// nobody's answering.
+	WvIPAddrList none;
+	finish(q, none, -1);
+	return;
+    }
+    q->server = q->tries % numservers;
+    send(q);
+}
+
+
+void WvDNSStream::finish(WvDNSQuery *q, WvIPAddrList &addrs, int ttl)
+{
+    // take it out first, so the callbacks can start new lookups
+    queries.set_autofree(q->name, false);
+    queries.remove(q);
+
+    WvList<WvDNSWaiter>::Iter i(q->waiters);
+    for (i.rewind(); i.next(); )
+	i->cb(i->name, addrs, ttl);
+    delete q;
+}
+
+
+void WvDNSStream::got_packet(const unsigned char *pkt, size_t len)
+{
+    if (len < 12)
+	return;
+    unsigned int id = get16(pkt), flags = get16(pkt + 2);
+    if (!(flags & DNS_QR) || get16(pkt + 4) != 1)
+	return;
+
+    // is it from somebody we asked?
+    WvIPPortAddr from(*(const WvIPPortAddr *)src());
+    int i;
+    for (i = 0; i < numservers; i++)
+	if (nameservers[i] == from)
+	    break;
+    if (i == numservers)
+	return;
+
+    // ...about something we asked?
+    WvDNSQuery *q = NULL;
+    WvDNSQueryDict::Iter qi(queries);
+    for (qi.rewind(); qi.next(); )
+	if (qi->id == id)
+	{
+	    q = qi.ptr();
+	    break;
+	}
+    size_t pos = 12;
+    if (!q || read_name(pkt, len, pos) != q->asking || pos + 4 > len
+	|| get16(pkt + pos) != DNS_TYPE_A
+	|| get16(pkt + pos + 2) != DNS_CLASS_IN)
+	return;
+    pos += 4;
+
+    unsigned int rcode = flags & DNS_RCODE;
+    if (rcode != DNS_NOERROR && rcode != DNS_NXDOMAIN)
+    {
+	// this one's having trouble; maybe another one isn't
+	next_server(q);
+	return;
+    }
+
+    // go through the answers for the A and CNAME records
+    WvString cname[DNS_MAXCNAMES], ctarget[DNS_MAXCNAMES];
+    int nc = 0, cttl = -1;
+    WvStringList aname;
+    WvIPAddrList addrs;
+    WvList<unsigned long> attl;
+    unsigned int ancount = get16(pkt + 6), nscount = get16(pkt + 8);
+    int neg_ttl = -1;
+    for (unsigned int n = 0; n < ancount + nscount; n++)
+    {
+	WvString owner = read_name(pkt, len, pos);
+	if (!owner || pos + 10 > len)
+	    break;
+	unsigned int type = get16(pkt + pos), rclass = get16(pkt + pos + 2);
+	unsigned long ttl = get32(pkt + pos + 4);
+	size_t rdlen = get16(pkt + pos + 8), rdata = pos + 10;
+	pos = rdata + rdlen;
+	if (pos > len)
+	    break;
+	if (ttl > 0x7fffffff)
+	    ttl = 0;
+	if (rclass != DNS_CLASS_IN)
+	    continue;
+
+	if (n >= ancount)
+	{
+	    // the authority section: the SOA says how long "no" lasts
+	    size_t p = rdata;
+	    if (type == DNS_TYPE_SOA && !!read_name(pkt, len, p)
+		&& !!read_name(pkt, len, p) && p + 20 <= pos)
+	    {
+		unsigned long minimum = get32(pkt + p + 16);
+		neg_ttl = minimum < ttl ? minimum : ttl;
+	    }
+	}
+	else if (type == DNS_TYPE_A && rdlen == 4)
+	{
+	    aname.append(owner);
+	    addrs.append(new WvIPAddr(pkt + rdata), true);
+	    attl.append(new unsigned long(ttl), true);
+	}
+	else if (type == DNS_TYPE_CNAME && nc < DNS_MAXCNAMES)
+	{
+	    size_t p = rdata;
+	    ctarget[nc] = read_name(pkt, len, p);
+	    cname[nc] = owner;
+	    if (!!ctarget[nc++] && (cttl < 0 || (int)ttl < cttl))
+		cttl = ttl;
+	}
+    }
+
+    // follow the CNAMEs from the name we asked about, to the one the
+    // addresses should be for
+    WvString target = q->asking;
+    for (int hops = 0; hops < DNS_MAXCNAMES; hops++)
+    {
+	int c;
+	for (c = 0; c < nc; c++)
+	    if (cname[c] == target)
+		break;
+	if (c == nc)
+	    break;
+	target = ctarget[c];
+    }
+
+    int ttl = cttl;
+    WvIPAddrList found;
+    WvStringList::Iter ni(aname);
+    WvIPAddrList::Iter ai(addrs);
+    WvList<unsigned long>::Iter ti(attl);
+    for (ni.rewind(), ai.rewind(), ti.rewind();
+	 ni.next() && ai.next() && ti.next(); )
+    {
+	if (*ni != target)
+	    continue;
+	found.append(new WvIPAddr(*ai), true);
+	if (ttl < 0 || (int)*ti < ttl)
+	    ttl = *ti;
+    }
+
+    if (!found.isempty())
+	finish(q, found, ttl);
+    else if (rcode == DNS_NOERROR && (flags & DNS_TC))
+	next_server(q); // the answer didn't fit, but another might
+    else
+	next_candidate(q, neg_ttl);
+}
+
+
+time_t WvDNSStream::next_timeout()
+{
+    if (queries.isempty())
+	return -1;
+
+    WvTime now = wvstime();
+    time_t soonest = -1;
+    WvDNSQueryDict::Iter i(queries);
+    for (i.rewind(); i.next(); )
+    {
+	time_t left = msecdiff(i->deadline, now);
+	if (left < 0)
+	    left = 0;
+	if (soonest < 0 || left < soonest)
+	    soonest = left;
+    }
+    return soonest;
+}
+
+
+void WvDNSStream::pre_select(SelectInfo &si)
+{
+    // we always want to hear the answers we're waiting for
+    bool oldr = si.wants.readable;
+    if (!queries.isempty())
+	si.wants.readable = true;
+    WvUDPStream::pre_select(si);
+    si.wants.readable = oldr;
+
+    time_t left = next_timeout();
+    if (left >= 0 && (left < si.msec_timeout || si.msec_timeout < 0))
+	si.msec_timeout = left;
+}
+
+
+bool WvDNSStream::post_select(SelectInfo &si)
+{
+    bool oldr = si.wants.readable;
+    if (!queries.isempty())
+	si.wants.readable = true;
+    bool ready = WvUDPStream::post_select(si);
+    si.wants.readable = oldr;
+
+    return ready || next_timeout() == 0;
+}
+
+
+void WvDNSStream::execute()
+{
+    WvUDPStream::execute();
+
+    unsigned char pkt[DNS_MAXPACKET];
+    size_t len;
+    while (isok() && (len = read(pkt, sizeof(pkt))) > 0)
+	got_packet(pkt, len);
+
+    // resend anything that's taking too long.  Doing that can finish
+    // (and delete) a query, so start over each time.
+    WvTime now = wvstime();
+    bool again = true;
+    while (again)
+    {
+	again = false;
+	WvDNSQueryDict::Iter i(queries);
+	for (i.rewind(); i.next(); )
+	{
+	    if (msecdiff(i->deadline, now) <= 0)
+	    {
+		next_server(i.ptr());
+		again = true;
+		break;
+	    }
+	}
+    }
+}
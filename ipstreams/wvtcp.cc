@@ -66,6 +66,125 @@
 WV_LINK(WvTCPConn);
 WV_LINK(WvTCPListener);
 
+// forget that an address failed after this many seconds
+#define FAIL_MEMORY 600
+
+// the most addresses to remember how connecting to them went
+#define MAX_HISTORY 1024
+
+time_t WvTCPConn::stagger = WVTCP_STAGGER;
+
+
+/** One of the connections racing in a WvTCPConn. */
+class WvTCPAttempt
+{
+public:
+    WvIPPortAddr addr;
+    int fd;
+    WvTime started;
+    time_t score;
+    
+    WvTCPAttempt(const WvIPPortAddr &_addr, time_t _score)
+        : addr(_addr), fd(-1), started(wvtime_zero), score(_score)
+        { }
+    ~WvTCPAttempt()
+        { if (fd >= 0) ::close(fd); }
+};
+
+
+/** How connecting to an address went lately. */
+class WvTCPHistory
+{
+public:
+    WvIPAddr addr;
+    time_t srtt;        // smoothed msec to connect, or 0 if we don't know
+    int failures;       // failures since the last success
+    time_t last_fail;
+    
+    WvTCPHistory(const WvIPAddr &_addr)
+        : addr(_addr), srtt(0), failures(0), last_fail(0)
+        { }
+};
+
+DeclareWvDict(WvTCPHistory, WvIPAddr, addr);
+static WvTCPHistoryDict history(16);
+
+
+static WvTCPHistory *remember(const WvIPAddr &addr)
+{
+    WvTCPHistory *h = history[addr];
+    if (!h)
+    {
+        if (history.count() >= MAX_HISTORY)
+            history.zap();
+        h = new WvTCPHistory(addr);
+        history.add(h, true);
+    }
+    return h;
+}
+
+
+static void remember_rtt(const WvIPAddr &addr, time_t msec)
+{
+    WvTCPHistory *h = remember(addr);
+    h->srtt = h->srtt ? (h->srtt * 7 + msec) / 8 : msec;
+    if (!h->srtt)
+        h->srtt = 1;
+    h->failures = 0;
+}
+
+
+static void remember_failure(const WvIPAddr &addr)
+{
+    WvTCPHistory *h = remember(addr);
+    h->failures++;
+    h->last_fail = time(NULL);
+}
+
+
+// Lower is better: the time it usually takes to connect, with addresses we
+// don't know about yet counted as taking one stagger, and addresses that
+// failed lately after all the others.
+static time_t score(const WvIPAddr &addr, time_t stagger)
+{
+    WvTCPHistory *h = history[addr];
+    if (h && h->failures && h->last_fail + FAIL_MEMORY > time(NULL))
+        return 1000000 * h->failures;
+    return (h && h->srtt) ? h->srtt : stagger;
+}
+
+
+// Start (or check on) a non-blocking connect() of 'fd' to 'addr'.  Returns 0
+// if it's connected, EINPROGRESS if it's still going, or else the error.
+static int start_connect(int fd, const WvIPPortAddr &addr)
+{
+#ifndef _WIN32
+    WvIPPortAddr newaddr(addr);
+#else
+    // Win32 doesn't like to connect to 0.0.0.0:port; it means "any address
+    // on the local machine", so let's just force localhost
+    WvIPAddr zero;
+    WvIPPortAddr newaddr(WvIPAddr(addr)==zero
+			    ? WvIPAddr("127.0.0.1") : addr,
+			 addr.port);
+#endif
+    sockaddr *sa = newaddr.sockaddr();
+    int ret = connect(fd, sa, newaddr.sockaddr_len()), err = errno;
+    assert(ret <= 0);
+    delete sa;
+    
+    if (ret == 0 || (ret < 0 && err == EISCONN))
+	return 0;
+    else if (err == EINPROGRESS
+	     || err == EWOULDBLOCK
+	     || err == EAGAIN
+	     || err == EALREADY
+	     || err == EINVAL /* apparently winsock 1.1 might do this */)
+	return EINPROGRESS;
+    else
+	return err;
+}
+
 
 static IWvStream *creator(WvStringParm s, IObject*)
 {
@@ -96,6 +215,8 @@ WvTCPConn::WvTCPConn(const WvIPPortAddr &_remaddr)
     resolved = true;
     connected = false;
     incoming = false;
+    candidates = NULL;
+    numtried = 0;
     
     do_connect();
 }
@@ -109,6 +230,8 @@ WvTCPConn::WvTCPConn(int _fd, const WvIPPortAddr &_remaddr)
     resolved = true;
     connected = true;
     incoming = true;
+    candidates = NULL;
+    numtried = 0;
     nice_tcpopts();
 }
 
@@ -136,6 +259,8 @@ WvTCPConn::WvTCPConn(WvStringParm _hostname, uint16_t _port)
     
     resolved = connected = false;
     incoming = false;
+    candidates = NULL;
+    numtried = 0;
     
     WvIPAddr x(hostname);
     if (x != WvIPAddr())
@@ -149,9 +274,22 @@ WvTCPConn::WvTCPConn(WvStringParm _hostname, uint16_t _port)
 }
 
 
+WvTCPConn::WvTCPConn(const WvIPAddrList &addrs, uint16_t port)
+{
+    remaddr.port = port;
+    resolved = true;
+    connected = false;
+    incoming = false;
+    candidates = NULL;
+    numtried = 0;
+    
+    start_race(addrs);
+}
+
+
 WvTCPConn::~WvTCPConn()
 {
-    // nothing to do
+    drop_race();
 }
 
 
@@ -199,44 +337,153 @@ void WvTCPConn::do_connect()
 	    return;
 	}
 	setfd(rwfd);
+	numtried++;
 	
 	nice_tcpopts();
     }
     
+    int err = start_connect(getfd(), remaddr);
+    if (!err)
+	connected = true;
+    else if (err != EINPROGRESS)
+    {
+	connected = true; // "connection phase" is ended, anyway
+	seterr(err);
+    }
+}
+
+
+void WvTCPConn::start_race(const WvIPAddrList &addrs)
+{
+    if (addrs.count() == 1)
+    {
+	remaddr = WvIPPortAddr(*addrs.first(), remaddr.port);
+	do_connect();
+	return;
+    }
+    else if (addrs.isempty())
+    {
+	seterr(EHOSTUNREACH);
+	return;
+    }
+    
+    // sort the addresses best first, keeping the DNS order for ties
+    candidates = new WvTCPAttemptList;
+    WvIPAddrList::Iter i(addrs);
+    for (i.rewind(); i.next(); )
+    {
+	WvTCPAttempt *a = new WvTCPAttempt(WvIPPortAddr(*i, remaddr.port),
+					   score(*i, stagger));
+	WvTCPAttemptList::Iter j(*candidates);
+	j.rewind();
+	WvLink *after = j.cur();
+	while (j.next() && j->score <= a->score)
+	    after = j.cur();
+	candidates->add_after(after, a, true);
+    }
+    
+    start_next();
+}
+
+
+void WvTCPConn::start_next()
+{
+    WvTCPAttemptList::Iter i(*candidates);
+    for (i.rewind(); i.next(); )
+    {
+	if (i->fd >= 0)
+	    continue;
+	
+	WvTCPAttempt *a = i.ptr();
+	a->fd = socket(PF_INET, SOCK_STREAM, 0);
+	if (a->fd < 0)
+	{
+	    seterr(errno);
+	    drop_race();
+	    return;
+	}
+	numtried++;
+	a->started = wvtime();
+	
+	// nice_tcpopts() does the rest once we know which one won
 #ifndef _WIN32
-    WvIPPortAddr newaddr(remaddr);
+	fcntl(a->fd, F_SETFD, FD_CLOEXEC);
+	fcntl(a->fd, F_SETFL, fcntl(a->fd, F_GETFL) | O_NONBLOCK);
 #else
-    // Win32 doesn't like to connect to 0.0.0.0:port; it means "any address
-    // on the local machine", so let's just force localhost
-    WvIPAddr zero;
-    WvIPPortAddr newaddr(WvIPAddr(remaddr)==zero
-			    ? WvIPAddr("127.0.0.1") : remaddr,
-			 remaddr.port);
+	u_long arg = 1;
+	ioctlsocket(a->fd, FIONBIO, &arg);
 #endif
-    sockaddr *sa = newaddr.sockaddr();
-    int ret = connect(getfd(), sa, newaddr.sockaddr_len()), err = errno;
-    assert(ret <= 0);
+	
+	int err = start_connect(a->fd, a->addr);
+	if (!err)
+	{
+	    win(a);
+	    return;
+	}
+	else if (err == EINPROGRESS)
+	{
+	    next_start = msecadd(a->started, stagger);
+	    return;
+	}
+	
+	// refused or unreachable: on to the next one right away
+	remember_failure(a->addr);
+	i.xunlink();
+	if (candidates->isempty())
+	{
+	    connected = true; // "connection phase" is ended, anyway
+	    seterr(err);
+	    drop_race();
+	    return;
+	}
+    }
     
-    if (ret == 0 || (ret < 0 && err == EISCONN))
-	connected = true;
-    else if (ret < 0
-	     && err != EINPROGRESS
-	     && err != EWOULDBLOCK
-	     && err != EAGAIN
-	     && err != EALREADY
-	     && err != EINVAL /* apparently winsock 1.1 might do this */)
+    // everything's started; just wait for them
+    next_start = wvtime_zero;
+}
+
+
+void WvTCPConn::win(WvTCPAttempt *a)
+{
+    remember_rtt(a->addr, msecdiff(wvtime(), a->started));
+    remaddr = a->addr;
+    setfd(a->fd);
+    a->fd = -1;
+    nice_tcpopts();
+    connected = true;
+    drop_race();
+}
+
+
+void WvTCPConn::drop_race()
+{
+    if (!candidates)
+	return;
+    
+    // the ones still going weren't failures, but they were at least this
+    // slow
+    WvTime now = wvtime();
+    WvTCPAttemptList::Iter i(*candidates);
+    for (i.rewind(); i.next(); )
     {
-	connected = true; // "connection phase" is ended, anyway
-	seterr(err);
+	if (i->fd < 0)
+	    continue;
+	WvTCPHistory *h = remember(i->addr);
+	time_t msec = msecdiff(now, i->started);
+	if (h->srtt < msec)
+	    h->srtt = msec;
     }
-    delete sa;
+    
+    delete candidates;
+    candidates = NULL;
 }
 
 
 void WvTCPConn::check_resolver()
 {
     const WvIPAddr *ipr;
-    int dnsres = dns.findaddr(0, hostname, &ipr);
+    WvIPAddrList addrs;
+    int dnsres = dns.findaddr(0, hostname, &ipr, &addrs);
     
     if (dnsres == 0)
     {
@@ -247,9 +494,8 @@ void WvTCPConn::check_resolver()
     else if (dnsres > 0)
     {
 	// fprintf(stderr, "%p: resolver succeeded!\n", this);
-	remaddr = WvIPPortAddr(*ipr, remaddr.port);
 	resolved = true;
-	do_connect();
+	start_race(addrs);
     }
 }
 
@@ -312,6 +558,31 @@ void WvTCPConn::pre_select(SelectInfo &si)
 	}
 	WvFDStream::pre_select(si);
 	si.wants.writable = oldw;
+	
+	if (candidates)
+	{
+	    WvTCPAttemptList::Iter i(*candidates);
+	    for (i.rewind(); i.next(); )
+	    {
+		if (i->fd < 0)
+		    continue;
+		FD_SET(i->fd, &si.write);
+#ifdef _WIN32
+		FD_SET(i->fd, &si.except); // see above
+#endif
+		if (si.max_fd < i->fd)
+		    si.max_fd = i->fd;
+	    }
+	    
+	    if (next_start != wvtime_zero)
+	    {
+		time_t left = msecdiff(next_start, wvtime());
+		if (left < 0)
+		    left = 0;
+		if (si.msec_timeout < 0 || si.msec_timeout > left)
+		    si.msec_timeout = left;
+	    }
+	}
 	return;
     }
 }
@@ -330,6 +601,55 @@ bool WvTCPConn::post_select(SelectInfo &si)
 		return true; // oops, failed to resolve the name!
 	}
     }
+    else if (candidates)
+    {
+	result = WvFDStream::post_select(si);
+	
+	// same as below, but for each of the racing connections
+	WvTCPAttemptList::Iter i(*candidates);
+	for (i.rewind(); i.next(); )
+	{
+	    WvTCPAttempt *a = i.ptr();
+	    if (a->fd < 0 || !(FD_ISSET(a->fd, &si.write)
+			       || FD_ISSET(a->fd, &si.except)))
+		continue;
+	    
+	    int conn_res = -1;
+	    socklen_t res_size = sizeof(conn_res);
+	    if (getsockopt(a->fd, SOL_SOCKET, SO_ERROR, &conn_res, &res_size))
+		conn_res = errno;
+	    if (!conn_res)
+		conn_res = start_connect(a->fd, a->addr);
+	    
+	    if (!conn_res)
+	    {
+		win(a);
+		return true;
+	    }
+	    else if (conn_res != EINPROGRESS)
+	    {
+		remember_failure(a->addr);
+		i.xunlink();
+		if (candidates->isempty())
+		{
+		    connected = true; // not in connecting phase anymore
+		    seterr(conn_res);
+		    drop_race();
+		    return true;
+		}
+		
+		// don't wait for the stagger: the next one can go now
+		next_start = wvtime();
+	    }
+	}
+	
+	if (next_start != wvtime_zero && msecdiff(wvtime(), next_start) >= 0)
+	{
+	    start_next();
+	    if (!candidates)
+		return true; // won or lost, either way there's news
+	}
+    }
     else
     {
 	result = WvFDStream::post_select(si);
@@ -374,7 +694,14 @@ bool WvTCPConn::post_select(SelectInfo &si)
 
 bool WvTCPConn::isok() const
 {
-    return !resolved || WvFDStream::isok();
+    return !resolved || candidates || WvFDStream::isok();
+}
+
+
+void WvTCPConn::close()
+{
+    drop_race();
+    WvFDStream::close();
 }
 
 
@@ -0,0 +1,31 @@
+#include "wvtest.h"
+#include "wvbufstream.h"
+
+WVTEST_MAIN("wvbufstream buffer writes keep their order")
+{
+    WvBufStream s;
+    s.delay_output(true);
+    s.write("abc", 3);
+
+    WvDynBuf buf;
+    buf.putstr("def");
+    WVPASSEQ(s.write(buf, 3), 3);
+    WVPASSEQ(buf.used(), 0);
+
+    s.delay_output(false);
+    s.flush(0);
+    s.seteof();
+    WVPASSEQ(s.getline(0, 'x'), "abcdef");
+}
+
+
+WVTEST_MAIN("wvbufstream buffer writes")
+{
+    WvBufStream s;
+    WvDynBuf buf;
+    buf.putstr("hello world");
+    WVPASSEQ(s.write(buf, 5), 5);
+    WVPASSEQ(buf.used(), 6);
+    s.seteof();
+    WVPASSEQ(s.getline(0, 'x'), "hello");
+}
@@ -0,0 +1,81 @@
+#include "wvtest.h"
+#include "wvlogasync.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+class CountingAsync : public WvLogAsync
+{
+public:
+    int written;
+
+    CountingAsync() : WvLogAsync(4096, Drop, 100000), written(0)
+        { }
+    virtual ~CountingAsync()
+        { stop(); }
+
+protected:
+    virtual void write_records(const struct iovec *iov, const int *levels,
+			       int count)
+        { written += count; }
+};
+
+
+WVTEST_MAIN("wvlogasync emergency flush")
+{
+    int fds[2];
+    WVPASS(pipe(fds) == 0);
+    // if something's wrong, fail instead of waiting forever
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    CountingAsync q;
+    WVPASS(q.start());
+    // once flush() returns, the writer is asleep for the next 100 seconds,
+    // so what we push now stays in the ring
+    q.flush();
+    WVPASS(q.push(0, "one\n", 4));
+    WVPASS(q.push(0, "two\n", 4));
+
+    q.emergency_flush(fds[1]);
+    char buf[64];
+    ssize_t len = read(fds[0], buf, sizeof(buf) - 1);
+    WVPASSEQ(len, 8);
+    buf[len > 0 ? len : 0] = 0;
+    WVPASSEQ(buf, "one\ntwo\n");
+
+    // after that, nothing more is queued, and the writer can still be
+    // stopped
+    WVFAIL(q.push(0, "three\n", 6));
+    q.stop();
+    WVPASSEQ(q.written, 0);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+
+WVTEST_MAIN("wvlogasync emergency flush with a blocking queue")
+{
+    int fds[2];
+    WVPASS(pipe(fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    CountingAsync q;
+    q.policy = WvLogAsync::Block;
+    WVPASS(q.start());
+    q.flush();
+    WVPASS(q.push(0, "one\n", 4));
+    q.emergency_flush(fds[1]);
+
+    // a full queue doesn't wait for a writer that has quit
+    char line[1000];
+    memset(line, 'x', sizeof(line));
+    for (int i = 0; i < 10; i++)
+        WVFAIL(q.push(0, line, sizeof(line)));
+    q.flush();
+    q.stop();
+    WVPASSEQ(q.written, 0);
+
+    close(fds[0]);
+    close(fds[1]);
+}
@@ -0,0 +1,117 @@
+#include "wvtest.h"
+#include "wvlogbinary.h"
+#include "wvfileutils.h"
+
+WVTEST_MAIN("wvlogbinary basics")
+{
+    WvString name(wvtmpfilename("wvtest-binlog"));
+    {
+        WvLogBinary bin(name, WvLog::Debug);
+        WvLog log("binsrc", WvLog::Info), other("other", WvLog::Debug3);
+        
+        log.print("hello\tworld\n");
+        log.print("second\n");
+        other.print("too verbose\n");
+        log.lvl(WvLog::Error).print("%s", WvString("bin\001ary"));
+        WVPASS(bin.isok());
+    }
+    
+    WvLogBinaryReader r(name);
+    WVPASS(r.isok());
+    WVPASS(r.next());
+    WVPASSEQ(r.source, "binsrc");
+    WVPASSEQ(r.level, WvLog::Info);
+    WVPASSEQ(r.len, 12);
+    WVPASS(!memcmp(r.data, "hello\tworld\n", 12));
+    WVPASS(r.next());
+    WVPASSEQ(r.len, 7);
+    WVPASS(!memcmp(r.data, "second\n", 7));
+    WVPASS(r.next());
+    WVPASSEQ(r.level, WvLog::Error);
+    WVPASSEQ(r.len, 7);
+    WVPASS(!memcmp(r.data, "bin\001ary", 7));
+    WVFAIL(r.next());
+    WVPASS(r.isok());
+    
+    ::unlink(name);
+}
+
+
+WVTEST_MAIN("wvlogbinary rotation")
+{
+    WvString name(wvtmpfilename("wvtest-binlog"));
+    {
+        WvLogBinary bin(name, WvLog::NUM_LOGLEVELS, 4096, 2);
+        WvLog a("a", WvLog::Info), b("b", WvLog::Info);
+        for (int i = 0; i < 1000; i++)
+            (i & 1 ? a : b).print("message number %s\n", i);
+    }
+    
+    // every file must decode on its own, including its source names
+    int count = 0;
+    WvString files[3] = { WvString("%s.2", name), WvString("%s.1", name),
+                          name };
+    for (int f = 0; f < 3; f++)
+    {
+        WvLogBinaryReader r(files[f]);
+        WVPASS(r.isok());
+        while (r.next())
+        {
+            WVPASS(r.source == "a" || r.source == "b");
+            count++;
+        }
+        ::unlink(files[f]);
+    }
+    
+    // the oldest files were thrown away
+    WVPASS(count > 0);
+    WVPASS(count < 1000);
+    WVPASS(access(WvString("%s.3", name), F_OK) != 0);
+}
+
+
+WVTEST_MAIN("wvlogbinary oversized records")
+{
+    WvString name(wvtmpfilename("wvtest-binlog"));
+    WvString longsrc, longmsg;
+    longsrc.setsize(10001);
+    memset(longsrc.edit(), 's', 10000);
+    longsrc.edit()[10000] = 0;
+    longmsg.setsize(10001);
+    memset(longmsg.edit(), 'm', 10000);
+    longmsg.edit()[10000] = 0;
+    {
+        WvLogBinary bin(name, WvLog::NUM_LOGLEVELS, 4096, 1);
+        WvLog big(longsrc, WvLog::Info), small("small", WvLog::Info);
+
+        // a source name bigger than the whole file gets cut short, and
+        // the biggest messages still fit next to it after rotating
+        for (int i = 0; i < 4; i++)
+        {
+            small.print("x");
+            big.write(longmsg, longmsg.len());
+        }
+        WVPASS(bin.isok());
+    }
+
+    for (int f = 0; f < 2; f++)
+    {
+        WvString fname(f ? WvString("%s.1", name) : name);
+        WvLogBinaryReader r(fname);
+        WVPASS(r.isok());
+        int n = 0;
+        while (r.next())
+        {
+            if (r.source != "small")
+            {
+                WVPASS(r.source.len() < 4096 / 2);
+                WVPASS(!strncmp(r.source, longsrc, r.source.len()));
+                WVPASS(r.len > 1000 && r.len < 4096 / 2);
+                WVPASS(!memcmp(r.data, longmsg, r.len));
+            }
+            n++;
+        }
+        WVPASS(n > 0);
+        ::unlink(fname);
+    }
+}
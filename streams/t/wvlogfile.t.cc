@@ -17,3 +17,36 @@ WVTEST_MAIN("wvlogfile")
     log.print("log test\n");
     WVPASS(true);
 }
+
+
+#ifndef _WIN32
+WVTEST_MAIN("wvlogfile async")
+{
+    WvString name(wvtmpfilename("wvtest-alog"));
+    {
+        WvLogFileBase f(name, WvLog::Debug5);
+        WVPASS(f.set_async(4096, WvLogAsync::Block));
+        
+        WvLog log("async", WvLog::Info);
+        for (int i = 0; i < 1000; i++)
+            log("line %s\n", i);
+        f.flush_async();
+        WVPASSEQ(f.dropped(), 0);
+        
+        log("last line\n");
+    } // destructor drains the queue
+    
+    WvFile in(name, O_RDONLY);
+    int count = 0;
+    const char *line;
+    WvString lastline;
+    while ((line = in.getline(0)) != NULL)
+    {
+        count++;
+        lastline = line;
+    }
+    WVPASSEQ(count, 1001);
+    WVPASS(strstr(lastline, "async<Info>: last line"));
+    ::unlink(name);
+}
+#endif
@@ -0,0 +1,77 @@
+#include "wvtest.h"
+#include "wvlogring.h"
+#include "wvlogbuffer.h"
+#include "wvfileutils.h"
+#include "wvbufstream.h"
+
+WVTEST_MAIN("wvlogring basics")
+{
+    WvLogRing ring(64*1024, WvLog::Debug);
+    WVPASS(ring.isok());
+    
+    WvLog log("ringtest", WvLog::Info), quiet("quiet", WvLog::Debug4);
+    log("first\n");
+    quiet("not saved\n");
+    log.lvl(WvLog::Error).print("second\n");
+    
+    WvLogBuffer buf(100);
+    ring.feed_receiver(buf);
+    WvLogBuffer::MsgList::Iter i(buf.messages());
+    i.rewind();
+    WVPASS(i.next());
+    WVPASSEQ(i->source, "ringtest");
+    WVPASSEQ(i->message, "first");
+    WVPASSEQ(i->level, WvLog::Info);
+    WVPASS(i.next());
+    WVPASSEQ(i->message, "second");
+    WVPASSEQ(i->level, WvLog::Error);
+    WVFAIL(i.next());
+}
+
+
+WVTEST_MAIN("wvlogring wraparound")
+{
+    WvLogRing ring(8192);
+    WvLog log("wrap", WvLog::Info);
+    for (int i = 0; i < 1000; i++)
+        log("message %s\n", i);
+    
+    // only the newest messages survive, in order, ending with the last one
+    int count = 0, last = -1;
+    const char *l;
+    WvBufStream s;
+    ring.dump(s);
+    while ((l = s.getline(0)) != NULL)
+    {
+        const char *m = strstr(l, "message ");
+        WVPASS(m);
+        if (!m)
+            break;
+        int n = atoi(m + 8);
+        WVPASSEQ(n, last < 0 ? n : last + 1);
+        last = n;
+        count++;
+    }
+    WVPASS(count > 10);
+    WVPASS(count < 1000);
+    WVPASSEQ(last, 999);
+}
+
+
+WVTEST_MAIN("wvlogring survives in its file")
+{
+    WvString name(wvtmpfilename("wvtest-ring"));
+    {
+        WvLogRing ring(name, 16384);
+        WvLog log("before", WvLog::Info);
+        log("about to crash\n");
+    }
+    
+    WvLogRing ring(name, 16384);
+    WvLogBuffer buf(100);
+    ring.feed_receiver(buf);
+    WVPASSEQ(buf.messages().count(), 1);
+    if (buf.messages().count())
+        WVPASSEQ(buf.messages().first()->message, "about to crash");
+    ::unlink(name);
+}
@@ -0,0 +1,74 @@
+#include "wvtest.h"
+#include "wvworkerpool.h"
+#include "wvistreamlist.h"
+#include <pthread.h>
+
+static void square(int *val)
+{
+    *val = *val * *val;
+}
+
+
+static void add_to(int *total, int *val)
+{
+    *total += *val;
+}
+
+
+static void note_thread(pthread_t *thread)
+{
+    *thread = pthread_self();
+}
+
+
+WVTEST_MAIN("wvworkerpool basics")
+{
+    WvWorkerPool pool(4);
+    WVPASS(pool.isok());
+    WVPASSEQ(pool.threads(), 4);
+
+    int vals[100], total = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        vals[i] = i;
+        pool.add(wv::bind(square, &vals[i]), wv::bind(add_to, &total, &vals[i]));
+    }
+    WVPASSEQ(pool.pending(), 100);
+
+    // the results only show up through the event loop
+    WvIStreamList l;
+    l.append(&pool, false, "pool");
+    for (int i = 0; i < 1000 && pool.pending(); i++)
+        l.runonce(10);
+    WVPASSEQ(pool.pending(), 0);
+    WVPASSEQ(total, 328350); // sum of the first 100 squares
+}
+
+
+WVTEST_MAIN("wvworkerpool threads")
+{
+    WvWorkerPool pool(2);
+    pthread_t worker = pthread_self(), doer = 0;
+    pool.add(wv::bind(note_thread, &worker), wv::bind(note_thread, &doer));
+    pool.finish();
+    WVPASSEQ(pool.pending(), 0);
+    WVFAIL(pthread_equal(worker, pthread_self()));
+    WVPASS(pthread_equal(doer, pthread_self()));
+}
+
+
+WVTEST_MAIN("wvworkerpool destroy with jobs queued")
+{
+    int vals[1000], total = 0;
+    {
+        WvWorkerPool pool(1);
+        for (int i = 0; i < 1000; i++)
+        {
+            vals[i] = i;
+            pool.add(wv::bind(square, &vals[i]),
+                     wv::bind(add_to, &total, &vals[i]));
+        }
+    }
+    // nothing was delivered, and nothing crashed
+    WVPASSEQ(total, 0);
+}
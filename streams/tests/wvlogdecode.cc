@@ -0,0 +1,78 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Decodes files written by WvLogBinary into the same text format that
+ * WvLogFile would have produced.
+ */
+#include "wvargs.h"
+#include "wvcrash.h"
+#include "wvlogbinary.h"
+#include "wvlogfile.h"
+#include "wvstringlist.h"
+
+/**
+ * A WvLogFileBase that writes to a given fd and uses the timestamp of the
+ * record being decoded, rather than the current time, for its prefixes.
+ */
+class WvLogDecodeRcv : public WvLogFileBase
+{
+public:
+    WvLogDecodeRcv(int fd, WvLog::LogLevel _max_level)
+	: WvLogFileBase(_max_level)
+    {
+	open(fd);
+	rectime = 0;
+    }
+
+    void decode(WvLogBinaryReader &r)
+    {
+	if (at_newline && r.tv.tv_sec != rectime)
+	    last_time = 0; // force a new prefix for the new timestamp
+	rectime = r.tv.tv_sec;
+	log(r.source, r.level, r.data, r.len);
+    }
+
+protected:
+    time_t rectime;
+
+    virtual void _make_prefix(time_t now)
+        { WvLogFileBase::_make_prefix(rectime); }
+};
+
+
+int main(int argc, char **argv)
+{
+    wvcrash_setup(argv[0]);
+
+    int level = WvLog::NUM_LOGLEVELS;
+    WvStringList files;
+
+    WvArgs args;
+    args.add_required_arg("logfile", true);
+    args.add_option('l', "level", "Highest log level to print (default: all)",
+		    "level", level);
+    if (!args.process(argc, argv, &files) || files.isempty())
+    {
+	args.print_help(argc, argv);
+	return 1;
+    }
+
+    int ret = 0;
+    WvLogDecodeRcv rcv(dup(1), (WvLog::LogLevel)level);
+    WvStringList::Iter i(files);
+    for (i.rewind(); i.next(); )
+    {
+	WvLogBinaryReader r(*i);
+	while (r.next())
+	    rcv.decode(r);
+	if (!r.isok())
+	{
+	    wverr->print("%s: %s\n", *i, r.errstr());
+	    ret = 1;
+	}
+    }
+    rcv.end_line();
+    rcv.flush(0);
+    return ret;
+}
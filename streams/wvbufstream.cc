@@ -45,6 +45,22 @@ size_t WvBufStream::uwrite(const void *buf, size_t size)
 }
 
 
+size_t WvBufStream::write(WvBuf &_inbuf, size_t count)
+{
+    // anything already waiting in outbuf (eg. after delay_output()) has to
+    // come out first, so let WvStream queue this up behind it
+    if (outbuf_delayed_flush || outbuf.used())
+	return WvStream::write(_inbuf, count);
+
+    if (!isok() || stop_write)
+	return 0;
+    if (count > _inbuf.used())
+	count = _inbuf.used();
+    inbuf.merge(_inbuf, count);
+    return count;
+}
+
+
 bool WvBufStream::isok() const
 {
     return !dead;
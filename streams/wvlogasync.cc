@@ -0,0 +1,314 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A bounded queue of finished log lines, drained by a dedicated writer
+ * thread.  See wvlogasync.h.
+ */
+#include "wvlogasync.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// marks the unused end of the ring; the next record starts at offset 0
+#define WRAP_MARKER ((unsigned int)-1)
+
+static inline size_t align8(size_t x)
+{
+    return (x + 7) & ~(size_t)7;
+}
+
+
+WvLogAsync::WvLogAsync(size_t _ringsize, OverflowPolicy _policy,
+		       int _flush_msec)
+    : policy(_policy), flush_msec(_flush_msec)
+{
+    ringsize = align8(_ringsize < 4096 ? 4096 : _ringsize);
+    ring = (char *)malloc(ringsize);
+    head = tail = 0;
+    num_dropped = reported_dropped = 0;
+    thread_running = want_stop = writer_waiting = writer_busy = false;
+    crashing = false;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_cond_init(&progress, NULL);
+}
+
+
+WvLogAsync::~WvLogAsync()
+{
+    // subclasses must have called stop() already, since the writer thread
+    // calls their virtual functions.
+    assert(!thread_running);
+    pthread_cond_destroy(&progress);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+    free(ring);
+}
+
+
+bool WvLogAsync::start()
+{
+    if (thread_running)
+	return true;
+    want_stop = false;
+    if (pthread_create(&thread, NULL, thread_main, this) != 0)
+	return false;
+    thread_running = true;
+    return true;
+}
+
+
+void WvLogAsync::stop()
+{
+    if (!thread_running)
+	return;
+    pthread_mutex_lock(&lock);
+    want_stop = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    thread_running = false;
+}
+
+
+size_t WvLogAsync::space() const
+{
+    return ringsize - (head - tail);
+}
+
+
+bool WvLogAsync::put_record(int level, const char *str, size_t len)
+{
+    // never let a single record hog the ring
+    if (len > ringsize / 4)
+	len = ringsize / 4;
+
+    size_t need = sizeof(Header) + align8(len + 1);
+    size_t pos = head % ringsize;
+    size_t contiguous = ringsize - pos;
+    size_t total = need + (contiguous < need ? contiguous : 0);
+
+    if (space() < total)
+	return false;
+
+    if (contiguous < need)
+    {
+	((Header *)(ring + pos))->len = WRAP_MARKER;
+	pos = 0;
+    }
+
+    Header *h = (Header *)(ring + pos);
+    h->len = len;
+    h->level = level;
+    memcpy(ring + pos + sizeof(Header), str, len);
+    ring[pos + sizeof(Header) + len] = 0;
+
+    // the writer thread must see the record before it sees the new head
+    __sync_synchronize();
+    head += total;
+    return true;
+}
+
+
+void WvLogAsync::kick()
+{
+    pthread_mutex_lock(&lock);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+
+bool WvLogAsync::push(int level, const char *str, size_t len)
+{
+    if (!thread_running || crashing)
+	return false;
+
+    if (num_dropped != reported_dropped)
+    {
+	char msg[64];
+	int msglen = snprintf(msg, sizeof(msg),
+			      "[%lu log records dropped]\n",
+			      num_dropped - reported_dropped);
+	if (put_record(level, msg, msglen))
+	    reported_dropped = num_dropped;
+    }
+
+    while (!put_record(level, str, len))
+    {
+	if (policy == Drop)
+	{
+	    ++num_dropped;
+	    kick();
+	    return false;
+	}
+
+	// the writer broadcasts 'progress' after every batch, and whenever
+	// it finds the ring empty, so this can't sleep forever.
+	pthread_mutex_lock(&lock);
+	if (crashing)
+	{
+	    // the writer has quit, so there's no point waiting for it
+	    pthread_mutex_unlock(&lock);
+	    ++num_dropped;
+	    return false;
+	}
+	pthread_cond_signal(&wake);
+	pthread_cond_wait(&progress, &lock);
+	pthread_mutex_unlock(&lock);
+    }
+
+    // don't wake the writer up for every line; that's what flush_msec is
+    // for.  But if we're filling up fast, get it started early.
+    if (writer_waiting && space() < ringsize / 2)
+	kick();
+    return true;
+}
+
+
+void WvLogAsync::flush()
+{
+    if (!thread_running)
+	return;
+    pthread_mutex_lock(&lock);
+    while ((head != tail || writer_busy) && !crashing)
+    {
+	pthread_cond_signal(&wake);
+	pthread_cond_wait(&progress, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+
+size_t WvLogAsync::write_batch()
+{
+    struct iovec iov[MAX_BATCH];
+    int levels[MAX_BATCH];
+    int count = 0;
+
+    size_t end = head;
+    __sync_synchronize();
+
+    size_t pos = tail;
+    while (pos != end && count < MAX_BATCH)
+    {
+	size_t off = pos % ringsize;
+	const Header *h = (const Header *)(ring + off);
+	if (h->len == WRAP_MARKER)
+	{
+	    pos += ringsize - off;
+	    continue;
+	}
+	iov[count].iov_base = ring + off + sizeof(Header);
+	iov[count].iov_len = h->len;
+	levels[count] = h->level;
+	count++;
+	pos += sizeof(Header) + align8(h->len + 1);
+    }
+
+    if (count)
+	write_records(iov, levels, count);
+
+    // we're done with the memory; let the producer reuse it
+    __sync_synchronize();
+    tail = pos;
+
+    pthread_mutex_lock(&lock);
+    pthread_cond_broadcast(&progress);
+    pthread_mutex_unlock(&lock);
+
+    return count;
+}
+
+
+void *WvLogAsync::thread_main(void *userdata)
+{
+    ((WvLogAsync *)userdata)->run();
+    return NULL;
+}
+
+
+void WvLogAsync::run()
+{
+    pthread_mutex_lock(&lock);
+    for (;;)
+    {
+	if (head == tail || crashing)
+	{
+	    pthread_cond_broadcast(&progress);
+	    // after emergency_flush(), nothing else gets written from here
+	    if (want_stop || crashing)
+		break;
+
+	    struct timespec ts;
+	    clock_gettime(CLOCK_REALTIME, &ts);
+	    ts.tv_sec += flush_msec / 1000;
+	    ts.tv_nsec += (flush_msec % 1000) * 1000000L;
+	    if (ts.tv_nsec >= 1000000000L)
+	    {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	    }
+
+	    writer_waiting = true;
+	    pthread_cond_timedwait(&wake, &lock, &ts);
+	    writer_waiting = false;
+	    continue;
+	}
+
+	writer_busy = true;
+	pthread_mutex_unlock(&lock);
+
+	while (head != tail && !crashing)
+	    write_batch();
+	sync();
+
+	pthread_mutex_lock(&lock);
+	writer_busy = false;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+
+void WvLogAsync::emergency_flush(int fd)
+{
+    // We may be in a signal handler, maybe even on the writer thread, so
+    // we can't stop() the writer or take the lock.  Tell it not to start
+    // another batch, then take a snapshot of the ring and write out what's
+    // in it.  Anything else still running can't corrupt the snapshot
+    // badly: the writer only ever moves tail forward, and a record is only
+    // reused after that.  So all we check for is a header that makes no
+    // sense.
+    crashing = true;
+    __sync_synchronize();
+    size_t end = __sync_fetch_and_add(&head, 0);
+    size_t start = __sync_fetch_and_add(&tail, 0), pos = start;
+    if (end - pos > ringsize)
+	return;
+
+    while (pos != end)
+    {
+	size_t off = pos % ringsize;
+	const Header *h = (const Header *)(ring + off);
+	unsigned int len = h->len;
+	if (len == WRAP_MARKER)
+	{
+	    pos += ringsize - off;
+	    continue;
+	}
+	if (len > ringsize / 4
+		|| off + sizeof(Header) + len > ringsize)
+	    break;
+	if (::write(fd, ring + off + sizeof(Header), len) < 0
+		&& errno != EINTR)
+	    break;
+	pos += sizeof(Header) + align8(len + 1);
+    }
+
+    // unless the writer got there first, those records are done
+    __sync_bool_compare_and_swap(&tail, start, pos);
+}
@@ -0,0 +1,317 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A "Log Receiver" that writes compact binary records to a memory-mapped
+ * file, and a reader for them.  See wvlogbinary.h.
+ */
+#include "wvlogbinary.h"
+#include "wvtimeutils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static inline size_t align4(size_t x)
+{
+    return (x + 3) & ~(size_t)3;
+}
+
+
+//----------------------------------- WvLogBinary --------------------
+
+WvLogBinary::WvLogBinary(WvStringParm _filename, WvLog::LogLevel _max_level,
+			 size_t _map_size, int _keep_files)
+    : filename(_filename), max_level(_max_level),
+      map_size(align4(_map_size)), keep_files(_keep_files), sources(50)
+{
+    fd = -1;
+    map = NULL;
+    used = 0;
+    last_source = NULL;
+    if (map_size < 4096)
+	map_size = 4096;
+    // don't open the file until the first message gets logged
+}
+
+
+WvLogBinary::~WvLogBinary()
+{
+    close_file();
+}
+
+
+bool WvLogBinary::start_file()
+{
+    fd = ::open(filename, O_RDWR|O_CREAT|O_TRUNC|O_LARGEFILE, 0644);
+    if (fd < 0)
+    {
+	seterr(errno);
+	return false;
+    }
+
+    // the unused part of the file stays a hole full of zeroes, which the
+    // reader treats as the end of the file if we never get to trim it.
+    if (ftruncate(fd, map_size) < 0)
+    {
+	seterr(errno);
+	::close(fd);
+	fd = -1;
+	return false;
+    }
+
+    void *p = mmap(NULL, map_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+	seterr(errno);
+	::close(fd);
+	fd = -1;
+	return false;
+    }
+
+    map = (char *)p;
+    memcpy(map, WVLOGBINARY_MAGIC, WVLOGBINARY_MAGIC_LEN);
+    used = WVLOGBINARY_MAGIC_LEN;
+    sources.zap();
+    last_source = NULL;
+    return true;
+}
+
+
+void WvLogBinary::close_file()
+{
+    if (map)
+    {
+	munmap(map, map_size);
+	map = NULL;
+    }
+    if (fd >= 0)
+    {
+	if (ftruncate(fd, used) < 0)
+	    seterr(errno);
+	::close(fd);
+	fd = -1;
+    }
+    sources.zap();
+    last_source = NULL;
+}
+
+
+void WvLogBinary::rotate()
+{
+    if (fd < 0)
+	return;
+    close_file();
+
+    for (int i = keep_files; i > 0; i--)
+    {
+	WvString older("%s.%s", filename, i);
+	if (i == keep_files)
+	    ::unlink(older);
+	else
+	    ::rename(older, WvString("%s.%s", filename, i + 1));
+    }
+    if (keep_files > 0)
+	::rename(filename, WvString("%s.1", filename));
+    else
+	::unlink(filename);
+}
+
+
+// The longest payload we'll write.  A message and the SourceDef for its
+// source, plus the end-of-file header, must always fit in an empty file.
+size_t WvLogBinary::max_payload() const
+{
+    size_t room = map_size - WVLOGBINARY_MAGIC_LEN
+	- 3 * sizeof(WvLogBinaryHeader);
+    return (room / 2) & ~(size_t)3;
+}
+
+
+bool WvLogBinary::reserve(size_t len)
+{
+    // always leave room for an end-of-file header, in case the file never
+    // gets trimmed.
+    size_t need = len + sizeof(WvLogBinaryHeader);
+    if (need > map_size - WVLOGBINARY_MAGIC_LEN)
+	return false; // wouldn't fit even in a new file
+    if (map && used + need <= map_size)
+	return true;
+
+    rotate();
+    return start_file();
+}
+
+
+void WvLogBinary::put_record(WvLogBinaryHeader::Type type,
+			     const struct timeval &tv, unsigned short src,
+			     int level, const char *buf, size_t len)
+{
+    WvLogBinaryHeader *h = (WvLogBinaryHeader *)(map + used);
+    h->len = len;
+    h->sec = tv.tv_sec;
+    h->usec = tv.tv_usec;
+    h->src = src;
+    h->level = level;
+    h->type = type;
+    memcpy(map + used + sizeof(*h), buf, len);
+    used += sizeof(*h) + align4(len);
+}
+
+
+unsigned short WvLogBinary::intern(WvStringParm source,
+				   const struct timeval &tv)
+{
+    if (last_source && last_source->name == source)
+	return last_source->id;
+
+    Source *s = sources[source];
+    if (!s)
+    {
+	size_t len = source.len();
+	if (len > max_payload())
+	    len = max_payload();
+	if (sources.count() >= 65535)
+	{
+	    // out of IDs: start over with a fresh file (and a fresh table)
+	    rotate();
+	    if (!start_file())
+		return 0;
+	}
+	if (!reserve(sizeof(WvLogBinaryHeader) + align4(len)))
+	    return 0;
+	s = new Source(source, sources.count() + 1);
+	sources.add(s, true);
+	put_record(WvLogBinaryHeader::SourceDef, tv, s->id, 0,
+		   source.cstr(), len);
+    }
+    last_source = s;
+    return s->id;
+}
+
+
+void WvLogBinary::log(WvStringParm source, int loglevel,
+		      const char *buf, size_t len)
+{
+    if (loglevel > max_level)
+	return;
+
+    if (!map && !start_file())
+	return;
+
+    if (len > max_payload())
+	len = max_payload();
+
+    struct timeval tv = wvtime();
+    unsigned short src = intern(source, tv);
+    if (!src)
+	return;
+
+    size_t need = sizeof(WvLogBinaryHeader) + align4(len);
+    if (!reserve(need))
+	return;
+
+    // reserve() may have rotated, which forgets all the source IDs.  The
+    // new SourceDef takes up some of the room we just made, so make sure
+    // the message still fits after it.
+    if (!last_source)
+    {
+	src = intern(source, tv);
+	if (!src || !reserve(need) || !last_source)
+	    return;
+    }
+
+    put_record(WvLogBinaryHeader::Message, tv, src, loglevel, buf, len);
+}
+
+
+//----------------------------------- WvLogBinaryReader --------------
+
+WvLogBinaryReader::WvLogBinaryReader(WvStringParm filename)
+{
+    map = NULL;
+    map_size = pos = 0;
+    data = NULL;
+    len = 0;
+    level = WvLog::Info;
+    tv.tv_sec = tv.tv_usec = 0;
+
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+	seterr(errno);
+	return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+	seterr(errno);
+    else if (st.st_size < WVLOGBINARY_MAGIC_LEN)
+	seterr("%s: not a binary log file", filename);
+    else
+    {
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+	    seterr(errno);
+	else
+	{
+	    map = (char *)p;
+	    map_size = st.st_size;
+	    if (memcmp(map, WVLOGBINARY_MAGIC, WVLOGBINARY_MAGIC_LEN))
+		seterr("%s: not a binary log file", filename);
+	    pos = WVLOGBINARY_MAGIC_LEN;
+	}
+    }
+    ::close(fd);
+}
+
+
+WvLogBinaryReader::~WvLogBinaryReader()
+{
+    if (map)
+	munmap(map, map_size);
+}
+
+
+bool WvLogBinaryReader::next()
+{
+    if (!isok())
+	return false;
+
+    while (pos + sizeof(WvLogBinaryHeader) <= map_size)
+    {
+	const WvLogBinaryHeader *h = (const WvLogBinaryHeader *)(map + pos);
+	const char *payload = map + pos + sizeof(*h);
+
+	if (!h->type || pos + sizeof(*h) + h->len > map_size)
+	    break; // end of file, or truncated record
+	pos += sizeof(*h) + align4(h->len);
+
+	if (h->type == WvLogBinaryHeader::SourceDef)
+	{
+	    if (names.size() <= h->src)
+		names.resize(h->src + 1);
+	    WvString name;
+	    name.setsize(h->len + 1);
+	    memcpy(name.edit(), payload, h->len);
+	    name.edit()[h->len] = 0;
+	    names[h->src] = name;
+	}
+	else if (h->type == WvLogBinaryHeader::Message)
+	{
+	    tv.tv_sec = h->sec;
+	    tv.tv_usec = h->usec;
+	    level = (WvLog::LogLevel)h->level;
+	    source = h->src < names.size() ? names[h->src] : WvString("unknown");
+	    data = payload;
+	    len = h->len;
+	    return true;
+	}
+	// else unknown record type from a newer version: skip it
+    }
+
+    pos = map_size;
+    return false;
+}
@@ -10,10 +10,12 @@
 #include "strutils.h"
 #include "wvdailyevent.h"
 #include "wvfork.h"
+#include "wvcrash.h"
 #include <time.h>
 #include <sys/types.h>
 #ifndef _WIN32
 #include <sys/wait.h>
+#include <sys/uio.h>
 #endif
 
 #define MAX_LOGFILE_SZ	1024*1024*100	// 100 Megs
@@ -32,6 +34,65 @@ static time_t gmtoffset()
 }
 
 
+#ifndef _WIN32
+
+// Writes queued log lines to the WvLogFileBase's current fd, from the
+// WvLogAsync writer thread.
+class WvLogFileWriter : public WvLogAsync
+{
+public:
+    WvLogFileWriter(WvLogFileBase &_file, size_t queue_size,
+		    OverflowPolicy policy)
+	: WvLogAsync(queue_size, policy), file(_file)
+        { }
+    virtual ~WvLogFileWriter()
+        { stop(); }
+
+protected:
+    WvLogFileBase &file;
+
+    virtual void write_records(const struct iovec *_iov, const int *levels,
+			       int count)
+    {
+	struct iovec iov[MAX_BATCH];
+	memcpy(iov, _iov, count * sizeof(*iov));
+
+	struct iovec *cur = iov;
+	while (count > 0)
+	{
+	    ssize_t wrote = ::writev(file.getwfd(), cur, count);
+	    if (wrote < 0)
+	    {
+		if (errno == EINTR || errno == EAGAIN)
+		    continue;
+		return; // nowhere useful to report it, so lose the lines
+	    }
+
+	    // skip past whatever got written, including partial records
+	    while (count > 0 && (size_t)wrote >= cur->iov_len)
+	    {
+		wrote -= cur->iov_len;
+		cur++;
+		count--;
+	    }
+	    if (count > 0)
+	    {
+		cur->iov_base = (char *)cur->iov_base + wrote;
+		cur->iov_len -= wrote;
+	    }
+	}
+    }
+
+    virtual void sync()
+    {
+	if (file.fsync_every)
+	    fsync(file.getwfd());
+    }
+};
+
+#endif
+
+
 //----------------------------------- WvLogFileBase ------------------
 
 WvLogFileBase::WvLogFileBase(WvStringParm _filename, WvLog::LogLevel _max_level)
@@ -39,6 +100,9 @@ WvLogFileBase::WvLogFileBase(WvStringParm _filename, WvLog::LogLevel _max_level)
       WvFile(_filename, O_WRONLY|O_APPEND|O_CREAT|O_LARGEFILE, 0644)
 {
     fsync_every = fsync_count = 0;
+#ifndef _WIN32
+    async = NULL;
+#endif
 }
 
 
@@ -46,17 +110,92 @@ WvLogFileBase::WvLogFileBase(WvLog::LogLevel _max_level)
     : WvLogRcv(_max_level) 
 { 
     fsync_every = fsync_count = 0;
+#ifndef _WIN32
+    async = NULL;
+#endif
+}
+
+
+WvLogFileBase::~WvLogFileBase()
+{
+#ifndef _WIN32
+    if (async)
+    {
+	end_line();
+	wvcrash_del_flush(crash_flush, this);
+	delete async; // drains the queue first
+	async = NULL;
+    }
+#endif
 }
 
 
+#ifndef _WIN32
+
+bool WvLogFileBase::set_async(size_t queue_size,
+			      WvLogAsync::OverflowPolicy policy)
+{
+    if (async)
+	return true;
+
+    async = new WvLogFileWriter(*this, queue_size, policy);
+    if (!async->start())
+    {
+	delete async;
+	async = NULL;
+	return false;
+    }
+    wvcrash_add_flush(crash_flush, this);
+    return true;
+}
+
+
+void WvLogFileBase::flush_async()
+{
+    if (async)
+	async->flush();
+}
+
+
+unsigned long WvLogFileBase::dropped() const
+{
+    return async ? async->dropped() : 0;
+}
+
+
+void WvLogFileBase::crash_flush(void *userdata)
+{
+    WvLogFileBase *file = (WvLogFileBase *)userdata;
+    if (file->async && file->getwfd() >= 0)
+	file->async->emergency_flush(file->getwfd());
+}
+
+#endif
+
+
 void WvLogFileBase::_mid_line(const char *str, size_t len)
 {
+#ifndef _WIN32
+    if (async)
+    {
+	current.put(str, len);
+	return;
+    }
+#endif
     WvFile::write(str, len);
 }
 
 
 void WvLogFileBase::_end_line()
 {
+#ifndef _WIN32
+    if (async)
+    {
+	size_t used = current.used();
+	async->push(last_level, (const char *)current.get(used), used);
+	return;
+    }
+#endif
     if (fsync_every)
     {
         fsync_count--;
@@ -138,6 +277,10 @@ static void trim_old_logs(WvStringParm filename, WvStringParm base,
 
 WvString WvLogFile::start_log()
 {
+#ifndef _WIN32
+    // the writer thread mustn't be using the old fd while we replace it
+    flush_async();
+#endif
     WvFile::close();
 
     int num = 0;
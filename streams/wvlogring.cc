@@ -0,0 +1,292 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A fixed-size ring of recent log messages in shared memory.  See
+ * wvlogring.h.
+ */
+#include "wvlogring.h"
+#include "wvcrash.h"
+#include "wvtimeutils.h"
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RING_MAGIC "WvLogRg1"
+#define RING_MAGIC_LEN 8
+#define RECORD_MAGIC 0xA5
+#define NO_RECORD (~0ULL)
+
+// The zone starts with this, followed by the ring of Records.  All the
+// offsets are "absolute": they keep counting up forever, and the position
+// in the ring is the offset modulo datasize.
+struct WvLogRing::RingHeader
+{
+    char magic[RING_MAGIC_LEN];
+    unsigned long long datasize;
+    volatile unsigned long long next;     // where the next record goes
+    volatile unsigned long long reserved; // end of the record being written
+    volatile unsigned long long last;     // start of the newest record
+};
+
+
+// Records never wrap around the end of the ring; if one doesn't fit, it
+// starts over at the beginning instead.  Each one points back at the one
+// before it, which is how we find the oldest message we still have.
+struct WvLogRing::Record
+{
+    unsigned long long pos;  // absolute offset of this record
+    unsigned long long prev; // absolute offset of the previous record
+    unsigned int sec, usec;
+    unsigned int msglen;
+    unsigned short srclen;   // including the terminating nul
+    unsigned char level;
+    unsigned char magic;
+
+    const char *source() const
+        { return (const char *)(this + 1); }
+    const char *msg() const
+        { return source() + srclen; }
+};
+
+
+static inline unsigned long long align8(unsigned long long x)
+{
+    return (x + 7) & ~7ULL;
+}
+
+
+// 32 == sizeof(WvLogRing::Record)
+static inline unsigned long long record_size(size_t srclen, size_t msglen)
+{
+    return align8(32 + srclen + msglen);
+}
+
+
+WvLogRing::WvLogRing(size_t size, WvLog::LogLevel _max_level)
+    : zone(size), max_level(_max_level)
+{
+    init();
+}
+
+
+WvLogRing::WvLogRing(WvStringParm filename, size_t size,
+		     WvLog::LogLevel _max_level)
+    : zone(filename, size), max_level(_max_level)
+{
+    init();
+}
+
+
+WvLogRing::~WvLogRing()
+{
+    if (ring)
+	wvcrash_del_dump(crash_dump, this);
+}
+
+
+void WvLogRing::init()
+{
+    crash_secs = 30;
+    ring = NULL;
+    data = NULL;
+    datasize = 0;
+
+    if (!zone.isok() || !zone.buf
+	    || zone.size < (int)sizeof(RingHeader) + 4096)
+	return;
+
+    assert(sizeof(Record) == 32);
+    ring = (RingHeader *)zone.buf;
+    data = zone.cbuf + sizeof(RingHeader);
+    datasize = (zone.size - sizeof(RingHeader)) & ~7;
+
+    // keep the old contents if it's a ring we know how to read
+    if (memcmp(ring->magic, RING_MAGIC, RING_MAGIC_LEN)
+	    || ring->datasize != datasize || ring->next > ring->reserved)
+    {
+	memset(ring, 0, sizeof(*ring));
+	ring->datasize = datasize;
+	ring->next = ring->reserved = 0;
+	ring->last = NO_RECORD;
+	memcpy(ring->magic, RING_MAGIC, RING_MAGIC_LEN);
+    }
+
+    wvcrash_add_dump(crash_dump, this);
+}
+
+
+void WvLogRing::log(WvStringParm source, int loglevel,
+		    const char *buf, size_t len)
+{
+    if (!ring || loglevel > max_level)
+	return;
+
+    const char *src = source.cstr();
+    size_t srclen = strlen(src) + 1;
+    if (srclen > 256)
+	srclen = 256;
+
+    // no single message gets to wipe out most of the ring
+    if (record_size(srclen, len) > datasize / 4)
+	len = datasize / 4 - record_size(srclen, 0);
+
+    unsigned long long size = record_size(srclen, len);
+    unsigned long long pos = ring->next;
+    size_t off = pos % datasize;
+    if (off + size > datasize)
+    {
+	pos += datasize - off;
+	off = 0;
+    }
+
+    // readers must stop trusting old records before we overwrite them
+    ring->reserved = pos + size;
+    __sync_synchronize();
+
+    struct timeval tv = wvtime();
+    Record *r = (Record *)(data + off);
+    r->pos = pos;
+    r->prev = ring->last;
+    r->sec = tv.tv_sec;
+    r->usec = tv.tv_usec;
+    r->msglen = len;
+    r->srclen = srclen;
+    r->level = loglevel;
+    r->magic = RECORD_MAGIC;
+    memcpy((char *)r->source(), src, srclen - 1);
+    ((char *)r->source())[srclen - 1] = 0;
+    memcpy((char *)r->msg(), buf, len);
+
+    __sync_synchronize();
+    ring->last = pos;
+    ring->next = pos + size;
+}
+
+
+const WvLogRing::Record *WvLogRing::find_first(int secs) const
+{
+    unsigned long long reserved = ring->reserved, next = ring->next;
+    unsigned long long oldest = reserved > datasize ? reserved - datasize : 0;
+
+    unsigned long long pos = ring->last;
+    if (pos == NO_RECORD || pos < oldest || pos >= next)
+	return NULL;
+
+    const Record *newest = (const Record *)(data + pos % datasize);
+    if (newest->pos != pos || newest->magic != RECORD_MAGIC)
+	return NULL;
+
+    const Record *first = newest;
+    for (;;)
+    {
+	unsigned long long prev = first->prev;
+	if (prev == NO_RECORD || prev < oldest || prev >= first->pos)
+	    break;
+	const Record *r = (const Record *)(data + prev % datasize);
+	if (r->pos != prev || r->magic != RECORD_MAGIC)
+	    break;
+	if (secs > 0 && r->sec + secs < newest->sec)
+	    break;
+	first = r;
+    }
+    return first;
+}
+
+
+const WvLogRing::Record *WvLogRing::next_record(const Record *r) const
+{
+    unsigned long long last = ring->last;
+    if (r->pos >= last || last == NO_RECORD)
+	return NULL;
+
+    // either it follows right after, or it didn't fit and went back to
+    // the start of the ring.
+    unsigned long long pos = r->pos + record_size(r->srclen, r->msglen);
+    for (int tries = 0; tries < 2; tries++)
+    {
+	const Record *n = (const Record *)(data + pos % datasize);
+	if (pos % datasize + 32 <= datasize
+		&& n->pos == pos && n->magic == RECORD_MAGIC)
+	    return n;
+	pos += datasize - pos % datasize;
+    }
+    return NULL;
+}
+
+
+void WvLogRing::feed_receiver(WvLogRcv &receiver, int secs)
+{
+    if (!ring)
+	return;
+    for (const Record *r = find_first(secs); r; r = next_record(r))
+	receiver.log(r->source(), r->level, r->msg(), r->msglen);
+}
+
+
+void WvLogRing::dump(WvStream &s, int secs)
+{
+    if (!ring)
+	return;
+    for (const Record *r = find_first(secs); r; r = next_record(r))
+    {
+	int lvl = r->level < WvLog::NUM_LOGLEVELS ? r->level : WvLog::Debug5;
+	s.print("%s %s<%s>: ", r->sec, r->source(), WvLogRcv::loglevels[lvl]);
+	s.write(r->msg(), r->msglen);
+	if (!r->msglen || r->msg()[r->msglen - 1] != '\n')
+	    s.write("\n", 1);
+    }
+}
+
+
+// convert 'num' to a string and write it to fd, without using stdio.
+static void wrn(int fd, unsigned int num)
+{
+    char buf[16];
+    int i = sizeof(buf);
+    do
+    {
+	buf[--i] = '0' + num % 10;
+	num /= 10;
+    } while (num && i > 0);
+    write(fd, buf + i, sizeof(buf) - i);
+}
+
+
+static void wr(int fd, const char *str)
+{
+    write(fd, str, strlen(str));
+}
+
+
+void WvLogRing::dump_fd(int fd, int secs) const
+{
+    if (!ring)
+	return;
+
+    const Record *r = find_first(secs);
+    if (!r)
+	return;
+
+    wr(fd, "\nRecent log messages:\n");
+    for (; r; r = next_record(r))
+    {
+	int lvl = r->level < WvLog::NUM_LOGLEVELS ? r->level : WvLog::Debug5;
+	wrn(fd, r->sec);
+	wr(fd, " ");
+	wr(fd, r->source());
+	wr(fd, "<");
+	wr(fd, WvLogRcv::loglevels[lvl]);
+	wr(fd, ">: ");
+	write(fd, r->msg(), r->msglen);
+	if (!r->msglen || r->msg()[r->msglen - 1] != '\n')
+	    wr(fd, "\n");
+    }
+}
+
+
+void WvLogRing::crash_dump(int fd, void *userdata)
+{
+    WvLogRing *ring = (WvLogRing *)userdata;
+    ring->dump_fd(fd, ring->crash_secs);
+}
@@ -19,6 +19,28 @@ WvSubProcQueueStream::~WvSubProcQueueStream()
 }
 
 
+void WvSubProcQueueStream::pre_select(SelectInfo &si)
+{
+    WvStream::pre_select(si);
+    
+    int fd = getexitfd();
+    if (fd >= 0 && running())
+    {
+	FD_SET(fd, &si.read);
+	if (si.max_fd < fd)
+	    si.max_fd = fd;
+    }
+}
+
+
+bool WvSubProcQueueStream::post_select(SelectInfo &si)
+{
+    bool result = WvStream::post_select(si);
+    int fd = getexitfd();
+    return result || (fd >= 0 && FD_ISSET(fd, &si.read));
+}
+
+
 void WvSubProcQueueStream::execute()
 {
     int started = WvSubProcQueue::go();
@@ -30,6 +52,8 @@ void WvSubProcQueueStream::execute()
 	alarm(1000); // nothing is even in the queue; come back later.
     else if (started)
 	alarm(0); // we're busy; go fast if possible
+    else if (getexitfd() >= 0 && !needs_polling())
+	alarm(1000); // we'll hear about it when something exits
     else
 	alarm(100); // no processes were ready *this* time; wait longer
 }
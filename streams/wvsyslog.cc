@@ -10,11 +10,36 @@
 #include <time.h>
 #include <syslog.h>
 
+#ifndef _WIN32
+// Passes queued lines to syslog() from the WvLogAsync writer thread.
+class WvSyslogWriter : public WvLogAsync
+{
+public:
+    WvSyslogWriter(size_t queue_size, OverflowPolicy policy)
+	: WvLogAsync(queue_size, policy)
+        { }
+    virtual ~WvSyslogWriter()
+        { stop(); }
+
+protected:
+    virtual void write_records(const struct iovec *iov, const int *levels,
+			       int count)
+    {
+	for (int i = 0; i < count; i++)
+	    syslog(levels[i], "%s", (const char *)iov[i].iov_base);
+    }
+};
+#endif
+
+
 WvSyslog::WvSyslog(WvStringParm _prefix, bool _include_appname,
 		   WvLog::LogLevel _first_debug,
 		   WvLog::LogLevel _max_level)
 	: WvLogRcv(_max_level), syslog_prefix(_prefix)
 {
+#ifndef _WIN32
+    async = NULL;
+#endif
     first_debug = _first_debug;
     include_appname = _include_appname;
     openlog(syslog_prefix, 0, LOG_DAEMON);
@@ -24,10 +49,31 @@ WvSyslog::WvSyslog(WvStringParm _prefix, bool _include_appname,
 WvSyslog::~WvSyslog()
 {
     end_line();
+#ifndef _WIN32
+    delete async; // drains the queue first
+#endif
     closelog();
 }
 
 
+#ifndef _WIN32
+bool WvSyslog::set_async(size_t queue_size, WvLogAsync::OverflowPolicy policy)
+{
+    if (async)
+	return true;
+
+    async = new WvSyslogWriter(queue_size, policy);
+    if (!async->start())
+    {
+	delete async;
+	async = NULL;
+	return false;
+    }
+    return true;
+}
+#endif
+
+
 void WvSyslog::_begin_line()
 {
     if (include_appname)
@@ -74,6 +120,14 @@ void WvSyslog::_end_line()
 	if (last_level < first_debug && lev == LOG_DEBUG)
 	    lev = LOG_INFO;
 	
+#ifndef _WIN32
+	if (lev >= 0 && async)
+	{
+	    size_t used = current.used();
+	    async->push(lev, (const char *)current.get(used), used);
+	}
+	else
+#endif
 	if (lev >= 0)
 	{
 	    current.put("", 1); // null-terminate
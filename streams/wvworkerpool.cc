@@ -0,0 +1,192 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * A pool of worker threads for CPU-heavy jobs.  See wvworkerpool.h.
+ */
+#include "wvworkerpool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+// the WvFdStream constructor runs before we get to make the pipe, so
+// make it here and hand the read end over.
+static int make_pipe(int &wfd)
+{
+    int fds[2];
+    if (pipe(fds) < 0)
+    {
+	wfd = -1;
+	return -1;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+	fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    wfd = fds[1];
+    return fds[0];
+}
+
+
+WvWorkerPool::WvWorkerPool(int _nthreads)
+    : WvFdStream(make_pipe(wakefd), -1)
+{
+    running = 0;
+    want_stop = false;
+    npending = 0;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&wake, NULL);
+    pthread_cond_init(&progress, NULL);
+
+    if (_nthreads <= 0)
+	_nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (_nthreads <= 0)
+	_nthreads = 1;
+
+    nthreads = 0;
+    workers = new pthread_t[_nthreads];
+    if (wakefd < 0)
+    {
+	seterr(errno);
+	return;
+    }
+    for (int i = 0; i < _nthreads; i++)
+    {
+	if (pthread_create(&workers[nthreads], NULL, thread_main, this) == 0)
+	    nthreads++;
+    }
+}
+
+
+WvWorkerPool::~WvWorkerPool()
+{
+    pthread_mutex_lock(&lock);
+    want_stop = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    for (int i = 0; i < nthreads; i++)
+	pthread_join(workers[i], NULL);
+    delete[] workers;
+
+    // the lists don't own the jobs, since they move between them
+    JobList::Iter i(queue);
+    for (i.rewind(); i.next(); )
+	delete i.ptr();
+    JobList::Iter j(finished);
+    for (j.rewind(); j.next(); )
+	delete j.ptr();
+    if (wakefd >= 0)
+	::close(wakefd);
+    pthread_cond_destroy(&progress);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+}
+
+
+void WvWorkerPool::add(const WvWorkerJob &job, const WvWorkerDone &done)
+{
+    Job *j = new Job(job, done);
+    npending++;
+
+    if (!nthreads)
+    {
+	j->job();
+	pthread_mutex_lock(&lock);
+	finished.append(j, false);
+	pthread_mutex_unlock(&lock);
+	::write(wakefd, "", 1);
+	return;
+    }
+
+    pthread_mutex_lock(&lock);
+    queue.append(j, false);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+
+void WvWorkerPool::finish()
+{
+    pthread_mutex_lock(&lock);
+    while (!queue.isempty() || running)
+	pthread_cond_wait(&progress, &lock);
+    pthread_mutex_unlock(&lock);
+    deliver();
+}
+
+
+void WvWorkerPool::execute()
+{
+    WvFdStream::execute();
+    deliver();
+}
+
+
+void WvWorkerPool::deliver()
+{
+    // empty the pipe first, so a job finishing after we look at the list
+    // wakes us up again.
+    char buf[256];
+    while (::read(getrfd(), buf, sizeof(buf)) > 0)
+	;
+
+    JobList done;
+    pthread_mutex_lock(&lock);
+    while (!finished.isempty())
+    {
+	Job *j = finished.first();
+	finished.unlink_first();
+	done.append(j, false);
+    }
+    pthread_mutex_unlock(&lock);
+
+    // the done functions might add() more jobs, so don't hold the lock
+    while (!done.isempty())
+    {
+	Job *j = done.first();
+	done.unlink_first();
+	npending--;
+	WvWorkerDone cb = j->done;
+	delete j;
+	if (cb)
+	    cb();
+    }
+}
+
+
+void *WvWorkerPool::thread_main(void *userdata)
+{
+    ((WvWorkerPool *)userdata)->run();
+    return NULL;
+}
+
+
+void WvWorkerPool::run()
+{
+    pthread_mutex_lock(&lock);
+    for (;;)
+    {
+	while (queue.isempty() && !want_stop)
+	    pthread_cond_wait(&wake, &lock);
+	if (want_stop)
+	    break;
+
+	Job *j = queue.first();
+	queue.unlink_first();
+	running++;
+	pthread_mutex_unlock(&lock);
+
+	j->job();
+
+	pthread_mutex_lock(&lock);
+	running--;
+	bool was_empty = finished.isempty();
+	finished.append(j, false);
+	if (was_empty)
+	    ::write(wakefd, "", 1);
+	pthread_cond_broadcast(&progress);
+    }
+    pthread_mutex_unlock(&lock);
+}
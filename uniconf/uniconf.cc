@@ -428,12 +428,15 @@ int UniConf::SortedIterBase::defcomparator(const UniConf &a,
 }
 
 
-static UniConf::SortedIterBase::Comparator innercomparator = NULL;
-
-static bool wrapcomparator(const UniConf &a, const UniConf &b)
+// turns a UniConf::SortedIterBase::Comparator into what std::sort() wants
+struct UniConfLess
 {
-    return innercomparator(a, b) < 0;
-}
+    UniConf::SortedIterBase::Comparator cmp;
+    
+    UniConfLess(UniConf::SortedIterBase::Comparator _cmp) : cmp(_cmp) { }
+    bool operator()(const UniConf &a, const UniConf &b) const
+        { return cmp(a, b) < 0; }
+};
 
 
 void UniConf::SortedIterBase::_purge()
@@ -448,9 +451,7 @@ void UniConf::SortedIterBase::_rewind()
     index = 0;
     count = xkeys.size();
     
-    // This code is NOT reentrant because qsort makes it too hard
-    innercomparator = xcomparator;
-    std::sort(xkeys.begin(), xkeys.end(), wrapcomparator);
+    std::stable_sort(xkeys.begin(), xkeys.end(), UniConfLess(xcomparator));
 }
 
 
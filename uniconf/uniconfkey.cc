@@ -8,6 +8,7 @@
 #include "wvstream.h"
 #include "uniconfkey.h"
 #include "wvhash.h"
+#include "wvstringcache.h"
 #include <climits>
 #include <assert.h>
 #include <strutils.h>
@@ -33,6 +34,14 @@ unsigned WvHash(const UniConfKey &k)
     return result;
 }
 
+// Long segment names tend to turn up in lots of keys, so share them.  This
+// is never deleted, since static keys might still be using it at exit.
+static WvStringCache &segment_cache()
+{
+    static WvStringCache *cache = new WvStringCache;
+    return *cache;
+}
+
 // The initial value of 1 for the ref_count of these guarantees
 // that they won't ever be deleted
 UniConfKey::Store UniConfKey::EMPTY_store(1, 1);
@@ -61,7 +70,7 @@ UniConfKey::Store::Store(int size, int _ref_count,
     {
         if (!*part)
             continue;
-        segments.append(*part);
+        segments.append(segment_cache().get(*part));
     }
     if (!!key && key[key.len()-1] == '/' && segments.used() > 0)
         segments.append(Segment());
@@ -259,3 +259,95 @@ WVTEST_MAIN("WvHttpPool pipelining")
     WVPASS(listener->isok());
 }
 
+
+
+unsigned int keepalive_conns = 0;
+
+static void keepalive_callback(WvStream &s)
+{
+    char *line;
+    while ((line = s.getline()) != NULL)
+    {
+        if (strncmp(line, "GET", 3) == 0)
+            s.print("HTTP/1.1 200 OK\n"
+                    "Content-Length: 5\n"
+                    "Content-Type: text/html\n\n"
+                    "Foo!\n");
+    }
+}
+
+
+static void keepalive_listener_callback(WvIStreamList *list,
+                                        IWvStream *_newconn)
+{
+    keepalive_conns++;
+    WvStreamClone *newconn = new WvStreamClone(_newconn);
+    newconn->setcallback(wv::bind(keepalive_callback, wv::ref(*newconn)));
+    list->append(newconn, true, "incoming keepalive conn");
+}
+
+
+static void discard_callback(WvStream &s)
+{
+    char buf[1024];
+    s.read(buf, sizeof(buf));
+}
+
+
+static void add_urls(WvHttpPool &pool, WvIStreamList &bufs,
+                     unsigned int port, int num)
+{
+    for (int i = 0; i < num; i++)
+    {
+        WvStream *buf;
+        WVPASS(buf = pool.addurl(WvString("http://127.0.0.1:%s/%s.html",
+                                          port, i)));
+        buf->setcallback(wv::bind(discard_callback, wv::ref(*buf)));
+        bufs.append(buf, true, "poolbuf");
+    }
+}
+
+
+WVTEST_MAIN("WvHttpPool per-host connections")
+{
+    WvIStreamList l;
+
+    unsigned int port = 4300;
+    WvTCPListener *listener;
+    while (!(listener = new WvTCPListener(port))->isok())
+    {
+        WVRELEASE(listener);
+        ++port;
+    }
+    listener->onaccept(wv::bind(keepalive_listener_callback, &l, _1));
+    l.append(listener, true, "http listener");
+
+    bool old_pipelining = WvHttpStream::global_enable_pipelining;
+    WvHttpStream::global_enable_pipelining = false;
+    {
+        WvHttpPool pool;
+        pool.max_conns_per_host = 3;
+        WvIStreamList bufs;
+        l.append(&pool, false, "WvHttpPool");
+        l.append(&bufs, false, "list of bufs");
+
+        // without pipelining, six requests get spread over three
+        // connections...
+        add_urls(pool, bufs, port, 6);
+        for (int i = 0; i < 500 && bufs.count(); i++)
+            l.runonce(10);
+        WVPASSEQ(bufs.count(), 0);
+        WVPASSEQ(keepalive_conns, 3);
+
+        // ...which then stick around to be reused.
+        add_urls(pool, bufs, port, 2);
+        for (int i = 0; i < 500 && bufs.count(); i++)
+            l.runonce(10);
+        WVPASSEQ(bufs.count(), 0);
+        WVPASSEQ(keepalive_conns, 3);
+
+        l.unlink(&bufs);
+        l.unlink(&pool);
+    }
+    WvHttpStream::global_enable_pipelining = old_pipelining;
+}
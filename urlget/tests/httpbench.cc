@@ -0,0 +1,185 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * WvHttpPool throughput benchmark.  Forks a trivial HTTP server on the
+ * loopback interface, downloads a big file from it, and reports how fast
+ * the body came through.
+ *
+ * Usage: httpbench [-c] [megabytes]
+ *    -c   use chunked transfer encoding instead of Content-Length
+ */
+#include "wvhttppool.h"
+#include "wvtimeutils.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+
+static bool write_all(int fd, const char *buf, size_t len)
+{
+    while (len)
+    {
+	ssize_t ret = write(fd, buf, len);
+	if (ret < 0 && errno == EINTR)
+	    continue;
+	if (ret <= 0)
+	    return false;
+	buf += ret;
+	len -= ret;
+    }
+    return true;
+}
+
+
+// Answers every request on 'listenfd' with 'size' bytes of junk, one
+// request per connection.  Never returns.
+static void serve(int listenfd, size_t size, bool chunked)
+{
+    static char block[65536];
+    memset(block, 'x', sizeof(block));
+
+    for (;;)
+    {
+	int fd = accept(listenfd, NULL, NULL);
+	if (fd < 0)
+	    continue;
+
+	// read (and ignore) the request headers
+	char req[4096];
+	size_t got = 0;
+	while (got < sizeof(req) - 1)
+	{
+	    ssize_t ret = read(fd, req + got, sizeof(req) - 1 - got);
+	    if (ret <= 0)
+		break;
+	    got += ret;
+	    req[got] = 0;
+	    if (strstr(req, "\r\n\r\n"))
+		break;
+	}
+
+	char hdr[256];
+	if (chunked)
+	    snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+		     "Transfer-Encoding: chunked\r\n"
+		     "Connection: close\r\n\r\n");
+	else
+	    snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n"
+		     "Content-Length: %lu\r\n"
+		     "Connection: close\r\n\r\n", (unsigned long)size);
+	bool ok = write_all(fd, hdr, strlen(hdr));
+
+	for (size_t left = size; ok && left; )
+	{
+	    size_t len = left < sizeof(block) ? left : sizeof(block);
+	    if (chunked)
+	    {
+		snprintf(hdr, sizeof(hdr), "%lx\r\n", (unsigned long)len);
+		ok = write_all(fd, hdr, strlen(hdr));
+	    }
+	    ok = ok && write_all(fd, block, len);
+	    if (chunked)
+		ok = ok && write_all(fd, "\r\n", 2);
+	    left -= len;
+	}
+	if (ok && chunked)
+	    write_all(fd, "0\r\n\r\n", 5);
+	close(fd);
+    }
+}
+
+
+static void got_data(WvStream &s, size_t &total)
+{
+    WvDynBuf sink;
+    size_t len;
+    while ((len = s.read(sink, 1024*1024)) > 0)
+    {
+	total += len;
+	sink.zap();
+    }
+}
+
+
+static void closed(bool &done)
+{
+    done = true;
+}
+
+
+int main(int argc, char **argv)
+{
+    bool chunked = false;
+    size_t megs = 256;
+    for (int i = 1; i < argc; i++)
+    {
+	if (!strcmp(argv[i], "-c"))
+	    chunked = true;
+	else
+	    megs = atoi(argv[i]);
+    }
+    size_t size = megs * 1024 * 1024;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sin;
+    socklen_t sinlen = sizeof(sin);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (listenfd < 0
+	    || bind(listenfd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+	    || listen(listenfd, 5) < 0
+	    || getsockname(listenfd, (struct sockaddr *)&sin, &sinlen) < 0)
+    {
+	perror("httpbench: listen");
+	return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+	perror("httpbench: fork");
+	return 1;
+    }
+    if (!pid)
+	serve(listenfd, size, chunked);
+    close(listenfd);
+
+    // keep the numbers about the body, not the pipelining check
+    WvHttpStream::global_enable_pipelining = false;
+
+    WvIStreamList l;
+    WvHttpPool pool;
+    l.append(&pool, false, "WvHttpPool");
+
+    size_t total = 0;
+    WvTime start = wvtime();
+    WvStream *s = pool.addurl(WvString("http://127.0.0.1:%s/bench",
+				       ntohs(sin.sin_port)));
+    bool done = false;
+    s->setcallback(wv::bind(got_data, wv::ref(*s), wv::ref(total)));
+    s->setclosecallback(wv::bind(closed, wv::ref(done)));
+    l.append(s, true, "url");
+
+    while (!done || !pool.idle())
+	l.runonce();
+    double secs = msecdiff(wvtime(), start) / 1000.0;
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    printf("%s: %lu of %lu bytes in %.3f seconds (%.1f MB/s)\n",
+	   chunked ? "chunked" : "content-length",
+	   (unsigned long)total, (unsigned long)size, secs,
+	   secs > 0 ? total / secs / (1024*1024) : 0.0);
+    return total == size ? 0 : 1;
+}
@@ -63,6 +63,8 @@ void WvUrlRequest::done()
     {
         outstream->seteof();
         outstream = NULL; 
+        if (ondone)
+            ondone(this);
     }
     if (putstream)
         putstream = NULL;
@@ -96,11 +98,14 @@ void WvUrlStream::delurl(WvUrlRequest *url)
 
 
 WvHttpPool::WvHttpPool() 
-    : log("HTTP Pool", WvLog::Debug), conns(10),
+    : log("HTTP Pool", WvLog::Debug), hosts(10),
       pipeline_incompatible(50)
 {
     log("Pool initializing.\n");
     num_streams_created = 0;
+    dispatch_needed = false;
+    max_conns_per_host = 1;
+    idle_timeout = 5000;
 }
 
 
@@ -111,38 +116,53 @@ WvHttpPool::~WvHttpPool()
     if (geterr())
         log("Error was: %s\n", errstr());
 
+    // the URLs get done() as they're deleted, but we won't be around to
+    // hear about it.
+    WvUrlRequestList::Iter i(urls);
+    for (i.rewind(); i.next(); )
+        i->ondone = WvUrlRequestCallback();
+    pending.zap();
+    waiting.zap();
+    finished.zap();
+
     // these must get zapped before the URL list, since they have pointers
     // to URLs.
     zap();
-    conns.zap();
+    hosts.zap();
 }
 
 
 void WvHttpPool::pre_select(SelectInfo &si)
 {
-    //    log(WvLog::Debug5, "pre_select: main:%s conns:%s urls:%s\n",
-    //         count(), conns.count(), urls.count());
+    //    log(WvLog::Debug5, "pre_select: main:%s hosts:%s urls:%s\n",
+    //         count(), hosts.count(), urls.count());
 
     WvIStreamList::pre_select(si);
 
-    WvUrlStreamDict::Iter ci(conns);
-    for (ci.rewind(); ci.next(); )
+    if (dispatch_needed || !finished.isempty())
+        si.msec_timeout = 0;
+
+    WvUrlHostDict::Iter hi(hosts);
+    for (hi.rewind(); hi.next(); )
     {
-        if (!ci->isok())
-            si.msec_timeout = 0;
+        WvUrlStreamList::Iter ci(hi->streams);
+        for (ci.rewind(); ci.next(); )
+        {
+            if (!ci->isok())
+                si.msec_timeout = 0;
+        }
     }
     
-    WvUrlRequestList::Iter i(urls);
+    // requests for the same host tend to come in bunches, so don't ask
+    // about the same name over and over.
+    WvString lasthost;
+    WvUrlRequestList::Iter i(pending);
     for (i.rewind(); i.next(); )
     {
-        if (!i->instream)
-        {
-            log(WvLog::Debug4, "Checking dns for '%s'\n", i->url.gethost());
-            if (i->url.resolve())
-                si.msec_timeout = 0;
-            else
-                dns.pre_select(i->url.gethost(), si);    
-        }
+        if (i->url.gethost() == lasthost)
+            continue;
+        lasthost = i->url.gethost();
+        dns.pre_select(lasthost, si);
     }
 }
 
@@ -151,50 +171,60 @@ bool WvHttpPool::post_select(SelectInfo &si)
 {
     bool sure = false;
 
-    WvUrlStreamDict::Iter ci(conns);
-    for (ci.rewind(); ci.next(); )
+    WvUrlHostDict::Iter hi(hosts);
+    for (hi.rewind(); hi.next(); )
     {
-        if (!ci->isok())
+        WvUrlStreamList::Iter ci(hi->streams);
+        for (ci.rewind(); ci.next(); )
         {
-            log(WvLog::Debug4, "Selecting true because of a dead stream.\n");
-            unconnect(ci.ptr());
-            ci.rewind();
-            sure = true;
+            if (!ci->isok())
+            {
+                log(WvLog::Debug4,
+                    "Selecting true because of a dead stream.\n");
+                unconnect(hi.ptr(), ci.ptr());
+                ci.rewind();
+                sure = true;
+            }
         }
     }
 
-    WvUrlRequestList::Iter i(urls);
+    WvString lasthost;
+    WvUrlRequestList::Iter i(pending);
     for (i.rewind(); i.next(); )
     {
-        if ((!i->outstream && !i->inuse) || !i->url.isok())
+        if (!i->url.isok())
         {
-            //log("'%s' is dead: %s/%s\n", 
-            //	i->url, i->url.isok(), i.outstream->isok());
-            if (!i->url.isok())
-            {
-                log("URL not okay: '%s'\n", i->url);
-                i->done();
-            }
-            // nicely delete the url request
-            WvUrlStream::Target target(i->url.getaddr(), i->url.getuser());
-            WvUrlStream *s = conns[target];
-            if (s)
-                s->delurl(i.ptr());
+            log("URL not okay: '%s'\n", i->url);
+            i->done();
             i.xunlink();
+            sure = true;
             continue;
         }
 
-        if (!i->instream)
+        if (i->url.gethost() == lasthost)
+            continue;
+        lasthost = i->url.gethost();
+        if (dns.post_select(lasthost, si))
         {
-            log(WvLog::Debug4, "Checking dns for '%s'\n", i->url.gethost());
-            if (i->url.resolve() || dns.post_select(i->url.gethost(), si))
-            {
-                log(WvLog::Debug4, "Selecting true because of '%s'\n", i->url);
-                sure = true;
-            }
+            log(WvLog::Debug4, "Selecting true because of '%s'\n", i->url);
+            dispatch_needed = sure = true;
         }
     }
 
+    // nicely delete the finished url requests
+    WvUrlRequestList::Iter fi(finished);
+    for (fi.rewind(); fi.next(); )
+    {
+        WvUrlRequest *url = fi.ptr();
+        fi.xunlink();
+        if (url->instream)
+            url->instream->delurl(url);
+        pending.unlink(url);
+        waiting.unlink(url);
+        urls.unlink(url);
+        dispatch_needed = sure = true;
+    }
+
     return WvIStreamList::post_select(si) || sure;
 }
 
@@ -203,52 +233,99 @@ void WvHttpPool::execute()
 {
     WvIStreamList::execute();
 
-    WvUrlRequestList::Iter i(urls);
+    if (!dispatch_needed)
+        return;
+    dispatch_needed = false;
+
+    WvUrlRequestList::Iter i(pending);
     for (i.rewind(); i.next(); )
     {
-        WvUrlStream *s;
+        if (!i->outstream || !i->url.isok())
+            continue; // post_select will deal with it
+        if (i->url.resolve())
+        {
+            WvUrlRequest *url = i.ptr();
+            i.xunlink();
+            waiting.append(url, false, "waiting for a connection");
+        }
+    }
 
-        if (!i->outstream || !i->url.isok() || !i->url.resolve())
-            continue; // skip it for now
+    WvUrlRequestList::Iter j(waiting);
+    for (j.rewind(); j.next(); )
+    {
+        WvUrlRequest *url = j.ptr();
+        if (!url->outstream)
+            continue; // finished in the meantime
 
-        WvUrlStream::Target target(i->url.getaddr(), i->url.getuser());
+        WvUrlStream *s = pick_stream(url);
+        if (!s)
+            continue; // all the connections to its server are busy
 
-        //log(WvLog::Info, "remaddr is %s; username is %s\n", target.remaddr,
-        //    target.username);
-        s = conns[target];
-        //if (!s) log("conn for '%s' is not found.\n", ip);
+        j.xunlink();
+        s->addurl(url);
+        url->instream = s;
+    }
+}
 
-        if (s && !s->isok())
-        {
-            unconnect(s);
-            s = NULL;
-        }
 
-        if (!i->outstream)
-            continue; // unconnect might have caused this URL to be marked bad
+// Find the best connection for 'url', opening a new one if that's what it
+// should get.  Returns NULL if it has to wait for a connection to free up.
+WvUrlStream *WvHttpPool::pick_stream(WvUrlRequest *url)
+{
+    WvUrlStream::Target target(url->url.getaddr(), url->url.getuser());
 
-        if (!s)
-        {
-            num_streams_created++;
-            if (!strncasecmp(i->url.getproto(), "http", 4))
-                s = new WvHttpStream(target.remaddr, target.username,
-                        i->url.getproto() == "https",
-                        pipeline_incompatible);
-            else if (!strcasecmp(i->url.getproto(), "ftp"))
-                s = new WvFtpStream(target.remaddr, target.username,
-                        i->url.getpassword());
-            conns.add(s, true);
-
-            // add it to the streamlist, so it can do things
-            append(s, false, "http/ftp stream");
-        }
+    //log(WvLog::Info, "remaddr is %s; username is %s\n", target.remaddr,
+    //    target.username);
+    WvUrlHost *host = hosts[target];
+    if (!host)
+    {
+        host = new WvUrlHost(target);
+        hosts.add(host, true);
+    }
 
-        if (!i->instream)
+    WvUrlStream *best = NULL;
+    size_t best_load = 0;
+    int num = 0;
+    WvUrlStreamList::Iter i(host->streams);
+    for (i.rewind(); i.next(); )
+    {
+        num++;
+        if (!i->isok() || i->used_up())
+            continue;
+        size_t load = i->load();
+        if (!best || load < best_load)
         {
-            s->addurl(i.ptr());
-            i->instream = s;
+            best = i.ptr();
+            best_load = load;
         }
     }
+
+    // only pile onto a busy connection if we can't open another one
+    if ((best && !best_load) || num >= max_conns_per_host)
+        return best;
+
+    WvUrlStream *s;
+    if (!strncasecmp(url->url.getproto(), "http", 4))
+        s = new WvHttpStream(target.remaddr, target.username,
+                url->url.getproto() == "https",
+                pipeline_incompatible);
+    else if (!strcasecmp(url->url.getproto(), "ftp"))
+        s = new WvFtpStream(target.remaddr, target.username,
+                url->url.getpassword());
+    else
+    {
+        log("Unsupported protocol: '%s'\n", url->url);
+        url->done();
+        return NULL;
+    }
+
+    num_streams_created++;
+    s->idle_msec = idle_timeout;
+    host->streams.append(s, true, "http/ftp stream");
+
+    // add it to the streamlist, so it can do things
+    append(s, false, "http/ftp stream");
+    return s;
 }
 
 
@@ -258,13 +335,22 @@ WvBufUrlStream *WvHttpPool::addurl(WvStringParm _url, WvStringParm _method,
     log(WvLog::Debug4, "Adding a new url to pool: '%s'\n", _url);
     WvUrlRequest *url = new WvUrlRequest(_url, _method, _headers, content_source,
                                          create_dirs, false);
+    url->ondone = wv::bind(&WvHttpPool::url_done, this, _1);
     urls.append(url, true, "addurl");
+    pending.append(url, false, "waiting for dns");
+    dispatch_needed = true;
 
     return url->outstream;
 }
 
 
-void WvHttpPool::unconnect(WvUrlStream *s)
+void WvHttpPool::url_done(WvUrlRequest *url)
+{
+    finished.append(url, false, "finished url");
+}
+
+
+void WvHttpPool::unconnect(WvUrlHost *host, WvUrlStream *s)
 {
     if (!s->target.username)
         log("Unconnecting stream to %s.\n", s->target.remaddr);
@@ -272,13 +358,19 @@ void WvHttpPool::unconnect(WvUrlStream *s)
         log("Unconnecting stream to %s@%s.\n", s->target.username,
                 s->target.remaddr);
 
+    // whatever it didn't finish has to go somewhere else
     WvUrlRequestList::Iter i(urls);
     for (i.rewind(); i.next(); )
     {
         if (i->instream == s)
+        {
             i->instream = NULL;
+            if (i->outstream)
+                waiting.append(i.ptr(), false, "waiting for a connection");
+        }
     }
+    dispatch_needed = true;
 
     unlink(s);
-    conns.remove(s);
+    host->streams.unlink(s);
 }
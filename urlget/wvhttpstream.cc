@@ -24,7 +24,7 @@ WvHttpStream::WvHttpStream(const WvIPPortAddr &_remaddr, WvStringParm _username,
                 bool _ssl, WvIPPortAddrTable &_pipeline_incompatible)
     : WvUrlStream(_remaddr, _username, WvString("HTTP %s", _remaddr)),
       pipeline_incompatible(_pipeline_incompatible),
-      in_doneurl(false)
+      in_doneurl(false), body_buf(BODY_CHUNK, BODY_CHUNK)
 {
     log("Opening server connection.\n");
     http_response = "";
@@ -336,9 +336,47 @@ bool WvHttpStream::post_select(SelectInfo &si)
 }
 
 
+// Read up to 'count' bytes of body data (at most BODY_CHUNK) and hand them
+// to the current url's outstream, or throw them away if 'deliver' is false
+// or nobody is listening anymore.
+//
+// The data is read straight into body_buf, whose chunks are exactly
+// BODY_CHUNK bytes, so WvBufStream::write() can link a big read into the
+// outstream without copying it again; body_buf then starts a new chunk.
+// Small reads are copied instead, so that a trickle of tiny packets doesn't
+// pin down a whole chunk apiece, and body_buf's chunk gets reused.
+size_t WvHttpStream::pass_body(size_t count, bool deliver)
+{
+    if (count > BODY_CHUNK)
+        count = BODY_CHUNK;
+    if (!count)
+        return 0;
+
+    assert(!body_buf.used());
+    size_t len = read(body_buf.alloc(count), count);
+    body_buf.unalloc(count - len);
+
+    // read() can close us, which finishes off curl
+    if (!len || !deliver || !curl || !curl->outstream)
+    {
+        body_buf.skip(len);
+        return len;
+    }
+
+    if (len >= BODY_CHUNK / 2)
+        curl->outstream->write(body_buf, len);
+    else
+        curl->outstream->write(body_buf.get(len), len);
+
+    // whatever the outstream didn't take is lost, just like before
+    body_buf.skip(body_buf.used());
+    return len;
+}
+
+
 void WvHttpStream::execute()
 {
-    char buf[1024], *line;
+    char *line;
     size_t len;
 
     WvStreamClone::execute();
@@ -397,7 +435,7 @@ void WvHttpStream::execute()
             {
                 int len = 0;
                 if(url->putstream->isok())
-                    len = url->putstream->read(putstream_data, 1024);
+                    len = url->putstream->read(putstream_data, BODY_CHUNK);
 
                 if(!url->putstream->isok() || len == 0)
                 {
@@ -552,7 +590,7 @@ void WvHttpStream::execute()
     }
     else if (encoding == ChuckInfinity)
     {
-	len = read(buf, sizeof(buf));
+	len = pass_body(BODY_CHUNK, false);
 	if (len)
 	    log(WvLog::Debug5, "Chucking %s bytes.\n", len);
 	if (!isok())
@@ -564,10 +602,7 @@ void WvHttpStream::execute()
     }
     else if (encoding == ChuckChunked || encoding == ChuckStream)
     {
-	if (bytes_remaining > sizeof(buf))
-	    len = read(buf, sizeof(buf));
-	else
-	    len = read(buf, bytes_remaining);
+	len = pass_body(bytes_remaining, false);
 	bytes_remaining -= len;
 	if (len)
 	    log(WvLog::Debug5,
@@ -612,14 +647,12 @@ void WvHttpStream::execute()
         // just read data until the connection closes, and assume all was
         // well.  It sucks, but there's no way to tell if all the data arrived
         // okay... that's why Chunked or ContentLength encoding is better.
-        len = read(buf, sizeof(buf));
+        len = pass_body(BODY_CHUNK, true);
 	if (!isok())
 	    return;
 
         if (len)
             log(WvLog::Debug5, "Infinity: read %s bytes.\n", len);
-        if (curl && curl->outstream)
-            curl->outstream->write(buf, len);
 
         if (!isok() && curl)
             doneurl();
@@ -629,10 +662,7 @@ void WvHttpStream::execute()
         // in the data section of a chunked or content-length encoding,
         // with 'bytes_remaining' bytes of data left.
 
-        if (bytes_remaining > sizeof(buf))
-            len = read(buf, sizeof(buf));
-        else
-            len = read(buf, bytes_remaining);
+        len = pass_body(bytes_remaining, true);
 	if (!isok())
 	    return;
 
@@ -640,8 +670,6 @@ void WvHttpStream::execute()
         if (len)
             log(WvLog::Debug5, 
                     "Read %s bytes (%s bytes left).\n", len, bytes_remaining);
-        if (curl && curl->outstream)
-            curl->outstream->write(buf, len);
 
         if (!bytes_remaining && encoding == ContentLength && curl)
             doneurl();
@@ -654,7 +682,7 @@ void WvHttpStream::execute()
     }
 
     if (urls.isempty())
-        alarm(5000); // just wait a few seconds before closing connection
+        alarm(idle_msec); // wait a bit in case someone wants to reuse us
     else
         alarm(60000); // give the server a minute to respond, if we're waiting
 }
@@ -7,6 +7,7 @@
  */
 #include "strutils.h"
 #include "wvbuf.h"
+#include "wvstringmask.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <string.h>
@@ -29,6 +30,35 @@
 #endif
 #endif
 
+
+// every character but the ASCII letters and digits, and those in 'also'
+static WvStringMask not_alnum(const char *also)
+{
+    char chars[256], *cptr = chars;
+    for (int c = 1; c < 256; c++)
+        if (!(isascii(c) && isalnum(c)) && !strchr(also, c))
+            *cptr++ = c;
+    *cptr = 0;
+    return WvStringMask(chars);
+}
+
+
+// These are functions, so they work even before static constructors have
+// run.
+static const WvStringMask &backslash_nasties()
+{
+    static const WvStringMask mask(not_alnum(""));
+    return mask;
+}
+
+
+static const WvStringMask &url_nasties()
+{
+    // everything but RFC 2396's "unreserved" characters
+    static const WvStringMask mask(not_alnum("_.!~*'()-"));
+    return mask;
+}
+
 char *terminate_string(char *string, char c)
 /**********************************************/
 // Add character c to the end of a string after removing crlf's.
@@ -83,18 +113,12 @@ char *trim_string(char *string, char c)
 // Searches the string for c and removes it plus everything afterwards.
 // Modifies the string and returns NULL if string == NULL.
 {
-    char *p;
-
     if (string == NULL)
         return NULL;
 
-    p = string;
-
-    while (*p != 0 && *p != c)
-        p++;
-
-    while (*p)
-        *(p++) = 0;
+    char *p = strchr(string, c);
+    if (p)
+        memset(p, 0, strlen(p));
 
     return string;
 }
@@ -239,67 +263,87 @@ bool is_word(const char *p)
 }
 
 
+// write one line of hexdump_buffer() into 'cptr', and return the new end.
+// The line is at most HEXDUMP_LINE characters long.
+#define HEXDUMP_LINE (20 + 16*2 + 3 + 1 + 4 + 16 + 1)
+static char *hexdump_line(char *cptr, const unsigned char *buf, size_t count,
+                          size_t top, bool charRep)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t count2;
+
+    cptr += sprintf(cptr, "[%03X] ", (unsigned int)count);
+
+    // dump hex values
+    for (count2 = 0; count2 < top; count2++)
+    {
+        if (count2 && !(count2 % 4))
+            *cptr++ = ' ';
+        *cptr++ = hex[buf[count2] >> 4];
+        *cptr++ = hex[buf[count2] & 0xf];
+    }
+
+    // print horizontal separation
+    for (count2 = top; count2 < 16; count2++)
+    {
+        if (count2 && !(count2 % 4))
+            *cptr++ = ' ';
+        *cptr++ = ' ';
+        *cptr++ = ' ';
+    }
+
+    *cptr++ = ' ';
+
+    // dump character representation
+    if (charRep)
+    {
+        for (count2 = 0; count2 < top; count2++)
+        {
+            if (!(count2 % 4))
+                *cptr++ = ' ';
+            *cptr++ = (isprint(buf[count2]) ? buf[count2] : '.');
+        }
+    }
+
+    *cptr++ = '\n';
+    return cptr;
+}
+
+
 // produce a hexadecimal dump of the data buffer in 'buf' of length 'len'.
 // it is formatted with 16 bytes per line; each line has an address offset,
 // hex representation, and printable representation.
 WvString hexdump_buffer(const void *_buf, size_t len, bool charRep)
 {
     const unsigned char *buf = (const unsigned char *)_buf;
-    size_t count, count2, top;
     WvString out;
 
-    out.setsize(len / 16 * 80 + 80);
+    out.setsize((len + 15) / 16 * HEXDUMP_LINE + 1);
     char *cptr = out.edit();
-    
-    for (count = 0; count < len; count+=16)
-    {
-	top = len-count < 16 ? len-count : 16;
-	cptr += sprintf(cptr, "[%03X] ", (unsigned int)count);
-	
-	// dump hex values
-	for (count2 = 0; count2 < top; count2++)
-	{
-	    if (count2 && !(count2 % 4))
-		*cptr++ = ' ';
-	    cptr += sprintf(cptr, "%02X", buf[count+count2]);
-	}
-	
-	// print horizontal separation
-	for (count2 = top; count2 < 16; count2++)
-	{
-	    if (count2 && !(count2 % 4))
-	    {
-		strcat(cptr, "   ");
-		cptr += 3;
-	    }
-	    else
-	    {
-		strcat(cptr, "  ");
-		cptr += 2;
-	    }
-	}
-	
-	*cptr++ = ' ';
-	
-	// dump character representation
-	if (charRep)
-	{
-	    for (count2 = 0; count2 < top; count2++)
-	    {
-		if (!(count2 % 4))
-		    *cptr++ = ' ';
-	        *cptr++ = (isprint(buf[count+count2])
-			   ? buf[count+count2] : '.');
-	    }
-	}
 
-	*cptr++ = '\n';
-    }
+    for (size_t count = 0; count < len; count += 16)
+        cptr = hexdump_line(cptr, buf + count, count,
+                            len-count < 16 ? len-count : 16, charRep);
     *cptr = 0;
     return out;
 }
 
 
+void hexdump_buffer(WvBuf &out, const void *_buf, size_t len, bool charRep)
+{
+    const unsigned char *buf = (const unsigned char *)_buf;
+
+    for (size_t count = 0; count < len; count += 16)
+    {
+        // sprintf() wants room for its NUL, too
+        char *line = (char *)out.alloc(HEXDUMP_LINE + 1);
+        char *end = hexdump_line(line, buf + count, count,
+                                 len-count < 16 ? len-count : 16, charRep);
+        out.unalloc(HEXDUMP_LINE + 1 - (end - line));
+    }
+}
+
+
 // return true if the character is a newline.
 bool isnewline(char c)
 {
@@ -307,42 +351,107 @@ bool isnewline(char c)
 }
 
 
-// ex: WvString foo = url_decode("I+am+text.%0D%0A");
-WvString url_decode(WvStringParm str, bool no_space)
+// url-decode s[0..len) into 'out', which must have room for 'len' chars,
+// and return the new end of 'out'
+static char *url_decode(char *out, const char *s, size_t len, bool no_space)
 {
-    if (!str)
-        return str;
- 
-    const char *iptr;
-    char *optr;
-    const char *idx1, *idx2;
+    static const WvStringMask plus_or_percent("+%"), percent("%");
     static const char hex[] = "0123456789ABCDEF";
-    WvString in, intmp(str), out;
-
-    in = trim_string(intmp.edit());
-    out.setsize(strlen(in) + 1);
+    const WvStringMask &specials = no_space ? percent : plus_or_percent;
+    const char *end = s + len;
 
-    optr = out.edit();
-    for (iptr = in, optr = out.edit(); *iptr; iptr++)
+    for (;;)
     {
-        if (*iptr == '+' && !no_space)
-            *optr++ = ' ';
-        else if (*iptr == '%' && iptr[1] && iptr[2])
+        size_t n = specials.find(s, end - s);
+        memcpy(out, s, n);
+        out += n;
+        s += n;
+        if (s == end)
+            break;
+
+        if (*s == '+')
+            *out++ = ' ';
+        else if (end - s > 2)
         {
-            idx1 = strchr(hex, toupper((unsigned char) iptr[1]));
-            idx2 = strchr(hex, toupper((unsigned char) iptr[2]));
+            const char *idx1 = strchr(hex, toupper((unsigned char)s[1]));
+            const char *idx2 = strchr(hex, toupper((unsigned char)s[2]));
 
             if (idx1 && idx2)
-                *optr++ = ((idx1 - hex) << 4) | (idx2 - hex);
+                *out++ = ((idx1 - hex) << 4) | (idx2 - hex);
 
-            iptr += 2;
+            s += 2;
         }
         else
-            *optr++ = *iptr;
+            *out++ = *s;
+        s++;
     }
+    return out;
+}
+
+
+// find the part of 'str' that's left after trim_string(), without changing
+// it
+static const char *trimmed(WvStringParm str, size_t &len)
+{
+    const char *start = str, *end = start + str.len();
+    while (end > start && isspace((unsigned char)end[-1]))
+        end--;
+    while (start < end && isspace((unsigned char)*start))
+        start++;
+    len = end - start;
+    return start;
+}
 
-    *optr = 0;
 
+// ex: WvString foo = url_decode("I+am+text.%0D%0A");
+WvString url_decode(WvStringParm str, bool no_space)
+{
+    if (!str)
+        return str;
+
+    size_t len;
+    const char *in = trimmed(str, len);
+    WvString out;
+    out.setsize(len + 1);
+    *url_decode(out.edit(), in, len, no_space) = 0;
+    return out;
+}
+
+
+void url_decode(WvBuf &out, WvStringParm str, bool no_space)
+{
+    if (!str)
+        return;
+
+    size_t len;
+    const char *in = trimmed(str, len);
+    char *optr = (char *)out.alloc(len);
+    out.unalloc(len - (url_decode(optr, in, len, no_space) - optr));
+}
+
+
+// url-encode s[0..len) into 'out', which must have room for 3*len chars,
+// and return the new end of 'out'
+static char *url_encode(char *out, const char *s, size_t len,
+                        const WvStringMask &nasties)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    const char *end = s + len;
+
+    for (;;)
+    {
+        size_t n = nasties.find(s, end - s);
+        memcpy(out, s, n);
+        out += n;
+        s += n;
+        if (s == end)
+            break;
+
+        *out++ = '%';
+        *out++ = hex[(unsigned char)*s >> 4];
+        *out++ = hex[*s & 0xf];
+        s++;
+    }
     return out;
 }
 
@@ -350,26 +459,35 @@ WvString url_decode(WvStringParm str, bool no_space)
 // And its magic companion: url_encode
 WvString url_encode(WvStringParm str, WvStringParm unsafe)
 {
-    unsigned int i;
-    WvDynBuf retval;
-
-    for (i=0; i < str.len(); i++)
+    WvString out;
+    out.setsize(str.len() * 3 + 1);
+    char *end;
+    if (!!unsafe)
     {
-        if (((!!unsafe && !strchr(unsafe, str[i])) ||
-             (!unsafe && (isalnum(str[i]) || strchr("_.!~*'()-", str[i])))) &&
-            str[i] != '%')
-        {
-            retval.put(&str[i], 1);
-        }
-        else
-        {               
-            char buf[4];
-            sprintf(buf, "%%%02X", str[i] & 0xff);
-            retval.put(&buf, 3);
-        }
+        WvStringMask nasties(unsafe);
+        nasties.set('%', true);
+        end = url_encode(out.edit(), str, str.len(), nasties);
     }
+    else
+        end = url_encode(out.edit(), str, str.len(), url_nasties());
+    *end = 0;
+    return out;
+}
 
-    return retval.getstr();
+
+void url_encode(WvBuf &out, WvStringParm str, WvStringParm unsafe)
+{
+    size_t len = str.len();
+    char *optr = (char *)out.alloc(len * 3), *end;
+    if (!!unsafe)
+    {
+        WvStringMask nasties(unsafe);
+        nasties.set('%', true);
+        end = url_encode(optr, str, len, nasties);
+    }
+    else
+        end = url_encode(optr, str, len, url_nasties());
+    out.unalloc(len * 3 - (end - optr));
 }
 
 
@@ -407,26 +525,47 @@ WvString rfc822_date(time_t when)
 }
 
 
+// stick a backslash in front of every non-alphanumeric character in
+// s[0..len), writing to 'out', which must have room for 2*len chars, and
+// return the new end of 'out'
+static char *backslash_escape(char *out, const char *s, size_t len)
+{
+    const WvStringMask &nasties = backslash_nasties();
+    const char *end = s + len;
+
+    for (;;)
+    {
+        size_t n = nasties.find(s, end - s);
+        memcpy(out, s, n);
+        out += n;
+        s += n;
+        if (s == end)
+            break;
+
+        *out++ = '\\';
+        *out++ = *s++;
+    }
+    return out;
+}
+
+
 WvString backslash_escape(WvStringParm s1)
 {
-    // stick a backslash in front of every !isalnum() character in s1
     if (!s1)
         return "";
 
     WvString s2;
     s2.setsize(s1.len() * 2 + 1);
+    *backslash_escape(s2.edit(), s1, s1.len()) = 0;
+    return s2;
+}
 
-    const char *p1 = s1;
-    char *p2 = s2.edit();
-    while (*p1)
-    {
-        if (!isalnum(*p1))
-            *p2++ = '\\';
-        *p2++ = *p1++;
-    }
-    *p2 = 0;
 
-    return s2;
+void backslash_escape(WvBuf &out, WvStringParm s1)
+{
+    size_t len = s1.len();
+    char *optr = (char *)out.alloc(len * 2);
+    out.unalloc(len * 2 - (backslash_escape(optr, s1, len) - optr));
 }
 
 
@@ -794,23 +933,66 @@ WvString secondstoa(unsigned int total_seconds)
     return result;
 }
 
+WvString *strcoll_piece(const char *s, size_t len)
+{
+    WvString *piece = new WvString;
+    piece->setsize(len);
+    char *p = piece->edit();
+    memcpy(p, s, len);
+    p[len] = 0;
+    return piece;
+}
+
+
 WvString strreplace(WvStringParm s, WvStringParm a, WvStringParm b)
 {
-    WvDynBuf buf;
     const char *sptr = s, *eptr;
-    
+    size_t alen = a.len(), blen = b.len(), matches = 0;
+    if (!sptr || !alen)
+        return s;
+
+    // count the matches first, so the result is allocated just once, at
+    // the right size, or not at all
+    for (eptr = sptr; (eptr = strstr(eptr, a)) != NULL; eptr += alen)
+        matches++;
+    if (!matches)
+        return s;
+
+    WvString out;
+    out.setsize(s.len() - matches * alen + matches * blen);
+    char *optr = out.edit();
     while ((eptr = strstr(sptr, a)) != NULL)
     {
-	buf.put(sptr, eptr-sptr);
-	buf.putstr(b);
-	sptr = eptr + strlen(a);
+        memcpy(optr, sptr, eptr - sptr);
+        optr += eptr - sptr;
+        memcpy(optr, b.cstr(), blen);
+        optr += blen;
+        sptr = eptr + alen;
     }
-    
-    buf.put(sptr, strlen(sptr));
-    
-    return buf.getstr();
+    strcpy(optr, sptr);
+
+    return out;
 }
 
+
+void strreplace(WvBuf &out, WvStringParm s, WvStringParm a, WvStringParm b)
+{
+    const char *sptr = s, *eptr;
+    size_t alen = a.len(), blen = b.len();
+    if (!sptr)
+        return;
+
+    while (alen && (eptr = strstr(sptr, a)) != NULL)
+    {
+        out.put(sptr, eptr - sptr);
+        out.put(b.cstr(), blen);
+        sptr = eptr + alen;
+    }
+
+    out.put(sptr, strlen(sptr));
+}
+
+
 WvString undupe(WvStringParm s, char c)
 {
     WvDynBuf out;
@@ -1140,27 +1322,56 @@ static inline bool cstr_unescape_char(const char *&cstr, char &ch)
     }
 }
 
-WvString cstr_escape(const void *data, size_t size,
-        const CStrExtraEscape extra_escapes[])
+// the characters cstr_escape_char() doesn't just leave alone
+static WvStringMask make_cstr_nasties()
 {
-    if (!data) return WvString::null;
+    char chars[256], *cptr = chars;
+    for (int c = 1; c < 256; c++)
+        if (c < ' ' || c > '~' || c == '"' || c == '\\')
+            *cptr++ = c;
+    *cptr = 0;
 
-    const char *cdata = (const char *)data;
+    WvStringMask mask(chars);
+    mask.set('\0', true);
+    return mask;
+}
 
-    WvString result;
-    result.setsize(4*size + 3); // We could do better but it would slow us down
-    char *cstr = result.edit();
-    
-    *cstr++ = '\"';
-    while (size-- > 0)
+
+// cstr_escape data[0..size), without the quotes, into 'out', which must
+// have room for 4*size chars, and return the new end of 'out'
+static char *cstr_escape(char *out, const char *data, size_t size,
+                         const CStrExtraEscape extra_escapes[])
+{
+    static const WvStringMask plain_nasties(make_cstr_nasties());
+    const WvStringMask *nasties = &plain_nasties;
+    const char *end = data + size;
+
+    WvStringMask extra_nasties;
+    if (extra_escapes && extra_escapes[0].ch && extra_escapes[0].esc)
+    {
+        extra_nasties = plain_nasties;
+        for (const CStrExtraEscape *extra = extra_escapes;
+             extra->ch && extra->esc; ++extra)
+            extra_nasties.set(extra->ch, true);
+        nasties = &extra_nasties;
+    }
+
+    for (;;)
     {
+        size_t n = nasties->find(data, end - data);
+        memcpy(out, data, n);
+        out += n;
+        data += n;
+        if (data == end)
+            break;
+
     	const char *esc = NULL;
         if (extra_escapes)
         {
             const CStrExtraEscape *extra = &extra_escapes[0];
             while (extra->ch && extra->esc)
             {
-                if (*cdata == extra->ch)
+                if (*data == extra->ch)
                 {
                     esc = extra->esc;
                     break;
@@ -1169,16 +1380,45 @@ WvString cstr_escape(const void *data, size_t size,
                 ++extra;
             }
         }
-        if (!esc) esc = cstr_escape_char(*cdata);
-        ++cdata;
-        while (*esc) *cstr++ = *esc++;
+        if (!esc) esc = cstr_escape_char(*data);
+        ++data;
+        while (*esc) *out++ = *esc++;
     }
+    return out;
+}
+
+
+WvString cstr_escape(const void *data, size_t size,
+        const CStrExtraEscape extra_escapes[])
+{
+    if (!data) return WvString::null;
+
+    WvString result;
+    result.setsize(4*size + 3); // We could do better but it would slow us down
+    char *cstr = result.edit();
+    
+    *cstr++ = '\"';
+    cstr = cstr_escape(cstr, (const char *)data, size, extra_escapes);
     *cstr++ = '\"';
     *cstr = '\0';
     
     return result;
 }
 
+
+void cstr_escape(WvBuf &out, const void *data, size_t size,
+        const CStrExtraEscape extra_escapes[])
+{
+    if (!data) return;
+
+    char *start = (char *)out.alloc(4*size + 2), *cstr = start;
+    *cstr++ = '\"';
+    cstr = cstr_escape(cstr, (const char *)data, size, extra_escapes);
+    *cstr++ = '\"';
+    out.unalloc(4*size + 2 - (cstr - start));
+}
+
+
 bool cstr_unescape(WvStringParm cstr, void *data, size_t max_size, size_t &size,
         const CStrExtraEscape extra_escapes[])
 {
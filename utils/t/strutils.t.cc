@@ -2,6 +2,9 @@
 #include "wvfile.h"
 #include "strutils.h"
 #include "wvlinklist.h"
+#include "wvstringmask.h"
+#include "wvtclstring.h"
+#include "wvtimeutils.h"
 #ifdef _WIN32
 #include <io.h>
 #else
@@ -11,7 +14,6 @@
 
 /**
  * Functions in strutils.h left untested:
- *  hexdump_buffer
  *  isnewline
  *  rfc822_date
  *  rfc1123_date
@@ -1197,3 +1199,212 @@ WVTEST_MAIN("intl_datetime")
     WVPASS(checkdateformat(intl_date(dt)));
     WVPASS(checkdatetimeformat(intl_datetime(dt)));
 }
+
+
+WVTEST_MAIN("hexdump_buffer")
+{
+    const char *data = "Hello, world!\n\x01\xff";
+    WVPASSEQ(hexdump_buffer(data, 16),
+             "[000] 48656C6C 6F2C2077 6F726C64 210A01FF "
+             " Hell o, w orld !...\n");
+    WVPASSEQ(hexdump_buffer(data, 5, false),
+             "[000] 48656C6C 6F" "                         " "\n");
+    WVPASSEQ(hexdump_buffer(data, 0), "");
+
+    WvString big;
+    big.setsize(1000);
+    for (int i = 0; i < 1000; i++)
+        big.edit()[i] = i;
+    WvDynBuf buf;
+    buf.putstr("x");
+    hexdump_buffer(buf, big.cstr(), 1000);
+    WvString dump = hexdump_buffer(big.cstr(), 1000);
+    WVPASSEQ(strcount(dump, '\n'), 63);
+    WVPASSEQ(buf.getstr(), WvString("x%s", dump));
+}
+
+
+// the WvBuf versions append exactly what the WvString versions return
+WVTEST_MAIN("strutils into a WvBuf")
+{
+    const char *inputs[] = { "", "plain", "two words",
+        "http://www.example.com/a path/with?lots=of&nasty%characters",
+        "%41%42+%43 %", "\t {braces} \"quotes\" \\backslashes\\ \x80\xff" };
+
+    for (unsigned i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        WvString in(inputs[i]);
+        WvDynBuf buf;
+
+        buf.putstr("<");
+        url_encode(buf, in);
+        WVPASSEQ(buf.getstr(), WvString("<%s", url_encode(in)));
+        url_encode(buf, in, " /");
+        WVPASSEQ(buf.getstr(), url_encode(in, " /"));
+        url_decode(buf, in);
+        WVPASSEQ(buf.getstr(), url_decode(in));
+        url_decode(buf, in, true);
+        WVPASSEQ(buf.getstr(), url_decode(in, true));
+        backslash_escape(buf, in);
+        WVPASSEQ(buf.getstr(), backslash_escape(in));
+        strreplace(buf, in, "a", "AAA");
+        WVPASSEQ(buf.getstr(), strreplace(in, "a", "AAA"));
+        cstr_escape(buf, in.cstr(), in.len(), CSTR_TCLSTR_ESCAPES);
+        WVPASSEQ(buf.getstr(),
+                 cstr_escape(in.cstr(), in.len(), CSTR_TCLSTR_ESCAPES));
+    }
+
+    // some corner cases the WvString versions used to trip over
+    WVPASSEQ(strreplace("abc", "", "x"), "abc");
+    WVPASSEQ(strreplace("abc", "d", "x"), "abc");
+    WVPASSEQ(strreplace("aaa", "a", ""), "");
+    WVPASS(strreplace(WvString::null, "a", "b").isnull());
+    WVPASSEQ(url_decode("  %4"), "%4");
+    char s[] = "no such thing";
+    WVPASSEQ(trim_string(s, 'x'), "no such thing");
+}
+
+
+// The way these functions used to work, one character at a time, to
+// compare with: both the answers and how long it takes to get them.
+static WvString old_backslash_escape(WvStringParm s1)
+{
+    WvString s2;
+    s2.setsize(s1.len() * 2 + 1);
+    const char *p1 = s1;
+    char *p2 = s2.edit();
+    while (*p1)
+    {
+        if (!isalnum(*p1))
+            *p2++ = '\\';
+        *p2++ = *p1++;
+    }
+    *p2 = 0;
+    return s2;
+}
+
+
+static WvString old_url_encode(WvStringParm str)
+{
+    WvDynBuf retval;
+    for (unsigned int i = 0; i < str.len(); i++)
+    {
+        if ((isalnum(str[i]) || strchr("_.!~*'()-", str[i])) && str[i] != '%')
+            retval.put(&str[i], 1);
+        else
+        {
+            char buf[4];
+            sprintf(buf, "%%%02X", str[i] & 0xff);
+            retval.put(&buf, 3);
+        }
+    }
+    return retval.getstr();
+}
+
+
+static WvString old_strreplace(WvStringParm s, WvStringParm a,
+                               WvStringParm b)
+{
+    WvDynBuf buf;
+    const char *sptr = s, *eptr;
+    while ((eptr = strstr(sptr, a)) != NULL)
+    {
+        buf.put(sptr, eptr-sptr);
+        buf.putstr(b);
+        sptr = eptr + strlen(a);
+    }
+    buf.put(sptr, strlen(sptr));
+    return buf.getstr();
+}
+
+
+// count the characters in 'mask', one at a time or a span at a time
+static int old_count(WvStringParm s, const WvStringMask &mask)
+{
+    int n = 0;
+    for (const char *p = s; *p; p++)
+        if (mask[*p])
+            n++;
+    return n;
+}
+
+
+static int new_count(WvStringParm s, const WvStringMask &mask)
+{
+    int n = 0;
+    const char *p = s, *end = p + s.len();
+    while ((p += mask.find(p, end - p)) < end)
+    {
+        n++;
+        p++;
+    }
+    return n;
+}
+
+
+static void report(const char *name, const WvTime &oldstart,
+                   const WvTime &newstart, const WvTime &end)
+{
+    printf("%-18s old %5ld ms, new %5ld ms\n", name,
+           (long)msecdiff(newstart, oldstart), (long)msecdiff(end, newstart));
+}
+
+
+WVTEST_MAIN("strutils speed")
+{
+    // something like a config file: mostly words, a few nasty characters
+    WvString text;
+    text.setsize(256 * 1024);
+    char *p = text.edit();
+    srandom(1);
+    for (int i = 0; i < 256 * 1024; i++)
+    {
+        int r = random() % 100;
+        p[i] = r < 12 ? ' ' : r < 13 ? '/' : r < 14 ? '.' : 'a' + r % 26;
+    }
+    p[256 * 1024] = 0;
+
+    WvString o, n;
+    WvTime t0, t1, t2;
+    const int reps = 4;
+
+    t0 = wvtime();
+    for (int i = 0; i < reps; i++) o = old_backslash_escape(text);
+    t1 = wvtime();
+    for (int i = 0; i < reps; i++) n = backslash_escape(text);
+    t2 = wvtime();
+    report("backslash_escape", t0, t1, t2);
+    WVPASSEQ(n, o);
+
+    t0 = wvtime();
+    for (int i = 0; i < reps; i++) o = old_url_encode(text);
+    t1 = wvtime();
+    for (int i = 0; i < reps; i++) n = url_encode(text);
+    t2 = wvtime();
+    report("url_encode", t0, t1, t2);
+    WVPASSEQ(n, o);
+
+    t0 = wvtime();
+    for (int i = 0; i < reps; i++) o = old_strreplace(text, "ab", "xyz");
+    t1 = wvtime();
+    for (int i = 0; i < reps; i++) n = strreplace(text, "ab", "xyz");
+    t2 = wvtime();
+    report("strreplace", t0, t1, t2);
+    WVPASSEQ(n, o);
+
+    int oc = 0, nc = 0;
+    t0 = wvtime();
+    for (int i = 0; i < reps; i++) oc = old_count(text, WVTCL_NASTY_SPACES);
+    t1 = wvtime();
+    for (int i = 0; i < reps; i++) nc = new_count(text, WVTCL_NASTY_SPACES);
+    t2 = wvtime();
+    report("WvStringMask scan", t0, t1, t2);
+    WVPASSEQ(nc, oc);
+
+    // a long string with spaces, but no braces, just gets braces around it
+    t0 = wvtime();
+    for (int i = 0; i < reps; i++) n = wvtcl_escape(text);
+    t1 = wvtime();
+    printf("%-18s new %5ld ms\n", "wvtcl_escape", (long)msecdiff(t1, t0));
+    WVPASSEQ(n, WvString("{%s}", text));
+}
@@ -0,0 +1,168 @@
+/*
+ * Tests for the LZ4 and zstd encoders and streams.  They're used the same
+ * way, so each test is a template run once for each one that's built.
+ */
+#include "wvautoconf.h"
+#include "wvtest.h"
+#include "wvloopback.h"
+#include "wvmoniker.h"
+#ifdef WITH_LZ4
+# include "wvlz4.h"
+# include "wvlz4stream.h"
+#endif
+#ifdef WITH_ZSTD
+# include "wvzstd.h"
+# include "wvzstdstream.h"
+#endif
+
+static WvString sample_text(size_t len)
+{
+    WvDynBuf buf;
+    srand(42);
+    while (buf.used() < len)
+        buf.putstr(WvString("line %s: value=%s\n", buf.used() / 20,
+                            rand() % 1000));
+    return buf.getstr();
+}
+
+
+template <class Encoder>
+static void test_encode(const char *name)
+{
+    WvString text = sample_text(200000);
+    size_t len = text.len();
+
+    Encoder comp(Encoder::Compress);
+    Encoder decomp(Encoder::Decompress);
+    WvDynBuf inbuf, compbuf, outbuf;
+
+    // the first half, flushed, has to come out the other end right away
+    inbuf.put(text.cstr(), len / 2);
+    WVPASS(comp.encode(inbuf, compbuf, true));
+    WVPASS(compbuf.used() < len / 2);
+    WVPASS(decomp.encode(compbuf, outbuf, true));
+    WVPASSEQ(outbuf.used(), len / 2);
+    WVFAIL(decomp.isfinished());
+
+    // then the rest, and the end of the frame
+    inbuf.put(text.cstr() + len / 2, len - len / 2);
+    WVPASS(comp.encode(inbuf, compbuf, true, true));
+    WVPASS(comp.isfinished());
+    compbuf.putstr("trailing junk");
+    WVPASS(decomp.encode(compbuf, outbuf, true));
+    WVPASS(decomp.isfinished());
+    WVPASSEQ(compbuf.getstr(), "trailing junk");
+    WVPASSEQ(outbuf.used(), len);
+    WVPASSEQ(outbuf.getstr(), text);
+
+    // reset() starts a new frame
+    comp.reset();
+    decomp.reset();
+    inbuf.putstr("hello");
+    WVPASS(comp.encode(inbuf, compbuf, true, true));
+    WVPASSEQ(decomp.strflushbuf(compbuf, true), "hello");
+    WVPASS(decomp.isok());
+
+    // garbage doesn't decompress
+    Encoder bad(Encoder::Decompress);
+    bad.strflushstr(WvString("this is not %s", name));
+    WVFAIL(bad.isok());
+}
+
+
+template <class Encoder>
+static size_t send_messages(Encoder &comp, Encoder &decomp, int count)
+{
+    size_t total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        WvString msg("{\"type\": \"update\", \"key\": \"/cfg/net/eth%s\", "
+                     "\"value\": \"%s\"}", i % 4, i);
+        // each message on its own, as if they were separate packets
+        WvDynBuf compbuf;
+        comp.reset();
+        comp.flushstrbuf(msg, compbuf, true);
+        total += compbuf.used();
+        decomp.reset();
+        WVPASSEQ(decomp.strflushbuf(compbuf, true), msg);
+    }
+    return total;
+}
+
+
+template <class Encoder>
+static void test_dictionary()
+{
+    static const char dict[] =
+        "{\"type\": \"update\", \"key\": \"/cfg/net/eth0\", \"value\": \"\"}"
+        "{\"type\": \"delete\", \"key\": \"/cfg/net/eth1\"}";
+
+    Encoder comp(Encoder::Compress), decomp(Encoder::Decompress);
+    size_t plain = send_messages(comp, decomp, 50);
+
+    Encoder dcomp(Encoder::Compress), ddecomp(Encoder::Decompress);
+    dcomp.set_dictionary(dict, sizeof(dict) - 1);
+    ddecomp.set_dictionary(dict, sizeof(dict) - 1);
+    size_t withdict = send_messages(dcomp, ddecomp, 50);
+
+    printf("50 small messages: %d bytes, %d with a dictionary\n",
+           (int)plain, (int)withdict);
+    WVPASS(withdict < plain * 3 / 4);
+}
+
+
+template <class Stream>
+static void test_stream(const char *moniker, const char *wstype)
+{
+    WvLoopback loopy;
+    Stream stream((loopy.addRef(), &loopy));
+    stream.print("a line of text\n");
+    stream.flush(0);
+    WVPASSEQ(stream.blocking_getline(1000), "a line of text");
+
+    IWvStream *s = wvcreate<IWvStream>(moniker);
+    WVPASS(s);
+    if (s)
+        WVPASSEQ(s->wstype(), wstype);
+    WVRELEASE(s);
+}
+
+
+#ifdef WITH_LZ4
+WVTEST_MAIN("lz4 encode + decode")
+{
+    test_encode<WvLZ4Encoder>("lz4");
+}
+
+
+WVTEST_MAIN("lz4 dictionary")
+{
+    test_dictionary<WvLZ4Encoder>();
+}
+
+
+WVTEST_MAIN("lz4 stream")
+{
+    test_stream<WvLZ4Stream>("lz4:loop", "WvLZ4Stream");
+}
+#endif
+
+
+#ifdef WITH_ZSTD
+WVTEST_MAIN("zstd encode + decode")
+{
+    test_encode<WvZstdEncoder>("zstd");
+}
+
+
+WVTEST_MAIN("zstd dictionary")
+{
+    test_dictionary<WvZstdEncoder>();
+}
+
+
+WVTEST_MAIN("zstd stream")
+{
+    test_stream<WvZstdStream>("zstd:loop", "WvZstdStream");
+}
+#endif
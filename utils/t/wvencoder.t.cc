@@ -1,4 +1,7 @@
 #include "wvencoder.h"
+#include "wvbase64.h"
+#include "wvgzip.h"
+#include "wvhex.h"
 #include "wvtest.h"
 
 // BEGIN encodertest.cc definition
@@ -138,3 +141,53 @@ WVTEST_MAIN("encodertest.cc")
 }
 
 // END encodertest.cc definition
+
+
+WVTEST_MAIN("chain matches its stages")
+{
+    WvDynBuf text;
+    srand(7);
+    while (text.used() < 300000)
+        text.putstr(WvString("record %s = %s\n", text.used(), rand() % 100));
+    WvString input = text.getstr();
+
+    // the long way around: each encoder over the whole input, in turn
+    WvGzipEncoder gz1(WvGzipEncoder::Deflate);
+    WvBase64Encoder b1;
+    WvHexEncoder h1;
+    WvDynBuf a, b, c;
+    a.putstr(input);
+    WVPASS(gz1.flush(a, b, true));
+    WVPASS(b1.flush(b, c, true));
+    WVPASS(h1.flush(c, a, true));
+    WvString expected = a.getstr();
+
+    // the same thing through a chain, in a few uneven pieces
+    WvEncoderChain chain;
+    chain.append(new WvGzipEncoder(WvGzipEncoder::Deflate), true);
+    chain.append(new WvBase64Encoder, true);
+    chain.append(new WvHexEncoder, true);
+    WvDynBuf in, out;
+    size_t len = input.len();
+    in.put(input.cstr(), 5);
+    WVPASS(chain.encode(in, out));
+    in.put(input.cstr() + 5, len / 2 - 5);
+    WVPASS(chain.encode(in, out));
+    in.put(input.cstr() + len / 2, len - len / 2);
+    WVPASS(chain.flush(in, out, true));
+    WVPASSEQ(in.used(), 0);
+    WVPASSEQ(chain.buffered(), 0);
+    WVPASSEQ(out.used(), expected.len());
+    WVPASS(out.getstr() == expected);
+
+    // and back again
+    WvEncoderChain unchain;
+    unchain.append(new WvHexDecoder, true);
+    unchain.append(new WvBase64Decoder, true);
+    unchain.append(new WvGzipEncoder(WvGzipEncoder::Inflate), true);
+    in.putstr(expected);
+    WVPASS(unchain.flush(in, out));
+    WVPASS(unchain.isfinished()); // the inflater saw the end of the stream
+    WVPASSEQ(out.used(), len);
+    WVPASS(out.getstr() == input);
+}
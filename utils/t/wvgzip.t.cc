@@ -1,5 +1,7 @@
 #include "wvgzip.h"
 #include "wvtest.h"
+#include "wvworkerpool.h"
+#include <zlib.h>
 
 const int PATTERN_LENGTH = 2;
 const int NUM_REPEATS = 500;
@@ -230,3 +232,77 @@ WVTEST_MAIN("severe compression errors")
     if (!gzipinf.isok())
         wvcon->print("GzipEncoder error: %s\n", gzipinf.geterror());
 }
+
+
+static void parallel_roundtrip(WvWorkerPool &pool, size_t total,
+                               size_t blocksize, bool full_flush)
+{
+    // compressible, but not too compressible, with matches across blocks
+    WvDynBuf orig;
+    srand(42);
+    while (orig.used() < total)
+        orig.putstr(WvString("line %s: %s\n", orig.used() / 100,
+                             rand() % 1000));
+    size_t len = orig.used();
+    WvString str = orig.getstr();
+
+    WvGzipEncoder def(WvGzipEncoder::Deflate);
+    def.full_flush = full_flush;
+    def.parallel(&pool, blocksize);
+
+    // feed it in uneven pieces, with a flush in the middle
+    WvDynBuf inbuf, comp;
+    const char *p = str.cstr();
+    size_t done = 0;
+    for (size_t piece = 1; done < len; piece = piece * 3 + 7)
+    {
+        size_t n = len - done < piece ? len - done : piece;
+        inbuf.put(p + done, n);
+        done += n;
+        WVPASS(def.encode(inbuf, comp, done > len / 2 && done - n <= len / 2));
+    }
+    WVPASS(def.finish(comp));
+    WVPASSEQ(inbuf.used(), 0);
+
+    // our own inflater has to read it...
+    size_t complen = comp.used();
+    unsigned char *compdata = new unsigned char[complen];
+    memcpy(compdata, comp.get(complen), complen);
+    comp.put(compdata, complen);
+
+    WvDynBuf uncomp;
+    WvGzipEncoder inf(WvGzipEncoder::Inflate);
+    WVPASS(inf.encode(comp, uncomp, true));
+    WVPASS(inf.isfinished());
+    WVPASSEQ(uncomp.used(), len);
+    WVPASS(uncomp.used() == len && !memcmp(uncomp.get(len), p, len));
+
+    // ...and so does zlib, checksum and all
+    unsigned char *out = new unsigned char[len + 1];
+    uLongf outlen = len + 1;
+    WVPASSEQ(uncompress(out, &outlen, compdata, complen), Z_OK);
+    WVPASSEQ(outlen, len);
+    delete[] out;
+    delete[] compdata;
+}
+
+
+WVTEST_MAIN("parallel deflate")
+{
+    WvWorkerPool pool(3);
+    parallel_roundtrip(pool, 1000, 4096, false);
+    parallel_roundtrip(pool, 300000, 16384, false);
+    parallel_roundtrip(pool, 300000, 65536, true);
+    parallel_roundtrip(pool, 100000, 100000, false);
+
+    // an empty stream is still a valid stream
+    WvGzipEncoder def(WvGzipEncoder::Deflate);
+    def.parallel(&pool);
+    WvDynBuf comp, uncomp;
+    WVPASS(def.finish(comp));
+    WvGzipEncoder inf(WvGzipEncoder::Inflate);
+    WVPASS(inf.encode(comp, uncomp, true));
+    WVPASS(inf.isfinished());
+    WVPASSEQ(uncomp.used(), 0);
+    pool.finish();
+}
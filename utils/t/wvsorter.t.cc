@@ -125,3 +125,101 @@ WVTEST_MAIN("sorttest.cc")
 	}	
     }
 }
+
+
+struct Pair
+{
+    int key, seq;
+};
+DeclareWvList(Pair);
+
+
+static int by_key(const Pair *a, const Pair *b)
+{
+    return a->key - b->key;
+}
+
+
+// sorts a little list of its own every time it's called, and clears
+// nested_ok if that ever comes out wrong
+static bool nested_ok;
+static int by_key_nested(const Pair *a, const Pair *b)
+{
+    WvStringList l;
+    l.split("c a b");
+    WvStringList::Sorter s(l, apples_to_oranges);
+    s.rewind();
+    if (!s.next() || *s != "a")
+	nested_ok = false;
+    return by_key(a, b);
+}
+
+
+// fills 'l' with 'n' Pairs with keys from 0 to 99, in a scrambled order
+static void fill(PairList &l, int n)
+{
+    unsigned int x = 1;
+    for (int i = 0; i < n; i++)
+    {
+	x = x * 1103515245 + 12345;
+	Pair *p = new Pair;
+	p->key = (x >> 16) % 100;
+	p->seq = i;
+	l.append(p, true);
+    }
+}
+
+
+// true if 's' is sorted by key, and by seq for equal keys
+static int check(PairList::Sorter &s)
+{
+    int count = 0;
+    Pair *prev = NULL;
+    for (s.rewind(); s.next(); count++)
+    {
+	if (prev && (prev->key > s->key
+		     || (prev->key == s->key && prev->seq > s->seq)))
+	    return -1;
+	prev = s.ptr();
+    }
+    return count;
+}
+
+
+WVTEST_MAIN("stable and reentrant")
+{
+    PairList l;
+    fill(l, 1000);
+    
+    PairList::Sorter s(l, by_key);
+    WVPASSEQ(check(s), 1000);
+    
+    // a compare function can use a WvSorter of its own
+    PairList small;
+    fill(small, 20);
+    nested_ok = true;
+    PairList::Sorter s2(small, by_key_nested);
+    WVPASSEQ(check(s2), 20);
+    WVPASS(nested_ok);
+}
+
+
+#ifndef _WIN32
+#include "wvworkerpool.h"
+
+WVTEST_MAIN("parallel sort")
+{
+    WvWorkerPool pool(3);
+    
+    for (int n = WVSORT_PARALLEL_MIN - 1; n < WVSORT_PARALLEL_MIN * 5;
+	 n += WVSORT_PARALLEL_MIN + 12345)
+    {
+	PairList l;
+	fill(l, n);
+	PairList::Sorter s(l, by_key);
+	s.parallel(&pool);
+	WVPASSEQ(check(s), n);
+    }
+    pool.finish();
+}
+#endif
@@ -1,5 +1,7 @@
 #include "wvtest.h"
 #include "wvstring.h"
+#include "wvtimeutils.h"
+#include <new>
 
 
 WVTEST_MAIN("basic")
@@ -61,9 +63,11 @@ WVTEST_MAIN("copying")
     
     // if we didn't crash yet, we're halfway there!
     
-    // equivalent pointers
-    WVPASS(e1+0 == e2+0);
-    WVPASS(e1.edit()+0 != e2+0);
+    // equivalent pointers (short strings are always copied, though)
+    WvString l1("a string too long to fit inside the WvString"), l2(l1);
+    WVPASS(l1+0 == l2+0);
+    WVPASS(l1.edit()+0 != l2+0);
+    WVPASS(e1+0 != e2+0);
     const char *olde1 = e1;
     { WvString x(e1); } // copy and destroy
     WVPASS(e1.edit() == olde1); // no unnecessary copies
@@ -186,6 +190,59 @@ WVTEST_MAIN("%$ns and %$nc formatting")
 }
 
 
+WVTEST_MAIN("formatting numbers and other types")
+{
+    enum { Three = 3 };
+    WVPASSEQ(WvString("%s %s %s %s", (short)-5, 7u, -123456789012LL,
+                      18446744073709551615ULL),
+             "-5 7 -123456789012 18446744073709551615");
+    WVPASSEQ(WvString("%s/%s/%s", 0.5, true, Three), "0.5/1/3");
+    WVPASSEQ(WvString("[%05s] [%-4s]", 42, 7), "[00042] [7   ]");
+    
+    char buf[16];
+    strcpy(buf, "buffer");
+    WVPASSEQ(WvString("%s %s %s", buf, (char *)buf, WvFastString(buf)),
+             "buffer buffer buffer");
+    WvString nul;
+    WVPASSEQ(WvString("%s-%s", nul, WvString::null), "(nil)-(nil)");
+
+#if __cplusplus >= 201103L
+    // no limit on the number of arguments
+    WVPASSEQ(WvString("%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s",
+                      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6, 7,
+                      8, 9, "a", "b", "c"),
+             "01234567890123456789abc");
+#endif
+}
+
+
+WVTEST_MAIN("format strings are remembered, but checked")
+{
+    char fmt[32];
+    for (int i = 0; i < 3; i++)
+    {
+        // the same buffer, saying something different each time
+        sprintf(fmt, "%%%ds|", i + 2);
+        WVPASSEQ(WvString(fmt, "x"), WvString("%s%s|",
+                                              WvString("   ").cstr() + 2 - i,
+                                              "x"));
+    }
+    strcpy(fmt, "%s and %s");
+    WVPASSEQ(WvString(fmt, 1, 2), "1 and 2");
+    strcpy(fmt, "%s or %s!");
+    WVPASSEQ(WvString(fmt, 1, 2), "1 or 2!");
+    
+    // too long to remember
+    WvString longfmt("%s");
+    for (int i = 0; i < 30; i++)
+        longfmt.append(" %s%%");
+    WvString expect("0");
+    for (int i = 0; i < 30; i++)
+        expect.append(" (nil)%");
+    WVPASSEQ(WvString(longfmt, 0), expect);
+}
+
+
 WVTEST_MAIN("conversion from int")
 {
     for (int i = 0; i < 1000000; ++i)
@@ -249,3 +306,161 @@ WVTEST_MAIN("nullbuf link counting")
     // ensure that we don't leak references when creating WvStrings
     WVPASS(before == after);
 }
+
+
+WVTEST_MAIN("short strings")
+{
+    WvString a("short"), b(a);
+    b.edit()[0] = 'S';
+    WVPASSEQ(a, "short");
+    WVPASSEQ(b, "Short");
+    WVPASS(a.is_unique());
+    WVPASS(b.is_unique());
+    
+    // copies of a short string have to outlive it
+    WvString *c = new WvString("temporary");
+    WvFastString fast(*c);
+    WvString d(fast.offset(4));
+    delete c;
+    WVPASSEQ(fast, "temporary");
+    WVPASSEQ(d, "orary");
+    
+    // assigning part of a string to itself
+    d = d.cstr() + 2;
+    WVPASSEQ(d, "ary");
+    WvString e("a string that's much too long to keep inside the object");
+    e = e.cstr() + 38;
+    WVPASSEQ(e, "inside the object");
+    
+    // the longest numbers still fit
+    WVPASSEQ(WvString(-9223372036854775807LL - 1), "-9223372036854775808");
+    WVPASSEQ(WvString(18446744073709551615ULL), "18446744073709551615");
+    WvString f;
+    f = -2147483647 - 1;
+    WVPASSEQ(f, "-2147483648");
+    
+    // right at the edge of local[]
+    for (size_t i = WVSTRING_LOCAL - 2; i <= WVSTRING_LOCAL + 1; i++)
+    {
+        WvString g;
+        g.setsize(i + 1);
+        memset(g.edit(), 'x', i);
+        g.edit()[i] = 0;
+        WvString h(g);
+        h.edit()[0] = 'y';
+        WVPASSEQ(g.len(), i);
+        WVPASSEQ(h.len(), i);
+        WVPASS(g != h);
+    }
+}
+
+
+// lets us look at the count in WvFastString::nullbuf
+class NullBufPeek : public WvFastString
+{
+public:
+    static unsigned links()
+        { return nullbuf.links; }
+};
+
+
+WVTEST_MAIN("nullbuf isn't reference counted")
+{
+    // every thread uses nullbuf at once, so it must never change
+    unsigned before = NullBufPeek::links();
+    {
+        WvFastString a("borrowed"), b(a);
+        WvString c, d(c), e("%s %s", a, 1);
+        c = a;
+        WVPASSEQ(NullBufPeek::links(), before);
+        WVPASSEQ(c.edit(), "borrowed");
+    }
+    WVPASSEQ(NullBufPeek::links(), before);
+}
+
+
+#if __cplusplus >= 201103L
+WVTEST_MAIN("copying a WvFormatArg")
+{
+    // a WvStringStar gets converted, so the short string ends up in the
+    // argument's own 'hold'
+    union { char c[sizeof(WvFormatArg)]; double d; long long l; } space;
+    WvString shortstr("short");
+    WvFormatArg *a = new(space.c) WvFormatArg(WvStringStar(shortstr));
+    WvFormatArg b(*a);
+    a->~WvFormatArg();
+    memset(space.c, 'x', sizeof(space.c));
+    WVPASSEQ(b.cstr(), "short");
+    
+    WvFormatArg n(42), m(n);
+    WVPASSEQ(m.cstr(), "42");
+    WvFormatArg s("plain"), t(s);
+    WVPASSEQ(t.cstr(), "plain");
+}
+
+
+WVTEST_MAIN("moving strings")
+{
+    WvString a("a string that's much too long to keep inside the object");
+    const char *p = a.cstr();
+    WvString b(std::move(a));
+    WVPASS(b.cstr() == p);
+    WVPASS(a.isnull());
+    WVPASS(b.is_unique());
+    
+    a = "small";
+    b = std::move(a);
+    WVPASSEQ(b, "small");
+    WVPASS(a.isnull());
+    a = b;
+    WVPASSEQ(a, b);
+    
+    // moved-from strings still work
+    WvString c(std::move(a));
+    WVFAIL(a.edit());
+    a.append("more");
+    WVPASSEQ(a, "more");
+    
+    WvFastString fast(std::move(c));
+    WVPASSEQ(fast, "small");
+    WVPASS(c.isnull());
+}
+#endif
+
+
+static void time_strings(const char *name, const char *s)
+{
+    const int count = 200000;
+    size_t total = 0;
+    
+    WvTime start = wvtime();
+    for (int i = 0; i < count; i++)
+    {
+        WvString a(s), b(a);
+        b.edit()[0] = 'x';
+        WvString c(b);
+        total += a.len() + c.len();
+    }
+    time_t ms = msecdiff(wvtime(), start);
+    
+    printf("%-6s strings: %8.0f thousand/sec\n", name,
+           ms ? count / (double)ms : 0.0);
+    WVPASSEQ(total, 2 * count * strlen(s));
+}
+
+
+WVTEST_MAIN("short string speed")
+{
+    time_strings("short", "/cfg/net/eth0");
+    time_strings("long", "/cfg/net/eth0/interfaces/primary/address");
+    
+    const int count = 200000;
+    size_t total = 0;
+    WvTime start = wvtime();
+    for (int i = 0; i < count; i++)
+        total += WvString(i).len();
+    time_t ms = msecdiff(wvtime(), start);
+    printf("number strings: %8.0f thousand/sec\n",
+           ms ? count / (double)ms : 0.0);
+    WVPASS(total);
+}
@@ -0,0 +1,135 @@
+#include "wvtest.h"
+#include "wvstringcache.h"
+#include "wvstringlist.h"
+
+// long enough not to fit in a WvString's local[]
+#define LONG "a string that's too long to keep inside a WvString"
+
+
+WVTEST_MAIN("sharing")
+{
+    WvStringCache cache;
+    cache.clean();
+    size_t start = cache.count();
+
+    WvString a(cache.get(WvString("%s %s", LONG, 1)));
+    WvString b(cache.get(WvString("%s %s", LONG, 1)));
+    WvString c(cache.get(WvString("%s %s", LONG, 2)));
+    WVPASSEQ(a, b);
+    WVPASS(a.cstr() == b.cstr());
+    WVPASS(a.cstr() != c.cstr());
+    WVPASSEQ(cache.count(), start + 2);
+    WVPASS(cache.size() > 2 * strlen(LONG));
+
+    // borrowed char* strings get a buf of their own
+    char buf[100];
+    strcpy(buf, LONG " 3");
+    WvString d(cache.get(buf));
+    WVPASS(d.cstr() != buf);
+    buf[0] = 'X';
+    WVPASSEQ(d, LONG " 3");
+
+    // short ones aren't worth it
+    WvString e(cache.get("short"));
+    WVPASSEQ(e, "short");
+    WVPASSEQ(cache.count(), start + 3);
+    WVPASS(!cache.get(WvString::null));
+
+    // only strings nobody else is using get cleaned
+    c = d = WvString::null;
+    cache.clean();
+    WVPASSEQ(cache.count(), start + 1);
+    WVPASS(cache.get(WvString("%s %s", LONG, 1)).cstr() == a.cstr());
+    WVPASS(!a.is_unique());
+
+    a = b = WvString::null;
+    cache.clean();
+    WVPASSEQ(cache.count(), start);
+}
+
+
+WVTEST_MAIN("eviction")
+{
+    WvStringCache cache;
+    cache.clean();
+    size_t start = cache.count();
+
+    // strings nobody is keeping get thrown out as new ones come in
+    WvString keep(cache.get(WvString("%s keep", LONG)));
+    for (int i = 0; i < 10000; i++)
+        cache.get(WvString("%s %s", LONG, i));
+    WVPASS(cache.count() - start < 5000);
+    WVPASS(cache.get(WvString("%s keep", LONG)).cstr() == keep.cstr());
+
+    // and the cache never gets bigger than the limit
+    cache.clean();
+    cache.set_limit(WVSTRINGCACHE_SHARDS * 1000);
+    WvStringList held;
+    for (int i = 0; i < 1000; i++)
+        held.append(cache.get(WvString("%s %s", LONG, i)));
+    WVPASS(cache.size() <= WVSTRINGCACHE_SHARDS * 1000);
+    WVPASS(cache.count() < 1000);
+
+    // the ones that didn't fit still come back right, just not shared
+    WvStringList::Iter i(held);
+    int n = 0;
+    for (i.rewind(); i.next(); n++)
+        if (*i != WvString("%s %s", LONG, n))
+            break;
+    WVPASSEQ(n, 1000);
+
+    cache.set_limit(WVSTRINGCACHE_MAXBYTES);
+    held.zap();
+    keep = WvString::null;
+    cache.clean();
+    WVPASSEQ(cache.count(), start);
+}
+
+
+#ifndef _WIN32
+#include "wvworkerpool.h"
+
+// every job looks up the same strings and passes copies of them around,
+// so the link counts get changed by all the threads at once
+static void hammer(WvStringCache &cache, WvString *results, int job)
+{
+    WvStringList l;
+    for (int i = 0; i < 20000; i++)
+    {
+        WvString s(cache.get(WvString("%s %s", LONG, i % 100)));
+        l.append(s);
+        if (l.count() > 50)
+            l.zap();
+    }
+    results[job] = cache.get(WvString("%s %s", LONG, job));
+}
+
+
+WVTEST_MAIN("threads")
+{
+    WvStringCache cache;
+    cache.clean();
+    size_t start = cache.count();
+    WvString results[8];
+    {
+        WvWorkerPool pool(4);
+        for (int i = 0; i < 8; i++)
+            pool.add(wv::bind(&hammer, wv::ref(cache), results, i));
+        pool.finish();
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        WVPASSEQ(results[i], WvString("%s %s", LONG, i));
+        WVPASS(results[i].cstr()
+               == cache.get(WvString("%s %s", LONG, i)).cstr());
+    }
+
+    // if any links were miscounted along the way, some strings would
+    // still look like they're in use
+    for (int i = 0; i < 8; i++)
+        results[i] = WvString::null;
+    cache.clean();
+    WVPASSEQ(cache.count(), start);
+}
+#endif
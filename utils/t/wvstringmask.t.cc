@@ -2,6 +2,9 @@
 #include "wvstringmask.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <climits>
 
 WVTEST_MAIN("wvstringmask")
@@ -72,3 +75,70 @@ WVTEST_MAIN("wvstringmask")
     }
     WVPASSEQ(d.first(), 'c');
 }
+
+
+// find() has to agree with operator[], whichever way it ends up looking
+WVTEST_MAIN("wvstringmask find")
+{
+    char many[60];
+    for (int i = 0; i < 29; i++)
+        many[i] = 'A' + 2*i; // every other character: too many runs for SSE
+    many[29] = 0;
+
+    WvStringMask masks[] = { WvStringMask(), WvStringMask('x'),
+                             WvStringMask(" \t\r\n"), WvStringMask("{}\\\""),
+                             WvStringMask(many), WvStringMask("\xff\x80") };
+
+    char buf[200];
+    srandom(42);
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = "abcdefgh"[random() % 8];
+
+    for (unsigned m = 0; m < sizeof(masks) / sizeof(masks[0]); m++)
+    {
+        int bad = 0;
+        for (int trial = 0; trial < 200; trial++)
+        {
+            // plant one of the mask's characters (maybe) somewhere
+            char saved[2];
+            size_t at[2] = { random() % sizeof(buf), random() % sizeof(buf) };
+            for (int k = 0; k < 2; k++)
+            {
+                saved[k] = buf[at[k]];
+                buf[at[k]] = random() % 256;
+            }
+
+            size_t start = random() % 40, len = random() % 150;
+            size_t want = 0;
+            while (want < len && !masks[m][buf[start + want]])
+                want++;
+            if (masks[m].find(buf + start, len) != want)
+                bad++;
+
+            for (int k = 1; k >= 0; k--)
+                buf[at[k]] = saved[k];
+        }
+        WVPASSEQ(bad, 0);
+    }
+}
+
+
+// url_encode()'s default mask: everything but RFC 2396's "unreserved"
+// characters, which comes out as 9 runs
+WVTEST_MAIN("wvstringmask url mask uses the fast find")
+{
+    char chars[256], *cptr = chars;
+    for (int c = 1; c < 256; c++)
+	if (!(isascii(c) && isalnum(c)) && !strchr("_.!~*'()-", c))
+	    *cptr++ = c;
+    *cptr = 0;
+
+    WvStringMask url(chars);
+    WVPASS(url.fast_find());
+    WVPASSEQ(url.find("abcdefghijklmnopqrstuvwxyz/0123", 31), 26);
+    WVPASSEQ(url.find("abcdefghijklmnopqrstuvwxyz_0123 x", 33), 31);
+
+    // but one run per character is too many
+    WvStringMask odd("acegikmoqsuwy");
+    WVFAIL(odd.fast_find());
+}
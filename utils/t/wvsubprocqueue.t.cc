@@ -10,6 +10,8 @@
 #include "wvfile.h"
 
 #include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
 
 struct WvSubProcQueueTester
 {
@@ -146,3 +148,152 @@ WVTEST_MAIN("wvsubprocqueue2")
 
     ::unlink(t.fn);
 }
+
+
+// a process that appends 'word' to 'fn'
+static WvSubProc *echo(WvStringParm fn, WvStringParm word)
+{
+    WvSubProc *p = new WvSubProc;
+    p->prepare("sh", "sh", "-c", WvString("echo %s >>%s", word, fn).cstr(), NULL);
+    return p;
+}
+
+
+WVTEST_MAIN("wvsubprocqueue priorities")
+{
+    WvSubProcQueueTester t;
+    WvSubProcQueue q(1);
+    
+    // higher priorities go first, but never past a sync point
+    ::unlink(t.fn);
+    q.add(NULL, echo(t.fn, "a"));
+    q.add(NULL, echo(t.fn, "b"), 5);
+    q.add(NULL, echo(t.fn, "c"), 5);
+    q.add(&t.c1, echo(t.fn, "sync"));
+    q.add(NULL, echo(t.fn, "d"));
+    q.add(NULL, echo(t.fn, "e"), 9);
+    q.add(NULL, echo(t.fn, "f"), -1);
+    q.add(NULL, echo(t.fn, "g"));
+    q.finish();
+    WVPASSEQ(contents(t.fn), "b\nc\na\nsync\ne\nd\ng\nf\n");
+    
+    ::unlink(t.fn);
+}
+
+
+WVTEST_MAIN("wvsubprocqueue one per cpu")
+{
+    WvSubProcQueue q(0);
+    WVPASS(q.max_running() >= 1);
+    WVPASSEQ(WvSubProcQueue(3).max_running(), 3);
+}
+
+
+WVTEST_MAIN("wvsubprocqueue exit notification")
+{
+    WvSubProcQueueTester t;
+    WvSubProcQueue q(2);
+#ifdef __linux__
+    WVPASS(q.getexitfd() >= 0);
+#endif
+    
+    const char *argv[] = { "true", NULL };
+    q.add(NULL, argv[0], argv);
+    WVPASSEQ(q.go(), 1);
+    WVFAIL(q.needs_polling());
+    if (q.getexitfd() >= 0)
+    {
+	struct pollfd pfd;
+	pfd.fd = q.getexitfd();
+	pfd.events = POLLIN;
+	WVPASSEQ(poll(&pfd, 1, 5000), 1);
+    }
+    else
+	usleep(200*1000);
+    q.go();
+    WVPASSEQ(q.remaining(), 0);
+    
+    // the main process exits right away, but leaves its child behind, so
+    // the queue has to keep checking on it
+    ::unlink(t.fn);
+    WvString cmd("(sleep 1; echo child >>%s) &", t.fn);
+    const char *argv2[] = { "sh", "-c", cmd, NULL };
+    q.add(NULL, argv2[0], argv2);
+    q.go();
+    for (int i = 0; i < 20 && !q.needs_polling(); i++)
+    {
+	usleep(50*1000);
+	q.go();
+    }
+    WVPASS(q.needs_polling());
+    WVPASSEQ(q.running(), 1);
+    q.finish();
+    WVFAIL(q.needs_polling());
+    WVPASSEQ(contents(t.fn), "child\n");
+    
+    ::unlink(t.fn);
+}
+
+
+WVTEST_MAIN("wvsubproc environment")
+{
+    WvSubProcQueueTester t;
+    ::unlink(t.fn);
+    setenv("WVSUBPROC_KEEP", "kept", 1);
+    setenv("WVSUBPROC_GONE", "gone", 1);
+    
+    WvSubProc p;
+    p.env.append("WVSUBPROC_NEW=new");
+    p.env.append("WVSUBPROC_GONE");
+    p.start("sh", "sh", "-c",
+	    WvString("echo $WVSUBPROC_KEEP.$WVSUBPROC_NEW.$WVSUBPROC_GONE >>%s",
+		     t.fn).cstr(), NULL);
+    p.wait(-1);
+    WVPASSEQ(p.estatus, 0);
+    WVPASSEQ(contents(t.fn), "kept.new.\n");
+    
+    // we didn't change our own environment doing that
+    WVPASSEQ(getenv("WVSUBPROC_GONE"), "gone");
+    WVFAIL(getenv("WVSUBPROC_NEW"));
+    unsetenv("WVSUBPROC_KEEP");
+    unsetenv("WVSUBPROC_GONE");
+    
+    // a program that isn't there still exits with 242
+    WvSubProc p2;
+    p2.start("/nonexistent/wvsubproc-test", "wvsubproc-test", NULL);
+    p2.wait(-1);
+    WVPASS(WIFEXITED(p2.estatus));
+    WVPASSEQ(WEXITSTATUS(p2.estatus), 242);
+    
+    ::unlink(t.fn);
+}
+
+
+// a subclass that sets things up in the child, the old-fashioned way
+class SetupSubProc : public WvSubProc
+{
+public:
+    virtual int fork(int *waitfd)
+    {
+	int pid = WvSubProc::fork(waitfd);
+	if (!pid)
+	    setenv("WVSUBPROC_SETUP", "done", 1);
+	return pid;
+    }
+};
+
+
+WVTEST_MAIN("wvsubproc subclass fork() still gets called")
+{
+    WvSubProcQueueTester t;
+    ::unlink(t.fn);
+    
+    SetupSubProc p;
+    p.start("sh", "sh", "-c",
+	    WvString("echo $WVSUBPROC_SETUP >>%s", t.fn).cstr(), NULL);
+    p.wait(-1);
+    WVPASSEQ(p.estatus, 0);
+    WVPASSEQ(contents(t.fn), "done\n");
+    
+    ::unlink(t.fn);
+}
@@ -1,9 +1,16 @@
 /*
  * FIXME: this is much less extensive than tasktest.cc...
  */
+#include "wvautoconf.h"
 #include "wvtest.h"
 #include "wvtask.h"
 #include "wvtimeutils.h" // for wvdelay()
+#include <string.h>
+#ifdef HAVE_VALGRIND_MEMCHECK_H
+# include <valgrind/valgrind.h>
+#else
+# define RUNNING_ON_VALGRIND 0
+#endif
 
 // BEGIN simple definition
 long glob;
@@ -189,3 +196,87 @@ WVTEST_MAIN("tasktest.cc")
     }
 }
 #endif
+
+
+static void deeptask(void *userdata)
+{
+    // use up about 'userdata' bytes of stack
+    size_t len = (size_t)userdata;
+    char *buf = (char *)__builtin_alloca(len);
+    memset(buf, 1, len);
+    glob = buf[len / 2];
+}
+
+
+static WvTaskStackStats *find_stats(WvTaskStackStats *stats, size_t count,
+                                    size_t stacksize)
+{
+    for (size_t i = 0; i < count; i++)
+        if (stats[i].stacksize == stacksize)
+            return &stats[i];
+    return NULL;
+}
+
+
+WVTEST_MAIN("stack pool")
+{
+    WvTaskMan *taskman = WvTaskMan::get();
+
+    // sizes are rounded up to a power of two
+    WvTask *a = taskman->start("task-a", deeptask, (void *)40000, 50000);
+    taskman->run(*a);
+    WVFAIL(a->isrunning());
+    a->recycle();
+
+    WvTaskStackStats stats[WVTASK_STACK_CLASSES];
+    size_t count = WvTaskMan::get_stack_stats(stats, WVTASK_STACK_CLASSES);
+    WvTaskStackStats *st = find_stats(stats, count, 65536);
+    if (!RUNNING_ON_VALGRIND && WVPASS(st))
+    {
+        WVPASS(st->mapped >= 1);
+        WVPASS(st->high_water >= 40000);
+        WVPASS(st->high_water <= 65536);
+    }
+
+    // a task with the same size of stack gets the recycled one
+    WvTask *b = taskman->start("task-b", deeptask, (void *)100, 65536);
+    WVPASS(a == b);
+    taskman->run(*b);
+    b->recycle();
+
+    // past a few, recycled tasks give back their memory, but still work
+    for (int round = 0; round < 2; round++)
+    {
+        WvTaskList tasks;
+        for (int i = 0; i < 20; i++)
+        {
+            WvTask *t = taskman->start("many", deeptask, (void *)8000, 16384);
+            tasks.append(t, false);
+        }
+        WvTaskList::Iter i(tasks);
+        for (i.rewind(); i.next(); )
+        {
+            glob = 0;
+            taskman->run(*i);
+            WVPASSEQ(glob, 1);
+            i->recycle();
+        }
+    }
+
+    // deleting tasks gives their stacks back to the pool, for next time
+    taskman->unlink();
+    taskman = WvTaskMan::get();
+    count = WvTaskMan::get_stack_stats(stats, WVTASK_STACK_CLASSES);
+    st = find_stats(stats, count, 65536);
+    if (!RUNNING_ON_VALGRIND && WVPASS(st))
+    {
+        int idle = st->idle;
+        WVPASS(idle >= 1);
+        WvTask *c = taskman->start("task-c", deeptask, (void *)100, 40000);
+        count = WvTaskMan::get_stack_stats(stats, WVTASK_STACK_CLASSES);
+        WVPASSEQ(find_stats(stats, count, 65536)->idle, idle - 1);
+        taskman->run(*c);
+        c->recycle();
+    }
+    taskman->unlink();
+}
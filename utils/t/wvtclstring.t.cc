@@ -371,3 +371,36 @@ WVTEST_MAIN("wvtcl_getword comprehensive nounescape")
     
     fprintf(stderr, "\n");
 }
+
+
+// long strings take a shortcut through the parts that need no escaping
+WVTEST_MAIN("long strings")
+{
+    WvString filler("%s", "abcdefghijklmnopqrstuvwxyz0123456789"
+                    "abcdefghijklmnopqrstuvwxyz0123456789"
+                    "abcdefghijklmnopqrstuvwxyz0123456789");
+    WvString plain("%s%s", filler, filler);
+    WVPASSEQ(wvtcl_escape(plain), plain);
+
+    WvString spaces("%s %s", filler, filler);
+    WVPASSEQ(wvtcl_escape(spaces), WvString("{%s}", spaces));
+
+    WvString unbalanced("%s} {%s\\", filler, filler);
+    WVPASSEQ(wvtcl_escape(unbalanced),
+             WvString("%s\\}\\ \\{%s\\\\", filler, filler));
+
+    WvString braced("%s{%s {x}}\\}%s", filler, filler, filler);
+    WVPASSEQ(wvtcl_escape(braced), WvString("{%s}", braced));
+
+    const char *tricky[] = { plain, spaces, unbalanced, braced };
+    for (int i = 0; i < 4; i++)
+    {
+        WVPASSEQ(wvtcl_unescape(wvtcl_escape(tricky[i])), tricky[i]);
+
+        // and the WvBuf version agrees
+        WvDynBuf buf;
+        buf.putstr("x");
+        wvtcl_escape(buf, tricky[i]);
+        WVPASSEQ(buf.getstr(), WvString("x%s", wvtcl_escape(tricky[i])));
+    }
+}
@@ -0,0 +1,115 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Compares running a few encoders one after another over a whole buffer,
+ * with a full-sized buffer between each of them, against running them as
+ * a WvEncoderChain, which pushes the data through all of them a slice at
+ * a time.
+ *
+ * Usage: chainbench [megs]
+ */
+#include "wvbase64.h"
+#include "wvgzip.h"
+#include "wvhex.h"
+#include "wvtimeutils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NSTAGES 4
+
+
+static double mbps(size_t bytes, const WvTime &start)
+{
+    time_t ms = msecdiff(wvtime(), start);
+    return ms ? bytes / 1048576.0 * 1000 / ms : 0.0;
+}
+
+
+static void make_stages(WvEncoder **stages, bool compress)
+{
+    if (compress)
+    {
+        stages[0] = new WvGzipEncoder(WvGzipEncoder::Deflate);
+        stages[3] = new WvGzipEncoder(WvGzipEncoder::Inflate);
+    }
+    else
+    {
+        stages[0] = new WvBase64Encoder;
+        stages[3] = new WvBase64Decoder;
+    }
+    stages[1] = new WvHexEncoder;
+    stages[2] = new WvHexDecoder;
+}
+
+
+static void bench(const char *name, WvBuf &input, bool compress)
+{
+    size_t total = input.used();
+    WvEncoder *stages[NSTAGES];
+
+    // one stage at a time, each over everything from the one before
+    make_stages(stages, compress);
+    WvDynBuf bufs[NSTAGES + 1];
+    WvTime start = wvtime();
+    for (size_t done = 0; done < total; done += 1048576)
+    {
+        size_t len = total - done < 1048576 ? total - done : 1048576;
+        bufs[0].put(input.peek(done, len), len);
+        for (int i = 0; i < NSTAGES; i++)
+            stages[i]->encode(bufs[i], bufs[i + 1]);
+        bufs[NSTAGES].zap();
+    }
+    for (int i = 0; i < NSTAGES; i++)
+        stages[i]->flush(bufs[i], bufs[i + 1], true);
+    double staged = mbps(total, start);
+    for (int i = 0; i < NSTAGES; i++)
+        delete stages[i];
+
+    // the same encoders in a chain
+    make_stages(stages, compress);
+    WvEncoderChain chain;
+    for (int i = 0; i < NSTAGES; i++)
+        chain.append(stages[i], true);
+    WvDynBuf in, out;
+    size_t outlen = 0;
+    start = wvtime();
+    for (size_t done = 0; done < total; done += 1048576)
+    {
+        size_t len = total - done < 1048576 ? total - done : 1048576;
+        in.put(input.peek(done, len), len);
+        chain.encode(in, out);
+        outlen += out.used();
+        out.zap();
+    }
+    chain.flush(in, out, true);
+    outlen += out.used();
+    double chained = mbps(total, start);
+
+    printf("%-8s staged: %7.1f MB/s   chained: %7.1f MB/s%s\n", name,
+           staged, chained, outlen == total ? "" : " (FAILED)");
+}
+
+
+int main(int argc, char **argv)
+{
+    int megs = argc > 1 ? atoi(argv[1]) : 32;
+    size_t total = megs * 1048576;
+    WvInPlaceBuf input(total);
+    char line[128];
+    srandom(1);
+    while (input.free())
+    {
+        int len = snprintf(line, sizeof(line),
+                           "request %ld from 10.0.%ld.%ld took %ld ms\n",
+                           random(), random() % 256, random() % 256,
+                           random() % 1000);
+        if ((size_t)len > input.free())
+            len = input.free();
+        input.put(line, len);
+    }
+
+    bench("base64", input, false);
+    bench("gzip", input, true);
+    return 0;
+}
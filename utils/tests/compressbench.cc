@@ -0,0 +1,138 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Compares the compression encoders: how fast each one compresses and
+ * decompresses, and how small it makes things, both for a big stream of
+ * log-like text and for a series of small messages compressed one at a
+ * time (with and without a shared dictionary).
+ *
+ * Usage: compressbench [megs]
+ */
+#include "wvautoconf.h"
+#include "wvgzip.h"
+#include "wvtimeutils.h"
+#ifdef WITH_LZ4
+# include "wvlz4.h"
+#endif
+#ifdef WITH_ZSTD
+# include "wvzstd.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char dict[] =
+    "{\"type\": \"update\", \"key\": \"/cfg/net/eth0/addr\", \"value\": \"\"}"
+    "{\"type\": \"delete\", \"key\": \"/cfg/net/eth1/mtu\"}";
+
+
+static double mbps(size_t bytes, const WvTime &start)
+{
+    time_t ms = msecdiff(wvtime(), start);
+    return ms ? bytes / 1048576.0 * 1000 / ms : 0.0;
+}
+
+
+static void bulk(const char *name, WvEncoder &comp, WvEncoder &decomp,
+		 WvBuf &input)
+{
+    size_t total = input.used();
+    WvDynBuf inbuf, compbuf, outbuf;
+
+    WvTime start = wvtime();
+    for (size_t done = 0; done < total; done += 65536)
+    {
+	size_t len = total - done < 65536 ? total - done : 65536;
+	inbuf.put(input.peek(done, len), len);
+	comp.encode(inbuf, compbuf);
+    }
+    comp.finish(compbuf);
+    double cspeed = mbps(total, start);
+    size_t complen = compbuf.used();
+
+    start = wvtime();
+    decomp.encode(compbuf, outbuf, true, true);
+    double dspeed = mbps(total, start);
+
+    printf("%-8s bulk:  %7.1f MB/s in, %7.1f MB/s out, %5.1f%% of the "
+	   "original%s\n", name, cspeed, dspeed, 100.0 * complen / total,
+	   outbuf.used() == total ? "" : " (FAILED)");
+}
+
+
+static void messages(const char *name, WvEncoder &comp, WvEncoder &decomp)
+{
+    const int count = 20000;
+    size_t total = 0, complen = 0;
+    WvDynBuf compbuf, outbuf;
+
+    WvTime start = wvtime();
+    for (int i = 0; i < count; i++)
+    {
+	WvString msg("{\"type\": \"update\", \"key\": \"/cfg/net/eth%s/addr\", "
+		     "\"value\": \"10.0.%s.%s\"}", i % 4, i / 256, i % 256);
+	total += msg.len();
+	comp.reset();
+	comp.flushstrbuf(msg, compbuf, true);
+	complen += compbuf.used();
+	decomp.reset();
+	decomp.encode(compbuf, outbuf, true, true);
+	outbuf.zap();
+    }
+
+    printf("%-8s small: %7.1f MB/s round trip,            %5.1f%% of the "
+	   "original\n", name, mbps(total, start), 100.0 * complen / total);
+}
+
+
+int main(int argc, char **argv)
+{
+    int megs = argc > 1 ? atoi(argv[1]) : 32;
+    size_t total = megs * 1048576;
+    WvInPlaceBuf input(total);
+    char line[128];
+    srandom(1);
+    while (input.free())
+    {
+	int len = snprintf(line, sizeof(line),
+			   "Oct 18 12:%02ld:%02ld host daemon[%ld]: "
+			   "request %ld from 10.0.%ld.%ld took %ld ms\n",
+			   random() % 60, random() % 60, random() % 32768,
+			   random(), random() % 256, random() % 256,
+			   random() % 1000);
+	if ((size_t)len > input.free())
+	    len = input.free();
+	input.put(line, len);
+    }
+
+    {
+	WvGzipEncoder comp(WvGzipEncoder::Deflate);
+	WvGzipEncoder decomp(WvGzipEncoder::Inflate);
+	bulk("gzip", comp, decomp, input);
+	messages("gzip", comp, decomp);
+    }
+#ifdef WITH_LZ4
+    {
+	WvLZ4Encoder comp(WvLZ4Encoder::Compress);
+	WvLZ4Encoder decomp(WvLZ4Encoder::Decompress);
+	bulk("lz4", comp, decomp, input);
+	messages("lz4", comp, decomp);
+	comp.set_dictionary(dict, sizeof(dict) - 1);
+	decomp.set_dictionary(dict, sizeof(dict) - 1);
+	messages("lz4+dict", comp, decomp);
+    }
+#endif
+#ifdef WITH_ZSTD
+    {
+	WvZstdEncoder comp(WvZstdEncoder::Compress);
+	WvZstdEncoder decomp(WvZstdEncoder::Decompress);
+	bulk("zstd", comp, decomp, input);
+	messages("zstd", comp, decomp);
+	comp.set_dictionary(dict, sizeof(dict) - 1);
+	decomp.set_dictionary(dict, sizeof(dict) - 1);
+	messages("zstd+dict", comp, decomp);
+    }
+#endif
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Compares the ways of formatting a typical log line: the old
+ * do_format(), which needs every argument turned into a WvFastString
+ * first, the WvString constructor, and plain snprintf() for reference.
+ *
+ * Usage: formatbench [count]
+ */
+#include "wvstring.h"
+#include "wvtimeutils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char fmt[] = "request %s from %s:%s took %s ms (%s)";
+
+
+static void report(const char *name, int count, const WvTime &start,
+                   size_t total)
+{
+    time_t ms = msecdiff(wvtime(), start);
+    printf("%-12s %8.0f lines/sec (%lu bytes)\n", name,
+           ms ? count * 1000.0 / ms : 0.0, (unsigned long)total);
+}
+
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    const char *host = "10.0.0.1";
+    size_t total;
+
+    total = 0;
+    WvTime start = wvtime();
+    for (int i = 0; i < count; i++)
+    {
+        WvString a(i), b(host), c(i % 65536), d(i % 1000), e("ok");
+        const WvFastString * const args[] = { &a, &b, &c, &d, &e, NULL };
+        WvFastString out;
+        WvFastString::do_format(out, fmt, args);
+        total += out.len();
+    }
+    report("old", count, start, total);
+
+    total = 0;
+    start = wvtime();
+    for (int i = 0; i < count; i++)
+    {
+        WvString out(fmt, i, host, i % 65536, i % 1000, "ok");
+        total += out.len();
+    }
+    report("WvString", count, start, total);
+
+    total = 0;
+    start = wvtime();
+    for (int i = 0; i < count; i++)
+    {
+        char out[128];
+        total += snprintf(out, sizeof(out),
+                          "request %d from %s:%d took %d ms (%s)",
+                          i, host, i % 65536, i % 1000, "ok");
+    }
+    report("snprintf", count, start, total);
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * How fast does WvGzipEncoder compress, inline and on a WvWorkerPool?
+ * Compresses 'megs' megabytes of log-like text both ways and reports the
+ * throughput and the compressed size of each.
+ *
+ * Usage: gzipbench [-t threads] [-b blocksize] [megs]
+ */
+#include "wvgzip.h"
+#include "wvtimeutils.h"
+#include "wvworkerpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void run(const char *name, WvGzipEncoder &enc, WvBuf &input)
+{
+    WvDynBuf inbuf, outbuf;
+    size_t total = input.used(), compressed = 0;
+    WvTime start = wvtime();
+
+    // in 64k writes, like a WvGzipStream full of log messages would see
+    size_t done = 0;
+    while (done < total)
+    {
+	size_t len = total - done < 65536 ? total - done : 65536;
+	inbuf.put(input.peek(done, len), len);
+	done += len;
+	enc.encode(inbuf, outbuf);
+	compressed += outbuf.used();
+	outbuf.zap();
+    }
+    enc.finish(outbuf);
+    compressed += outbuf.used();
+
+    double secs = msecdiff(wvtime(), start) / 1000.0;
+    printf("%-24s %7.1f MB/s, %5.1f%% of the original size%s\n", name,
+	   secs > 0 ? total / 1048576.0 / secs : 0.0,
+	   100.0 * compressed / total, enc.isok() ? "" : " (FAILED)");
+}
+
+
+int main(int argc, char **argv)
+{
+    int megs = 64, threads = 0;
+    size_t blocksize = 128*1024;
+    for (int i = 1; i < argc; i++)
+    {
+	if (!strcmp(argv[i], "-t") && i + 1 < argc)
+	    threads = atoi(argv[++i]);
+	else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+	    blocksize = atoi(argv[++i]);
+	else
+	    megs = atoi(argv[i]);
+    }
+
+    // a single big buffer, so peek() never has to copy
+    size_t total = megs * 1048576;
+    WvInPlaceBuf input(total);
+    char line[128];
+    srandom(1);
+    while (input.free())
+    {
+	int len = snprintf(line, sizeof(line),
+			   "Oct 18 12:%02ld:%02ld host daemon[%ld]: "
+			   "request %ld from 10.0.%ld.%ld took %ld ms\n",
+			   random() % 60, random() % 60, random() % 32768,
+			   random(), random() % 256, random() % 256,
+			   random() % 1000);
+	if ((size_t)len > input.free())
+	    len = input.free();
+	input.put(line, len);
+    }
+
+    WvGzipEncoder inline_enc(WvGzipEncoder::Deflate);
+    run("inline", inline_enc, input);
+
+    WvWorkerPool pool(threads);
+    WvGzipEncoder par_enc(WvGzipEncoder::Deflate);
+    par_enc.parallel(&pool, blocksize);
+    WvString name("%s worker threads", pool.threads());
+    run(name, par_enc, input);
+    pool.finish();
+
+    return 0;
+}
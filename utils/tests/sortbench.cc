@@ -0,0 +1,82 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Compares sorting a big WvStringList the way WvSorter used to (qsort()
+ * through a static compare function pointer) with WvSorter now, on one
+ * thread and on a WvWorkerPool.
+ *
+ * Usage: sortbench [count] [threads]
+ */
+#include "wvstringlist.h"
+#include "wvtimeutils.h"
+#include "wvworkerpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static WvSorterBase::CompareFunc *actual_compare;
+
+
+static int magic_compare(const void *a, const void *b)
+{
+    return actual_compare(*(void **)a, *(void **)b);
+}
+
+
+static int strcompare(const WvString *a, const WvString *b)
+{
+    return strcmp(*a, *b);
+}
+
+
+static void report(const char *name, const WvTime &start)
+{
+    printf("%-12s %6ld ms\n", name, (long)msecdiff(wvtime(), start));
+}
+
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    int threads = argc > 2 ? atoi(argv[2]) : 0;
+
+    WvStringList l;
+    srandom(1);
+    for (int i = 0; i < count; i++)
+	l.append(WvString("key%s.%s", random(), i));
+
+    void **array = new void *[count];
+    WvStringList::Iter i(l);
+    int n = 0;
+    for (i.rewind(); i.next(); )
+	array[n++] = i.ptr();
+
+    actual_compare = (WvSorterBase::CompareFunc *)strcompare;
+    WvTime start = wvtime();
+    qsort(array, count, sizeof(void *), magic_compare);
+    report("qsort", start);
+
+    start = wvtime();
+    WvStringList::Sorter s(l, strcompare);
+    s.rewind();
+    report("WvSorter", start);
+
+    WvWorkerPool pool(threads);
+    start = wvtime();
+    WvStringList::Sorter s2(l, strcompare);
+    s2.parallel(&pool);
+    s2.rewind();
+    report("parallel", start);
+
+    // make sure they all agree
+    n = 0;
+    for (s.rewind(), s2.rewind(); s.next() && s2.next(); n++)
+	if (s.ptr() != array[n] || s2.ptr() != array[n])
+	    break;
+    if (n != count)
+	printf("MISMATCH at %d\n", n);
+
+    pool.finish();
+    delete[] array;
+    return 0;
+}
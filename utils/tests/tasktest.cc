@@ -5,6 +5,7 @@
  * WvTask test program.
  */
 #include "wvtask.h"
+#include "wvtimeutils.h"
 #include <unistd.h> // for sleep()
 
 WvTask *ga, *gb;
@@ -49,6 +50,31 @@ void gentask(void *userdata)
 }
 
 
+void switchtask(void *userdata)
+{
+    int *count = (int *)userdata;
+    while (*count > 0)
+    {
+	(*count)--;
+	gman->yield();
+    }
+}
+
+
+void quicktask(void *userdata)
+{
+    (*(int *)userdata)++;
+}
+
+
+static void report(const char *what, int count, const WvTime &start)
+{
+    time_t ms = msecdiff(wvtime(), start);
+    printf("%d %s in %ld ms: %.0f per second\n", count, what, (long)ms,
+	   ms ? count * 1000.0 / ms : 0.0);
+}
+
+
 int main()
 {
     WvTaskMan *man = WvTaskMan::get();
@@ -117,6 +143,28 @@ int main()
 	}
     }
     
+    // benchmark: a run() and a yield() are two switches each
+    const int switches = 1000000;
+    int count = switches / 2;
+    WvTask *t = man->start("switchtask", switchtask, &count);
+    WvTime start = wvtime();
+    while (t->isrunning())
+	man->run(*t);
+    report("context switches", switches, start);
+    t->recycle();
+    
+    // benchmark: starting (recycled) tasks
+    const int starts = 200000;
+    count = 0;
+    start = wvtime();
+    for (int x = 0; x < starts; x++)
+    {
+	t = man->start("quicktask", quicktask, &count);
+	man->run(*t);
+	t->recycle();
+    }
+    report("task starts", count, start);
+    
     man->unlink();
     return 0;
 }
@@ -211,6 +211,9 @@ static void wvcrash_real(int sig, int fd, pid_t pid)
         }
     }
     
+    // Write out whatever else people asked us to, like recent log messages
+    wvcrash_run_dump(fd);
+    
     // Write out the assertion message, as logged by __assert*_fail(), if any.
     {
 	const char *assert_msg = wvcrash_read_assert();
@@ -315,6 +318,9 @@ void wvcrash(int sig)
     signal(sig, SIG_DFL);
     wr(2, "\n\nwvcrash: crashing!\n");
     
+    // get any queued log data onto the disk before we start closing fds
+    wvcrash_run_flush();
+    
     // close some fds, just in case the reason we're crashing is fd
     // exhaustion!  Otherwise we won't be able to create our pipe to a
     // subprocess.  Probably only closing two fds is possible, but the
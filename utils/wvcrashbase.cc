@@ -64,6 +64,105 @@ const char *wvcrash_ring_buffer_get()
 }
 
 
+static const int max_flush_funcs = 16;
+static struct
+{
+    WvCrashFlushFunc *func;
+    void *userdata;
+} flush_funcs[max_flush_funcs];
+
+
+void wvcrash_add_flush(WvCrashFlushFunc *func, void *userdata)
+{
+    for (int i = 0; i < max_flush_funcs; ++i)
+    {
+        if (!flush_funcs[i].func)
+        {
+            flush_funcs[i].userdata = userdata;
+            flush_funcs[i].func = func;
+            return;
+        }
+    }
+}
+
+
+void wvcrash_del_flush(WvCrashFlushFunc *func, void *userdata)
+{
+    for (int i = 0; i < max_flush_funcs; ++i)
+    {
+        if (flush_funcs[i].func == func && flush_funcs[i].userdata == userdata)
+        {
+            flush_funcs[i].func = NULL;
+            flush_funcs[i].userdata = NULL;
+        }
+    }
+}
+
+
+void wvcrash_run_flush()
+{
+    for (int i = 0; i < max_flush_funcs; ++i)
+    {
+        WvCrashFlushFunc *func = flush_funcs[i].func;
+        if (func)
+        {
+            // only ever give it one chance, in case it crashes too
+            flush_funcs[i].func = NULL;
+            func(flush_funcs[i].userdata);
+        }
+    }
+}
+
+
+
+static const int max_dump_funcs = 16;
+static struct
+{
+    WvCrashDumpFunc *func;
+    void *userdata;
+} dump_funcs[max_dump_funcs];
+
+
+void wvcrash_add_dump(WvCrashDumpFunc *func, void *userdata)
+{
+    for (int i = 0; i < max_dump_funcs; ++i)
+    {
+        if (!dump_funcs[i].func)
+        {
+            dump_funcs[i].userdata = userdata;
+            dump_funcs[i].func = func;
+            return;
+        }
+    }
+}
+
+
+void wvcrash_del_dump(WvCrashDumpFunc *func, void *userdata)
+{
+    for (int i = 0; i < max_dump_funcs; ++i)
+    {
+        if (dump_funcs[i].func == func && dump_funcs[i].userdata == userdata)
+        {
+            dump_funcs[i].func = NULL;
+            dump_funcs[i].userdata = NULL;
+        }
+    }
+}
+
+
+void wvcrash_run_dump(int fd)
+{
+    for (int i = 0; i < max_dump_funcs; ++i)
+    {
+        WvCrashDumpFunc *func = dump_funcs[i].func;
+        if (func)
+        {
+            dump_funcs[i].func = NULL;
+            func(fd, dump_funcs[i].userdata);
+        }
+    }
+}
+
 
 // FIXME: leaving of a will and catching asserts mostly only works in Linux
 #ifdef __linux
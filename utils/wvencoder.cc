@@ -247,6 +247,14 @@ WvString WvEncoderChain::_geterror() const
 }
 
 
+// The most input we push through the whole chain at a time.  Small enough
+// that each stage's output is still in the cache when the next stage reads
+// it, and that the scratch buffers between stages stay the same size from
+// one slice to the next, so WvDynBuf keeps reusing them instead of
+// allocating new ones.
+#define CHAIN_SLICE 16384
+
+
 // NOTE: In this function we deliberately ignore deep isok() and
 //       isfinished() results to allow addition/removal of
 //       individual broken encoders while still processing data
@@ -255,6 +263,41 @@ bool WvEncoderChain::do_encode(WvBuf &in, WvBuf &out, ChainElem *start_after,
 			       bool flush, bool finish)
 {
     bool success = true;
+
+    // Feed big inputs through in slices, as long as each slice goes all
+    // the way down the chain.  The last slice, along with any flush or
+    // finish, gets the full treatment below.
+    if (encoders.count() > 1)
+    {
+        for (;;)
+        {
+            size_t n = in.optgettable();
+            if (n > CHAIN_SLICE)
+                n = CHAIN_SLICE;
+            if (!n || n == in.used())
+                break;
+            WvConstInPlaceBuf slice(in.get(n), n);
+            if (!run_stages(slice, out, start_after, false, false))
+                success = false;
+            if (slice.used())
+            {
+                // the first stage wants to see more at once
+                in.unget(slice.used());
+                break;
+            }
+        }
+    }
+
+    if (!run_stages(in, out, start_after, flush, finish))
+        success = false;
+    return success;
+}
+
+
+bool WvEncoderChain::run_stages(WvBuf &in, WvBuf &out, ChainElem *start_after,
+				bool flush, bool finish)
+{
+    bool success = true;
     WvBuf *tmpin = &in;
     ChainElemList::Iter it(encoders);
     it.rewind();
@@ -262,14 +305,27 @@ bool WvEncoderChain::do_encode(WvBuf &in, WvBuf &out, ChainElem *start_after,
     last_run = start_after;
     for (; it.cur() && it.next(); )
     {
-        if (!it->enc->encode(*tmpin, it->out, flush))
+        // the last stage writes straight into the caller's buffer; the
+        // others leave their output in their own scratch buffer, which
+        // the next stage drains.
+        WvBuf *tmpout = &it->out;
+        if (!it.cur()->next)
+        {
+            out.merge(it->out); // left over from before a stage was removed
+            tmpout = &out;
+        }
+        // a stage whose input all got buffered further up has nothing to
+        // do yet; that's not an error.
+        if ((tmpin->used() || flush || finish)
+            && !it->enc->encode(*tmpin, *tmpout, flush))
             success = false;
-        if (finish && !it->enc->finish(it->out))
+        if (finish && !it->enc->finish(*tmpout))
             success = false;
 	last_run = it.ptr();
-        tmpin = &it->out;
+        tmpin = tmpout;
     }
-    out.merge(*tmpin);
+    if (tmpin != &out)
+        out.merge(*tmpin);
     return success;
 }
 
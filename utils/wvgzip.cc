@@ -7,21 +7,121 @@
 #include "wvgzip.h"
 #include <zlib.h>
 #include <assert.h>
+#ifndef _WIN32
+# include "wvworkerpool.h"
+# include <pthread.h>
+#endif
 
 #define ZBUFSIZE 10240
+#define ZWINDOW 32768 // the most deflate can look back
+
+#ifndef _WIN32
+
+/*
+ * The parallel compressor works like pigz: the input is cut into blocks,
+ * and each block is deflated on its own, on the worker pool, with the end
+ * of the previous block's input as its dictionary.  Every block but the
+ * last ends with a sync flush, so it ends on a byte boundary, and the
+ * compressed blocks can simply be glued together in order, between a
+ * zlib header and a trailer with the Adler-32 of the whole input.
+ */
+struct WvGzipEncoder::Parallel
+{
+    struct Block
+    {
+        Parallel *par;
+        unsigned char *data; // 'dictlen' bytes of dictionary, then the input
+        size_t dictlen, len;
+        bool last;
+
+        // filled in by the worker; only look at them once 'done' is set
+        bool done, ok;
+        unsigned char *out;
+        size_t outlen;
+        uLong adler;
+
+        Block(Parallel *_par, size_t size)
+            : par(_par), data(new unsigned char[size]), dictlen(0), len(0),
+              last(false), done(false), ok(false), out(NULL), outlen(0) {}
+        ~Block()
+            { delete[] data; delete[] out; }
+    };
+    DeclareWvList(Block);
+
+    WvWorkerPool *pool;
+    size_t blocksize, max_blocks;
+    pthread_mutex_t lock; // protects every Block's 'done'
+    pthread_cond_t done;
+
+    BlockList blocks; // submitted to the pool, in order
+    Block *cur;       // still being filled
+    unsigned char dict[ZWINDOW];
+    size_t dictlen;
+    uLong adler;
+    bool started;
+
+    Parallel(WvWorkerPool *_pool, size_t _blocksize)
+        : pool(_pool), blocksize(_blocksize), cur(NULL), dictlen(0),
+          adler(adler32(0, NULL, 0)), started(false)
+    {
+        // enough to keep every thread busy while we collect the output
+        max_blocks = 2 * pool->threads() + 2;
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&done, NULL);
+    }
+
+    ~Parallel()
+    {
+        // the workers still have pointers to whatever's in flight
+        wait_all();
+        delete cur;
+        pthread_cond_destroy(&done);
+        pthread_mutex_destroy(&lock);
+    }
+
+    void wait(Block *b)
+    {
+        pthread_mutex_lock(&lock);
+        while (!b->done)
+            pthread_cond_wait(&done, &lock);
+        pthread_mutex_unlock(&lock);
+    }
+
+    void wait_all()
+    {
+        BlockList::Iter i(blocks);
+        for (i.rewind(); i.next(); )
+            wait(i.ptr());
+    }
+
+    static void compress(Block *b);
+};
+
+#else // _WIN32
+
+// there's no WvWorkerPool on win32 (yet), so we always compress inline.
+struct WvGzipEncoder::Parallel
+{
+    WvWorkerPool *pool;
+    size_t blocksize;
+};
+
+#endif // _WIN32
 
 
 WvGzipEncoder::WvGzipEncoder(Mode _mode, size_t _out_limit) :
-    out_limit(_out_limit), tmpbuf(ZBUFSIZE), mode(_mode)
+    out_limit(_out_limit), mode(_mode)
 {
     ignore_decompression_errors = false;
     full_flush = false;
+    par = NULL;
     init();
 }
 
 
 WvGzipEncoder::~WvGzipEncoder()
 {
+    parallel(NULL);
     close();
 }
 
@@ -65,6 +165,9 @@ void WvGzipEncoder::close()
 
 bool WvGzipEncoder::_encode(WvBuf &inbuf, WvBuf &outbuf, bool flush)
 {
+    if (par)
+        return par_encode(inbuf, outbuf, flush);
+
     bool success;
     output = 0;
     for (;;)
@@ -90,6 +193,9 @@ bool WvGzipEncoder::_encode(WvBuf &inbuf, WvBuf &outbuf, bool flush)
 
 bool WvGzipEncoder::_finish(WvBuf &outbuf)
 {
+    if (par)
+        return par_finish(outbuf);
+
     prepare(NULL);
     return process(outbuf, false, true);
 }
@@ -97,6 +203,13 @@ bool WvGzipEncoder::_finish(WvBuf &outbuf)
 
 bool WvGzipEncoder::_reset()
 {
+    if (par)
+    {
+        WvWorkerPool *pool = par->pool;
+        size_t blocksize = par->blocksize;
+        parallel(NULL);
+        parallel(pool, blocksize);
+    }
     close();
     init();
     return true;
@@ -128,26 +241,30 @@ bool WvGzipEncoder::process(WvBuf &outbuf, bool flush, bool finish)
     int retval;
     do
     {
-        // process the next chunk
-        tmpbuf.zap();
-        size_t avail_out = tmpbuf.free();
-        if (out_limit)
-            avail_out = tmpbuf.free() < (out_limit - output) ? tmpbuf.free()
-                : (out_limit - output);
+        // process the next chunk, straight into outbuf's free space
+        size_t avail_out = outbuf.optallocable();
+        if (avail_out < ZBUFSIZE)
+            avail_out = outbuf.free() < ZBUFSIZE ? outbuf.free() : ZBUFSIZE;
+        else if (avail_out > 8 * ZBUFSIZE)
+            avail_out = 8 * ZBUFSIZE;
+        if (out_limit && avail_out > out_limit - output)
+            avail_out = out_limit - output;
+        if (avail_out == 0)
+        {
+            retval = Z_BUF_ERROR; // outbuf is full; try again later
+            break;
+        }
 
         zstr->avail_out = avail_out;
-	zstr->next_out = tmpbuf.alloc(avail_out);
+	zstr->next_out = outbuf.alloc(avail_out);
 	if (mode == Deflate)
 	    retval = deflate(zstr, flushmode);
 	else
 	    retval = inflate(zstr, flushmode);
-	tmpbuf.unalloc(zstr->avail_out);
+	outbuf.unalloc(zstr->avail_out);
 
         output += avail_out - zstr->avail_out;
 
-        // consume pending output
-        outbuf.merge(tmpbuf);
-
         if (retval == Z_DATA_ERROR && mode == Inflate
             && ignore_decompression_errors)
             retval = inflateSync(zstr);
@@ -168,3 +285,183 @@ bool WvGzipEncoder::process(WvBuf &outbuf, bool flush, bool finish)
     return true;
 }
 
+
+
+#ifndef _WIN32
+
+// runs on a worker thread, so it mustn't touch anything but 'b'
+void WvGzipEncoder::Parallel::compress(Block *b)
+{
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    // negative windowBits means raw deflate: no header or trailer
+    if (deflateInit2(&z, Z_BEST_SPEED, Z_DEFLATED, -15, 8,
+                     Z_DEFAULT_STRATEGY) == Z_OK)
+    {
+        if (b->dictlen)
+            deflateSetDictionary(&z, b->data, b->dictlen);
+
+        // a sync flush adds at most a few bytes past deflateBound()
+        size_t bound = deflateBound(&z, b->len) + 16;
+        b->out = new unsigned char[bound];
+        z.next_in = b->data + b->dictlen;
+        z.avail_in = b->len;
+        z.next_out = b->out;
+        z.avail_out = bound;
+        int retval = deflate(&z, b->last ? Z_FINISH : Z_SYNC_FLUSH);
+        b->outlen = bound - z.avail_out;
+        b->ok = b->last ? retval == Z_STREAM_END
+            : (retval == Z_OK && z.avail_in == 0 && z.avail_out != 0);
+        deflateEnd(&z);
+    }
+    b->adler = adler32(adler32(0, NULL, 0), b->data + b->dictlen, b->len);
+
+    pthread_mutex_lock(&b->par->lock);
+    b->done = true;
+    pthread_cond_broadcast(&b->par->done);
+    pthread_mutex_unlock(&b->par->lock);
+}
+
+
+void WvGzipEncoder::parallel(WvWorkerPool *pool, size_t _blocksize)
+{
+    if (par)
+    {
+        delete par;
+        par = NULL;
+    }
+    if (pool && mode == Deflate)
+        par = new Parallel(pool, _blocksize ? _blocksize : 128*1024);
+}
+
+
+bool WvGzipEncoder::par_encode(WvBuf &inbuf, WvBuf &outbuf, bool flush)
+{
+    while (inbuf.used())
+    {
+        if (!par->cur)
+        {
+            Parallel::Block *b = new Parallel::Block(par,
+                                     par->dictlen + par->blocksize);
+            memcpy(b->data, par->dict, par->dictlen);
+            b->dictlen = par->dictlen;
+            par->cur = b;
+        }
+
+        Parallel::Block *b = par->cur;
+        size_t len = inbuf.optgettable();
+        if (len > par->blocksize - b->len)
+            len = par->blocksize - b->len;
+        memcpy(b->data + b->dictlen + b->len, inbuf.get(len), len);
+        b->len += len;
+
+        if (b->len == par->blocksize)
+        {
+            par_submit(false);
+            if (!par_collect(outbuf, par->max_blocks))
+                return false;
+        }
+    }
+
+    if (flush && par->cur)
+    {
+        par_submit(false);
+        if (full_flush)
+            par->dictlen = 0;
+    }
+    return par_collect(outbuf, flush ? 0 : par->max_blocks);
+}
+
+
+bool WvGzipEncoder::par_finish(WvBuf &outbuf)
+{
+    par_submit(true);
+    return par_collect(outbuf, 0);
+}
+
+
+void WvGzipEncoder::par_submit(bool last)
+{
+    Parallel::Block *b = par->cur;
+    if (!b)
+    {
+        // finishing with nothing left over still needs a final block
+        b = new Parallel::Block(par, 0);
+    }
+    par->cur = NULL;
+    b->last = last;
+
+    // the next block's dictionary is the end of this one (including its
+    // own dictionary, if this block was short)
+    size_t total = b->dictlen + b->len;
+    par->dictlen = total < ZWINDOW ? total : ZWINDOW;
+    memcpy(par->dict, b->data + total - par->dictlen, par->dictlen);
+
+    par->blocks.append(b, true);
+    par->pool->add(wv::bind(&Parallel::compress, b));
+}
+
+
+bool WvGzipEncoder::par_collect(WvBuf &outbuf, size_t max_left)
+{
+    while (!par->blocks.isempty())
+    {
+        Parallel::Block *b = par->blocks.first();
+        if (par->blocks.count() > max_left)
+            par->wait(b);
+        else
+        {
+            pthread_mutex_lock(&par->lock);
+            bool done = b->done;
+            pthread_mutex_unlock(&par->lock);
+            if (!done)
+                break;
+        }
+
+        if (!b->ok)
+        {
+            seterror("error during parallel gzip compression");
+            par->wait_all();
+            par->blocks.zap();
+            return false;
+        }
+
+        if (!par->started)
+        {
+            // the same header deflateInit(Z_BEST_SPEED) would write
+            outbuf.put("\x78\x01", 2);
+            par->started = true;
+        }
+        outbuf.put(b->out, b->outlen);
+        par->adler = adler32_combine(par->adler, b->adler, b->len);
+        if (b->last)
+        {
+            unsigned char trailer[4];
+            trailer[0] = par->adler >> 24;
+            trailer[1] = par->adler >> 16;
+            trailer[2] = par->adler >> 8;
+            trailer[3] = par->adler;
+            outbuf.put(trailer, 4);
+        }
+        par->blocks.unlink_first();
+    }
+    return true;
+}
+
+#else // _WIN32
+
+void WvGzipEncoder::parallel(WvWorkerPool *pool, size_t _blocksize)
+{
+}
+
+bool WvGzipEncoder::par_encode(WvBuf &inbuf, WvBuf &outbuf, bool flush)
+{
+    return false;
+}
+
+bool WvGzipEncoder::par_finish(WvBuf &outbuf)
+{
+    return false;
+}
+
+#endif // _WIN32
@@ -0,0 +1,223 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * LZ4 encoder/decoder based on liblz4.  See wvlz4.h.
+ */
+#include "wvlz4.h"
+#define LZ4F_STATIC_LINKING_ONLY // for the dictionary functions
+#include <lz4frame.h>
+#include <string.h>
+
+#define LZ4CHUNK 65536 // the most we compress or decompress in one call
+
+
+WvLZ4Encoder::WvLZ4Encoder(Mode _mode, int _level) :
+    mode(_mode), level(_level)
+{
+    cctx = NULL;
+    dctx = NULL;
+    cdict = NULL;
+    dict = NULL;
+    dictlen = 0;
+    started = false;
+
+    size_t retval;
+    if (mode == Compress)
+        retval = LZ4F_createCompressionContext(&cctx, LZ4F_VERSION);
+    else
+        retval = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+    check(retval);
+}
+
+
+WvLZ4Encoder::~WvLZ4Encoder()
+{
+    if (cctx)
+        LZ4F_freeCompressionContext(cctx);
+    if (dctx)
+        LZ4F_freeDecompressionContext(dctx);
+    if (cdict)
+        LZ4F_freeCDict(cdict);
+    delete[] dict;
+}
+
+
+void WvLZ4Encoder::set_dictionary(const void *_dict, size_t len)
+{
+    if (cdict)
+        LZ4F_freeCDict(cdict);
+    cdict = NULL;
+    delete[] dict;
+    dict = NULL;
+    dictlen = 0;
+
+    if (_dict && len)
+    {
+        dict = new unsigned char[len];
+        memcpy(dict, _dict, len);
+        dictlen = len;
+        if (mode == Compress)
+            cdict = LZ4F_createCDict(dict, dictlen);
+    }
+    reset();
+}
+
+
+bool WvLZ4Encoder::check(size_t result)
+{
+    if (!LZ4F_isError(result))
+        return true;
+    seterror("error during lz4 %s: %s",
+             mode == Compress ? "compression" : "decompression",
+             LZ4F_getErrorName(result));
+    return false;
+}
+
+
+static void get_prefs(LZ4F_preferences_t &prefs, int level)
+{
+    memset(&prefs, 0, sizeof(prefs));
+    // linked blocks, so small writes can refer back to earlier ones
+    prefs.frameInfo.blockMode = LZ4F_blockLinked;
+    prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+    prefs.compressionLevel = level;
+}
+
+
+bool WvLZ4Encoder::begin(WvBuf &outbuf)
+{
+    if (started)
+        return true;
+
+    LZ4F_preferences_t prefs;
+    get_prefs(prefs, level);
+    unsigned char *out = outbuf.alloc(LZ4F_HEADER_SIZE_MAX);
+    size_t len;
+    if (cdict)
+        len = LZ4F_compressBegin_usingCDict(cctx, out, LZ4F_HEADER_SIZE_MAX,
+                                            cdict, &prefs);
+    else
+        len = LZ4F_compressBegin(cctx, out, LZ4F_HEADER_SIZE_MAX, &prefs);
+    if (!check(len))
+    {
+        outbuf.unalloc(LZ4F_HEADER_SIZE_MAX);
+        return false;
+    }
+    outbuf.unalloc(LZ4F_HEADER_SIZE_MAX - len);
+    started = true;
+    return true;
+}
+
+
+bool WvLZ4Encoder::compress(WvBuf &outbuf, const void *data, size_t len)
+{
+    // the bound allows for whatever's left in lz4's own buffers, too
+    LZ4F_preferences_t prefs;
+    get_prefs(prefs, level);
+    size_t avail = LZ4F_compressBound(len, &prefs);
+    unsigned char *out = outbuf.alloc(avail);
+    size_t used = data ? LZ4F_compressUpdate(cctx, out, avail,
+                                             data, len, NULL)
+        : LZ4F_flush(cctx, out, avail, NULL);
+    if (!check(used))
+    {
+        outbuf.unalloc(avail);
+        return false;
+    }
+    outbuf.unalloc(avail - used);
+    return true;
+}
+
+
+bool WvLZ4Encoder::_encode(WvBuf &inbuf, WvBuf &outbuf, bool flush)
+{
+    if (mode == Decompress)
+        return decompress(inbuf, outbuf);
+
+    if (!begin(outbuf))
+        return false;
+    while (inbuf.used())
+    {
+        size_t len = inbuf.optgettable();
+        if (len > LZ4CHUNK)
+            len = LZ4CHUNK;
+        if (!compress(outbuf, inbuf.get(len), len))
+            return false;
+    }
+    if (flush)
+        return compress(outbuf, NULL, 0);
+    return true;
+}
+
+
+bool WvLZ4Encoder::_finish(WvBuf &outbuf)
+{
+    if (mode == Decompress)
+        return true;
+
+    if (!begin(outbuf))
+        return false;
+    LZ4F_preferences_t prefs;
+    get_prefs(prefs, level);
+    size_t avail = LZ4F_compressBound(0, &prefs);
+    unsigned char *out = outbuf.alloc(avail);
+    size_t used = LZ4F_compressEnd(cctx, out, avail, NULL);
+    if (!check(used))
+    {
+        outbuf.unalloc(avail);
+        return false;
+    }
+    outbuf.unalloc(avail - used);
+    started = false;
+    return true;
+}
+
+
+bool WvLZ4Encoder::decompress(WvBuf &inbuf, WvBuf &outbuf)
+{
+    while (inbuf.used())
+    {
+        size_t inlen = inbuf.optgettable();
+        const unsigned char *in = inbuf.get(inlen);
+
+        // keep going until lz4 has taken all the input and has no more
+        // output for us
+        size_t outlen, retval;
+        do
+        {
+            size_t avail = LZ4CHUNK, taken = inlen;
+            unsigned char *out = outbuf.alloc(avail);
+            outlen = avail;
+            retval = LZ4F_decompress_usingDict(dctx, out, &outlen, in, &taken,
+                                               dict, dictlen, NULL);
+            outbuf.unalloc(avail - outlen);
+            if (!check(retval))
+            {
+                inbuf.unget(inlen);
+                return false;
+            }
+            in += taken;
+            inlen -= taken;
+        } while (retval != 0 && (inlen || outlen == LZ4CHUNK));
+
+        if (retval == 0)
+        {
+            // the end of the frame; leave whatever follows it
+            inbuf.unget(inlen);
+            setfinished();
+            break;
+        }
+    }
+    return true;
+}
+
+
+bool WvLZ4Encoder::_reset()
+{
+    if (dctx)
+        LZ4F_resetDecompressionContext(dctx);
+    // LZ4F_compressBegin() starts the compressor over on its own
+    started = false;
+    return true;
+}
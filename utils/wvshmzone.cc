@@ -27,10 +27,42 @@ WvShmZone::WvShmZone(size_t _size)
 	return;
     }
     
-    buf = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);              
+    map(MAP_SHARED);
+}
+
+
+WvShmZone::WvShmZone(WvStringParm filename, size_t _size)
+{
+    size = (int)_size;
+    assert(size > 0);
+    
+    buf = NULL;
+    
+    fd = open(filename, O_RDWR|O_CREAT, 0600);
+    if (fd < 0)
+    {
+	seterr(errno);
+	return;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (st.st_size < size && ftruncate(fd, size) < 0))
+    {
+	seterr(errno);
+	return;
+    }
+    
+    map(MAP_SHARED);
+}
+
+
+void WvShmZone::map(int flags)
+{
+    buf = mmap(0, size, PROT_READ|PROT_WRITE, flags, fd, 0);              
     
-    if (!buf)
+    if (buf == MAP_FAILED)
     {
+	buf = NULL;
 	seterr(errno);
 	return;
     }
@@ -1,20 +1,200 @@
 /*
  * Worldvisions Weaver Software:
  *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
- * 
+ *
  * An iterator that can sort anything that has an Iter subclass with the
  * right member functions.
- * 
+ *
  * See wvsorter.h.
  */
 #include "wvsorter.h"
+#include <string.h>
 
-WvSorterBase::CompareFunc *WvSorterBase::actual_compare;
+#ifndef _WIN32
+# include "wvworkerpool.h"
+# include <pthread.h>
+#endif
 
-int WvSorterBase::magic_compare(const void *_a, const void *_b)
+// below this many elements, an insertion sort is quicker than merging
+#define INSERTION_MAX 16
+
+typedef WvSorterBase::CompareFunc CompareFunc;
+
+
+// merge the sorted runs src[0..mid) and src[mid..n) into dst
+static void merge(void **src, size_t mid, size_t n, void **dst,
+		  CompareFunc *cmp)
 {
-    void *a = *(void **)_a, *b = *(void **)_b;
-    return actual_compare(a, b);
+    void **l = src, **lend = src + mid, **r = lend, **rend = src + n;
+
+    // take from the left on ties, so equal elements keep their order
+    while (l < lend && r < rend)
+	*dst++ = (cmp(*r, *l) < 0) ? *r++ : *l++;
+    while (l < lend)
+	*dst++ = *l++;
+    while (r < rend)
+	*dst++ = *r++;
+}
+
+
+// sort a[0..n), using tmp[0..n) as scratch space
+static void msort(void **a, void **tmp, size_t n, CompareFunc *cmp)
+{
+    if (n <= INSERTION_MAX)
+    {
+	for (size_t i = 1; i < n; i++)
+	{
+	    void *x = a[i];
+	    size_t j = i;
+	    for (; j > 0 && cmp(x, a[j-1]) < 0; j--)
+		a[j] = a[j-1];
+	    a[j] = x;
+	}
+	return;
+    }
+
+    size_t mid = n / 2;
+    msort(a, tmp, mid, cmp);
+    msort(a + mid, tmp + mid, n - mid, cmp);
+
+    // already in order?  (Common when the list was mostly sorted.)
+    if (cmp(a[mid], a[mid-1]) >= 0)
+	return;
+
+    memcpy(tmp, a, n * sizeof(void *));
+    merge(tmp, mid, n, a, cmp);
 }
 
 
+#ifndef _WIN32
+
+// Sorts (or merges) runs of an array on a WvWorkerPool, and lets the
+// caller wait for all of them.
+class WvParallelSort
+{
+public:
+    struct Run
+    {
+	WvParallelSort *ps;
+	void **a, **tmp;
+	size_t mid, n;
+    };
+
+    CompareFunc *cmp;
+    pthread_mutex_t lock; // protects 'left'
+    pthread_cond_t done;
+    int left;
+
+    WvParallelSort(CompareFunc *_cmp) : cmp(_cmp), left(0)
+    {
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&done, NULL);
+    }
+
+    ~WvParallelSort()
+    {
+	pthread_cond_destroy(&done);
+	pthread_mutex_destroy(&lock);
+    }
+
+    // mid == 0 means sort the run; otherwise, merge its two halves
+    static void run(Run *r)
+    {
+	if (!r->mid)
+	    msort(r->a, r->tmp, r->n, r->ps->cmp);
+	else if (r->ps->cmp(r->a[r->mid], r->a[r->mid-1]) < 0)
+	{
+	    memcpy(r->tmp, r->a, r->n * sizeof(void *));
+	    merge(r->tmp, r->mid, r->n, r->a, r->ps->cmp);
+	}
+
+	pthread_mutex_lock(&r->ps->lock);
+	if (!--r->ps->left)
+	    pthread_cond_signal(&r->ps->done);
+	pthread_mutex_unlock(&r->ps->lock);
+    }
+
+    // run runs[1..n) on the pool, and runs[0] here, and wait for them all
+    void go(WvWorkerPool *pool, Run *runs, int n)
+    {
+	left = n;
+	for (int i = 1; i < n; i++)
+	    pool->add(wv::bind(&WvParallelSort::run, &runs[i]));
+	run(&runs[0]);
+
+	pthread_mutex_lock(&lock);
+	while (left)
+	    pthread_cond_wait(&done, &lock);
+	pthread_mutex_unlock(&lock);
+    }
+};
+
+
+// Sort one chunk per thread, then merge pairs of neighbouring chunks until
+// there's only one left.
+static void psort(void **a, void **tmp, size_t n, CompareFunc *cmp,
+		  WvWorkerPool *pool)
+{
+    int nchunks = pool->threads() + 1;
+    if (n / nchunks < INSERTION_MAX)
+	nchunks = n / INSERTION_MAX;
+
+    size_t *start = new size_t[nchunks + 1];
+    for (int i = 0; i <= nchunks; i++)
+	start[i] = n * i / nchunks;
+
+    WvParallelSort ps(cmp);
+    WvParallelSort::Run *runs = new WvParallelSort::Run[nchunks];
+    for (int i = 0; i < nchunks; i++)
+    {
+	runs[i].ps = &ps;
+	runs[i].a = a + start[i];
+	runs[i].tmp = tmp + start[i];
+	runs[i].mid = 0;
+	runs[i].n = start[i+1] - start[i];
+    }
+    ps.go(pool, runs, nchunks);
+
+    // each round merges chunks 2k and 2k+1 into chunk k
+    while (nchunks > 1)
+    {
+	int nruns = nchunks / 2;
+	for (int i = 0; i < nruns; i++)
+	{
+	    runs[i].a = a + start[2*i];
+	    runs[i].tmp = tmp + start[2*i];
+	    runs[i].mid = start[2*i + 1] - start[2*i];
+	    runs[i].n = start[2*i + 2] - start[2*i];
+	}
+	ps.go(pool, runs, nruns);
+
+	// an odd chunk out just moves along to the next round
+	for (int i = 0; i <= nruns; i++)
+	    start[i] = start[2*i];
+	if (nchunks & 1)
+	    start[nruns + 1] = n;
+	nchunks = (nchunks + 1) / 2;
+    }
+
+    deletev runs;
+    deletev start;
+}
+
+#endif // !_WIN32
+
+
+void WvSorterBase::sort(void **array, size_t n, CompareFunc *cmp,
+			WvWorkerPool *pool)
+{
+    if (n < 2)
+	return;
+
+    void **tmp = new void *[n];
+#ifndef _WIN32
+    if (pool && pool->threads() && n >= WVSORT_PARALLEL_MIN)
+	psort(array, tmp, n, cmp, pool);
+    else
+#endif
+	msort(array, tmp, n, cmp);
+    deletev tmp;
+}
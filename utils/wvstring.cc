@@ -10,6 +10,7 @@
 #include <assert.h>
 
 WvStringBuf WvFastString::nullbuf = { 0, 1 };
+WvStringBuf WvFastString::localbuf = { 0, 1 };
 const WvFastString WvFastString::null;
 
 const WvString WvString::empty("");
@@ -38,13 +39,13 @@ WvFastString::WvFastString()
 
 WvFastString::WvFastString(const WvFastString &s)
 {
-    link(s.buf, s.str);
+    link(s);
 }
 
 
 WvFastString::WvFastString(const WvString &s)
 {
-    link(s.buf, s.str);
+    link(s);
 }
 
 
@@ -72,7 +73,7 @@ void WvString::copy_constructor(const WvFastString &s)
 	unique();
     }
     else
-	link(s.buf, s.str); // already in a nice, safe WvStreamBuf
+	link(s); // already in a nice, safe WvStreamBuf (or our own local[])
 }
 
 
@@ -173,68 +174,71 @@ inline static void wv_strrev(char *begin, char *end)
 
 
 
-// NOTE: make sure that 32 bytes is big enough for your longest int.
-// This is true up to at least 64 bits.
+// The longest 64-bit number, "-9223372036854775808", is 20 characters,
+// which still leaves room in local[].  So does anything "%g" can produce.
+#define NUMLEN 20
+#define DOUBLELEN 20
+
 WvFastString::WvFastString(short i)
 {
-    newbuf(32);
+    newbuf(NUMLEN);
     wv_strrev(str, wv_itoar(str, i));
 }
 
 
 WvFastString::WvFastString(unsigned short i)
 {
-    newbuf(32);
+    newbuf(NUMLEN);
     wv_strrev(str, wv_uitoar(str, i));
 }
 
 
 WvFastString::WvFastString(int i)
 {
-    newbuf(32);
+    newbuf(NUMLEN);
     wv_strrev(str, wv_itoar(str, i));
 }
 
 
 WvFastString::WvFastString(unsigned int i)
 {
-    newbuf(32);
+    newbuf(NUMLEN);
     wv_strrev(str, wv_uitoar(str, i));
 }
 
 
 WvFastString::WvFastString(long i)
 {
-    newbuf(32);
+    newbuf(NUMLEN);
     wv_strrev(str, wv_itoar(str, i));
 }
 
 
 WvFastString::WvFastString(unsigned long i)
 {
-    newbuf(32);
+    newbuf(NUMLEN);
     wv_strrev(str, wv_uitoar(str, i));
 }
 
 
 WvFastString::WvFastString(long long i)
 {
-    newbuf(32);
+    newbuf(NUMLEN);
     wv_strrev(str, wv_itoar(str, i));
 }
 
 
 WvFastString::WvFastString(unsigned long long i)
 {
-    newbuf(32);
+    newbuf(NUMLEN);
     wv_strrev(str, wv_uitoar(str, i));
 }
 
 
 WvFastString::WvFastString(double i)
 {
-    newbuf(32);
-    sprintf(str, "%g", i);
+    newbuf(DOUBLELEN);
+    snprintf(str, DOUBLELEN + 1, "%g", i);
 }
 
 
@@ -244,9 +248,21 @@ WvFastString::~WvFastString()
 }
 
 
+// nullbuf is shared by every borrowed and null string, in every thread,
+// so it isn't counted at all (and is never freed).
+unsigned WvFastString::unlink_buf(WvStringBuf *buf)
+{
+    if (buf == &nullbuf)
+	return 1;
+    if (buf->links & WVSTRINGBUF_SHARED)
+	return __sync_sub_and_fetch(&buf->links, 1) & ~WVSTRINGBUF_SHARED;
+    return --buf->links;
+}
+
+
 void WvFastString::unlink()
 { 
-    if (buf && ! --buf->links)
+    if (buf && buf != &localbuf && !unlink_buf(buf))
     {
 	free(buf);
         buf = NULL;
@@ -257,8 +273,13 @@ void WvFastString::unlink()
 void WvFastString::link(WvStringBuf *_buf, const char *_str)
 {
     buf = _buf;
-    if (buf)
-	buf->links++;
+    if (buf && buf != &nullbuf)
+    {
+	if (buf->links & WVSTRINGBUF_SHARED)
+	    __sync_fetch_and_add(&buf->links, 1);
+	else
+	    buf->links++;
+    }
     str = (char *)_str; // I promise not to change it without asking!
 }
     
@@ -295,6 +316,12 @@ size_t WvFastString::len() const
 
 void WvFastString::newbuf(size_t size)
 {
+    if (size + WVSTRING_EXTRA <= sizeof(local))
+    {
+	buf = &localbuf;
+	str = local;
+	return;
+    }
     buf = alloc(size);
     buf->links = 1;
     str = buf->data;
@@ -307,10 +334,13 @@ WvString &WvString::unique()
 {
     if (!is_unique() && str)
     {
-	WvStringBuf *newb = alloc(len() + 1);
-	memcpy(newb->data, str, newb->size);
-	unlink();
-	link(newb, newb->data);
+	// not unique, so dropping our link can't free the old buffer
+	WvStringBuf *oldbuf = buf;
+	const char *oldstr = str;
+	size_t size = len();
+	newbuf(size);
+	memcpy(str, oldstr, size + 1);
+	unlink_buf(oldbuf);
     }
 	    
     return *this; 
@@ -319,7 +349,37 @@ WvString &WvString::unique()
 
 bool WvString::is_unique() const
 {
-    return (buf->links <= 1);
+    // localbuf.links is always 1; buf is NULL only after a move.  nullbuf
+    // isn't counted, and it's never ours to change anyway.
+    return (!buf || (buf != &nullbuf
+		     && (buf->links & ~WVSTRINGBUF_SHARED) <= 1));
+}
+
+
+WvString &WvString::shareable()
+{
+    // copies of local[] never share anything
+    if (!str || buf == &localbuf)
+	return *this;
+
+    if (!buf || buf == &nullbuf)
+    {
+	// borrowed from somebody's char*, so we need a buf of our own
+	WvStringBuf *oldbuf = buf;
+	const char *oldstr = str;
+	size_t size = len();
+	newbuf(size);
+	memcpy(str, oldstr, size + 1);
+	if (oldbuf)
+	    unlink_buf(oldbuf);
+	if (buf == &localbuf)
+	    return *this;
+    }
+
+    // if it's not shared yet, no other thread can be looking at it
+    if (!(buf->links & WVSTRINGBUF_SHARED))
+	buf->links |= WVSTRINGBUF_SHARED;
+    return *this;
 }
 
 
@@ -330,7 +390,7 @@ WvFastString &WvFastString::operator= (const WvFastString &s2)
     else
     {
 	unlink();
-	link(s2.buf, s2.str);
+	link(s2);
     }
     return *this;
 }
@@ -339,7 +399,7 @@ WvFastString &WvFastString::operator= (const WvFastString &s2)
 WvString &WvString::operator= (int i)
 {
     unlink();
-    newbuf(32);
+    newbuf(NUMLEN);
     sprintf(str, "%d", i);
     return *this;
 }
@@ -352,17 +412,30 @@ WvString &WvString::operator= (const WvFastString &s2)
     else if (!s2.buf)
     {
 	// We have a string, and we're about to free() it.
-	if (str && buf && buf->links == 1)
+	if (str && buf && buf != &nullbuf && buf->links == 1)
 	{
-	    // Set buf->size, if we don't already know it.
-	    if (buf->size == 0)
-		buf->size = strlen(str);
+	    char *base;
+	    size_t size;
+	    if (buf == &localbuf)
+	    {
+		base = local;
+		size = sizeof(local);
+	    }
+	    else
+	    {
+		// Set buf->size, if we don't already know it.
+		if (buf->size == 0)
+		    buf->size = strlen(str);
+		base = buf->data;
+		size = buf->size + WVSTRING_EXTRA;
+	    }
 
-	    if (str < s2.str && s2.str <= (str + buf->size))
+	    if (base <= s2.str && s2.str < base + size)
 	    {
 		// If the two strings overlap, we'll just need to
 		// shift s2.str over to here.
-		memmove(buf->data, s2.str, buf->size);
+		memmove(base, s2.str, strlen(s2.str) + 1);
+		str = base;
 		return *this;
 	    }
 	}
@@ -375,7 +448,7 @@ WvString &WvString::operator= (const WvFastString &s2)
     {
 	// just a normal string link
 	unlink();
-	link(s2.buf, s2.str);
+	link(s2);
     }
     return *this;
 }
@@ -625,3 +698,226 @@ void WvFastString::do_format(WvFastString &output, const char *format,
 }
 
 
+
+
+void WvFormatArg::setnum(long long i)
+{
+    char *end = wv_itoar(num, i);
+    wv_strrev(num, end);
+    numlen = end - num;
+}
+
+
+void WvFormatArg::setunum(unsigned long long i)
+{
+    char *end = wv_uitoar(num, i);
+    wv_strrev(num, end);
+    numlen = end - num;
+}
+
+
+void WvFormatArg::setdouble(double d)
+{
+    numlen = snprintf(num, sizeof(num), "%g", d);
+}
+
+
+// One piece of a parsed format string: some literal text, followed by
+// a conversion (or not, at the end or for a "%%").
+struct FormatOp
+{
+    unsigned int litstart, litlen;
+    char conv;         // 's', 'c', or 0 for none
+    bool zeropad;
+    int justify, maxlen;
+    int argnum;        // counting from zero
+};
+
+
+#define FORMAT_CACHE_SLOTS 16 // per thread
+#define FORMAT_CACHE_LEN 96   // the longest format string we'll remember
+#define FORMAT_CACHE_OPS 12   // ... and the most conversions in it
+
+struct FormatCacheSlot
+{
+    const char *format; // where the format string was
+    size_t len;
+    char copy[FORMAT_CACHE_LEN]; // and what it said
+    int nops;
+    FormatOp ops[FORMAT_CACHE_OPS];
+};
+
+#ifdef __GNUC__
+static __thread FormatCacheSlot format_cache[FORMAT_CACHE_SLOTS];
+#endif
+
+
+// Breaks 'format' into 'ops', which has room for at least one more op than
+// there are '%' signs in it.  Returns the number of ops.
+static int parse_format(const char *format, FormatOp *ops)
+{
+    const char *lit = format, *iptr = format;
+    int nops = 0, nextarg = 0;
+    bool zeropad;
+    int justify, maxlen, argnum;
+    
+    for (;;)
+    {
+        FormatOp &op = ops[nops++];
+        const char *pct = strchr(iptr, '%');
+        op.litstart = lit - format;
+        op.litlen = (pct ? pct : iptr + strlen(iptr)) - lit;
+        op.conv = 0;
+        if (!pct)
+            return nops;
+
+        argnum = 0;
+        iptr = pparse(pct, zeropad, justify, maxlen, argnum);
+        if (!*iptr)
+            return nops;
+        if (*iptr == '%')
+        {
+            // a literal percent: it starts the next piece of text
+            lit = iptr++;
+            continue;
+        }
+        if (*iptr == 's' || *iptr == 'c')
+        {
+            op.conv = *iptr;
+            op.zeropad = zeropad;
+            op.justify = justify;
+            op.maxlen = maxlen;
+            op.argnum = argnum > 0 ? argnum - 1 : nextarg++;
+        }
+        lit = ++iptr;
+    }
+}
+
+
+static const char *format_arg(const FormatOp &op, const WvFormatArg *argv,
+                              size_t argc, size_t &aplen)
+{
+    static const char blank[] = "(nil)";
+    const char *arg = (size_t)op.argnum < argc
+        ? argv[op.argnum].cstr() : NULL;
+    if (arg)
+        aplen = argv[op.argnum].len();
+    else
+    {
+        arg = blank;
+        aplen = sizeof(blank) - 1;
+    }
+    if (op.maxlen && (size_t)op.maxlen < aplen)
+        aplen = op.maxlen;
+    return arg;
+}
+
+
+static size_t format_len(const FormatOp *ops, int nops,
+                         const WvFormatArg *argv, size_t argc)
+{
+    size_t total = 0, aplen;
+    for (int i = 0; i < nops; i++)
+    {
+        const FormatOp &op = ops[i];
+        total += op.litlen;
+        if (op.conv == 's')
+        {
+            format_arg(op, argv, argc, aplen);
+            total += _max(abs(op.justify), aplen);
+        }
+        else if (op.conv == 'c')
+            total++;
+    }
+    return total;
+}
+
+
+static void render_format(char *optr, const char *format,
+                          const FormatOp *ops, int nops,
+                          const WvFormatArg *argv, size_t argc)
+{
+    size_t aplen;
+    for (int i = 0; i < nops; i++)
+    {
+        const FormatOp &op = ops[i];
+        memcpy(optr, format + op.litstart, op.litlen);
+        optr += op.litlen;
+        
+        if (op.conv == 's')
+        {
+            const char *arg = format_arg(op, argv, argc, aplen);
+            char pad = op.zeropad ? '0' : ' ';
+            if (op.justify > (int)aplen)
+            {
+                memset(optr, pad, op.justify - aplen);
+                optr += op.justify - aplen;
+            }
+            memcpy(optr, arg, aplen);
+            optr += aplen;
+            if (op.justify < 0 && -op.justify > (int)aplen)
+            {
+                memset(optr, pad, -op.justify - aplen);
+                optr += -op.justify - aplen;
+            }
+        }
+        else if (op.conv == 'c')
+        {
+            const char *arg = (size_t)op.argnum < argc
+                ? argv[op.argnum].cstr() : NULL;
+            *optr++ = (arg && *arg) ? (char)atoi(arg) : 0;
+        }
+    }
+    *optr = 0;
+}
+
+
+void WvFastString::do_format(WvFastString &output, const char *format,
+                             const WvFormatArg *argv, size_t argc)
+{
+    size_t len = strlen(format);
+    const FormatOp *ops;
+    FormatOp *newops = NULL;
+    int nops;
+    
+#ifdef __GNUC__
+    // the same format string usually comes from the same place; but check
+    // that it still says the same thing, in case it was in a buffer.
+    FormatCacheSlot &slot =
+        format_cache[((size_t)format >> 3) % FORMAT_CACHE_SLOTS];
+    if (slot.format == format && slot.len == len
+            && !memcmp(slot.copy, format, len))
+    {
+        ops = slot.ops;
+        nops = slot.nops;
+    }
+    else
+#endif
+    {
+        int percents = 0;
+        for (const char *cptr = format; (cptr = strchr(cptr, '%')) != NULL;
+             cptr++)
+            percents++;
+        
+#ifdef __GNUC__
+        if (len <= FORMAT_CACHE_LEN && percents < FORMAT_CACHE_OPS)
+        {
+            slot.format = format;
+            slot.len = len;
+            memcpy(slot.copy, format, len);
+            slot.nops = parse_format(format, slot.ops);
+            ops = slot.ops;
+            nops = slot.nops;
+        }
+        else
+#endif
+        {
+            ops = newops = new FormatOp[percents + 1];
+            nops = parse_format(format, newops);
+        }
+    }
+    
+    output.setsize(format_len(ops, nops, argv, argc) + 1);
+    render_format(output.str, format, ops, nops, argv, argc);
+    delete[] newops;
+}
@@ -3,95 +3,243 @@
  *   Copyright (C) 2005 Net Integration Technologies, Inc.
  *
  * Definition for the WvStringCache class.  See wvstringcache.h.
+ *
+ * Each shard keeps its strings in a hash table, to find them, and in a
+ * ring, for a "clock" hand to sweep around evicting the ones that nobody
+ * else has a link to.  Each string has a 'used' flag that get() sets, and
+ * the hand clears as it goes by, so a string that keeps being asked for
+ * survives even if there are moments when nobody is holding onto it.
  */
 #include "wvstringcache.h"
-#include "wvstringlist.h"
+#include "wvscatterhash.h"
+#include <stdlib.h>
 
-WvStringTable *WvStringCache::t;
-int WvStringCache::refcount;
-size_t WvStringCache::clean_threshold;
+#ifndef _WIN32
+# include <pthread.h>
+#endif
 
-WvStringCache::WvStringCache()
+// how many entries the hand looks at each time a string is added
+#define SWEEP_STEPS 2
+
+struct WvCachedString
+{
+    WvString s;
+    bool used;    // asked for since the hand last went by
+    size_t slot;  // where we are in the shard's ring
+
+    WvCachedString(WvStringParm _s) : s(_s), used(true)
+        { s.shareable(); }
+
+    // roughly what keeping this string around costs us
+    size_t cost() const
+        { return sizeof(*this) + sizeof(WvStringBuf) + s.len(); }
+};
+
+DeclareWvScatterDict(WvCachedString, WvFastString, s);
+
+
+struct WvStringCache::Shard
 {
-    refcount++;
-    if (!t)
+#ifndef _WIN32
+    pthread_mutex_t mutex;
+#endif
+    WvCachedStringDict dict;
+    WvCachedString **ring;
+    size_t used, alloced, hand, bytes;
+
+    Shard() : ring(NULL), used(0), alloced(0), hand(0), bytes(0)
+    {
+#ifndef _WIN32
+        pthread_mutex_init(&mutex, NULL);
+#endif
+    }
+
+    ~Shard()
+    {
+        dict.zap();
+        free(ring);
+#ifndef _WIN32
+        pthread_mutex_destroy(&mutex);
+#endif
+    }
+
+    void lock()
+    {
+#ifndef _WIN32
+        pthread_mutex_lock(&mutex);
+#endif
+    }
+
+    void unlock()
+    {
+#ifndef _WIN32
+        pthread_mutex_unlock(&mutex);
+#endif
+    }
+
+    void add(WvCachedString *c)
+    {
+        if (used == alloced)
+        {
+            alloced = alloced ? alloced * 2 : 64;
+            ring = (WvCachedString **)realloc(ring,
+                                              alloced * sizeof(*ring));
+        }
+        c->slot = used;
+        ring[used++] = c;
+        bytes += c->cost();
+        dict.add(c, true);
+    }
+
+    // the last string in the ring takes c's place, so this is O(1)
+    void evict(WvCachedString *c)
+    {
+        bytes -= c->cost();
+        ring[c->slot] = ring[--used];
+        ring[c->slot]->slot = c->slot;
+        dict.remove(c);
+    }
+
+    // Move the hand along by up to 'n' entries, evicting unused strings
+    // (recently used ones too, if 'force') until we're down to 'target'
+    // bytes.
+    //
+    // Nobody can make a new link to a string without asking us for it, so
+    // if the cache has the only link, there's no race in throwing it out.
+    void sweep(size_t n, bool force, size_t target)
     {
-	t = new WvStringTable;
-	clean_threshold = 0;
+        while (n-- && used && bytes > target)
+        {
+            if (hand >= used)
+                hand = 0;
+            WvCachedString *c = ring[hand];
+            if ((c->used && !force) || !c->s.is_unique())
+            {
+                c->used = false;
+                hand++;
+            }
+            else
+                evict(c);
+        }
     }
+};
+
+
+WvStringCache::Shard *WvStringCache::shards;
+int WvStringCache::refcount;
+size_t WvStringCache::maxbytes = WVSTRINGCACHE_MAXBYTES;
+
+#ifndef _WIN32
+static pthread_mutex_t refcount_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+WvStringCache::WvStringCache()
+{
+#ifndef _WIN32
+    pthread_mutex_lock(&refcount_mutex);
+#endif
+    if (!refcount++)
+        shards = new Shard[WVSTRINGCACHE_SHARDS];
+#ifndef _WIN32
+    pthread_mutex_unlock(&refcount_mutex);
+#endif
 }
 
 
 WvStringCache::~WvStringCache()
 {
-    refcount--;
-    if (!refcount)
+#ifndef _WIN32
+    pthread_mutex_lock(&refcount_mutex);
+#endif
+    if (!--refcount)
     {
-	delete t;
-	t = NULL;
-	clean_threshold = 0;
+        deletev shards;
+        shards = NULL;
     }
-    else
-	clean();
+#ifndef _WIN32
+    pthread_mutex_unlock(&refcount_mutex);
+#endif
 }
-    
+
 
 WvString WvStringCache::get(WvStringParm s)
 {
-    // return s; // disable cache
-    WvString *ret = (*t)[s];
-    if (ret)
+    // short strings get copied into each WvString anyway
+    if (!s || s.len() < WVSTRING_LOCAL)
+        return s;
+
+    Shard &shard = shards[WvHash(s) % WVSTRINGCACHE_SHARDS];
+    shard.lock();
+
+    WvCachedString *c = shard.dict[s];
+    if (c)
     {
-	// printf("found(%s)\n", s.cstr());
-	return *ret;
+        c->used = true;
+        WvString ret(c->s);
+        shard.unlock();
+        return ret;
     }
-    else
+
+    // make room, if we can; if we can't, just don't cache this one
+    c = new WvCachedString(s);
+    size_t limit = maxbytes / WVSTRINGCACHE_SHARDS;
+    shard.sweep(SWEEP_STEPS, false, 0);
+    if (shard.bytes + c->cost() > limit && c->cost() <= limit)
+        shard.sweep(shard.used, true, limit - c->cost());
+    if (shard.bytes + c->cost() > limit)
     {
-	// printf("  new(%s)\n", s.cstr());
-	ret = new WvString(s);
-	t->add(ret, true);
-	return *ret;
+        WvString ret(c->s);
+        shard.unlock();
+        delete c;
+        return ret;
     }
+
+    shard.add(c);
+    WvString ret(c->s);
+    shard.unlock();
+    return ret;
 }
 
 
 void WvStringCache::clean()
 {
-    // do we actually need to clean yet?  Skip it if we haven't added too
-    // many items since the last clean, since cleaning is pretty slow.
-    if (t->count() < clean_threshold)
-	return;
-    
-    WvStringList l;
-    
-    // use a two-stage process so the iterator doesn't get messed up
-    // FIXME: this might actually be unnecessary with WvScatterHash, but
-    // someone should actually confirm that before taking this out.
+    for (int i = 0; i < WVSTRINGCACHE_SHARDS; i++)
     {
-	WvStringTable::Iter i(*t);
-	for (i.rewind(); i.next(); )
-	{
-	    if (i->is_unique()) // last remaining instance
-	    {
-		// printf("CLEANUP(%s)\n", i->cstr());
-		l.append(i.ptr(), false);
-	    }
-	}
+        shards[i].lock();
+        shards[i].sweep(shards[i].used, true, 0);
+        shards[i].unlock();
     }
-    
-//    printf("CLEANUP-1: %d elements at start (%d to remove)\n",
-//	   (int)t->count(), (int)l.count());
-    
+}
+
+
+void WvStringCache::set_limit(size_t bytes)
+{
+    maxbytes = bytes;
+}
+
+
+size_t WvStringCache::count()
+{
+    size_t n = 0;
+    for (int i = 0; shards && i < WVSTRINGCACHE_SHARDS; i++)
     {
-	WvStringList::Iter i(l);
-	for (i.rewind(); i.next(); )
-	    t->remove(i.ptr());
+        shards[i].lock();
+        n += shards[i].used;
+        shards[i].unlock();
     }
-    
-    clean_threshold = t->count() + t->count()/10 + 1;
-    
-//    printf("CLEANUP-2: %d elements left (thres=%d).\n", 
-//	   (int)t->count(), (int)clean_threshold);
+    return n;
 }
 
 
+size_t WvStringCache::size()
+{
+    size_t n = 0;
+    for (int i = 0; shards && i < WVSTRINGCACHE_SHARDS; i++)
+    {
+        shards[i].lock();
+        n += shards[i].bytes;
+        shards[i].unlock();
+    }
+    return n;
+}
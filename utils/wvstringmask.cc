@@ -9,6 +9,10 @@
  */
 #include "wvstringmask.h"
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 WvStringMask::WvStringMask(WvStringParm s)
 {
     zap();
@@ -36,6 +40,7 @@ void WvStringMask::zap()
 {
     memset(_set, 0, sizeof(bool) * sizeof(_set));
     _first = '\0';
+    _runs = 0;
 }
 
 void WvStringMask::set(const char c, bool value)
@@ -43,7 +48,8 @@ void WvStringMask::set(const char c, bool value)
     if (!_first)
 	_first = c;
 
-    _set[unsigned(c)] = value;
+    _set[(unsigned char)c] = value;
+    find_runs();
 }
 
 void WvStringMask::set(WvStringParm s, bool value)
@@ -57,8 +63,74 @@ void WvStringMask::set(WvStringParm s, bool value)
 
 	while (*c)
 	{
-	    _set[unsigned(*c)] = value;
+	    _set[(unsigned char)*c] = value;
 	    ++c;
 	}
+	find_runs();
     }
 }
+
+void WvStringMask::find_runs()
+{
+    _runs = 0;
+    for (int c = 0; c < 256; c++)
+    {
+	if (!_set[c])
+	    continue;
+	if (_runs && _hi[_runs-1] == c - 1)
+	    _hi[_runs-1] = c;
+	else if (_runs == WVSTRINGMASK_RUNS)
+	{
+	    _runs = -1;
+	    return;
+	}
+	else
+	{
+	    _lo[_runs] = _hi[_runs] = c;
+	    _runs++;
+	}
+    }
+}
+
+size_t WvStringMask::find(const char *s, size_t len) const
+{
+    size_t i = 0;
+
+    if (!_runs)
+	return len;
+
+#ifdef __SSE2__
+    if (_runs > 0 && len >= 16)
+    {
+	__m128i lo[WVSTRINGMASK_RUNS], width[WVSTRINGMASK_RUNS];
+	for (int r = 0; r < _runs; r++)
+	{
+	    lo[r] = _mm_set1_epi8(_lo[r]);
+	    width[r] = _mm_set1_epi8(_hi[r] - _lo[r]);
+	}
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 16 <= len; i += 16)
+	{
+	    __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+	    __m128i hit = zero;
+
+	    // x is in [lo, lo+width] if x-lo (mod 256) is no more than width
+	    for (int r = 0; r < _runs; r++)
+	    {
+		__m128i over = _mm_subs_epu8(_mm_sub_epi8(x, lo[r]), width[r]);
+		hit = _mm_or_si128(hit, _mm_cmpeq_epi8(over, zero));
+	    }
+
+	    int bits = _mm_movemask_epi8(hit);
+	    if (bits)
+		return i + __builtin_ctz(bits);
+	}
+    }
+#endif
+
+    for (; i < len; i++)
+	if (_set[(unsigned char)s[i]])
+	    return i;
+    return len;
+}
@@ -15,9 +15,16 @@
 #include <stdarg.h>
 #include <errno.h>
 #include <assert.h>
+#include <typeinfo>
 
 #include "wvfork.h"
 
+#ifndef _WIN32
+# include <spawn.h>
+# define WVSUBPROC_SPAWN 1
+extern char **environ;
+#endif
+
 void WvSubProc::init()
 {
     pid = -1;
@@ -39,6 +46,9 @@ int WvSubProc::_startv(const char cmd[], const char * const *argv)
 {
     int waitfd = -1;
     
+    if (spawnable() && spawn(cmd, argv) == 0)
+	return 0;
+    
     pid = fork(&waitfd);
     //fprintf(stderr, "pid for '%s' is %d\n", cmd, pid);
     
@@ -76,6 +86,103 @@ int WvSubProc::_startv(const char cmd[], const char * const *argv)
 }
 
 
+bool WvSubProc::spawnable() const
+{
+    // a subclass may have overridden fork(), which posix_spawn() skips
+    return typeid(*this) == typeid(WvSubProc) && can_spawn();
+}
+
+
+bool WvSubProc::can_spawn() const
+{
+#if WVSUBPROC_SPAWN
+    return memlimit <= 0; // posix_spawn() can't set an rlimit
+#else
+    return false;
+#endif
+}
+
+
+// Like fork() and then exec() in _startv(), but without the fork(), using
+// the same environment and process group rules as fork().  Returns 0 if
+// the program started, or -1 if we should fall back to fork() (which, if
+// the program really can't be run, will exit with the usual code).
+int WvSubProc::spawn(const char cmd[], const char * const *argv)
+{
+#if WVSUBPROC_SPAWN
+    running = false;
+    estatus = 0;
+    
+    // build the child's environment from ours, merging and overriding it
+    // the same way fork() does
+    WvStringList envlist;
+    for (char **e = environ; e && *e; e++)
+	envlist.append(*e);
+    WvStringList::Iter i(env);
+    for (i.rewind(); i.next(); )
+    {
+	WvStringList words;
+	words.splitstrict(*i, "=");
+	WvString name = words.popstr();
+	WvString value = words.join("=");
+	WvString prefix("%s=", name);
+	
+	WvString old;
+	WvStringList::Iter j(envlist);
+	for (j.rewind(); j.next(); )
+	{
+	    if (!strncmp(*j, prefix, prefix.len()))
+	    {
+		old = j->cstr() + prefix.len();
+		j.xunlink();
+		break;
+	    }
+	}
+	
+	if (!value)
+	{
+	    // no equals or setting to empty string?  Then unset it, unless
+	    // it's one of the ones we merge.
+	    if (!!old && (name == "LD_LIBRARY_PATH" || name == "LD_PRELOAD"))
+		envlist.append(WvString("%s%s", prefix, old));
+	}
+	else if (!!old && (name == "LD_LIBRARY_PATH" || name == "LD_PRELOAD"))
+	    envlist.append(WvString("%s%s:%s", prefix, value, old));
+	else
+	    envlist.append(*i);
+    }
+    
+    const char **envp = new const char*[envlist.count() + 1];
+    const char **envptr = envp;
+    WvStringList::Iter j(envlist);
+    for (j.rewind(); j.next(); )
+	*envptr++ = *j;
+    *envptr = NULL;
+    
+    // put the child in its own process group, like fork() does
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+    
+    pid_t newpid;
+    int err = posix_spawnp(&newpid, cmd, NULL, &attr,
+			   (char * const *)argv, (char * const *)envp);
+    posix_spawnattr_destroy(&attr);
+    deletev envp;
+    
+    if (err)
+	return -1;
+    
+    pid = newpid;
+    running = true;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+
 void WvSubProc::prepare(const char cmd[], ...)
 {
     va_list ap;
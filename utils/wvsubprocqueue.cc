@@ -7,20 +7,58 @@
 #include "wvsubprocqueue.h"
 #include <unistd.h>
 #include <assert.h>
+#include <poll.h>
+#include <string.h>
+
+#ifdef __linux__
+# include <sched.h>
+# include <sys/epoll.h>
+# include <sys/syscall.h>
+# ifdef SYS_pidfd_open
+#  define WVSUBPROC_PIDFD 1
+# endif
+#endif
+
+// the most exits we collect from the kernel at a time
+#define MAX_EVENTS 64
+
+
+// the number of CPUs we're allowed to run on
+static unsigned num_cpus()
+{
+#if defined(__linux__) && defined(CPU_COUNT)
+    cpu_set_t set;
+    if (!sched_getaffinity(0, sizeof(set), &set) && CPU_COUNT(&set) > 0)
+	return CPU_COUNT(&set);
+#endif
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
 
 
 WvSubProcQueue::WvSubProcQueue(unsigned _maxrunning)
 {
-    maxrunning = _maxrunning;
+    maxrunning = _maxrunning ? _maxrunning : num_cpus();
+    cookies_running = npolled = 0;
+#if WVSUBPROC_PIDFD
+    exitfd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    exitfd = -1;
+#endif
 }
 
 
 WvSubProcQueue::~WvSubProcQueue()
 {
+    EntList::Iter i(runq);
+    for (i.rewind(); i.next(); )
+	unwatch(i.ptr());
+    if (exitfd >= 0)
+	close(exitfd);
 }
 
 
-void WvSubProcQueue::add(void *cookie, WvSubProc *proc)
+void WvSubProcQueue::add(void *cookie, WvSubProc *proc, int priority)
 {
     assert(proc);
     assert(!proc->running);
@@ -44,28 +82,130 @@ void WvSubProcQueue::add(void *cookie, WvSubProc *proc)
 		return;
 	    }
 	}
+	
+	waitq.append(new Ent(cookie, proc, 0), true);
+	return;
     }
     
-    waitq.append(new Ent(cookie, proc), true);
+    // usually everything has the same priority, and it just goes at the end
+    Ent *last = waitq.last();
+    if (!last || last->cookie || last->priority >= priority)
+    {
+	waitq.append(new Ent(cookie, proc, priority), true);
+	return;
+    }
+    
+    // otherwise it goes after the last sync point, and after everything
+    // since then that's at least as important.  (Each stretch between sync
+    // points is always sorted, so that's the right spot.)
+    EntList::Iter i(waitq);
+    i.rewind();
+    WvLink *after = i.cur();
+    while (i.next())
+	if (i->cookie || i->priority >= priority)
+	    after = i.cur();
+    waitq.add_after(after, new Ent(cookie, proc, priority), true);
 }
 
 
 void WvSubProcQueue::add(void *cookie,
-			 const char *cmd, const char * const *argv)
+			 const char *cmd, const char * const *argv,
+			 int priority)
 {
     WvSubProc *p = new WvSubProc;
     p->preparev(cmd, argv);
-    add(cookie, p);
+    add(cookie, p, priority);
 }
 
 
-bool WvSubProcQueue::cookie_running()
+void WvSubProcQueue::start(Ent *e)
 {
-    EntList::Iter i(runq);
-    for (i.rewind(); i.next(); )
-	if (i->cookie)
-	    return true;
-    return false;
+    e->proc->start_again();
+    if (e->cookie)
+	cookies_running++;
+    watch(e);
+}
+
+
+// Arrange to hear about e's process exiting through exitfd if we can, or
+// else remember that we'll have to poll it.
+void WvSubProcQueue::watch(Ent *e)
+{
+#if WVSUBPROC_PIDFD
+    if (exitfd >= 0 && e->proc->running && e->proc->pid > 0)
+    {
+	e->pidfd = syscall(SYS_pidfd_open, e->proc->pid, 0);
+	if (e->pidfd >= 0)
+	{
+	    struct epoll_event ev;
+	    memset(&ev, 0, sizeof(ev));
+	    ev.events = EPOLLIN;
+	    ev.data.ptr = e;
+	    if (!epoll_ctl(exitfd, EPOLL_CTL_ADD, e->pidfd, &ev))
+		return;
+	    close(e->pidfd);
+	    e->pidfd = -1;
+	}
+    }
+#endif
+    npolled++;
+}
+
+
+void WvSubProcQueue::unwatch(Ent *e)
+{
+    if (e->pidfd >= 0)
+    {
+	// closing it isn't enough to take it out of the epoll set if a
+	// child we're forking right now still has a copy
+#if WVSUBPROC_PIDFD
+	epoll_ctl(exitfd, EPOLL_CTL_DEL, e->pidfd, NULL);
+#endif
+	close(e->pidfd);
+	e->pidfd = -1;
+    }
+    else
+	npolled--;
+}
+
+
+// Returns true if e's process (and all its children) are done.
+bool WvSubProcQueue::reap(Ent *e)
+{
+    e->proc->wait(0, true);
+    if (e->proc->running)
+    {
+	// if we were told the main process exited, but it left children
+	// behind, the pidfd would just keep telling us; poll it instead.
+	if (e->pidfd >= 0 && e->proc->pid < 0)
+	{
+	    unwatch(e);
+	    npolled++;
+	}
+	return false;
+    }
+    
+    unwatch(e);
+    if (e->cookie)
+	cookies_running--;
+    return true;
+}
+
+
+// Take the finished process at 'i' out of the running queue.
+void WvSubProcQueue::retire(EntList::Iter &i)
+{
+    Ent *e = i.ptr();
+    if (e->redo)
+    {
+	// someone re-enqueued this task while it was
+	// waiting/running
+	e->redo = false;
+	i.xunlink(false);
+	waitq.append(e, true);
+    }
+    else
+	i.xunlink();
 }
 
 
@@ -76,56 +216,60 @@ int WvSubProcQueue::go()
     //fprintf(stderr, "go: %d waiting, %d running\n",
     //	waitq.count(), runq.count());
     
-    // first we need to clean up any finished processes
+    // first we need to clean up any finished processes: the ones the
+    // kernel told us about, and the ones we have to poll.
+#if WVSUBPROC_PIDFD
+    if (exitfd >= 0)
     {
-	EntList::Iter i(runq);
-	for (i.rewind(); i.next(); )
+	struct epoll_event events[MAX_EVENTS];
+	int n;
+	do
 	{
-	    Ent *e = i.ptr();
-	    
-	    e->proc->wait(0, true);
-	    if (!e->proc->running)
+	    n = epoll_wait(exitfd, events, MAX_EVENTS, 0);
+	    for (int j = 0; j < n; j++)
 	    {
-		if (e->redo)
+		Ent *e = (Ent *)events[j].data.ptr;
+		if (reap(e))
 		{
-		    // someone re-enqueued this task while it was
-		    // waiting/running
-		    e->redo = false;
-		    i.xunlink(false);
-		    waitq.append(e, true);
+		    EntList::Iter i(runq);
+		    i.find(e);
+		    retire(i);
 		}
-		else
-		    i.xunlink();
 	    }
-	}
+	} while (n == MAX_EVENTS);
+    }
+#endif
+    if (npolled)
+    {
+	EntList::Iter i(runq);
+	for (i.rewind(); i.next(); )
+	    if (i->pidfd < 0 && reap(i.ptr()))
+		retire(i);
     }
     
     while (!waitq.isempty() && runq.count() < maxrunning)
     {
-	EntList::Iter i(waitq);
-	for (i.rewind(); i.next(); )
-	{
-	    // elements with cookies are "sync points" in the queue;
-	    // they guarantee that everything before that point has
-	    // finished running before they run, and don't let anything
-	    // after them run until they've finished.
-	    if (i->cookie && !runq.isempty())
-		goto out;
-	    if (cookie_running())
-		goto out;
-	    
-	    // jump it into the running queue, but be careful not to
-	    // delete the object when removing!
-	    Ent *e = i.ptr();
-	    i.xunlink(false);
-	    runq.append(e, true);
-	    e->proc->start_again();
-	    started++;
+	// elements with cookies are "sync points" in the queue;
+	// they guarantee that everything before that point has
+	// finished running before they run, and don't let anything
+	// after them run until they've finished.
+	Ent *e = waitq.first();
+	if (e->cookie && !runq.isempty())
 	    break;
-	}
+	if (cookies_running)
+	    break;
+	
+	// jump it into the running queue, but be careful not to
+	// delete the object when removing!
+	EntList::Iter j(waitq);
+	j.rewind();
+	j.next();
+	j.xunlink(false);
+	runq.append(e, true);
+	start(e);
+	started++;
     }
     
-out:
     assert(runq.count() <= maxrunning);
     return started;
 }
@@ -154,7 +298,18 @@ void WvSubProcQueue::finish()
     while (!isempty())
     {
 	go();
-	if (!isempty())
+	if (isempty())
+	    break;
+	
+	// wait for something to exit, if we can tell when that happens
+	if (exitfd >= 0 && !npolled)
+	{
+	    struct pollfd pfd;
+	    pfd.fd = exitfd;
+	    pfd.events = POLLIN;
+	    poll(&pfd, 1, 1000);
+	}
+	else
 	    usleep(100*1000);
     }
 }
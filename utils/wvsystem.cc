@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <typeinfo>
 
 WvSystem::~WvSystem()
 {
@@ -56,6 +57,16 @@ int WvSystem::fork(int *waitfd)
 }
 
 
+// overrides WvSubProc::spawnable(): fork() has to do the redirections,
+// and a subclass may have overridden fork() again.
+bool WvSystem::spawnable() const
+{
+    return typeid(*this) == typeid(WvSystem)
+	&& fdfiles[0].isnull() && fdfiles[1].isnull() && fdfiles[2].isnull()
+	&& can_spawn();
+}
+
+
 int WvSystem::go()
 {
     if (!started)
@@ -31,6 +31,8 @@ char *alloca ();
 #include "wvtask.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <assert.h>
 #include <sys/mman.h>
 #include <signal.h>
@@ -55,15 +57,155 @@ char *alloca ();
 # define Dprintf(fmt, args...)
 #endif
 
+// getcontext() and setcontext() save and restore the signal mask, which
+// costs a system call each time.  Where we know how, we switch tasks by
+// hand instead: wvtask_swap() pushes the callee-saved registers onto the
+// current stack, saves the stack pointer in *from, and pops the same
+// registers off the stack at 'to'.  Build with -DWVTASK_UCONTEXT to use
+// the ucontext functions everywhere.
+#if defined(__GNUC__) && defined(__ELF__) && !defined(WVTASK_UCONTEXT) \
+    && (defined(__x86_64__) || defined(__aarch64__))
+# define WVTASK_FASTSWITCH 1
+
+extern "C" {
+    void wvtask_swap(void **from, void *to) __attribute__((visibility("hidden")));
+    void wvtask_start() __attribute__((visibility("hidden")));
+}
+
+#if defined(__x86_64__)
+__asm__(
+    ".pushsection .text\n"
+    ".globl wvtask_swap\n"
+    ".hidden wvtask_swap\n"
+    ".type wvtask_swap, @function\n"
+    "wvtask_swap:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size wvtask_swap, .-wvtask_swap\n"
+    "\n"
+    // a new task's first wvtask_swap() "returns" here, with the function
+    // to call in r12 and its argument in r13.
+    ".globl wvtask_start\n"
+    ".hidden wvtask_start\n"
+    ".type wvtask_start, @function\n"
+    "wvtask_start:\n"
+    "    movq %r13, %rdi\n"
+    "    callq *%r12\n"
+    "    ud2\n"
+    ".size wvtask_start, .-wvtask_start\n"
+    ".popsection\n");
+
+// the registers wvtask_swap() pops, lowest address first
+enum { SAVED_CSR, SAVED_R15, SAVED_R14, SAVED_R13, SAVED_R12, SAVED_RBX,
+       SAVED_RBP, SAVED_RET, SAVED_WORDS };
+
+static void **init_frame(void **sp, void (*func)(void *), void *arg)
+{
+    sp -= SAVED_WORDS;
+    memset(sp, 0, SAVED_WORDS * sizeof(void *));
+    uint32_t mxcsr = 0x1f80;  // the defaults: all exceptions masked,
+    uint16_t fpucw = 0x037f;  // round to nearest
+    memcpy(&sp[SAVED_CSR], &mxcsr, 4);
+    memcpy((char *)&sp[SAVED_CSR] + 4, &fpucw, 2);
+    sp[SAVED_R12] = (void *)func;
+    sp[SAVED_R13] = arg;
+    sp[SAVED_RET] = (void *)wvtask_start;
+    return sp;
+}
+
+#else // __aarch64__
+__asm__(
+    ".pushsection .text\n"
+    ".globl wvtask_swap\n"
+    ".hidden wvtask_swap\n"
+    ".type wvtask_swap, %function\n"
+    "wvtask_swap:\n"
+    "    sub sp, sp, #0xa0\n"
+    "    stp x19, x20, [sp, #0x00]\n"
+    "    stp x21, x22, [sp, #0x10]\n"
+    "    stp x23, x24, [sp, #0x20]\n"
+    "    stp x25, x26, [sp, #0x30]\n"
+    "    stp x27, x28, [sp, #0x40]\n"
+    "    stp x29, x30, [sp, #0x50]\n"
+    "    stp d8, d9, [sp, #0x60]\n"
+    "    stp d10, d11, [sp, #0x70]\n"
+    "    stp d12, d13, [sp, #0x80]\n"
+    "    stp d14, d15, [sp, #0x90]\n"
+    "    mov x9, sp\n"
+    "    str x9, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp x19, x20, [sp, #0x00]\n"
+    "    ldp x21, x22, [sp, #0x10]\n"
+    "    ldp x23, x24, [sp, #0x20]\n"
+    "    ldp x25, x26, [sp, #0x30]\n"
+    "    ldp x27, x28, [sp, #0x40]\n"
+    "    ldp x29, x30, [sp, #0x50]\n"
+    "    ldp d8, d9, [sp, #0x60]\n"
+    "    ldp d10, d11, [sp, #0x70]\n"
+    "    ldp d12, d13, [sp, #0x80]\n"
+    "    ldp d14, d15, [sp, #0x90]\n"
+    "    add sp, sp, #0xa0\n"
+    "    ret\n"
+    ".size wvtask_swap, .-wvtask_swap\n"
+    "\n"
+    // a new task's first wvtask_swap() "returns" here, with the function
+    // to call in x19 and its argument in x20.
+    ".globl wvtask_start\n"
+    ".hidden wvtask_start\n"
+    ".type wvtask_start, %function\n"
+    "wvtask_start:\n"
+    "    mov x0, x20\n"
+    "    blr x19\n"
+    "    brk #0\n"
+    ".size wvtask_start, .-wvtask_start\n"
+    ".popsection\n");
+
+// the registers wvtask_swap() pops, lowest address first
+enum { SAVED_X19, SAVED_X20, SAVED_X29 = 10, SAVED_X30, SAVED_WORDS = 20 };
+
+static void **init_frame(void **sp, void (*func)(void *), void *arg)
+{
+    sp -= SAVED_WORDS;
+    memset(sp, 0, SAVED_WORDS * sizeof(void *));
+    sp[SAVED_X19] = (void *)func;
+    sp[SAVED_X20] = arg;
+    sp[SAVED_X30] = (void *)wvtask_start;
+    return sp;
+}
+#endif
+
+#endif // WVTASK_FASTSWITCH
+
+
 int WvTask::taskcount, WvTask::numtasks, WvTask::numrunning;
 
 WvTaskMan *WvTaskMan::singleton;
 int WvTaskMan::links, WvTaskMan::magic_number;
-WvTaskList WvTaskMan::all_tasks, WvTaskMan::free_tasks;
+WvTaskList WvTaskMan::all_tasks, WvTaskMan::free_tasks[WVTASK_STACK_CLASSES];
 ucontext_t WvTaskMan::stackmaster_task, WvTaskMan::get_stack_return,
     WvTaskMan::toplevel;
 WvTask *WvTaskMan::current_task, *WvTaskMan::stack_target;
 char *WvTaskMan::stacktop;
+void *WvTaskMan::toplevel_sp;
 
 static int context_return;
 
@@ -74,6 +216,151 @@ static bool use_shared_stack()
 }
 
 
+// valgrind wants the shared stack, and that only works with ucontext.
+static bool use_fast_switch()
+{
+#ifdef WVTASK_FASTSWITCH
+    return !use_shared_stack();
+#else
+    return false;
+#endif
+}
+
+
+#ifndef MAP_ANONYMOUS
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_NORESERVE
+# define MAP_NORESERVE 0
+#endif
+
+// Task stacks are kept in pools, one for each power of two, so that a
+// new task can reuse the stack of one that was deleted.  Each stack has
+// an inaccessible guard page below it, so an overflow crashes right away
+// instead of scribbling on whatever comes next.  Memory for a stack is
+// only committed as the task touches it, and is given back when the task
+// is deleted, or recycled while plenty of others like it are waiting.
+struct StackPool
+{
+    struct FreeStack
+    {
+        void *stack;
+        FreeStack *next;
+    };
+    FreeStack *free;
+    int mapped, idle;
+    size_t high_water;
+    int recycled; // tasks in WvTaskMan::free_tasks with these stacks
+};
+
+// recycled tasks that keep their stack memory, for each size
+#define WARM_STACKS 8
+
+static StackPool stack_pools[WVTASK_STACK_CLASSES];
+
+
+static size_t page_size()
+{
+    static size_t page = 0;
+    if (!page)
+        page = sysconf(_SC_PAGESIZE);
+    return page;
+}
+
+
+// the pool for stacks of at least 'size' bytes
+static unsigned int stack_class(size_t size)
+{
+    unsigned int c = 12;
+    while (c < WVTASK_STACK_CLASSES - 1 && ((size_t)1 << c) < size)
+        c++;
+    return c;
+}
+
+
+static size_t stack_class_size(unsigned int c)
+{
+    size_t size = (size_t)1 << c;
+    return size < page_size() ? page_size() : size;
+}
+
+
+static void *get_pooled_stack(size_t size)
+{
+    StackPool &pool = stack_pools[stack_class(size)];
+    if (pool.free)
+    {
+        StackPool::FreeStack *f = pool.free;
+        void *stack = f->stack;
+        pool.free = f->next;
+        pool.idle--;
+        delete f;
+        return stack;
+    }
+
+    size_t guard = page_size();
+    char *area = (char *)mmap(NULL, guard + size, PROT_NONE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                              -1, 0);
+    if (area == MAP_FAILED)
+        return NULL;
+    if (mprotect(area + guard, size, PROT_READ | PROT_WRITE) != 0)
+    {
+        munmap(area, guard + size);
+        return NULL;
+    }
+    pool.mapped++;
+    return area + guard;
+}
+
+
+// Notes how deep a stack has been used.  The lowest page always holds the
+// task's stack_magic, so it doesn't count.
+static void note_stack_use(void *stack, size_t size)
+{
+#ifdef __linux__
+    StackPool &pool = stack_pools[stack_class(size)];
+    size_t page = page_size(), pages = size / page;
+    unsigned char *resident = new unsigned char[pages];
+    if (mincore(stack, size, resident) == 0)
+    {
+        for (size_t i = 1; i < pages; i++)
+        {
+            if (resident[i] & 1)
+            {
+                if (size - i * page > pool.high_water)
+                    pool.high_water = size - i * page;
+                break;
+            }
+        }
+    }
+    delete[] resident;
+#endif
+}
+
+
+// Gives back the memory below 'keep', which nothing is using anymore.
+static void trim_pooled_stack(void *stack, size_t size, const void *keep)
+{
+    note_stack_use(stack, size);
+    size_t len = ((const char *)keep - (char *)stack) & ~(page_size() - 1);
+    if (len)
+        madvise(stack, len, MADV_DONTNEED);
+}
+
+
+static void put_pooled_stack(void *stack, size_t size)
+{
+    trim_pooled_stack(stack, size, (char *)stack + size);
+    StackPool &pool = stack_pools[stack_class(size)];
+    StackPool::FreeStack *f = new StackPool::FreeStack;
+    f->stack = stack;
+    f->next = pool.free;
+    pool.free = f;
+    pool.idle++;
+}
+
+
 static void valgrind_fix(char *stacktop)
 {
 #ifdef HAVE_VALGRIND_MEMCHECK_H
@@ -87,10 +374,15 @@ static void valgrind_fix(char *stacktop)
 
 WvTask::WvTask(WvTaskMan &_man, size_t _stacksize) : man(_man)
 {
-    stacksize = _stacksize;
+    if (use_shared_stack())
+        stacksize = _stacksize;
+    else
+        stacksize = stack_class_size(stack_class(_stacksize));
+    stack = NULL;
     running = recycled = false;
     func = NULL;
     userdata = NULL;
+    mysp = NULL;
     
     tid = ++taskcount;
     numtasks++;
@@ -109,6 +401,11 @@ WvTask::~WvTask()
     if (running)
 	numrunning--;
     magic_number = 42;
+    man.all_tasks.unlink(this);
+    if (recycled)
+        stack_pools[stack_class(stacksize)].recycled--;
+    if (stack)
+        put_pooled_stack(stack, stacksize);
 }
 
 
@@ -129,7 +426,22 @@ void WvTask::recycle()
     
     if (!running && !recycled)
     {
-	man.free_tasks.append(this, true);
+        unsigned int c = stack_class(stacksize);
+        StackPool &pool = stack_pools[c];
+
+        // the task's function is done with its stack.  Unless this task
+        // is likely to be started again soon, give the memory back.
+        // With the fast switch, the frame the task is parked in sits at
+        // the top; otherwise it's parked on the stackmaster's stack.
+        if (stack && pool.recycled >= WARM_STACKS)
+        {
+            trim_pooled_stack(stack, stacksize,
+                              mysp ? mysp : (char *)stack + stacksize);
+            *stack_magic = WVTASK_MAGIC;
+        }
+
+	man.free_tasks[c].append(this, true);
+	pool.recycled++;
 	recycled = true;
     }
 }
@@ -183,6 +495,28 @@ WvString WvTaskMan::debugger_tasks_run_cb(WvStringParm cmd, WvStringList &args,
 }
 
 
+WvString WvTaskMan::debugger_stacks_run_cb(WvStringParm cmd,
+        WvStringList &args, WvStreamsDebugger::ResultCallback result_cb, void *)
+{
+    const char *format_str = "%8s%s%6s%s%6s%s%s";
+    WvStringList result;
+    result.append(format_str, "---StkSz", "-", "Mapped", "-", "--Idle", "-",
+                  "HighWater");
+    result_cb(cmd, result);
+
+    WvTaskStackStats stats[WVTASK_STACK_CLASSES];
+    size_t count = get_stack_stats(stats, WVTASK_STACK_CLASSES);
+    for (size_t i = 0; i < count; i++)
+    {
+        result.zap();
+        result.append(format_str, stats[i].stacksize, " ", stats[i].mapped,
+                      " ", stats[i].idle, " ", stats[i].high_water);
+        result_cb(cmd, result);
+    }
+    return WvString::null;
+}
+
+
 WvTaskMan::WvTaskMan()
 {
     static bool first = true;
@@ -190,6 +524,7 @@ WvTaskMan::WvTaskMan()
     {
         first = false;
         WvStreamsDebugger::add_command("tasks", 0, debugger_tasks_run_cb, 0);
+        WvStreamsDebugger::add_command("stacks", 0, debugger_stacks_run_cb, 0);
     }
 
     stack_target = NULL;
@@ -198,6 +533,10 @@ WvTaskMan::WvTaskMan()
     
     stacktop = (char *)alloca(0);
     
+    // tasks get their own stacks right away; no stackmaster needed
+    if (use_fast_switch())
+        return;
+
     context_return = 0;
     assert(getcontext(&get_stack_return) == 0);
     if (context_return == 0)
@@ -212,7 +551,8 @@ WvTaskMan::WvTaskMan()
 WvTaskMan::~WvTaskMan()
 {    
     magic_number = -42;
-    free_tasks.zap();
+    for (unsigned int c = 0; c < WVTASK_STACK_CLASSES; c++)
+        free_tasks[c].zap();
 }
 
 
@@ -222,18 +562,20 @@ WvTask *WvTaskMan::start(WvStringParm name,
 {
     WvTask *t;
     
-    WvTaskList::Iter i(free_tasks);
-    for (i.rewind(); i.next(); )
+    // every task in the list has the same size of stack, except with
+    // use_shared_stack(), when they can be a bit smaller.
+    unsigned int c = stack_class(stacksize);
+    WvTaskList::Iter i(free_tasks[c]);
+    i.rewind();
+    if (i.next() && i().stacksize >= stacksize)
     {
-	if (i().stacksize >= stacksize)
-	{
-	    t = &i();
-	    i.set_autofree(false);
-	    i.unlink();
-	    t->recycled = false;
-	    t->start(name, func, userdata);
-	    return t;
-	}
+        stack_pools[c].recycled--;
+        t = &i();
+        i.set_autofree(false);
+        i.unlink();
+        t->recycled = false;
+        t->start(name, func, userdata);
+        return t;
     }
     
     // if we get here, no matching task was found.
@@ -257,6 +599,18 @@ int WvTaskMan::run(WvTask &task, int val)
         
     WvTask *old_task = current_task;
     current_task = &task;
+
+#ifdef WVTASK_FASTSWITCH
+    if (use_fast_switch())
+    {
+        context_return = val;
+        wvtask_swap(old_task ? &old_task->mysp : &toplevel_sp, task.mysp);
+        // someone did yield() (if toplevel) or run() on our old task; done.
+        current_task = old_task;
+        return context_return;
+    }
+#endif
+
     ucontext_t *state;
     
     if (!old_task)
@@ -317,6 +671,16 @@ int WvTaskMan::yield(int val)
                 (long)current_task->stacksize);
     }
 #endif
+
+#ifdef WVTASK_FASTSWITCH
+    if (use_fast_switch())
+    {
+        context_return = val;
+        wvtask_swap(&current_task->mysp, toplevel_sp);
+        // back because someone called run() again.
+        return context_return;
+    }
+#endif
 		
     context_return = 0;
     assert(getcontext(&current_task->mystate) == 0);
@@ -340,6 +704,23 @@ int WvTaskMan::yield(int val)
 
 void WvTaskMan::get_stack(WvTask &task, size_t size)
 {
+#ifdef WVTASK_FASTSWITCH
+    if (use_fast_switch())
+    {
+        task.stack = get_pooled_stack(task.stacksize);
+        assert(task.stack);
+
+        // the stack grows down, so an overflow hits this first
+        task.stack_magic = (int *)task.stack;
+        *task.stack_magic = WVTASK_MAGIC;
+
+        // the first run() of the task starts task_main() at the top
+        uintptr_t top = ((uintptr_t)task.stack + task.stacksize) & ~15UL;
+        task.mysp = init_frame((void **)top, task_main, &task);
+        return;
+    }
+#endif
+
     context_return = 0;
     assert(getcontext(&get_stack_return) == 0);
     if (context_return == 0)
@@ -349,23 +730,8 @@ void WvTaskMan::get_stack(WvTask &task, size_t size)
 
         if (!use_shared_stack())
         {
-#if defined(__linux__) && (defined(__386__) || defined(__i386) || defined(__i386__))
-            static char *next_stack_addr = (char *)0xB0000000;
-            static const size_t stack_shift = 0x00100000;
-
-            next_stack_addr -= stack_shift;
-#else
-            static char *next_stack_addr = NULL;
-#endif
-        
-            task.stack = mmap(next_stack_addr, task.stacksize,
-                PROT_READ | PROT_WRITE,
-#ifndef MACOS 
-                MAP_PRIVATE | MAP_ANONYMOUS,
-#else
-                MAP_PRIVATE,
-#endif
-                -1, 0);
+            task.stack = get_pooled_stack(task.stacksize);
+            assert(task.stack);
         }
 	
 	// initial setup
@@ -537,6 +903,30 @@ void WvTaskMan::do_task()
 }
 
 
+// Where a task starts when WvTaskMan switches stacks itself: the same
+// as the loop at the end of do_task(), but right on the task's own stack.
+void WvTaskMan::task_main(void *userdata)
+{
+    WvTask *task = (WvTask *)userdata;
+    for (;;)
+    {
+        assert(magic_number == -WVTASK_MAGIC);
+        assert(task->magic_number == WVTASK_MAGIC);
+
+        if (task->func && task->running)
+        {
+            call_func(task);
+
+            // the task's function terminated.
+            task->name = "DEAD";
+            task->running = false;
+            task->numrunning--;
+        }
+        yield();
+    }
+}
+
+
 const void *WvTaskMan::current_top_of_stack()
 {
 #ifdef HAVE_LIBC_STACK_END
@@ -551,6 +941,29 @@ const void *WvTaskMan::current_top_of_stack()
 }
 
 
+size_t WvTaskMan::get_stack_stats(WvTaskStackStats *stats, size_t max)
+{
+    WvTaskList::Iter i(all_tasks);
+    for (i.rewind(); i.next(); )
+        if (i->stack)
+            note_stack_use(i->stack, i->stacksize);
+
+    size_t count = 0;
+    for (unsigned int c = 0; c < WVTASK_STACK_CLASSES && count < max; c++)
+    {
+        StackPool &pool = stack_pools[c];
+        if (!pool.mapped)
+            continue;
+        stats[count].stacksize = stack_class_size(c);
+        stats[count].mapped = pool.mapped;
+        stats[count].idle = pool.idle;
+        stats[count].high_water = pool.high_water;
+        count++;
+    }
+    return count;
+}
+
+
 size_t WvTaskMan::current_stacksize_limit()
 {
     if (use_shared_stack() || current_task == NULL)
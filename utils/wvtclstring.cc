@@ -14,8 +14,24 @@ const WvStringMask WVTCL_NASTY_SPACES(WVTCL_NASTY_SPACES_STR);
 const WvStringMask WVTCL_NASTY_NEWLINES(WVTCL_NASTY_NEWLINES_STR);
 const WvStringMask WVTCL_SPLITCHARS(WVTCL_SPLITCHARS_STR);
 
+// For strings at least this long, it's worth making a mask of all the
+// characters wvtcl_escape() has to think about, so it can skip over the
+// rest of them quickly.
+#define WVTCL_SCAN_MIN 128
+
+
+// 'nasties', plus the characters that are always nasty
+static void wvtcl_specials(WvStringMask &specials, const WvStringMask &nasties)
+{
+    specials = nasties;
+    specials.set("{}\\\"", true);
+}
+
+
+// if 'specials' isn't NULL, it has to be the wvtcl_specials() of 'nasties'
 static size_t wvtcl_escape(char *dst, const char *s, size_t s_len,
-			   const WvStringMask &nasties, bool *verbatim = NULL)
+			   const WvStringMask &nasties, bool *verbatim = NULL,
+			   const WvStringMask *specials = NULL)
 {
     if (verbatim) *verbatim = false;
 
@@ -42,6 +58,21 @@ static size_t wvtcl_escape(char *dst, const char *s, size_t s_len,
     // backslashify, if it turns out that's necessary.
     for (cptr = s; cptr != cptr_end; cptr++)
     {
+	if (specials)
+	{
+	    // nothing but braces, backslashes and nasties can change our minds
+	    size_t n = specials->find(cptr, cptr_end - cptr);
+	    if (n)
+	    {
+		if (dst) memcpy(dst + len, cptr, n);
+		len += n;
+		cptr += n;
+		inescape = false;
+		if (cptr == cptr_end)
+		    break;
+	    }
+	}
+
         // Assume we do nothing
         if (dst) dst[len] = *cptr;
         ++len;
@@ -89,6 +120,16 @@ static size_t wvtcl_escape(char *dst, const char *s, size_t s_len,
             len = 0;
             for (cptr = s; cptr != cptr_end; ++cptr)
 	    {
+		if (specials)
+		{
+		    size_t n = specials->find(cptr, cptr_end - cptr);
+		    memcpy(dst + len, cptr, n);
+		    len += n;
+		    cptr += n;
+		    if (cptr == cptr_end)
+			break;
+		}
+
 		bool doit = false;
 		switch (*cptr)
 		{
@@ -115,8 +156,8 @@ static size_t wvtcl_escape(char *dst, const char *s, size_t s_len,
         {
             len = 0;
             dst[len++] = '{';
-            for (cptr = s; cptr != cptr_end; ++cptr)
-                dst[len++] = *cptr;
+            memcpy(dst + len, s, s_len);
+            len += s_len;
             dst[len++] = '}';
             return len;
         }
@@ -125,23 +166,51 @@ static size_t wvtcl_escape(char *dst, const char *s, size_t s_len,
 }
 
 
-WvString wvtcl_escape(WvStringParm s, const WvStringMask &nasties)
+static WvString wvtcl_escape(WvStringParm s, size_t s_len,
+			     const WvStringMask &nasties,
+			     const WvStringMask *specials)
 {
-    size_t s_len = s.len();
-
     bool verbatim;
-    size_t len = wvtcl_escape(NULL, s, s_len, nasties, &verbatim);
+    size_t len = wvtcl_escape(NULL, s, s_len, nasties, &verbatim, specials);
     if (verbatim) return s;
 
     WvString result;
     result.setsize(len);
     char *e = result.edit();
-    e += wvtcl_escape(e, s, s_len, nasties);
+    e += wvtcl_escape(e, s, s_len, nasties, NULL, specials);
     *e = '\0';
     return result;
 }
 
 
+WvString wvtcl_escape(WvStringParm s, const WvStringMask &nasties)
+{
+    size_t s_len = s.len();
+    if (s_len < WVTCL_SCAN_MIN)
+	return wvtcl_escape(s, s_len, nasties, NULL);
+
+    WvStringMask specials;
+    wvtcl_specials(specials, nasties);
+    return wvtcl_escape(s, s_len, nasties, &specials);
+}
+
+
+void wvtcl_escape(WvBuf &out, WvStringParm s, const WvStringMask &nasties)
+{
+    size_t s_len = s.len();
+    WvStringMask specials;
+    const WvStringMask *sp = NULL;
+    if (s_len >= WVTCL_SCAN_MIN)
+    {
+	wvtcl_specials(specials, nasties);
+	sp = &specials;
+    }
+
+    size_t len = wvtcl_escape(NULL, s, s_len, nasties, NULL, sp);
+    wvtcl_escape((char *)out.alloc(len), s, s_len, nasties, NULL, sp);
+}
+
+
 static size_t wvtcl_unescape(char *dst, const char *s, size_t s_len,
         bool *verbatim = NULL)
 {
@@ -223,11 +292,15 @@ WvString wvtcl_encode(WvList<WvString> &l, const WvStringMask &nasties,
 {
     int size = 0;
 
+    // the mask is only made once, so it's worth it for all but tiny lists
+    WvStringMask specials;
+    wvtcl_specials(specials, nasties);
+
     WvList<WvString>::Iter i(l);
     int count = 0;
     for (i.rewind(); i.next(); )
     {
-        size += wvtcl_escape(NULL, *i, i->len(), nasties);
+        size += wvtcl_escape(NULL, *i, i->len(), nasties, NULL, &specials);
         ++count;
     }
     
@@ -238,7 +311,7 @@ WvString wvtcl_encode(WvList<WvString> &l, const WvStringMask &nasties,
     int j;
     for (i.rewind(), j=0; i.next(); ++j)
     {
-        p += wvtcl_escape(p, *i, i->len(), nasties);
+        p += wvtcl_escape(p, *i, i->len(), nasties, NULL, &specials);
         if (j < count - 1)
 	    *p++ = splitchars.first();
     }
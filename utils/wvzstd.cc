@@ -0,0 +1,192 @@
+/*
+ * Worldvisions Weaver Software:
+ *   Copyright (C) 1997-2002 Net Integration Technologies, Inc.
+ *
+ * Zstandard encoder/decoder based on libzstd.  See wvzstd.h.
+ */
+#include "wvzstd.h"
+#include <zstd.h>
+
+#define ZSTDCHUNK 65536 // the most we compress or decompress in one call
+#define ZSTDMINOUT 4096 // the least output space we offer zstd
+
+
+WvZstdEncoder::WvZstdEncoder(Mode _mode, int _level) :
+    mode(_mode), level(_level)
+{
+    cctx = NULL;
+    dctx = NULL;
+    cdict = NULL;
+    ddict = NULL;
+
+    if (mode == Compress)
+    {
+        cctx = ZSTD_createCCtx();
+        if (cctx)
+            check(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+                                         level));
+    }
+    else
+        dctx = ZSTD_createDCtx();
+    if (!cctx && !dctx)
+        seterror("error initializing zstd %s",
+                 mode == Compress ? "compressor" : "decompressor");
+}
+
+
+WvZstdEncoder::~WvZstdEncoder()
+{
+    if (cctx)
+        ZSTD_freeCCtx(cctx);
+    if (dctx)
+        ZSTD_freeDCtx(dctx);
+    if (cdict)
+        ZSTD_freeCDict(cdict);
+    if (ddict)
+        ZSTD_freeDDict(ddict);
+}
+
+
+void WvZstdEncoder::set_dictionary(const void *dict, size_t len)
+{
+    if (cctx)
+        ZSTD_CCtx_refCDict(cctx, NULL);
+    if (dctx)
+        ZSTD_DCtx_refDDict(dctx, NULL);
+    if (cdict)
+        ZSTD_freeCDict(cdict);
+    if (ddict)
+        ZSTD_freeDDict(ddict);
+    cdict = NULL;
+    ddict = NULL;
+
+    // digesting the dictionary takes a while, so do it once, here,
+    // rather than at the start of every frame.
+    if (dict && len)
+    {
+        if (cctx)
+        {
+            cdict = ZSTD_createCDict(dict, len, level);
+            if (cdict)
+                ZSTD_CCtx_refCDict(cctx, cdict);
+        }
+        if (dctx)
+        {
+            ddict = ZSTD_createDDict(dict, len);
+            if (ddict)
+                ZSTD_DCtx_refDDict(dctx, ddict);
+        }
+        if (!cdict && !ddict)
+            seterror("error loading zstd dictionary");
+    }
+    reset();
+}
+
+
+bool WvZstdEncoder::check(size_t result)
+{
+    if (!ZSTD_isError(result))
+        return true;
+    seterror("error during zstd %s: %s",
+             mode == Compress ? "compression" : "decompression",
+             ZSTD_getErrorName(result));
+    return false;
+}
+
+
+bool WvZstdEncoder::compress(WvBuf &outbuf, const void *data, size_t len,
+                             int op)
+{
+    ZSTD_inBuffer in = { data, len, 0 };
+    for (;;)
+    {
+        size_t avail = ZSTD_compressBound(len - in.pos);
+        if (avail < ZSTDMINOUT)
+            avail = ZSTDMINOUT;
+        ZSTD_outBuffer out = { outbuf.alloc(avail), avail, 0 };
+        size_t left = ZSTD_compressStream2(cctx, &out, &in,
+                                           (ZSTD_EndDirective)op);
+        outbuf.unalloc(avail - out.pos);
+        if (!check(left))
+            return false;
+
+        // without a flush, zstd can keep whatever it likes for later
+        if (op == ZSTD_e_continue ? in.pos == in.size : left == 0)
+            return true;
+    }
+}
+
+
+bool WvZstdEncoder::_encode(WvBuf &inbuf, WvBuf &outbuf, bool flush)
+{
+    if (mode == Decompress)
+        return decompress(inbuf, outbuf);
+
+    while (inbuf.used())
+    {
+        size_t len = inbuf.optgettable();
+        if (len > ZSTDCHUNK)
+            len = ZSTDCHUNK;
+        if (!compress(outbuf, inbuf.get(len), len, ZSTD_e_continue))
+            return false;
+    }
+    if (flush)
+        return compress(outbuf, NULL, 0, ZSTD_e_flush);
+    return true;
+}
+
+
+bool WvZstdEncoder::_finish(WvBuf &outbuf)
+{
+    if (mode == Decompress)
+        return true;
+    return compress(outbuf, NULL, 0, ZSTD_e_end);
+}
+
+
+bool WvZstdEncoder::decompress(WvBuf &inbuf, WvBuf &outbuf)
+{
+    while (inbuf.used())
+    {
+        size_t inlen = inbuf.optgettable();
+        ZSTD_inBuffer in = { inbuf.get(inlen), inlen, 0 };
+
+        // keep going until zstd has taken all the input and has no more
+        // output for us
+        size_t retval;
+        ZSTD_outBuffer out;
+        do
+        {
+            out.dst = outbuf.alloc(ZSTDCHUNK);
+            out.size = ZSTDCHUNK;
+            out.pos = 0;
+            retval = ZSTD_decompressStream(dctx, &out, &in);
+            outbuf.unalloc(ZSTDCHUNK - out.pos);
+            if (!check(retval))
+            {
+                inbuf.unget(in.size - in.pos);
+                return false;
+            }
+        } while (retval != 0 && (in.pos < in.size || out.pos == out.size));
+
+        if (retval == 0)
+        {
+            // the end of the frame; leave whatever follows it
+            inbuf.unget(in.size - in.pos);
+            setfinished();
+            break;
+        }
+    }
+    return true;
+}
+
+
+bool WvZstdEncoder::_reset()
+{
+    // this keeps the level and the dictionary
+    if (cctx)
+        ZSTD_CCtx_reset(cctx, ZSTD_reset_session_only);
+    if (dctx)
+        ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+    return true;
+}
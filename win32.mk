@@ -33,6 +33,10 @@ OBJSKIP=$(OBJREPLACED) $(OBJFIXME) \
 	streams/wvprociter.o \
 	\
 	streams/wvlockdev.o \
+	streams/wvlogasync.o \
+	streams/wvlogbinary.o \
+	streams/wvlogring.o \
+	streams/wvworkerpool.o \
 	streams/wvlockfile.o \
 	streams/wvmagicloopback.o \
 	streams/wvmodem.o \
@@ -42,6 +46,8 @@ OBJSKIP=$(OBJREPLACED) $(OBJFIXME) \
 	ipstreams/wvipraw.o \
 	ipstreams/wvunixdgsocket.o \
 	\
+	crypto/wvverifycache.o \
+	\
 	uniconf/unigenhack.o \
 	uniconf/daemon/uniconfd.o \
 	
@@ -84,12 +90,18 @@ TOBJSKIP=$(TOBJFIXME) \
 	\
 	streams/t/wvmagicloopback.t.o \
 	streams/t/wvlogrotator.t.o \
+	streams/t/wvlogbinary.t.o \
+	streams/t/wvlogasync.t.o \
+	streams/t/wvlogring.t.o \
+	streams/t/wvworkerpool.t.o \
 	streams/t/wvsubprocqueuestream.t.o \
 	streams/t/wvlockfile.t.o \
 	\
 	ipstreams/t/wvunixdgsocket.t.o \
 	ipstreams/t/wvunixsocket.t.o \
 	\
+	crypto/t/wvverifycache.t.o \
+	\
 	linuxstreams/t/wvpty.t.o \
 	\
 	crypto/t/wvocsp.t.o \
@@ -97,6 +109,9 @@ TOBJSKIP=$(TOBJFIXME) \
 	uniconf/t/unitempgenvsdaemon.t.o \
 	
 PROGSKIP=\
+	crypto/tests/sslbench \
+	crypto/tests/sslhandshakebench \
+	crypto/tests/cryptojobbench \
 	ipstreams/tests/unixtest \
 	utils/tests/wvgrep \
 	utils/tests/wvegrep \
@@ -104,6 +119,7 @@ PROGSKIP=\
 	utils/tests/crashtest \
 	utils/tests/crashtest-nofd \
 	utils/tests/forktest \
+	utils/tests/gzipbench \
 	utils/tests/magiccircletest \
 	utils/tests/proctest \
 	utils/tests/rateadjtest \
@@ -111,6 +127,7 @@ PROGSKIP=\
 	utils/tests/tasktest \
 	utils/tests/testtest \
 	streams/tests/logfiletest \
+	streams/tests/wvlogdecode \
 	streams/tests/looptest \
 	streams/tests/modemtest \
 	streams/tests/pamtest \
@@ -123,6 +140,7 @@ PROGSKIP=\
 	ipstreams/tests/unixdgtest \
 	ipstreams/tests/xplctest \
 	ipstreams/tests/wsd \
+	urlget/tests/httpbench \
 	crypto/tests/cryptotest \
 	linuxstreams/tests/aliastest \
 	linuxstreams/tests/ifctest \